@@ -0,0 +1,241 @@
+// Closed-loop RFFE attenuation ranging on short ADC captures
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "autorange.h"
+#include "fcs_client.h"
+#include "stats.h"
+#include "quality.h"
+
+typedef int16_t ar_v4s_t __attribute__ ((vector_size (NUM_CHANNELS*sizeof (int16_t))));
+typedef int32_t ar_v4i_t __attribute__ ((vector_size (NUM_CHANNELS*sizeof (int32_t))));
+
+#define AR_SEL(m,a,b)           (((m)&(a))|(~(m)&(b)))
+
+int ar_init (struct ar_s *ar, double lo, double hi, unsigned int natt)
+{
+    memset (ar, 0, sizeof *ar);
+
+    if (!(lo > 0 && lo < hi && hi < 1) || natt < 1 || natt > 2) {
+        return -1;
+    }
+
+    ar->lo = lo;
+    ar->hi = hi;
+    ar->natt = natt;
+    ar->clip_att = -1;
+
+    return 0;
+}
+
+double ar_peak_16 (const int16_t *rows, uint32_t n)
+{
+    ar_v4i_t peak = {0}, x, m;
+    ar_v4s_t row;
+    int32_t max = 0;
+    unsigned int c;
+    uint32_t i;
+
+    // Widened first: |INT16_MIN| does not fit
+    for (i = 0; i < n; ++i) {
+        memcpy (&row, rows + i*NUM_CHANNELS, sizeof row);
+        x = __builtin_convertvector (row, ar_v4i_t);
+        x = AR_SEL (x < 0, -x, x);
+        m = x > peak;
+        peak = AR_SEL (m, x, peak);
+    }
+
+    for (c = 0; c < NUM_CHANNELS; ++c) {
+        max = peak[c] > max ? peak[c] : max;
+    }
+
+    return (double) max/INT16_MAX;
+}
+
+/* Total of the adjusted attenuators */
+static double ar_total (const struct ar_s *ar)
+{
+    return ar->natt == 2 ? ar->att[0] + ar->att[1] : ar->att[0];
+}
+
+/* att1 takes the larger half */
+static void ar_split (struct ar_s *ar, double total)
+{
+    if (ar->natt == 1) {
+        ar->att[0] = total;
+        return;
+    }
+
+    ar->att[0] = ceil (total/2/AR_ATT_STEP)*AR_ATT_STEP;
+    if (ar->att[0] > AR_ATT_MAX) {
+        ar->att[0] = AR_ATT_MAX;
+    }
+    ar->att[1] = total - ar->att[0];
+}
+
+enum ar_status_e ar_step (struct ar_s *ar, double peak)
+{
+    double total = ar_total (ar), max = ar->natt*AR_ATT_MAX, next;
+
+    if (ar->steps < AR_MAX_STEPS) {
+        ar->step_att[ar->steps][0] = ar->att[0];
+        ar->step_att[ar->steps][1] = ar->att[1];
+        ar->step_peak[ar->steps] = peak;
+    }
+    ++ar->steps;
+
+    if (peak >= 1.0 - 1.0/QC_CLIP_DIV) {
+        // How far above full scale is unknown
+        if (total > ar->clip_att) {
+            ar->clip_att = total;
+        }
+        next = total + AR_CLIP_STEP;
+    }
+    else if (peak >= ar->lo && peak <= ar->hi) {
+        return ar->status = AR_IN_WINDOW;
+    }
+    else if (peak > 0) {
+        next = total + 20*log10 (peak/sqrt (ar->lo*ar->hi));
+    }
+    else {
+        next = 0;
+    }
+
+    next = next < 0 ? 0 : next > max ? max : next;
+    next = floor (next/AR_ATT_STEP + 0.5)*AR_ATT_STEP;
+    if (ar->clip_att >= 0 && next <= ar->clip_att) {
+        next = ar->clip_att + AR_ATT_STEP;
+    }
+
+    // At a limit already, or the window is narrower than a step
+    if (next > max || next == total || ar->steps >= AR_MAX_STEPS) {
+        return ar->status = AR_OUT_OF_RANGE;
+    }
+
+    ar_split (ar, next);
+
+    return ar->status = AR_RUNNING;
+}
+
+/* Only the attenuators that changed are written */
+static int ar_write_att (fcs_session_t *fe, const double *att, double *cur)
+{
+    static const char *name[2] = {GETSET_FE_ATT1_NAME, GETSET_FE_ATT2_NAME};
+    unsigned int i;
+    int err;
+
+    for (i = 0; i < 2; ++i) {
+        if (att[i] != cur[i]) {
+            if ((err = fcs_var_write (fe, name[i], &att[i])) != FCS_OK) {
+                return err;
+            }
+            cur[i] = att[i];
+        }
+    }
+
+    return FCS_OK;
+}
+
+/* A capture of AR_NPTS rows, of which only the blocks holding them are
+ * read, up to the nblocks of the curve */
+static int ar_capture (fcs_session_t *fpga, uint8_t *buf, uint32_t size,
+        uint32_t nblocks, double *peak)
+{
+    uint32_t block, len = 0;
+    uint16_t block_len;
+    uint64_t t0;
+    int err;
+
+    if ((err = fcs_func_execute (fpga, SET_ACQ_START_NAME, NULL, NULL))
+            != FCS_OK) {
+        return err;
+    }
+
+    t0 = stats_now ();
+    for (block = 0, err = BSMP_SUCCESS; len < size && block < nblocks && !err;
+            ++block) {
+        err = fcs_curve_read_block (fpga, CURVE_ADC_ID, (uint16_t) block,
+                buf + len, &block_len);
+        if (!err && block_len == 0) {
+            break;
+        }
+        len += block_len;
+    }
+    stats_record (STATS_EP_FPGA, STATS_OP_READ_CURVE, t0, err);
+
+    if (err) {
+        return err;
+    }
+    if (len == 0) {
+        return FCS_ERR_SIZE;
+    }
+
+    len = len < size ? len : size;
+    *peak = ar_peak_16 ((const int16_t *) buf,
+            len/(NUM_CHANNELS*sizeof (int16_t)));
+
+    return FCS_OK;
+}
+
+int ar_run (fcs_session_t *fpga, fcs_session_t *fe, struct ar_s *ar)
+{
+    uint32_t acq[2], param[2] = {AR_NPTS, CURVE_ADC_ID}, size;
+    uint32_t curve_size, block_size;
+    double cur[2], peak = 0;
+    uint64_t t0;
+    uint8_t *buf;
+    int err, restore;
+
+    curve_size = fcs_curve_size (fpga, CURVE_ADC_ID);
+    block_size = fcs_curve_block_size (fpga, CURVE_ADC_ID);
+    if (!curve_size || !block_size) {
+        return FCS_ERR_NAME;
+    }
+
+    size = AR_NPTS*NUM_CHANNELS*sizeof (int16_t);
+    if (size > curve_size) {
+        size = curve_size;
+        param[0] = size/(NUM_CHANNELS*sizeof (int16_t));
+    }
+
+    // Whole blocks, as libbsmp fills them
+    buf = malloc ((size/block_size + 1)*block_size);
+    if (!buf) {
+        perror ("ar: malloc");
+        return FCS_ERR_SIZE;
+    }
+
+    if ((err = fcs_var_read (fe, GETSET_FE_ATT1_NAME, &cur[0])) != FCS_OK ||
+            (err = fcs_var_read (fe, GETSET_FE_ATT2_NAME, &cur[1])) != FCS_OK ||
+            (err = fcs_func_execute (fpga, GET_ACQ_SAMPLES_NAME, NULL,
+                                     &acq[0])) != FCS_OK ||
+            (err = fcs_func_execute (fpga, GET_ACQ_CHAN_NAME, NULL,
+                                     &acq[1])) != FCS_OK ||
+            (err = fcs_func_execute (fpga, SET_ACQ_PARAM_NAME, param, NULL))
+            != FCS_OK) {
+        free (buf);
+        return err;
+    }
+
+    ar->att[0] = cur[0];
+    ar->att[1] = cur[1];
+    ar->status = AR_RUNNING;
+
+    t0 = stats_now ();
+    while (ar->status == AR_RUNNING) {
+        if ((err = ar_write_att (fe, ar->att, cur)) != FCS_OK ||
+                (err = ar_capture (fpga, buf, size,
+                    curve_size/block_size, &peak)) != FCS_OK) {
+            break;
+        }
+        ar_step (ar, peak);
+    }
+    ar->ns = stats_now () - t0;
+
+    restore = fcs_func_execute (fpga, SET_ACQ_PARAM_NAME, acq, NULL);
+    free (buf);
+
+    return err != FCS_OK ? err : restore;
+}
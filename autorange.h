@@ -0,0 +1,56 @@
+#ifndef _AUTORANGE_H_
+#define _AUTORANGE_H_
+
+#include <inttypes.h>
+
+#include "libfcsclient.h"
+
+/* Closed-loop RFFE attenuation ranging. A short ADC capture gives the peak
+ * level, as a fraction of full scale; the attenuation moves by the dB
+ * that bring it to the middle (geometric) of the target window. The ADC
+ * is linear below full scale, so one step usually gets there and a second
+ * one fixes the 0.5 dB quantization. A clipped capture only tells the
+ * level is too high: the attenuation goes up by AR_CLIP_STEP, and later
+ * steps never go back to an attenuation seen clipping */
+#define AR_ATT_MAX              31.5 // dB, each attenuator
+#define AR_ATT_STEP             0.5 // dB
+#define AR_CLIP_STEP            12.0 // dB
+#define AR_MAX_STEPS            8 // captures
+#define AR_NPTS                 8192 // ADC rows captured per step
+
+enum ar_status_e {
+    AR_RUNNING = 0,
+    AR_IN_WINDOW,
+    AR_OUT_OF_RANGE                 // window not reachable by the attenuators
+};
+
+struct ar_s {
+    double lo, hi;                  // target window of the peak, of full scale
+    unsigned int natt;              // adjusted: 1 (att1 only) or 2
+    double att[2];                  // dB, to be written
+    double clip_att;                // highest total seen clipping, < 0 none
+    enum ar_status_e status;
+    // Steps taken, with the attenuators and the peak they gave
+    unsigned int steps;
+    double step_att[AR_MAX_STEPS][2];
+    double step_peak[AR_MAX_STEPS];
+    uint64_t ns;                    // from the first capture to the result
+};
+
+/* Window lo..hi, 0 < lo < hi < 1. ar->att is to be set before stepping,
+ * ar_run reads it */
+int ar_init (struct ar_s *ar, double lo, double hi, unsigned int natt);
+
+/* Largest |sample| of rows of 4 ADC samples, of full scale */
+double ar_peak_16 (const int16_t *rows, uint32_t n);
+
+/* Takes the peak of a capture with ar->att and moves ar->att to the next
+ * attenuation to try, unless done. Returns ar->status */
+enum ar_status_e ar_step (struct ar_s *ar, double peak);
+
+/* The whole loop: the attenuators start as read from fe, and are left at
+ * the result. The acquisition parameters of fpga are restored. Returns
+ * FCS_OK or an fcs/BSMP error; the outcome is in ar->status */
+int ar_run (fcs_session_t *fpga, fcs_session_t *fe, struct ar_s *ar);
+
+#endif
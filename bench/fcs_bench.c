@@ -0,0 +1,749 @@
+// Benchmark driver for BSMP operations against a local mock server.
+// Results are printed as one JSON object per line, tagged with the
+// build revision so runs of different revisions can be compared
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <getopt.h>
+#include <signal.h>
+#include <time.h>
+#include <math.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#include "fcs_bench.h"
+#include "output.h"
+#include "soa.h"
+#include "ddc.h"
+#include "libfcsclient.h"
+#include "revision.h"
+#include "debug.h"
+
+#define B "BENCH: "
+
+#define TRY(name, func)\
+    do {\
+        int _try_err = func;\
+        if(_try_err) {\
+            fprintf(stderr, B "%s: %s\n", name, fcs_error_str(_try_err));\
+            exit(-1);\
+        }\
+    }while(0)
+
+#define ARRAY_SIZE(x) (sizeof(x) / sizeof((x)[0]))
+
+const char* program_name;
+
+static const char *mock_path = BENCH_MOCK_PATH;
+static const char *client_path = BENCH_CLIENT_PATH;
+static uint32_t iters = BENCH_DEFAULT_ITERS;
+static int bench_failed = 0;        // a kernel check did not pass
+
+static const struct bench_geometry_s geometries[] = {
+    {4096,  8192},
+    {4096,  100000},
+    {16384, 32768},
+    {16384, 100000},
+    {32768, 100000},
+    {65000, 500000}
+};
+
+/***************************************************************/
+/********************** Utility functions **********************/
+/***************************************************************/
+
+static double now_usec (void)
+{
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1e6 + ts.tv_nsec*1e-3;
+}
+
+static void stats_init (struct bench_stats_s *s, uint32_t size)
+{
+    s->usec = malloc (size*sizeof(double));
+    s->n = 0;
+    s->size = size;
+
+    if (!s->usec) {
+        fprintf (stderr, B "could not allocate %u samples\n", size);
+        exit (-1);
+    }
+}
+
+static void stats_add (struct bench_stats_s *s, double usec)
+{
+    if (s->n < s->size) {
+        s->usec[s->n++] = usec;
+    }
+}
+
+static int cmp_double (const void *a, const void *b)
+{
+    double x = *(const double *) a;
+    double y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+/* Nearest-rank percentile. stats must be sorted */
+static double stats_pct (struct bench_stats_s *s, double p)
+{
+    uint32_t rank;
+
+    if (s->n == 0) {
+        return 0.0;
+    }
+
+    rank = (uint32_t) (p/100.0*s->n + 0.999999);
+    rank = rank == 0 ? 1 : rank;
+    return s->usec[(rank > s->n ? s->n : rank) - 1];
+}
+
+static double stats_mean (struct bench_stats_s *s)
+{
+    double sum = 0.0;
+    uint32_t i;
+
+    for (i = 0; i < s->n; ++i) {
+        sum += s->usec[i];
+    }
+
+    return s->n ? sum/s->n : 0.0;
+}
+
+/* Emits a latency line. extra, if not NULL, is appended verbatim and must
+ * start with a comma */
+static void report_latency (const char *bench, const char *op,
+        struct bench_stats_s *s, const char *extra)
+{
+    qsort (s->usec, s->n, sizeof(double), cmp_double);
+
+    printf ("{\"revision\": \"%s\", \"bench\": \"%s\", \"op\": \"%s\", "
+            "\"n\": %u, \"mean_us\": %.3f, \"p50_us\": %.3f, "
+            "\"p99_us\": %.3f, \"p999_us\": %.3f, \"max_us\": %.3f%s}\n",
+            build_revision, bench, op, s->n, stats_mean (s),
+            stats_pct (s, 50.0), stats_pct (s, 99.0), stats_pct (s, 99.9),
+            s->n ? s->usec[s->n-1] : 0.0, extra ? extra : "");
+    fflush (stdout);
+}
+
+/***************************************************************/
+/************************ Mock handling ************************/
+/***************************************************************/
+
+/* 1 if something accepts connections on port, 0 if not, -1 if port
+ * cannot be resolved */
+static int port_open (const char *port)
+{
+    struct addrinfo hints, *servinfo;
+    int fd, ret = 0;
+
+    memset (&hints, 0, sizeof hints);
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    if (getaddrinfo ("localhost", port, &hints, &servinfo) != 0) {
+        return -1;
+    }
+
+    fd = socket (servinfo->ai_family, servinfo->ai_socktype,
+            servinfo->ai_protocol);
+    if (fd >= 0) {
+        ret = connect (fd, servinfo->ai_addr, servinfo->ai_addrlen) == 0;
+        close (fd);
+    }
+
+    freeaddrinfo (servinfo);
+    return ret;
+}
+
+/* 1 while pid runs. Reaps it (and says why) once it is gone */
+static int mock_alive (pid_t pid)
+{
+    int status;
+
+    if (waitpid (pid, &status, WNOHANG) != pid) {
+        return 1;
+    }
+
+    if (WIFEXITED (status)) {
+        fprintf (stderr, B "%s exited with status %d\n", mock_path,
+                WEXITSTATUS (status));
+    }
+    else if (WIFSIGNALED (status)) {
+        fprintf (stderr, B "%s killed by signal %d\n", mock_path,
+                WTERMSIG (status));
+    }
+    return 0;
+}
+
+/* Waits until the mock (pid) accepts connections on both ports. Returns
+ * -1 if it does not in time, -2 if it is gone (and reaped) */
+static int wait_ports (pid_t pid)
+{
+    double deadline = now_usec () + BENCH_CONNECT_TIMEOUT;
+
+    while (now_usec () < deadline) {
+        int fpga_up = port_open (FCS_FPGA_PORT);
+        int fe_up = port_open (FCS_FE_PORT);
+
+        // Still running once both ports answer: they are its own
+        if (!mock_alive (pid)) {
+            return -2;
+        }
+        if (fpga_up < 0 || fe_up < 0) {
+            return -1;
+        }
+        if (fpga_up && fe_up) {
+            return 0;
+        }
+        usleep (10000);
+    }
+
+    fprintf (stderr, B "nothing listening on port %s and %s\n", FCS_FPGA_PORT,
+            FCS_FE_PORT);
+    return -1;
+}
+
+static pid_t mock_start (uint32_t block_size, uint32_t samples)
+{
+    char bs[16], ns[16];
+    pid_t pid;
+
+    snprintf (bs, sizeof bs, "%u", block_size);
+    snprintf (ns, sizeof ns, "%u", samples);
+
+    // Or the probes below would find the other server, not the mock
+    if (port_open (FCS_FPGA_PORT) || port_open (FCS_FE_PORT)) {
+        fprintf (stderr, B "port %s or %s already in use\n", FCS_FPGA_PORT,
+                FCS_FE_PORT);
+        exit (-1);
+    }
+
+    pid = fork ();
+    if (pid == 0) {
+        int devnull = open ("/dev/null", O_WRONLY);
+        dup2 (devnull, STDERR_FILENO);
+        execl (mock_path, mock_path, "-p", FCS_FPGA_PORT, "-f", FCS_FE_PORT,
+                "-s", bs, "-n", ns, "-t", "0", (char *) NULL);
+        _exit (127);
+    }
+
+    if (pid < 0) {
+        perror ("fork");
+        exit (-1);
+    }
+
+    switch (wait_ports (pid)) {
+        case 0:
+            break;
+        case -1:
+            kill (pid, SIGTERM);
+            waitpid (pid, NULL, 0);
+            // Fall through
+        default:
+            fprintf (stderr, B "could not start %s\n", mock_path);
+            exit (-1);
+    }
+
+    return pid;
+}
+
+static void mock_stop (pid_t pid)
+{
+    kill (pid, SIGTERM);
+    waitpid (pid, NULL, 0);
+}
+
+/***************************************************************/
+/********************** BSMP connection ************************/
+/***************************************************************/
+
+/* The mock's servers, on the ports libfcsclient reaches */
+static fcs_session_t *bench_connect (enum fcs_ep_e ep)
+{
+    fcs_session_t *s = fcs_open (ep, FCS_DEV_ETHERNET, "localhost", 0);
+
+    if (!s) {
+        fprintf (stderr, B "could not connect to port %s\n",
+                ep == FCS_EP_FE ? FCS_FE_PORT : FCS_FPGA_PORT);
+        exit (-1);
+    }
+
+    return s;
+}
+
+/***************************************************************/
+/************************* Benchmarks **************************/
+/***************************************************************/
+
+static void bench_session (void)
+{
+    struct bench_stats_s s;
+    uint32_t i, n = iters/20 ? iters/20 : 1;
+
+    stats_init (&s, n);
+    for (i = 0; i < n; ++i) {
+        double t0 = now_usec ();
+        fcs_session_t *fpga = bench_connect (FCS_EP_FPGA);
+        stats_add (&s, now_usec () - t0);
+        fcs_close (fpga);
+    }
+    report_latency ("latency", "session_init", &s, NULL);
+    free (s.usec);
+}
+
+static void bench_ops (void)
+{
+    fcs_session_t *fpga = bench_connect (FCS_EP_FPGA);
+    fcs_session_t *fe = bench_connect (FCS_EP_FE);
+    struct bench_stats_s get, set, setget, vread, vwrite, monit;
+    uint32_t in[2] = {0};
+    uint8_t out[BSMP_MAX_MESSAGE];
+    uint32_t len;
+    double att = 15.0;
+    uint32_t i;
+
+    stats_init (&get, iters);
+    stats_init (&set, iters);
+    stats_init (&setget, iters);
+    stats_init (&vread, iters);
+    stats_init (&vwrite, iters);
+    stats_init (&monit, iters);
+
+    in[0] = BENCH_KX_VALUE;
+
+    for (i = 0; i < iters; ++i) {
+        double t0 = now_usec (), t1, t2;
+
+        TRY (SET_KX_NAME, fcs_func_execute_id (fpga, SET_KX_ID, in, out));
+        t1 = now_usec ();
+        TRY (GET_KX_NAME, fcs_func_execute_id (fpga, GET_KX_ID, in, out));
+        t2 = now_usec ();
+
+        stats_add (&set, t1 - t0);
+        stats_add (&get, t2 - t1);
+        stats_add (&setget, t2 - t0);
+    }
+
+    for (i = 0; i < iters; ++i) {
+        double t0 = now_usec (), t1, t2;
+
+        TRY (GETSET_FE_ATT1_NAME, fcs_var_write (fe, GETSET_FE_ATT1_NAME,
+                    &att));
+        t1 = now_usec ();
+        TRY (GETSET_FE_ATT1_NAME, fcs_var_read (fe, GETSET_FE_ATT1_NAME, out));
+        t2 = now_usec ();
+
+        stats_add (&vwrite, t1 - t0);
+        stats_add (&vread, t2 - t1);
+    }
+
+    for (i = 0; i < iters; ++i) {
+        double t0 = now_usec ();
+        TRY (CURVE_MONIT_AMP_NAME, fcs_curve_read (fpga,
+                    END_CURVE_ID+CURVE_MONIT_AMP_ID, out, sizeof out, &len));
+        stats_add (&monit, now_usec () - t0);
+    }
+
+    report_latency ("latency", "func_set", &set, NULL);
+    report_latency ("latency", "func_get", &get, NULL);
+    report_latency ("latency", "func_setget", &setget, NULL);
+    report_latency ("latency", "var_write", &vwrite, NULL);
+    report_latency ("latency", "var_read", &vread, NULL);
+    report_latency ("latency", "monit_read", &monit, NULL);
+
+    free (get.usec);
+    free (set.usec);
+    free (setget.usec);
+    free (vread.usec);
+    free (vwrite.usec);
+    free (monit.usec);
+
+    fcs_close (fe);
+    fcs_close (fpga);
+}
+
+/* Full curve reads of the TBT amplitude curve for the current geometry */
+static void bench_curve (void)
+{
+    fcs_session_t *fpga = bench_connect (FCS_EP_FPGA);
+    uint32_t size = fcs_curve_size (fpga, CURVE_TBTAMP_ID);
+    uint32_t block_size = fcs_curve_block_size (fpga, CURVE_TBTAMP_ID);
+    struct bench_stats_s s;
+    uint8_t *data;
+    uint32_t len = 0;
+    uint32_t i;
+    double mbps;
+    char extra[256];
+
+    data = size ? malloc (size) : NULL;
+    if (!data) {
+        fprintf (stderr, B "could not allocate %u bytes of %s\n", size,
+                CURVE_TBTAMP_NAME);
+        fcs_close (fpga);
+        return;
+    }
+
+    stats_init (&s, BENCH_CURVE_ITERS);
+    for (i = 0; i < BENCH_CURVE_ITERS; ++i) {
+        double t0 = now_usec ();
+        TRY (CURVE_TBTAMP_NAME, fcs_curve_read (fpga, CURVE_TBTAMP_ID, data,
+                    size, &len));
+        stats_add (&s, now_usec () - t0);
+    }
+
+    // Throughput at the median read time
+    qsort (s.usec, s.n, sizeof(double), cmp_double);
+    mbps = len / stats_pct (&s, 50.0);
+    snprintf (extra, sizeof extra, ", \"block_size\": %u, \"nblocks\": %u, "
+            "\"bytes\": %u, \"mb_per_s\": %.3f", block_size, size/block_size,
+            len, mbps);
+    report_latency ("curve", CURVE_TBTAMP_NAME, &s, extra);
+
+    free (s.usec);
+    free (data);
+    fcs_close (fpga);
+}
+
+/* Text formatter throughput, with stdout sent to /dev/null */
+static void bench_formatter (void)
+{
+    const uint32_t samples = 500000;
+    int16_t *d16 = malloc (samples*NUM_CHANNELS*sizeof(int16_t));
+    int32_t *d32 = malloc (samples*NUM_CHANNELS*sizeof(int32_t));
+    int devnull = open ("/dev/null", O_WRONLY);
+    int saved = dup (STDOUT_FILENO);
+    double t16, t32, t0;
+    uint32_t i;
+
+    if (!d16 || !d32 || devnull < 0 || saved < 0) {
+        fprintf (stderr, B "could not set up formatter benchmark\n");
+        exit (-1);
+    }
+
+    for (i = 0; i < samples*NUM_CHANNELS; ++i) {
+        d16[i] = (int16_t) (i*7919);
+        d32[i] = (int32_t) (i*2654435761u);
+    }
+
+    fflush (stdout);
+    dup2 (devnull, STDOUT_FILENO);
+
+    t0 = now_usec ();
+    print_curve_16 ((uint8_t *) d16, samples*NUM_CHANNELS*sizeof(int16_t));
+    fflush (stdout);
+    t16 = now_usec () - t0;
+
+    t0 = now_usec ();
+    print_curve_32 ((uint8_t *) d32, samples*NUM_CHANNELS*sizeof(int32_t));
+    fflush (stdout);
+    t32 = now_usec () - t0;
+
+    dup2 (saved, STDOUT_FILENO);
+    close (saved);
+    close (devnull);
+
+    printf ("{\"revision\": \"%s\", \"bench\": \"formatter\", \"op\": "
+            "\"print_curve_16\", \"samples\": %u, \"usec\": %.1f, "
+            "\"msamples_per_s\": %.3f, \"mb_per_s\": %.3f}\n",
+            build_revision, samples, t16, samples/t16,
+            samples*NUM_CHANNELS*sizeof(int16_t)/t16);
+    printf ("{\"revision\": \"%s\", \"bench\": \"formatter\", \"op\": "
+            "\"print_curve_32\", \"samples\": %u, \"usec\": %.1f, "
+            "\"msamples_per_s\": %.3f, \"mb_per_s\": %.3f}\n",
+            build_revision, samples, t32, samples/t32,
+            samples*NUM_CHANNELS*sizeof(int32_t)/t32);
+    fflush (stdout);
+
+    free (d16);
+    free (d32);
+}
+
+/* 0 if kernel isa gives, for rows of d16 and d32, the very doubles the
+ * scalar one does */
+static int check_deinterleave (int isa, const int16_t *d16, const int32_t *d32,
+        uint32_t rows, const double *scale, struct soa_s *ref, struct soa_s *soa)
+{
+    unsigned int c;
+    uint32_t i;
+
+    for (c = 0; c < 2; ++c) {
+        if (c == 0) {
+            soa_deinterleave_16_isa (SOA_ISA_SCALAR, d16, rows, scale, ref->ch);
+            soa_deinterleave_16_isa (isa, d16, rows, scale, soa->ch);
+        }
+        else {
+            soa_deinterleave_32_isa (SOA_ISA_SCALAR, d32, rows, scale, ref->ch);
+            soa_deinterleave_32_isa (isa, d32, rows, scale, soa->ch);
+        }
+
+        for (i = 0; i < rows*NUM_CHANNELS; ++i) {
+            double want = ref->ch[i % NUM_CHANNELS][i/NUM_CHANNELS];
+            double got = soa->ch[i % NUM_CHANNELS][i/NUM_CHANNELS];
+
+            if (memcmp (&want, &got, sizeof want) != 0) {
+                fprintf (stderr, B "%s int%d kernel: row %u channel %u is "
+                        "%.17g, scalar %.17g\n", soa_isa_name (isa),
+                        c ? 32 : 16, i/NUM_CHANNELS, i % NUM_CHANNELS, got, want);
+                return -1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+/* De-interleave and scaling throughput of each kernel the CPU runs, once
+ * checked against the scalar one. GB/s counts the bytes read and written */
+static void bench_deinterleave (void)
+{
+    const uint32_t samples = 500000;
+    const double scale[NUM_CHANNELS] = {1e-6, 1e-6, 1e-6, 1e-6};
+    int16_t *d16 = malloc (samples*NUM_CHANNELS*sizeof(int16_t));
+    int32_t *d32 = malloc (samples*NUM_CHANNELS*sizeof(int32_t));
+    double base16 = 0, base32 = 0;
+    struct soa_s soa, ref;
+    uint32_t i;
+    int isa;
+
+    if (!d16 || !d32 || soa_alloc (&soa, samples) < 0 ||
+            soa_alloc (&ref, samples) < 0) {
+        fprintf (stderr, B "could not set up de-interleave benchmark\n");
+        exit (-1);
+    }
+
+    for (i = 0; i < samples*NUM_CHANNELS; ++i) {
+        d16[i] = (int16_t) (i*7919);
+        d32[i] = (int32_t) (i*2654435761u);
+    }
+
+    for (isa = 0; isa < SOA_ISA_END; ++isa) {
+        double t16 = 0, t32 = 0, t0;
+        uint32_t it;
+
+        if (!soa_isa_supported (isa)) {
+            continue;
+        }
+
+        // Whole and partial vectors: the row count leaves a tail
+        if (check_deinterleave (isa, d16, d32, samples, scale, &ref, &soa) < 0 ||
+                check_deinterleave (isa, d16, d32, samples - 3, scale, &ref,
+                    &soa) < 0 ||
+                check_deinterleave (isa, d16, d32, samples, NULL, &ref, &soa) < 0) {
+            bench_failed = 1;
+            continue;
+        }
+
+        // Best of the iterations: the first ones fault the pages in
+        for (it = 0; it < BENCH_CURVE_ITERS; ++it) {
+            t0 = now_usec ();
+            soa_deinterleave_16_isa (isa, d16, samples, scale, soa.ch);
+            t0 = now_usec () - t0;
+            t16 = it == 0 || t0 < t16 ? t0 : t16;
+
+            t0 = now_usec ();
+            soa_deinterleave_32_isa (isa, d32, samples, scale, soa.ch);
+            t0 = now_usec () - t0;
+            t32 = it == 0 || t0 < t32 ? t0 : t32;
+        }
+
+        if (isa == SOA_ISA_SCALAR) {
+            base16 = t16;
+            base32 = t32;
+        }
+
+        printf ("{\"revision\": \"%s\", \"bench\": \"deinterleave\", \"op\": "
+                "\"int16\", \"isa\": \"%s\", \"samples\": %u, \"usec\": %.1f, "
+                "\"gb_per_s\": %.3f, \"speedup\": %.2f}\n",
+                build_revision, soa_isa_name (isa), samples, t16,
+                samples*NUM_CHANNELS*(sizeof(int16_t) + sizeof(double))/t16/1e3,
+                base16/t16);
+        printf ("{\"revision\": \"%s\", \"bench\": \"deinterleave\", \"op\": "
+                "\"int32\", \"isa\": \"%s\", \"samples\": %u, \"usec\": %.1f, "
+                "\"gb_per_s\": %.3f, \"speedup\": %.2f}\n",
+                build_revision, soa_isa_name (isa), samples, t32,
+                samples*NUM_CHANNELS*(sizeof(int32_t) + sizeof(double))/t32/1e3,
+                base32/t32);
+    }
+    fflush (stdout);
+
+    soa_free (&soa);
+    soa_free (&ref);
+    free (d16);
+    free (d32);
+}
+
+/* Software down-conversion of an ADC capture, to TBT and FOFB rates */
+static void bench_ddc (void)
+{
+    const uint32_t samples = 100000;
+    const uint32_t decims[] = {35, 1000};
+    struct soa_s adc, amp;
+    uint32_t i, d;
+    unsigned int c;
+
+    if (soa_alloc (&adc, samples) < 0 || soa_alloc (&amp, samples) < 0) {
+        fprintf (stderr, B "could not set up DDC benchmark\n");
+        exit (-1);
+    }
+
+    // The mock's IF: 8 cycles every 35 samples
+    for (i = 0; i < samples; ++i) {
+        for (c = 0; c < NUM_CHANNELS; ++c) {
+            adc.ch[c][i] = 8000.0*cos (2*M_PI*8.0/35.0*i + c);
+        }
+    }
+    adc.rows = samples;
+
+    for (d = 0; d < ARRAY_SIZE(decims); ++d) {
+        struct ddc_s ddc;
+        double t = 0, t0;
+        uint32_t it;
+
+        if (ddc_init (&ddc, 35000000, 8000000, decims[d], DDC_ORDER) < 0) {
+            fprintf (stderr, B "could not set up DDC benchmark\n");
+            exit (-1);
+        }
+
+        for (it = 0; it < BENCH_CURVE_ITERS; ++it) {
+            ddc_reset (&ddc);
+            t0 = now_usec ();
+            ddc_process (&ddc, &adc, &amp, NULL);
+            t0 = now_usec () - t0;
+            t = it == 0 || t0 < t ? t0 : t;
+        }
+
+        printf ("{\"revision\": \"%s\", \"bench\": \"ddc\", \"decim\": %u, "
+                "\"samples\": %u, \"usec\": %.1f, \"msamples_per_s\": %.1f}\n",
+                build_revision, decims[d], samples, t,
+                samples*NUM_CHANNELS/t);
+        ddc_free (&ddc);
+    }
+    fflush (stdout);
+
+    soa_free (&adc);
+    soa_free (&amp);
+}
+
+/* Wall time of a complete fcs_client invocation doing one get */
+static void bench_startup (void)
+{
+    struct bench_stats_s s;
+    uint32_t i;
+
+    stats_init (&s, BENCH_STARTUP_ITERS);
+    for (i = 0; i < BENCH_STARTUP_ITERS; ++i) {
+        double t0 = now_usec ();
+        int status;
+        pid_t pid = fork ();
+
+        if (pid == 0) {
+            int devnull = open ("/dev/null", O_WRONLY);
+            dup2 (devnull, STDOUT_FILENO);
+            execl (client_path, client_path, "-o", "localhost", "-X",
+                    (char *) NULL);
+            _exit (127);
+        }
+
+        if (pid < 0 || waitpid (pid, &status, 0) < 0 ||
+                !WIFEXITED (status) || WEXITSTATUS (status) != 0) {
+            fprintf (stderr, B "could not run %s\n", client_path);
+            free (s.usec);
+            return;
+        }
+        stats_add (&s, now_usec () - t0);
+    }
+
+    report_latency ("startup", "fcs_client_getkx", &s, NULL);
+    free (s.usec);
+}
+
+/***************************************************************/
+/********************* Command-line handling *******************/
+/***************************************************************/
+
+void print_usage (FILE* stream, int exit_code) __attribute__((noreturn));
+
+void print_usage (FILE* stream, int exit_code)
+{
+    fprintf (stream, "FCS Client benchmark\n");
+    fprintf (stream, "Git commit ID: %s.\n", build_revision);
+    fprintf (stream, "Build date: %s.\n\n", build_date);
+    fprintf (stream, "Usage:  %s options \n", program_name);
+    fprintf (stream,
+            "  -h  --help                      Display this usage information.\n"
+            "  -m  --mock         <path>       Mock server binary [default: " BENCH_MOCK_PATH "]\n"
+            "  -c  --client       <path>       Client binary [default: " BENCH_CLIENT_PATH "]\n"
+            "  -n  --iterations   <number>     Iterations of each latency benchmark\n"
+           );
+    exit (exit_code);
+}
+
+static struct option long_options[] =
+{
+    {"help",            no_argument,         NULL, 'h'},
+    {"mock",            required_argument,   NULL, 'm'},
+    {"client",          required_argument,   NULL, 'c'},
+    {"iterations",      required_argument,   NULL, 'n'},
+    {NULL, 0, NULL, 0}
+};
+
+int main(int argc, char *argv[])
+{
+    pid_t mock;
+    unsigned int i;
+    int ch;
+
+    program_name = argv[0];
+
+    while ((ch = getopt_long(argc, argv, "hm:c:n:",
+                    long_options, NULL)) != -1)
+    {
+        switch (ch)
+        {
+            case 'h':
+                print_usage (stderr, 0);
+            case 'm':
+                mock_path = optarg;
+                break;
+            case 'c':
+                client_path = optarg;
+                break;
+            case 'n':
+                iters = (uint32_t) atoi (optarg);
+                break;
+            default:
+                print_usage (stderr, 1);
+        }
+    }
+
+    if (iters == 0) {
+        fprintf (stderr, "%s: iterations must be positive\n", program_name);
+        return -1;
+    }
+
+    signal (SIGPIPE, SIG_IGN);
+
+    mock = mock_start (BENCH_DEFAULT_BLOCK_SIZE, BENCH_DEFAULT_SAMPLES);
+    bench_session ();
+    bench_ops ();
+    bench_startup ();
+    mock_stop (mock);
+
+    for (i = 0; i < ARRAY_SIZE(geometries); ++i) {
+        mock = mock_start (geometries[i].block_size, geometries[i].samples);
+        bench_curve ();
+        mock_stop (mock);
+    }
+
+    bench_formatter ();
+    bench_deinterleave ();
+    bench_ddc ();
+
+    return bench_failed ? -1 : 0;
+}
@@ -0,0 +1,33 @@
+#ifndef _FCS_BENCH_H_
+#define _FCS_BENCH_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+#include "fcs_client.h"
+
+#define BENCH_MOCK_PATH         "./bpm_mock"
+#define BENCH_CLIENT_PATH       "./fcs_client"
+
+#define BENCH_DEFAULT_ITERS     2000
+#define BENCH_DEFAULT_BLOCK_SIZE 16384
+#define BENCH_DEFAULT_SAMPLES   100000
+#define BENCH_CURVE_ITERS       20
+#define BENCH_STARTUP_ITERS     20
+#define BENCH_CONNECT_TIMEOUT   5000000 // usec to wait for the mock
+#define BENCH_KX_VALUE          10000000
+
+/* Curve geometries the throughput benchmark walks through */
+struct bench_geometry_s {
+    uint32_t block_size;            // bytes per BSMP block
+    uint32_t samples;               // 4-channel, 32-bit samples per curve
+};
+
+struct bench_stats_s {
+    double *usec;                   // one latency sample per iteration
+    uint32_t n;
+    uint32_t size;
+};
+
+#endif
@@ -0,0 +1,895 @@
+// Index of experiment captures: metadata columns, filters
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "dataindex.h"
+
+#define DX_MIN_CAP              64 // captures
+#define DX_METADATA_EXT         ".metadata"
+
+void dx_init (struct dx_s *dx)
+{
+    memset (dx, 0, sizeof *dx);
+}
+
+void dx_free (struct dx_s *dx)
+{
+    uint32_t k;
+
+    for (k = 0; k < dx->nkeys; ++k) {
+        free (dx->col[k]);
+    }
+    free (dx->col);
+    free (dx->key);
+    free (dx->pool);
+    free (dx->str);
+    free (dx->meta);
+    free (dx->data);
+    free (dx->signature);
+    free (dx->timestamp);
+    free (dx->mtime);
+    free (dx->size);
+    memset (dx, 0, sizeof *dx);
+}
+
+const char *dx_str (const struct dx_s *dx, uint32_t off)
+{
+    return dx->pool ? dx->pool + off : "";
+}
+
+/***************************************************************/
+/*************************** Strings ***************************/
+/***************************************************************/
+
+/* Slot of the string, or the empty one it would take */
+static uint32_t dx_slot (const struct dx_s *dx, const char *s, uint32_t len)
+{
+    uint32_t mask = dx->str_cap - 1, i = md_hash (s, len) & mask;
+
+    while (dx->str[i]) {
+        const char *p = dx->pool + dx->str[i] - 1;
+
+        if (!strncmp (p, s, len) && p[len] == '\0') {
+            break;
+        }
+        i = (i + 1) & mask;
+    }
+
+    return i;
+}
+
+/* A table for str_n + 1 strings at most a quarter full */
+static int dx_str_grow (struct dx_s *dx)
+{
+    uint32_t cap = dx->str_cap ? 2*dx->str_cap : 1024, off;
+    uint32_t *str;
+
+    while (cap < 4*(dx->str_n + 1)) {
+        cap *= 2;
+    }
+    str = calloc (cap, sizeof *str);
+    if (!str) {
+        return -1;
+    }
+
+    free (dx->str);
+    dx->str = str;
+    dx->str_cap = cap;
+
+    // Every string of the pool, "" (0) aside
+    for (off = 1; off < dx->pool_len; off += strlen (dx->pool + off) + 1) {
+        uint32_t len = strlen (dx->pool + off);
+
+        dx->str[dx_slot (dx, dx->pool + off, len)] = off + 1;
+    }
+
+    return 0;
+}
+
+/* Offset of the string in the pool, added if new. Returns -1 if out of
+ * memory */
+static int64_t dx_intern (struct dx_s *dx, const char *s, uint32_t len)
+{
+    uint32_t i, off;
+
+    if (!len) {
+        return 0;
+    }
+
+    if (2*(dx->str_n + 1) > dx->str_cap && dx_str_grow (dx) < 0) {
+        return -1;
+    }
+
+    i = dx_slot (dx, s, len);
+    if (dx->str[i]) {
+        return dx->str[i] - 1;
+    }
+
+    if (!dx->pool_len || dx->pool_len + len + 1 > dx->pool_cap) {
+        uint32_t cap = dx->pool_cap ? dx->pool_cap : 4096;
+        char *pool;
+
+        while (dx->pool_len + len + 2 > cap) {
+            cap *= 2;
+        }
+        pool = realloc (dx->pool, cap);
+        if (!pool) {
+            return -1;
+        }
+        dx->pool = pool;
+        dx->pool_cap = cap;
+        if (!dx->pool_len) {
+            dx->pool[dx->pool_len++] = '\0';
+        }
+    }
+
+    off = dx->pool_len;
+    memcpy (dx->pool + off, s, len);
+    dx->pool[off + len] = '\0';
+    dx->pool_len += len + 1;
+
+    dx->str[i] = off + 1;
+    ++dx->str_n;
+
+    return off;
+}
+
+/***************************************************************/
+/*************************** Columns ***************************/
+/***************************************************************/
+
+static int dx_grow (struct dx_s *dx)
+{
+    uint32_t cap = dx->cap ? 2*dx->cap : DX_MIN_CAP, k;
+
+#define DX_REALLOC(p)\
+    do {\
+        void *_p = realloc (p, cap*sizeof *(p));\
+        if (!_p) {\
+            return -1;\
+        }\
+        p = _p;\
+    }while(0)
+
+    DX_REALLOC (dx->meta);
+    DX_REALLOC (dx->data);
+    DX_REALLOC (dx->signature);
+    DX_REALLOC (dx->timestamp);
+    DX_REALLOC (dx->mtime);
+    DX_REALLOC (dx->size);
+    for (k = 0; k < dx->nkeys; ++k) {
+        DX_REALLOC (dx->col[k]);
+    }
+
+#undef DX_REALLOC
+
+    dx->cap = cap;
+
+    return 0;
+}
+
+/* A new capture, with no values yet. Returns its row or -1 */
+static int64_t dx_add (struct dx_s *dx)
+{
+    uint32_t k, row = dx->n;
+
+    if (dx->n == dx->cap && dx_grow (dx) < 0) {
+        return -1;
+    }
+
+    dx->meta[row] = dx->data[row] = dx->signature[row] = 0;
+    dx->timestamp[row] = DX_TIME_NONE;
+    dx->mtime[row] = 0;
+    dx->size[row] = 0;
+    for (k = 0; k < dx->nkeys; ++k) {
+        dx->col[k][row] = 0;
+    }
+
+    return dx->n++;
+}
+
+/* Column of the key (interned at off), or -1 */
+static int64_t dx_column (const struct dx_s *dx, uint32_t off)
+{
+    uint32_t k;
+
+    for (k = 0; k < dx->nkeys; ++k) {
+        if (dx->key[k] == off) {
+            return k;
+        }
+    }
+
+    return -1;
+}
+
+/* Column of key, added ("" for the captures so far) if new. Returns -1
+ * if out of memory */
+static int64_t dx_key (struct dx_s *dx, const char *key)
+{
+    int64_t koff = dx_intern (dx, key, strlen (key)), k;
+
+    if (koff < 0) {
+        return -1;
+    }
+
+    k = dx_column (dx, koff);
+    if (k < 0) {
+        uint32_t cap = dx->key_cap ? 2*dx->key_cap : 64;
+
+        if (dx->nkeys == dx->key_cap) {
+            uint32_t *key = realloc (dx->key, cap*sizeof *key);
+            uint32_t **col;
+
+            if (!key) {
+                return -1;
+            }
+            dx->key = key;
+            col = realloc (dx->col, cap*sizeof *col);
+            if (!col) {
+                return -1;
+            }
+            dx->col = col;
+            dx->key_cap = cap;
+        }
+
+        dx->col[dx->nkeys] = calloc (dx->cap ? dx->cap : 1, sizeof **dx->col);
+        if (!dx->col[dx->nkeys]) {
+            return -1;
+        }
+        dx->key[dx->nkeys] = koff;
+        k = dx->nkeys++;
+    }
+
+    return k;
+}
+
+/* Value of key for capture row */
+static int dx_set (struct dx_s *dx, uint32_t row, const char *key,
+        const char *value)
+{
+    int64_t k = dx_key (dx, key), voff;
+
+    if (k < 0 || (voff = dx_intern (dx, value, strlen (value))) < 0) {
+        return -1;
+    }
+
+    dx->col[k][row] = voff;
+
+    return 0;
+}
+
+/***************************************************************/
+/**************************** File *****************************/
+/***************************************************************/
+
+int dx_write (const struct dx_s *dx, const char *path)
+{
+    uint32_t hdr[5] = {DX_MAGIC, DX_VERSION, dx->n, dx->nkeys, dx->pool_len};
+    size_t len = strlen (path);
+    char *tmp = malloc (len + 5);
+    FILE *f;
+    uint32_t k;
+    int err = 0;
+
+    if (!tmp) {
+        return -1;
+    }
+    memcpy (tmp, path, len);
+    memcpy (tmp + len, ".tmp", 5);
+
+    f = fopen (tmp, "wb");
+    if (!f) {
+        free (tmp);
+        return -1;
+    }
+
+    err |= fwrite (hdr, sizeof hdr, 1, f) != 1;
+    err |= fwrite (dx->pool, 1, dx->pool_len, f) != dx->pool_len;
+    err |= fwrite (dx->meta, sizeof *dx->meta, dx->n, f) != dx->n;
+    err |= fwrite (dx->data, sizeof *dx->data, dx->n, f) != dx->n;
+    err |= fwrite (dx->signature, sizeof *dx->signature, dx->n, f) != dx->n;
+    err |= fwrite (dx->timestamp, sizeof *dx->timestamp, dx->n, f) != dx->n;
+    err |= fwrite (dx->mtime, sizeof *dx->mtime, dx->n, f) != dx->n;
+    err |= fwrite (dx->size, sizeof *dx->size, dx->n, f) != dx->n;
+    err |= fwrite (dx->key, sizeof *dx->key, dx->nkeys, f) != dx->nkeys;
+    for (k = 0; k < dx->nkeys; ++k) {
+        err |= fwrite (dx->col[k], sizeof **dx->col, dx->n, f) != dx->n;
+    }
+
+    err |= fclose (f) != 0;
+    err = err || rename (tmp, path) < 0;
+    if (err) {
+        remove (tmp);
+    }
+    free (tmp);
+
+    return err ? -1 : 0;
+}
+
+/* Every offset of the n in p within the pool */
+static int dx_check (const struct dx_s *dx, const uint32_t *p, uint32_t n)
+{
+    uint32_t i;
+
+    for (i = 0; i < n; ++i) {
+        if (p[i] >= dx->pool_len) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+int dx_read (struct dx_s *dx, const char *path)
+{
+    FILE *f = fopen (path, "rb");
+    uint32_t hdr[5], k;
+    int err = 0;
+
+    if (!f) {
+        return errno == ENOENT ? 0 : -1;
+    }
+
+    if (fread (hdr, sizeof hdr, 1, f) != 1 || hdr[0] != DX_MAGIC ||
+            hdr[1] != DX_VERSION || (!hdr[4] && (hdr[2] || hdr[3]))) {
+        fclose (f);
+        errno = EINVAL;
+        return -1;
+    }
+
+    dx_free (dx);
+
+    // No captures yet
+    if (!hdr[4]) {
+        fclose (f);
+        return 1;
+    }
+    dx->pool = malloc (hdr[4]);
+    dx->pool_len = dx->pool_cap = hdr[4];
+    dx->key = malloc ((hdr[3] ? hdr[3] : 1)*sizeof *dx->key);
+    dx->col = calloc (hdr[3] ? hdr[3] : 1, sizeof *dx->col);
+    dx->key_cap = hdr[3];
+    if (!dx->pool || !dx->key || !dx->col) {
+        err = -1;
+    }
+    while (!err && dx->cap < hdr[2]) {
+        err = dx_grow (dx);
+    }
+    for (k = 0; !err && k < hdr[3]; ++k, ++dx->nkeys) {
+        dx->col[k] = malloc ((dx->cap ? dx->cap : 1)*sizeof **dx->col);
+        err = dx->col[k] ? 0 : -1;
+    }
+    if (err) {
+        fclose (f);
+        dx_free (dx);
+        errno = ENOMEM;
+        return -1;
+    }
+    dx->n = hdr[2];
+
+    err |= fread (dx->pool, 1, dx->pool_len, f) != dx->pool_len;
+    err |= fread (dx->meta, sizeof *dx->meta, dx->n, f) != dx->n;
+    err |= fread (dx->data, sizeof *dx->data, dx->n, f) != dx->n;
+    err |= fread (dx->signature, sizeof *dx->signature, dx->n, f) != dx->n;
+    err |= fread (dx->timestamp, sizeof *dx->timestamp, dx->n, f) != dx->n;
+    err |= fread (dx->mtime, sizeof *dx->mtime, dx->n, f) != dx->n;
+    err |= fread (dx->size, sizeof *dx->size, dx->n, f) != dx->n;
+    err |= fread (dx->key, sizeof *dx->key, dx->nkeys, f) != dx->nkeys;
+    for (k = 0; k < dx->nkeys; ++k) {
+        err |= fread (dx->col[k], sizeof **dx->col, dx->n, f) != dx->n;
+    }
+    fclose (f);
+
+    // Offsets that stay in the pool, and a pool that ends a string
+    err = err || dx->pool[0] != '\0' || dx->pool[dx->pool_len - 1] != '\0';
+    err = err || dx_check (dx, dx->meta, dx->n) < 0 ||
+        dx_check (dx, dx->data, dx->n) < 0 ||
+        dx_check (dx, dx->signature, dx->n) < 0 ||
+        dx_check (dx, dx->key, dx->nkeys) < 0;
+    for (k = 0; !err && k < dx->nkeys; ++k) {
+        err = dx_check (dx, dx->col[k], dx->n) < 0;
+    }
+
+    if (err) {
+        dx_free (dx);
+        errno = EINVAL;
+        return -1;
+    }
+
+    for (k = 1; k < dx->pool_len; k += strlen (dx->pool + k) + 1) {
+        ++dx->str_n;
+    }
+    if (dx_str_grow (dx) < 0) {
+        dx_free (dx);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    return 1;
+}
+
+/***************************************************************/
+/**************************** Scan *****************************/
+/***************************************************************/
+
+struct dx_walk_s {
+    struct dx_s *dx;
+    const struct dx_s *old;
+    uint32_t *row;                  // of old by metadata file, row + 1
+    uint32_t row_cap;
+    uint32_t *keymap;               // column of each old key in dx + 1
+    char path[PATH_MAX];
+    size_t root_len;                // of the directory, with its '/'
+    uint32_t parsed;
+};
+
+/* "2014-03-20T10:04:18.123456789Z" */
+static int64_t dx_timestamp (const char *s)
+{
+    struct tm tm;
+    int64_t ns = 0, scale = 100000000;
+    int n = 0;
+
+    memset (&tm, 0, sizeof tm);
+    if (sscanf (s, "%d-%d-%dT%d:%d:%d%n", &tm.tm_year, &tm.tm_mon,
+                &tm.tm_mday, &tm.tm_hour, &tm.tm_min, &tm.tm_sec, &n) != 6) {
+        return DX_TIME_NONE;
+    }
+    tm.tm_year -= 1900;
+    tm.tm_mon -= 1;
+
+    if (s[n] == '.') {
+        for (++n; isdigit ((unsigned char) s[n]); ++n, scale /= 10) {
+            ns += (s[n] - '0')*scale;
+        }
+    }
+
+    return (int64_t) timegm (&tm)*1000000000 + ns;
+}
+
+/* Old rows by metadata file */
+static int dx_walk_init (struct dx_walk_s *w, struct dx_s *dx,
+        const struct dx_s *old)
+{
+    uint32_t i;
+
+    memset (w, 0, sizeof *w);
+    w->dx = dx;
+    w->old = old;
+
+    if (!old || !old->n) {
+        return 0;
+    }
+
+    for (w->row_cap = 1; w->row_cap < 2*old->n; w->row_cap *= 2);
+    w->row = calloc (w->row_cap, sizeof *w->row);
+    w->keymap = calloc (old->nkeys ? old->nkeys : 1, sizeof *w->keymap);
+    if (!w->row || !w->keymap) {
+        return -1;
+    }
+
+    for (i = 0; i < old->n; ++i) {
+        const char *m = dx_str (old, old->meta[i]);
+        uint32_t s = md_hash (m, strlen (m)) & (w->row_cap - 1);
+
+        while (w->row[s]) {
+            s = (s + 1) & (w->row_cap - 1);
+        }
+        w->row[s] = i + 1;
+    }
+
+    return 0;
+}
+
+static int64_t dx_walk_old (const struct dx_walk_s *w, const char *meta)
+{
+    uint32_t s;
+
+    if (!w->row) {
+        return -1;
+    }
+
+    s = md_hash (meta, strlen (meta)) & (w->row_cap - 1);
+    while (w->row[s]) {
+        if (!strcmp (dx_str (w->old, w->old->meta[w->row[s] - 1]), meta)) {
+            return w->row[s] - 1;
+        }
+        s = (s + 1) & (w->row_cap - 1);
+    }
+
+    return -1;
+}
+
+/* Old capture i, unchanged */
+static int dx_copy (struct dx_walk_s *w, uint32_t i)
+{
+    struct dx_s *dx = w->dx;
+    const struct dx_s *old = w->old;
+    int64_t row = dx_add (dx), off;
+    uint32_t k;
+
+    if (row < 0) {
+        return -1;
+    }
+
+#define DX_COPY_STR(field)\
+    do {\
+        const char *_s = dx_str (old, old->field[i]);\
+        if ((off = dx_intern (dx, _s, strlen (_s))) < 0) {\
+            return -1;\
+        }\
+        dx->field[row] = off;\
+    }while(0)
+
+    DX_COPY_STR (meta);
+    DX_COPY_STR (data);
+    DX_COPY_STR (signature);
+
+#undef DX_COPY_STR
+
+    dx->timestamp[row] = old->timestamp[i];
+    dx->mtime[row] = old->mtime[i];
+    dx->size[row] = old->size[i];
+
+    for (k = 0; k < old->nkeys; ++k) {
+        const char *v = dx_str (old, old->col[k][i]);
+
+        if (!*v) {
+            continue;
+        }
+        if (!w->keymap[k]) {
+            if ((off = dx_key (dx, dx_str (old, old->key[k]))) < 0) {
+                return -1;
+            }
+            w->keymap[k] = off + 1;
+        }
+        if ((off = dx_intern (dx, v, strlen (v))) < 0) {
+            return -1;
+        }
+        dx->col[w->keymap[k] - 1][row] = off;
+    }
+
+    return 0;
+}
+
+/* Metadata file at w->path, new or changed */
+static int dx_parse (struct dx_walk_s *w, const struct stat *st)
+{
+    struct dx_s *dx = w->dx;
+    const char *rel = w->path + w->root_len, *slash = strrchr (rel, '/');
+    const struct md_entry_s *e;
+    struct md_s md;
+    char data[PATH_MAX];
+    int64_t row, off;
+    uint32_t i;
+    int err = 0;
+
+    md_init (&md);
+    if (md_load (&md, w->path) < 0) {
+        // Not fatal: one bad file does not stop the others
+        perror (w->path);
+        md_free (&md);
+        return 0;
+    }
+    ++w->parsed;
+
+    row = dx_add (dx);
+    err = row < 0;
+
+    if (!err && (off = dx_intern (dx, rel, strlen (rel))) >= 0) {
+        dx->meta[row] = off;
+    }
+    else {
+        err = 1;
+    }
+
+    // Saved next to its metadata
+    e = md_get (&md, "data_original_filename");
+    if (!err && e && *e->value) {
+        int len = snprintf (data, sizeof data, "%.*s%s",
+                slash ? (int) (slash - rel + 1) : 0, rel, e->value);
+
+        if (len > 0 && (size_t) len < sizeof data) {
+            err = (off = dx_intern (dx, data, len)) < 0;
+            dx->data[row] = err ? 0 : off;
+        }
+    }
+
+    e = md_get (&md, "data_signature");
+    if (!err && e) {
+        err = (off = dx_intern (dx, e->value, strlen (e->value))) < 0;
+        dx->signature[row] = err ? 0 : off;
+    }
+
+    e = md_get (&md, "timestamp_start");
+    if (!err && e) {
+        dx->timestamp[row] = dx_timestamp (e->value);
+    }
+
+    if (!err) {
+        dx->mtime[row] = (int64_t) st->st_mtim.tv_sec*1000000000 +
+            st->st_mtim.tv_nsec;
+        dx->size[row] = st->st_size;
+    }
+
+    for (i = 0; !err && i < md.n; ++i) {
+        e = md_sorted (&md, i);
+        err = dx_set (dx, row, md_key (&md, e), e->value) < 0;
+    }
+
+    md_free (&md);
+
+    return err ? -1 : 0;
+}
+
+static int dx_is_metadata (const char *name)
+{
+    size_t len = strlen (name), ext = strlen (DX_METADATA_EXT);
+
+    return len > ext && !strcmp (name + len - ext, DX_METADATA_EXT);
+}
+
+/* Entries of w->path (len long), by name */
+static int dx_walk (struct dx_walk_s *w, size_t len, unsigned int depth)
+{
+    struct dirent **names;
+    struct stat st;
+    int n, i, err = 0;
+
+    n = scandir (w->path, &names, NULL, alphasort);
+    if (n < 0) {
+        return depth ? 0 : -1;
+    }
+
+    for (i = 0; i < n; ++i) {
+        const char *name = names[i]->d_name;
+        size_t nlen = strlen (name);
+        int64_t old;
+
+        // Hidden entries, the index among them
+        if (err || name[0] == '.' || len + nlen + 2 > sizeof w->path) {
+            free (names[i]);
+            continue;
+        }
+
+        w->path[len] = '/';
+        memcpy (w->path + len + 1, name, nlen + 1);
+
+        if (names[i]->d_type == DT_DIR || (names[i]->d_type == DT_UNKNOWN &&
+                    !stat (w->path, &st) && S_ISDIR (st.st_mode))) {
+            if (depth + 1 < DX_MAX_DEPTH) {
+                err = dx_walk (w, len + 1 + nlen, depth + 1) < 0;
+            }
+        }
+        else if (dx_is_metadata (name) && !stat (w->path, &st) &&
+                S_ISREG (st.st_mode)) {
+            old = dx_walk_old (w, w->path + w->root_len);
+
+            if (old >= 0 && w->old->size[old] == (uint64_t) st.st_size &&
+                    w->old->mtime[old] == (int64_t) st.st_mtim.tv_sec*1000000000 +
+                    st.st_mtim.tv_nsec) {
+                err = dx_copy (w, old) < 0;
+            }
+            else {
+                err = dx_parse (w, &st) < 0;
+            }
+            if (err) {
+                errno = ENOMEM;
+            }
+        }
+
+        free (names[i]);
+    }
+
+    free (names);
+    w->path[len] = '\0';
+
+    return err ? -1 : 0;
+}
+
+int dx_scan (struct dx_s *dx, const struct dx_s *old, const char *dir,
+        uint32_t *parsed)
+{
+    struct dx_walk_s w;
+    size_t len = strlen (dir);
+    int err;
+
+    while (len > 1 && dir[len - 1] == '/') {
+        --len;
+    }
+    if (len + 1 >= sizeof w.path) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+
+    if (dx_walk_init (&w, dx, old) < 0) {
+        free (w.row);
+        free (w.keymap);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    memcpy (w.path, dir, len);
+    w.path[len] = '\0';
+    w.root_len = len + 1;
+
+    err = dx_walk (&w, len, 0);
+    *parsed = w.parsed;
+
+    free (w.row);
+    free (w.keymap);
+
+    return err ? -1 : 0;
+}
+
+/***************************************************************/
+/************************** Queries ****************************/
+/***************************************************************/
+
+int dx_filter_parse (struct dx_filter_s *f, const char *arg)
+{
+    const char *op = arg + strcspn (arg, "=!<>"), *dot;
+    char *end;
+
+    memset (f, 0, sizeof *f);
+
+    if (!*op || op == arg) {
+        return -1;
+    }
+
+    switch (*op) {
+        case '!':
+            if (op[1] != '=') {
+                return -1;
+            }
+            f->op = DX_NE;
+            f->value = op + 2;
+            break;
+        case '<':
+            f->op = DX_LT;
+            f->value = op + 1;
+            break;
+        case '>':
+            f->op = DX_GT;
+            f->value = op + 1;
+            break;
+        default:
+            f->op = DX_EQ;
+            f->value = op + 1;
+    }
+
+    f->key = arg;
+    f->key_len = op - arg;
+
+    dot = memchr (arg, '.', f->key_len);
+    if (dot) {
+        f->item = strtoul (dot + 1, &end, 10);
+        if (end != op || !f->item) {
+            return -1;
+        }
+        f->key_len = dot - arg;
+    }
+
+    f->number = md_number (f->value, &f->num, f->unit);
+
+    return 0;
+}
+
+/* item-th comma-separated item of v (from 1), without blanks, into buf */
+static const char *dx_item (const char *v, unsigned int item, char *buf)
+{
+    const char *end;
+    size_t len;
+
+    for (; item > 1 && v; --item) {
+        v = strchr (v, ',');
+        v = v ? v + 1 : NULL;
+    }
+    if (!v) {
+        return "";
+    }
+
+    while (isspace ((unsigned char) *v)) {
+        ++v;
+    }
+    end = v + strcspn (v, ",");
+    while (end > v && isspace ((unsigned char) end[-1])) {
+        --end;
+    }
+
+    len = end - v < DX_VALUE_LEN - 1 ? (size_t) (end - v) : DX_VALUE_LEN - 1;
+    memcpy (buf, v, len);
+    buf[len] = '\0';
+
+    return buf;
+}
+
+static int dx_match (const struct dx_filter_s *f, const char *v)
+{
+    char buf[DX_VALUE_LEN], unit[MD_UNIT_LEN];
+    double num;
+    int c;
+
+    if (f->item) {
+        v = dx_item (v, f->item, buf);
+    }
+
+    if (f->number) {
+        if (!md_number (v, &num, unit) || (f->unit[0] && strcmp (unit, f->unit))) {
+            return f->op == DX_NE;
+        }
+        c = (num > f->num) - (num < f->num);
+    }
+    else {
+        c = strcmp (v, f->value);
+    }
+
+    switch (f->op) {
+        case DX_NE:
+            return c != 0;
+        case DX_LT:
+            return c < 0;
+        case DX_GT:
+            return c > 0;
+        default:
+            return c == 0;
+    }
+}
+
+static int dx_by_time (const void *a, const void *b, void *arg)
+{
+    const struct dx_s *dx = arg;
+    uint32_t i = *(const uint32_t *) a, j = *(const uint32_t *) b;
+
+    if (dx->timestamp[i] != dx->timestamp[j]) {
+        return dx->timestamp[i] < dx->timestamp[j] ? -1 : 1;
+    }
+
+    return strcmp (dx_str (dx, dx->meta[i]), dx_str (dx, dx->meta[j]));
+}
+
+uint32_t dx_query (const struct dx_s *dx, const struct dx_filter_s *f,
+        unsigned int nf, uint32_t *rows)
+{
+    uint32_t i, n = 0, k;
+    unsigned int j;
+
+    for (i = 0; i < dx->n; ++i) {
+        rows[n++] = i;
+    }
+
+    // One column at a time, over the captures still in
+    for (j = 0; j < nf; ++j) {
+        const uint32_t *col = NULL;
+        uint32_t m = 0;
+
+        for (k = 0; k < dx->nkeys; ++k) {
+            const char *key = dx_str (dx, dx->key[k]);
+
+            if (!strncmp (key, f[j].key, f[j].key_len) &&
+                    key[f[j].key_len] == '\0') {
+                col = dx->col[k];
+                break;
+            }
+        }
+
+        for (i = 0; i < n; ++i) {
+            if (dx_match (&f[j], col ? dx_str (dx, col[rows[i]]) : "")) {
+                rows[m++] = rows[i];
+            }
+        }
+        n = m;
+    }
+
+    qsort_r (rows, n, sizeof *rows, dx_by_time, (void *) dx);
+
+    return n;
+}
@@ -0,0 +1,95 @@
+#ifndef _DATAINDEX_H_
+#define _DATAINDEX_H_
+
+#include <inttypes.h>
+
+#include "metadata.h"
+
+/* Index of the captures saved under a directory, one per .metadata file
+ * (as bpm_experiment.py writes them, next to their data file), found
+ * anywhere below it. Strings (paths, keys and values) are kept once each
+ * in a pool and referred to by offset; the captures are columns of those
+ * offsets: the metadata file, its data file and signature, then one
+ * column per metadata key, "" where a capture lacks it. Captures also
+ * keep their timestamp_start and the time and size of the metadata file.
+ *
+ * The index is saved in the directory itself (DX_FILENAME) as the arrays
+ * it is made of, native-endian. A scan walks the directory again but only
+ * parses the metadata files that are new or changed since the saved index;
+ * the data files are never opened. Filters are answered from the columns */
+#define DX_MAGIC                0x58444946 // "FIDX"
+#define DX_VERSION              1
+#define DX_FILENAME             ".fcs_index"
+#define DX_MAX_DEPTH            16 // directory levels scanned
+#define DX_VALUE_LEN            256 // of a list item compared
+#define DX_TIME_NONE            INT64_MIN
+
+struct dx_s {
+    char *pool;                     // strings, '\0'-terminated, 0 -> ""
+    uint32_t pool_len;
+    uint32_t pool_cap;
+    uint32_t *str;                  // pool offset + 1, 0 -> empty
+    uint32_t str_n;
+    uint32_t str_cap;               // a power of two
+    uint32_t n;                     // captures
+    uint32_t cap;
+    uint32_t *meta;                 // metadata file, relative to the directory
+    uint32_t *data;                 // data file, "" if the metadata has none
+    uint32_t *signature;
+    int64_t *timestamp;             // ns since the epoch, or DX_TIME_NONE
+    int64_t *mtime;                 // of the metadata file, ns
+    uint64_t *size;                 // of the metadata file
+    uint32_t nkeys;
+    uint32_t key_cap;
+    uint32_t *key;
+    uint32_t **col;                 // [key][capture] value
+};
+
+enum dx_op_e {
+    DX_EQ = 0,
+    DX_NE,
+    DX_LT,
+    DX_GT
+};
+
+/* <key>[.<item>]<op><value>: the value of key, or its item-th comma-
+ * separated item (from 1), compared with value. Numbers ("14", "-10 dBm")
+ * compare as numbers, with the unit if value has one; anything else as
+ * text */
+struct dx_filter_s {
+    const char *key;                // in the argument parsed
+    uint32_t key_len;
+    unsigned int item;              // 0 -> the whole value
+    enum dx_op_e op;
+    const char *value;
+    int number;
+    double num;
+    char unit[MD_UNIT_LEN];
+};
+
+void dx_init (struct dx_s *dx);
+void dx_free (struct dx_s *dx);
+
+const char *dx_str (const struct dx_s *dx, uint32_t off);
+
+/* Returns 1 if read, 0 if there is no index at path, or -1 (errno EINVAL
+ * if the file is not an index of this version) */
+int dx_read (struct dx_s *dx, const char *path);
+/* Through a temporary file, renamed over path. Returns -1 on failure */
+int dx_write (const struct dx_s *dx, const char *path);
+
+/* Index of the captures under dir into dx (empty), taking those of old
+ * (NULL: none) whose metadata file did not change. Sets parsed to the
+ * metadata files read. Returns -1 if out of memory or dir cannot be
+ * read */
+int dx_scan (struct dx_s *dx, const struct dx_s *old, const char *dir,
+        uint32_t *parsed);
+
+/* Returns -1 if arg is not a filter */
+int dx_filter_parse (struct dx_filter_s *f, const char *arg);
+/* Captures passing every filter, oldest first, into rows (dx->n).
+ * Returns how many */
+uint32_t dx_query (const struct dx_s *dx, const struct dx_filter_s *f,
+        unsigned int nf, uint32_t *rows);
+
+#endif
@@ -0,0 +1,257 @@
+// Software DDC: NCO mixing, CIC + FIR decimation and amplitude of ADC data
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+#include "ddc.h"
+
+typedef double ddc_v4d_t __attribute__ ((vector_size (4*sizeof (double))));
+typedef int64_t ddc_v4l_t __attribute__ ((vector_size (4*sizeof (int64_t))));
+
+#define DDC_MIX_SCALE           ((double) (1 << DDC_FRAC_BITS))
+
+int ddc_init (struct ddc_s *ddc, uint32_t adc_clk, uint32_t dds_freq,
+        uint32_t decim, unsigned int order)
+{
+    double h;
+    uint32_t i;
+
+    memset (ddc, 0, sizeof *ddc);
+
+    if (!adc_clk || !decim || !order || order > DDC_ORDER_MAX) {
+        return -1;
+    }
+
+    // Mixer output (16 + DDC_FRAC_BITS bits) plus the CIC growth must fit
+    // in 64 bits for the wrapping integrators to come out right
+    if (1 + 15 + DDC_FRAC_BITS + order*ceil (log2 (decim)) > 64) {
+        return -1;
+    }
+
+    ddc->f_nco = (double) dds_freq/adc_clk;
+    ddc->decim = decim;
+    ddc->order = order;
+    ddc->gain = 2.0/(pow (decim, order)*DDC_MIX_SCALE);
+
+    // Droop of the CIC at DDC_FIR_FREQ, undone there by the FIR
+    h = pow (fabs (sin (M_PI*DDC_FIR_FREQ)/
+                (decim*sin (M_PI*DDC_FIR_FREQ/decim))), order);
+    ddc->fir_c = (1.0/h - 1.0)/2.0;
+
+    ddc->nco_cos = malloc (DDC_BLOCK*sizeof (double));
+    ddc->nco_sin = malloc (DDC_BLOCK*sizeof (double));
+    if (!ddc->nco_cos || !ddc->nco_sin) {
+        perror ("ddc: malloc");
+        ddc_free (ddc);
+        return -1;
+    }
+
+    for (i = 0; i < DDC_BLOCK; ++i) {
+        double arg = 2*M_PI*ddc->f_nco*i;
+
+        ddc->nco_cos[i] = cos (arg);
+        ddc->nco_sin[i] = sin (arg);
+    }
+
+    return 0;
+}
+
+void ddc_free (struct ddc_s *ddc)
+{
+    free (ddc->nco_cos);
+    free (ddc->nco_sin);
+    ddc->nco_cos = ddc->nco_sin = NULL;
+}
+
+void ddc_reset (struct ddc_s *ddc)
+{
+    memset (ddc->ch, 0, sizeof ddc->ch);
+}
+
+uint32_t ddc_rows (const struct ddc_s *ddc, uint32_t rows)
+{
+    return ((uint64_t) ddc->ch[0].phase + rows)/ddc->decim;
+}
+
+/***************************************************************/
+/*************************** Kernels ***************************/
+/***************************************************************/
+
+/* x[i]*exp(-j*(2*pi*f_nco*i + p)), i in [0, n), n a multiple of 4, to
+ * fixed point I and Q. The table turned by p gives the NCO at any sample.
+ * Built for AVX2 too, picked at load time on CPUs that have it */
+__attribute__ ((target_clones ("avx2", "default")))
+static void ddc_mix_kernel (const double *x, const double *tc,
+        const double *ts, double p, int64_t *mi, int64_t *mq, uint32_t n)
+{
+    ddc_v4d_t v, c, s, i_v, q_v;
+    ddc_v4l_t l;
+    double cp = cos (p)*DDC_MIX_SCALE, sp = sin (p)*DDC_MIX_SCALE;
+    uint32_t i;
+
+    for (i = 0; i < n; i += 4) {
+        memcpy (&v, x + i, sizeof v);
+        memcpy (&c, tc + i, sizeof c);
+        memcpy (&s, ts + i, sizeof s);
+
+        i_v = v*(c*cp - s*sp);
+        q_v = -v*(s*cp + c*sp);
+
+        l = __builtin_convertvector (i_v, ddc_v4l_t);
+        memcpy (mi + i, &l, sizeof l);
+        l = __builtin_convertvector (q_v, ddc_v4l_t);
+        memcpy (mq + i, &l, sizeof l);
+    }
+}
+
+static void ddc_mix (const struct ddc_s *ddc, const double *x, double p,
+        int64_t *mi, int64_t *mq, uint32_t n)
+{
+    uint32_t n4 = n & ~3u;
+    uint32_t i;
+
+    ddc_mix_kernel (x, ddc->nco_cos, ddc->nco_sin, p, mi, mq, n4);
+
+    for (i = n4; i < n; ++i) {
+        double arg = 2*M_PI*ddc->f_nco*i + p;
+
+        mi[i] = (int64_t) (x[i]*cos (arg)*DDC_MIX_SCALE);
+        mq[i] = (int64_t) (-x[i]*sin (arg)*DDC_MIX_SCALE);
+    }
+}
+
+/* One CIC output (comb section) of I or Q, in ADC counts */
+static double ddc_comb (const struct ddc_s *ddc, uint64_t *integ,
+        uint64_t *comb)
+{
+    uint64_t y = integ[ddc->order - 1], t;
+    unsigned int k;
+
+    for (k = 0; k < ddc->order; ++k) {
+        t = y;
+        y -= comb[k];
+        comb[k] = t;
+    }
+
+    return (int64_t) y*ddc->gain;
+}
+
+/* Droop compensation. One output row of delay */
+static double ddc_fir (const struct ddc_s *ddc, double *hist, double y)
+{
+    double out = (1 + 2*ddc->fir_c)*hist[1] - ddc->fir_c*(hist[0] + y);
+
+    hist[0] = hist[1];
+    hist[1] = y;
+
+    return out;
+}
+
+uint32_t ddc_process_channel (const struct ddc_s *ddc, struct ddc_chan_s *st,
+        const double *in, uint32_t rows, double *amp, double *phase)
+{
+    int64_t mix[2][DDC_BLOCK];
+    uint32_t out = 0, b;
+
+    for (b = 0; b < rows; b += DDC_BLOCK) {
+        uint32_t n = rows - b < DDC_BLOCK ? rows - b : DDC_BLOCK;
+        double cycles = ddc->f_nco*st->n;
+        uint32_t i;
+        unsigned int k, q;
+
+        ddc_mix (ddc, in + b, 2*M_PI*(cycles - floor (cycles)),
+                mix[0], mix[1], n);
+        st->n += n;
+
+        // Integrators run at the ADC rate, the rest at the output rate
+        for (i = 0; i < n; ++i) {
+            double iq[2];
+
+            for (q = 0; q < 2; ++q) {
+                uint64_t y = (uint64_t) mix[q][i];
+
+                for (k = 0; k < ddc->order; ++k) {
+                    st->integ[q][k] += y;
+                    y = st->integ[q][k];
+                }
+            }
+
+            if (++st->phase < ddc->decim) {
+                continue;
+            }
+            st->phase = 0;
+
+            for (q = 0; q < 2; ++q) {
+                iq[q] = ddc_fir (ddc, st->fir[q],
+                        ddc_comb (ddc, st->integ[q], st->comb[q]));
+            }
+
+            amp[out] = hypot (iq[0], iq[1]);
+            if (phase) {
+                phase[out] = atan2 (iq[1], iq[0]);
+            }
+            ++out;
+        }
+    }
+
+    return out;
+}
+
+struct ddc_job_s {
+    const struct ddc_s *ddc;
+    struct ddc_chan_s *st;
+    const double *in;
+    uint32_t rows;
+    double *amp;
+    double *phase;                  // NULL -> not wanted
+};
+
+static void *ddc_channel (void *arg)
+{
+    struct ddc_job_s *job = arg;
+
+    ddc_process_channel (job->ddc, job->st, job->in, job->rows, job->amp,
+            job->phase);
+
+    return NULL;
+}
+
+int ddc_process (struct ddc_s *ddc, const struct soa_s *adc,
+        struct soa_s *amp, struct soa_s *phase)
+{
+    struct ddc_job_s job[NUM_CHANNELS];
+    pthread_t thread[NUM_CHANNELS];
+    int started[NUM_CHANNELS];
+    uint32_t rows = ddc_rows (ddc, adc->rows);
+    int err = 0;
+    unsigned int c;
+
+    for (c = 0; c < NUM_CHANNELS; ++c) {
+        job[c] = (struct ddc_job_s) {ddc, &ddc->ch[c], adc->ch[c], adc->rows,
+            amp->ch[c], phase ? phase->ch[c] : NULL};
+        started[c] = pthread_create (&thread[c], NULL, ddc_channel,
+                &job[c]) == 0;
+        err |= !started[c];
+    }
+
+    for (c = 0; c < NUM_CHANNELS; ++c) {
+        if (started[c]) {
+            pthread_join (thread[c], NULL);
+        }
+    }
+
+    // Channels that did run are now ahead of the others
+    if (err) {
+        fprintf (stderr, "ddc: could not start the channel threads\n");
+        return -1;
+    }
+
+    amp->rows = rows;
+    if (phase) {
+        phase->rows = rows;
+    }
+
+    return rows;
+}
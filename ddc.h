@@ -0,0 +1,67 @@
+#ifndef _DDC_H_
+#define _DDC_H_
+
+#include <inttypes.h>
+
+#include "output.h"
+#include "soa.h"
+
+/* Software down-conversion of raw ADC data, as the FPGA does it: each
+ * channel is mixed to baseband by an NCO at the DDS frequency, decimated
+ * by a CIC filter (integer, wrapping arithmetic), flattened by a 3-tap
+ * FIR that compensates the CIC droop, and turned into amplitude (and
+ * phase) by the magnitude of I/Q. Amplitudes are in ADC counts (peak of
+ * the IF carrier); the FPGA adds a fixed gain of its own.
+ *
+ * Processing is block by block, so a stream of curves can be fed one
+ * after the other: the NCO phase, CIC and FIR state carry over until
+ * ddc_reset. The channels run in threads of their own. The first
+ * order + 1 rows after a reset are the filters settling */
+#define DDC_BLOCK               4096 // input samples per NCO table pass
+#define DDC_FRAC_BITS           15 // fraction bits of the mixer output
+#define DDC_ORDER               3 // CIC stages, default
+#define DDC_ORDER_MAX           6
+#define DDC_FIR_FREQ            0.25 // output cycles/sample, FIR matched here
+
+struct ddc_chan_s {
+    uint64_t n;                     // input samples so far
+    uint32_t phase;                 // input samples into the next output
+    uint64_t integ[2][DDC_ORDER_MAX]; // I, Q
+    uint64_t comb[2][DDC_ORDER_MAX];
+    double fir[2][2];               // I, Q of the last two CIC outputs
+};
+
+struct ddc_s {
+    double f_nco;                   // cycles per ADC sample
+    uint32_t decim;
+    unsigned int order;
+    double fir_c;                   // taps -c, 1 + 2c, -c
+    double gain;                    // CIC output to ADC counts
+    double *nco_cos;                // DDC_BLOCK entries
+    double *nco_sin;
+    struct ddc_chan_s ch[NUM_CHANNELS];
+};
+
+/* NCO at dds_freq for ADC samples at adc_clk [Hz], decimation by decim
+ * (CURVE_TBT_DECIM, CURVE_FOFB_DECIM, ...) through order CIC stages.
+ * Returns -1 if the parameters make no sense or the CIC would overflow */
+int ddc_init (struct ddc_s *ddc, uint32_t adc_clk, uint32_t dds_freq,
+        uint32_t decim, unsigned int order);
+void ddc_free (struct ddc_s *ddc);
+/* Back to the start of a stream */
+void ddc_reset (struct ddc_s *ddc);
+
+/* Rows ddc_process would output for rows more input rows */
+uint32_t ddc_rows (const struct ddc_s *ddc, uint32_t rows);
+/* adc->rows rows of ADC samples (A, B, C, D) to amplitudes and, if not
+ * NULL, phases [rad]. Both must have room for ddc_rows rows. Returns the
+ * rows output, or -1 if the threads could not be started */
+int ddc_process (struct ddc_s *ddc, const struct soa_s *adc,
+        struct soa_s *amp, struct soa_s *phase);
+/* A single channel, on the calling thread, with state st (zeroed to start
+ * a stream). ddc is only read, so channels of several streams can run on
+ * one ddc at once. Returns the rows output */
+uint32_t ddc_process_channel (const struct ddc_s *ddc, struct ddc_chan_s *st,
+        const double *in, uint32_t rows, double *amp, double *phase);
+
+#endif
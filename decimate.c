@@ -0,0 +1,290 @@
+// Plot-oriented downsampling of curves and monitoring streams
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "decimate.h"
+
+typedef int64_t decim_v4l_t __attribute__ ((vector_size (NUM_CHANNELS*sizeof (int64_t))));
+
+/* Lane-wise a where the mask m is set, b elsewhere (integer vectors) */
+#define DECIM_SEL(m, a, b)      (((m) & (a)) | (~(m) & (b)))
+#define DECIM_TO_V4D(v)         __builtin_convertvector ((v), decim_v4d_t)
+
+static const char *decim_names[DECIM_END] = {
+    "minmax", "lttb", "mean"
+};
+
+int decim_method (const char *name)
+{
+    int i;
+
+    for (i = 0; i < DECIM_END; ++i) {
+        if (strcmp (name, decim_names[i]) == 0) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+const char *decim_method_name (int method)
+{
+    return method >= 0 && method < DECIM_END ? decim_names[method] : "?";
+}
+
+/***************************************************************/
+/*************************** Kernels ***************************/
+/***************************************************************/
+
+static unsigned int decim_minmax (const decim_row_t *in, uint32_t n,
+        decim_row_t *out)
+{
+    decim_row_t lo = in[0], hi = in[0];
+    decim_row_t ilo = {0, 0, 0, 0}, ihi = {0, 0, 0, 0};
+    decim_row_t m;
+    uint32_t i;
+
+    if (n == 1) {
+        out[0] = in[0];
+        return 1;
+    }
+
+    for (i = 1; i < n; ++i) {
+        decim_row_t idx = {i, i, i, i};
+
+        m = in[i] < lo;
+        lo = DECIM_SEL (m, in[i], lo);
+        ilo = DECIM_SEL (m, idx, ilo);
+
+        m = in[i] > hi;
+        hi = DECIM_SEL (m, in[i], hi);
+        ihi = DECIM_SEL (m, idx, ihi);
+    }
+
+    // Keep the time order of the two extremes, channel by channel
+    m = ilo <= ihi;
+    out[0] = DECIM_SEL (m, lo, hi);
+    out[1] = DECIM_SEL (m, hi, lo);
+
+    return 2;
+}
+
+/* bias is taken off the rows (as decim_stream_s) for the sum, so it is
+ * that of the words */
+static unsigned int decim_mean (const decim_row_t *in, uint32_t n,
+        uint32_t bias, decim_row_t *out)
+{
+    decim_v4l_t sum = {0, 0, 0, 0};
+    decim_v4l_t off = {bias, bias, bias, bias};
+    uint32_t i;
+
+    for (i = 0; i < n; ++i) {
+        sum += __builtin_convertvector (in[i], decim_v4l_t) + off;
+    }
+
+    out[0] = __builtin_convertvector (sum/(int64_t) n - off, decim_row_t);
+
+    return 1;
+}
+
+static void decim_avg (const decim_row_t *in, uint32_t n, decim_v4d_t *avg)
+{
+    decim_v4d_t sum = {0, 0, 0, 0};
+    uint32_t i;
+
+    for (i = 0; i < n; ++i) {
+        sum += DECIM_TO_V4D (in[i]);
+    }
+
+    *avg = sum/(double) n;
+}
+
+/* Picks, for each channel, the row of in[0, n) (x0 being the x of in[0])
+ * that spans the largest triangle with the previous pick (ax, ay) and
+ * the average (cx, cy) of the next bucket. The pick becomes (ax, ay) */
+static void decim_lttb_pick (const decim_row_t *in, uint32_t n, double x0,
+        decim_v4d_t *ax, decim_v4d_t *ay, const decim_v4d_t *cy, double cx,
+        decim_row_t *out)
+{
+    decim_v4d_t best = {-1, -1, -1, -1};
+    decim_v4d_t bx = *ax;
+    decim_row_t pick = in[0];
+    uint32_t i;
+
+    for (i = 0; i < n; ++i) {
+        decim_v4d_t x = {x0 + i, x0 + i, x0 + i, x0 + i};
+        decim_v4d_t y = DECIM_TO_V4D (in[i]);
+        // Twice the area, squared: same order, no fabs ()
+        decim_v4d_t area = (*ax - cx)*(y - *ay) - (*ax - x)*(*cy - *ay);
+        decim_v4l_t m;
+
+        area *= area;
+        m = area > best;
+        best = (decim_v4d_t) DECIM_SEL (m, (decim_v4l_t) area, (decim_v4l_t) best);
+        bx = (decim_v4d_t) DECIM_SEL (m, (decim_v4l_t) x, (decim_v4l_t) bx);
+        pick = DECIM_SEL (__builtin_convertvector (m, decim_row_t), in[i], pick);
+    }
+
+    *ax = bx;
+    *ay = DECIM_TO_V4D (pick);
+    *out = pick;
+}
+
+static uint32_t decim_lttb (uint32_t factor, const decim_row_t *in,
+        uint32_t npts, decim_row_t *out)
+{
+    uint32_t nout = (npts + factor - 1)/factor;
+    decim_v4d_t ax = {0, 0, 0, 0};
+    decim_v4d_t ay, cy;
+    double every;
+    uint32_t b;
+
+    // The first and the last rows are always kept
+    if (nout < 3) {
+        nout = 3;
+    }
+
+    if (npts <= nout) {
+        memcpy (out, in, npts*sizeof *in);
+        return npts;
+    }
+
+    every = (double) (npts - 2)/(nout - 2);
+    ay = DECIM_TO_V4D (in[0]);
+    out[0] = in[0];
+
+    for (b = 0; b < nout - 2; ++b) {
+        uint32_t start = (uint32_t) (b*every) + 1;
+        uint32_t end = (uint32_t) ((b + 1)*every) + 1;
+        uint32_t next_end = (uint32_t) ((b + 2)*every) + 1;
+
+        // The next bucket of the last one is the last row
+        if (next_end > npts) {
+            next_end = npts;
+        }
+
+        decim_avg (in + end, next_end - end, &cy);
+        decim_lttb_pick (in + start, end - start, start, &ax, &ay, &cy,
+                (end + next_end - 1)/2.0, &out[b + 1]);
+    }
+
+    out[nout - 1] = in[npts - 1];
+
+    return nout;
+}
+
+/***************************************************************/
+/**************************** Curves ***************************/
+/***************************************************************/
+
+uint32_t decim_curve_rows (int method, uint32_t factor, uint32_t npts)
+{
+    uint32_t buckets = (npts + factor - 1)/factor;
+
+    switch (method) {
+        case DECIM_MINMAX:
+            return DECIM_MAX_ROWS*buckets;
+        case DECIM_LTTB:
+            return buckets < 3 ? 3 : buckets;
+        default:
+            return buckets;
+    }
+}
+
+uint32_t decim_curve (int method, uint32_t factor, const decim_row_t *in,
+        uint32_t npts, decim_row_t *out)
+{
+    uint32_t i, nout = 0;
+
+    if (method == DECIM_LTTB) {
+        return decim_lttb (factor, in, npts, out);
+    }
+
+    for (i = 0; i < npts; i += factor) {
+        uint32_t n = npts - i < factor ? npts - i : factor;
+
+        nout += method == DECIM_MINMAX ? decim_minmax (in + i, n, out + nout) :
+            decim_mean (in + i, n, 0, out + nout);
+    }
+
+    return nout;
+}
+
+/***************************************************************/
+/*************************** Streams ***************************/
+/***************************************************************/
+
+int decim_stream_init (struct decim_stream_s *s, int method, uint32_t factor,
+        int is_unsigned)
+{
+    memset (s, 0, sizeof *s);
+    s->method = method;
+    s->factor = factor;
+    // The kernels compare int32: uint32 words keep their order once
+    // offset by 2^31, and lttb's triangles do not move
+    s->bias = is_unsigned ? 0x80000000u : 0;
+
+    // lttb needs the next bucket to pick from the current one
+    s->buf = malloc ((method == DECIM_LTTB ? 2 : 1)*factor*sizeof *s->buf);
+    if (!s->buf) {
+        perror ("decimate: malloc");
+        return -1;
+    }
+
+    return 0;
+}
+
+unsigned int decim_stream_push (struct decim_stream_s *s,
+        const plot_values_monit_uint32_t *val, plot_values_monit_uint32_t *out)
+{
+    decim_row_t rows[DECIM_MAX_ROWS];
+    decim_row_t row;
+    decim_row_t bias = {s->bias, s->bias, s->bias, s->bias};
+    unsigned int i, nout = 0;
+    uint32_t f = s->factor;
+
+    memcpy (&row, val, sizeof row);
+    row ^= bias;
+    s->pos++;
+
+    if (s->method != DECIM_LTTB) {
+        s->buf[s->n++] = row;
+        if (s->n == f) {
+            nout = s->method == DECIM_MINMAX ? decim_minmax (s->buf, f, rows) :
+                decim_mean (s->buf, f, s->bias, rows);
+            s->n = 0;
+        }
+    }
+    else if (!s->anchored) {
+        s->ay = DECIM_TO_V4D (row);
+        s->anchored = 1;
+        rows[nout++] = row;
+    }
+    else {
+        s->buf[s->n++] = row;
+        if (s->n == 2*f) {
+            decim_v4d_t cy;
+
+            decim_avg (s->buf + f, f, &cy);
+            decim_lttb_pick (s->buf, f, s->pos - 2*f, &s->ax, &s->ay, &cy,
+                    s->pos - f + (f - 1)/2.0, &rows[nout++]);
+
+            memmove (s->buf, s->buf + f, f*sizeof *s->buf);
+            s->n = f;
+        }
+    }
+
+    for (i = 0; i < nout; ++i) {
+        rows[i] ^= bias;
+    }
+    memcpy (out, rows, nout*sizeof *rows);
+
+    return nout;
+}
+
+void decim_stream_free (struct decim_stream_s *s)
+{
+    free (s->buf);
+    s->buf = NULL;
+}
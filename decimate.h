@@ -0,0 +1,61 @@
+#ifndef _DECIMATE_H_
+#define _DECIMATE_H_
+
+#include <inttypes.h>
+
+#include "output.h"
+
+/* Reduction of 4-channel data for plotting. Every bucket of <factor>
+ * rows becomes:
+ *  minmax: 2 rows, the minimum and the maximum of each channel, in the
+ *          order they occurred, so no peak is lost
+ *  lttb:   1 row, the sample of each channel that spans the largest
+ *          triangle with its neighbours (Largest-Triangle-Three-Buckets)
+ *  mean:   1 row, the average of each channel
+ * The four channels are processed together as one SIMD vector, each
+ * channel picking its own sample. Streams of unsigned words (Monitoring
+ * amplitudes) are compared and averaged as such */
+#define DECIM_MAX_ROWS          2 // rows a bucket can produce
+
+enum decim_method_e {
+    DECIM_MINMAX = 0,
+    DECIM_LTTB,
+    DECIM_MEAN,
+    DECIM_END
+};
+
+typedef int32_t decim_row_t __attribute__ ((vector_size (NUM_CHANNELS*sizeof (int32_t))));
+typedef double decim_v4d_t __attribute__ ((vector_size (NUM_CHANNELS*sizeof (double))));
+
+struct decim_stream_s {
+    int method;
+    uint32_t factor;
+    uint32_t n;                     // rows buffered
+    uint32_t bias;                  // flips the sign bit of unsigned words
+    decim_row_t *buf;               // a bucket, two for lttb
+    uint64_t pos;                   // index of the next row
+    int anchored;                   // lttb: first row already out
+    decim_v4d_t ax;                 // lttb: last selected point
+    decim_v4d_t ay;
+};
+
+/* Returns -1 if name is not a method */
+int decim_method (const char *name);
+const char *decim_method_name (int method);
+
+/* Upper bound of the rows decim_curve () writes for npts rows */
+uint32_t decim_curve_rows (int method, uint32_t factor, uint32_t npts);
+/* Reduces npts rows of in to out. Returns the number of rows written */
+uint32_t decim_curve (int method, uint32_t factor, const decim_row_t *in,
+        uint32_t npts, decim_row_t *out);
+
+/* is_unsigned: the samples are uint32 words, not int32 */
+int decim_stream_init (struct decim_stream_s *s, int method, uint32_t factor,
+        int is_unsigned);
+/* Adds a sample. Returns the number of rows (0 to DECIM_MAX_ROWS) of
+ * reduced data it completed, written to out. lttb is one bucket late */
+unsigned int decim_stream_push (struct decim_stream_s *s,
+        const plot_values_monit_uint32_t *val, plot_values_monit_uint32_t *out);
+void decim_stream_free (struct decim_stream_s *s);
+
+#endif
@@ -0,0 +1,132 @@
+// Software deswitching of raw ADC data
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "deswitch.h"
+#include "fcs_client.h"
+
+typedef double dsw_v4d_t __attribute__ ((vector_size (4*sizeof (double))));
+typedef uint64_t dsw_v4u_t __attribute__ ((vector_size (4*sizeof (uint64_t))));
+
+int dsw_init (struct dsw_s *dsw, uint32_t divclk, uint32_t phaseclk)
+{
+    memset (dsw, 0, sizeof *dsw);
+
+    dsw->period = divclk*FE_SW_DIV_FACTOR;
+    dsw->phase = phaseclk;
+
+    return dsw->period < 2 ? -1 : 0;
+}
+
+void dsw_reset (struct dsw_s *dsw)
+{
+    dsw->n = 0;
+}
+
+int dsw_crossed (const struct dsw_s *dsw, uint64_t i)
+{
+    return ((i + dsw->phase) % dsw->period) >= dsw->period/2;
+}
+
+/* Length of the run of samples, from sample i of the stream, in the same
+ * half of the period; *crossed tells which half */
+static uint32_t dsw_run (const struct dsw_s *dsw, uint64_t i, int *crossed)
+{
+    uint32_t pos = (i + dsw->phase) % dsw->period;
+    uint32_t half = dsw->period/2;
+
+    *crossed = pos >= half;
+
+    return *crossed ? dsw->period - pos : half - pos;
+}
+
+/***************************************************************/
+/*************************** Kernels ***************************/
+/***************************************************************/
+
+/* Swaps x[i] and y[i], i in [0, n). Built for AVX2 too, picked at load
+ * time on CPUs that have it */
+__attribute__ ((target_clones ("avx2", "default")))
+static void dsw_swap_kernel (double *x, double *y, uint32_t n)
+{
+    dsw_v4d_t a, b;
+    uint32_t i;
+
+    for (i = 0; i + 4 <= n; i += 4) {
+        memcpy (&a, x + i, sizeof a);
+        memcpy (&b, y + i, sizeof b);
+        memcpy (x + i, &b, sizeof b);
+        memcpy (y + i, &a, sizeof a);
+    }
+
+    for (; i < n; ++i) {
+        double t = x[i];
+
+        x[i] = y[i];
+        y[i] = t;
+    }
+}
+
+/* A row of 4 int16 is one 64-bit word; swapping A <-> C and B <-> D is
+ * rotating it by 32 bits */
+__attribute__ ((target_clones ("avx2", "default")))
+static void dsw_rotate_kernel (uint64_t *rows, uint32_t n)
+{
+    dsw_v4u_t v;
+    uint32_t i;
+
+    for (i = 0; i + 4 <= n; i += 4) {
+        memcpy (&v, rows + i, sizeof v);
+        v = (v << 32) | (v >> 32);
+        memcpy (rows + i, &v, sizeof v);
+    }
+
+    for (; i < n; ++i) {
+        rows[i] = (rows[i] << 32) | (rows[i] >> 32);
+    }
+}
+
+void dsw_apply (struct dsw_s *dsw, struct soa_s *adc)
+{
+    uint32_t i, n;
+    int crossed;
+
+    for (i = 0; i < adc->rows; i += n) {
+        n = dsw_run (dsw, dsw->n + i, &crossed);
+        n = n < adc->rows - i ? n : adc->rows - i;
+
+        if (crossed) {
+            dsw_swap_kernel (adc->ch[0] + i, adc->ch[2] + i, n);
+            dsw_swap_kernel (adc->ch[1] + i, adc->ch[3] + i, n);
+        }
+    }
+
+    dsw->n += adc->rows;
+}
+
+void dsw_apply_16 (struct dsw_s *dsw, int16_t *rows, uint32_t nrows)
+{
+    uint32_t i, n;
+    int crossed;
+
+    for (i = 0; i < nrows; i += n) {
+        n = dsw_run (dsw, dsw->n + i, &crossed);
+        n = n < nrows - i ? n : nrows - i;
+
+        if (crossed) {
+            uint64_t w[64];
+            uint32_t j, m;
+
+            // Through a bounce buffer: rows need not be 8-byte aligned
+            for (j = 0; j < n; j += m) {
+                m = n - j < 64 ? n - j : 64;
+                memcpy (w, rows + (size_t) (i + j)*NUM_CHANNELS, m*sizeof *w);
+                dsw_rotate_kernel (w, m);
+                memcpy (rows + (size_t) (i + j)*NUM_CHANNELS, w, m*sizeof *w);
+            }
+        }
+    }
+
+    dsw->n += nrows;
+}
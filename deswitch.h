@@ -0,0 +1,40 @@
+#ifndef _DESWITCH_H_
+#define _DESWITCH_H_
+
+#include <inttypes.h>
+
+#include "output.h"
+#include "soa.h"
+
+/* Software deswitching of raw ADC data. With the RFFE switching, RF path
+ * c carries antenna c + 2 (A <-> C, B <-> D) during the second half of
+ * every switching period of divclk*FE_SW_DIV_FACTOR ADC clocks, offset
+ * by phaseclk clocks: sample i is crossed if
+ *  ((i + phaseclk) % period) >= period/2
+ * Deswitching swaps the pairs back in the crossed halves, so channel c is
+ * antenna c again, seen through both paths in turn. Averaging over whole
+ * periods (the DDC decimation does) then cancels the path gain mismatch,
+ * as the FPGA does with set_sw_on.
+ *
+ * As with the DDC, the sample count carries over between calls, so a
+ * stream of curves can be fed one after the other until dsw_reset */
+struct dsw_s {
+    uint32_t period;                // ADC clocks
+    uint32_t phase;                 // ADC clocks
+    uint64_t n;                     // samples so far
+};
+
+/* From the get_sw_divclk and get_sw_phaseclk words. Returns -1 if the
+ * period is too short to switch */
+int dsw_init (struct dsw_s *dsw, uint32_t divclk, uint32_t phaseclk);
+void dsw_reset (struct dsw_s *dsw);
+
+/* 1 if sample i of the stream is crossed */
+int dsw_crossed (const struct dsw_s *dsw, uint64_t i);
+
+/* In place, on de-interleaved samples (adc->rows of them) */
+void dsw_apply (struct dsw_s *dsw, struct soa_s *adc);
+/* In place, on rows of the ADC curve as read (int16, interleaved) */
+void dsw_apply_16 (struct dsw_s *dsw, int16_t *rows, uint32_t nrows);
+
+#endif
@@ -5,39 +5,43 @@
 #include <unistd.h>
 #include <errno.h>
 #include <string.h>
+#include <limits.h>
+#include <math.h>
 #include <getopt.h>
 #include <signal.h>
 #include <time.h>
+#include <pthread.h>
 
 #include "fcs_client.h"
-#include "transport/transport.h"
-#include "transport/ethernet.h"
-#include "transport/serial_rs232.h"
+#include "libfcsclient.h"
+#include "transport/replay.h"
 #include "revision.h"
 #include "debug.h"
+#include "output.h"
+#include "stats.h"
+#include "trace.h"
+#include "metrics.h"
+#include "monit_shm.h"
+#include "decimate.h"
+#include "soa.h"
+#include "position.h"
+#include "ddc.h"
+#include "deswitch.h"
+#include "window.h"
+#include "tune.h"
+#include "goertzel.h"
+#include "summary.h"
+#include "autorange.h"
+#include "xcorr.h"
+#include "dataindex.h"
 
 #define C "CLIENT: "
-#define PORT "8080" // the FPGA port client will be connecting to
-#define FE_PORT "6791" // the RFFE port client will be connecting to
-
-enum dev_type_e {
-    ETHERNET_DEV = 0,
-    SERIAL_RS232_DEV
-};
-
-// Our FPGA transport
-static struct transport_s transport_fpga;
-// Our FE transport
-static struct transport_s transport_fe;
-
-#define PACKET_SIZE             BSMP_MAX_MESSAGE
-#define PACKET_HEADER           BSMP_HEADER_SIZE
 
 #define TRY(name, func)\
     do {\
-        enum bsmp_err err = func;\
-        if(err) {\
-            fprintf(stderr, C "%s: %s\n", name, bsmp_error_str(err));\
+        int _try_err = func;\
+        if(_try_err) {\
+            fprintf(stderr, C "%s: %s\n", name, fcs_error_str(_try_err));\
             exit(-1);\
         }\
     }while(0)
@@ -51,23 +55,40 @@ static struct transport_s transport_fe;
 
 #define ARRAY_SIZE(x) (sizeof(x) / sizeof((x)[0]))
 #define MONIT_POLL_RATE 200000 //usec
-
-#define TIMESTAMP_BUF_LEN 80
-
-static char buffer[TIMESTAMP_BUF_LEN];
-static char * timestamp_str()
-{
-    struct timespec tsp;
-    int ret;
-    int len = TIMESTAMP_BUF_LEN;
-
-    clock_gettime(CLOCK_REALTIME, &tsp);   //Call clock_gettime to fill tsp
-    ret = strftime (buffer, 80, "%Y-%m-%dT%H:%M:%S", localtime(&tsp.tv_sec));
-    len -= ret-1;
-    snprintf(&buffer[strlen(buffer)], len, ".%09ldZ", tsp.tv_nsec);
-
-    return buffer;
-}
+#define CURVE_CONN_TIMEOUT 5 //sec, on the extra curve connections
+#define DSW_CHECK_TOL 0.001 // of the channel shares, for --dswcheck
+#define CURVE_FILENAME_LEN 256
+
+// Long-only options
+#define OPT_STATS 0x100
+#define OPT_TRACE 0x101
+#define OPT_REPLAY 0x102
+#define OPT_METRICS 0x103
+#define OPT_CURVEFILE 0x104
+#define OPT_ACQCYCLES 0x105
+#define OPT_ACQOVERLAP 0x106
+#define OPT_ACQASYNC 0x107
+#define OPT_PUBLISH 0x108
+#define OPT_SUBSCRIBE 0x109
+#define OPT_DECIMATE 0x10A
+#define OPT_METHOD 0x10B
+#define OPT_BINARY 0x10C
+#define OPT_SCALE 0x10D
+#define OPT_COMPUTEPOS 0x10E
+#define OPT_DDC 0x10F
+#define OPT_DESWITCH 0x110
+#define OPT_WINDOW 0x111
+#define OPT_TUNE 0x112
+#define OPT_GOERTZEL 0x113
+#define OPT_GOERTZELWIN 0x114
+#define OPT_GOERTZELOUT 0x115
+#define OPT_SUMMARY 0x116
+#define OPT_SUMMARYOUT 0x117
+#define OPT_SUMMARYMERGE 0x118
+#define OPT_AUTORANGE 0x119
+#define OPT_XCORR 0x11A
+#define OPT_INDEX 0x11B
+#define OPT_DSWCHECK 0x11C
 
 const char* program_name;
 char *hostname = NULL;
@@ -75,8 +96,49 @@ int need_hostname = 0;
 char *fe_hostname = NULL;
 int need_fe_hostname = 0;
 int monit_timestamp = 0;
+uint32_t decimate_factor = 0;
+int decimate_method = DECIM_MINMAX;
+int curve_binary = 0;
+double curve_scale[NUM_CHANNELS] = {1.0, 1.0, 1.0, 1.0};
+int compute_pos = -1;
+struct pos_k_s pos_k;
+uint32_t ddc_decim = 0;
+struct ddc_s ddc;
+int deswitch = 0;
+struct dsw_s dsw;
+int dsw_check = 0;
+double dsw_check_amp[NUM_CHANNELS]; // mean of the software amplitudes
+int dsw_check_have = 0;
+int window_dly = -1;
+struct wdw_s wdw;
+int tune = 0;
+struct tune_plan_s tune_plan;
+double xcorr_carrier = 0;           // Hz, RF. 0 -> no --xcorr
+double xcorr_lag_ps = 0;            // per sample of lag
+struct xc_s xc;
+// tune_plan, xc and dsw_check_*: curves are written from the readout
+// threads too
+pthread_mutex_t stage_lock = PTHREAD_MUTEX_INITIALIZER;
+unsigned int gtz_nfreqs = 0;
+double gtz_freq[GTZ_MAX_FREQS];     // Hz
+uint32_t gtz_win = GTZ_DEFAULT_WIN;
+uint32_t gtz_hop = 0;               // 0 -> gtz_win/4
+char *gtz_out = NULL;
+int summary = 0;
+uint32_t summary_every = 0;         // 0 -> only the totals, at exit
+char *summary_out = NULL;
+int autorange = 0;
+struct ar_s ar;
+uint64_t acq_clocks = 0;            // ADC clocks of the last capture, 0 -> unknown
+                                    // or not needed (no analysis stage)
+
+static const uint32_t curve_decim[END_CURVE_ID] = {
+    CURVE_ADC_DECIM, CURVE_TBT_DECIM, CURVE_TBT_DECIM, CURVE_FOFB_DECIM,
+    CURVE_FOFB_DECIM
+};
 
 sig_atomic_t _interrupted = 0;
+sig_atomic_t _dump_stats = 0;
 
 // C^c signal handler
 static void sigint_handler (int sig, siginfo_t *siginfo, void *context)
@@ -87,183 +149,54 @@ static void sigint_handler (int sig, siginfo_t *siginfo, void *context)
     _interrupted = 1;
 }
 
-#define PLOT_BUFFER_LEN 1024 // in 32-bit words
-#define NUM_CHANNELS 4
-typedef struct _plot_values_monit_double_t {
-    double ch0[PLOT_BUFFER_LEN];
-    double ch1[PLOT_BUFFER_LEN];
-    double ch2[PLOT_BUFFER_LEN];
-    double ch3[PLOT_BUFFER_LEN];
-} plot_values_monit_double_t;
-
-typedef struct _plot_values_monit_uint32_t {
-    uint32_t ch0;
-    uint32_t ch1;
-    uint32_t ch2;
-    uint32_t ch3;
-} plot_values_monit_uint32_t;
-
-/* 4096 data of A, B, C or D */
-plot_values_monit_uint32_t pval_monit_uint32[PLOT_BUFFER_LEN];
-plot_values_monit_double_t pval_monit_double;
-
-/* Our send/receive packet for the FPGA */
-recv_pkt_t recv_pkt;
-send_pkt_t send_pkt;
-/* Our send/receive packet for the FE */
-recv_pkt_t fe_recv_pkt;
-send_pkt_t fe_send_pkt;
-
-
-/***************************************************************/
-/**********************      Functions       *******************/
-/***************************************************************/
-
-void print_packet (char* pre, uint8_t *data, uint32_t size)
+// SIGUSR1 handler. Stats are dumped outside of the handler
+static void sigusr1_handler (int sig, siginfo_t *siginfo, void *context)
 {
-#ifdef DEBUG
-    printf("%s: [", pre);
-
-    if(size < 32)
-    {
-        unsigned int i;
-        for(i = 0; i < size; ++i)
-            printf("%02X ", data[i]);
-        printf("]\n");
-    }
-    else
-        printf("%d bytes ]\n", size);
-#else
-    (void) pre;
-    (void) data;
-    (void) size;
-#endif
+    (void) sig;
+    (void) siginfo;
+    (void) context;
+    _dump_stats = 1;
 }
 
-int __bpm_send(int (*send_f)(int, uint8_t *, uint32_t *), int fd, uint8_t *data, uint32_t *count)
+// SIGUSR2 handler. Only there to fail (EINTR) a blocking call of the
+// thread it is sent to
+static void sigusr2_handler (int sig, siginfo_t *siginfo, void *context)
 {
-    uint8_t  packet[BSMP_MAX_MESSAGE];
-    uint32_t packet_size = *count;
-    uint32_t len = *count;
-
-    memcpy (packet, data, *count);
-
-    print_packet("SEND()", packet, packet_size);
-
-    if (!send_f) {
-        fprintf(stderr, "recv function not implemented!\n");
-        return -1;
-    }
-
-    int ret = send_f(fd, packet, &len);
-    DEBUGP ("bpm_send(%d): %d bytes sent!\n", fd, len);
-
-    if(len != packet_size) {
-        if(ret < 0)
-            perror("send");
-        return -1;
-    }
-
-    return 0;
+    (void) sig;
+    (void) siginfo;
+    (void) context;
 }
 
-int __bpm_recv(int (*recv_f)(int, uint8_t *, uint32_t *), int fd, uint8_t *data, uint32_t *count)
+static void stats_dump_exit (void)
 {
-    uint8_t packet[PACKET_SIZE] = {0};
-    uint32_t packet_size;
-    uint32_t len = PACKET_HEADER;
-
-    if (!recv_f) {
-        fprintf(stderr, "recv function not implemented!\n");
-        return -1;
-    }
-
-    int ret = recv_f(fd, packet, &len);
-    if(len != PACKET_HEADER) {
-        if(ret < 0)
-            perror("recv");
-        return -1;
-    }
-
-    DEBUGP ("bpm_recv(%d): received %d bytes (header)!\n", fd, PACKET_HEADER);
-
-    //uint32_t remaining = (packet[2] << 8) + packet[3];
-    uint32_t remaining = (packet[1] << 8) + packet[2];
-    len = remaining;
-
-    DEBUGP ("bpm_recv(%d): %d bytes to recv!\n", fd, remaining);
-
-    ret = recv_f(fd, packet + PACKET_HEADER, &len);
-    if(len != remaining) {
-        if(ret < 0)
-            perror("recv");
-        return -1;
-    }
-
-    DEBUGP("bpm_recv(%d) received payload!\n", fd);
-
-    packet_size = PACKET_HEADER + remaining;
-
-    print_packet("RECV", packet, packet_size);
-
-    *count = packet_size;
-    memcpy(data, packet, *count);
-
-    return 0;
+    stats_dump (stderr);
 }
 
-/***************************************************************/
-/**********************      Wrappers       *******************/
-/***************************************************************/
-int bpm_init (enum dev_type_e dev_type, struct transport_s *transport)
-{
-    //dev_type is:
-    //0 -> Ethernet
-    //1 -> Serial RS-232
-
-    switch (dev_type) {
-        case ETHERNET_DEV:
-            transport->ops = &ethernet_ops;
-            break;
-
-        case SERIAL_RS232_DEV:
-            transport->ops = &serial_rs232_ops;
-            break;
-
-        // Ethernet is default
-        default:
-            transport->ops = &ethernet_ops;
-    }
-
-    return 0;
-}
+/* Ring being published, closed however the client exits */
+static struct monit_shm_s *shm_published = NULL;
 
-int bpm_fpga_send(uint8_t *data, uint32_t *count)
+static void monit_shm_close_exit (void)
 {
-    return __bpm_send(transport_fpga.ops->bpm_send, transport_fpga.fd, data, count);
-    //return transport_fpga.ops->bpm_send(transport_fpga.fd, data, count); // fd is the FPGA socket
+    if (shm_published) {
+        monit_shm_close (shm_published);
+    }
 }
 
-int bpm_fpga_recv(uint8_t *data, uint32_t *count)
-{
-    return __bpm_recv(transport_fpga.ops->bpm_recv, transport_fpga.fd, data, count);
-    //return transport_fpga.ops->bpm_recv(transport_fpga.fd, data, count); // fd is the FPGA socket
-}
+/* 4096 data of A, B, C or D */
+plot_values_monit_double_t pval_monit_double;
 
-int bpm_fe_send(uint8_t *data, uint32_t *count)
-{
-    return __bpm_send(transport_fe.ops->bpm_send, transport_fe.fd, data, count);
-    //return transport_fe.ops->bpm_send(transport_fe.fd, data, count); // fd is the FE socket
-}
+/* Our send/receive packet for the FPGA */
+recv_pkt_t recv_pkt;
+send_pkt_t send_pkt;
+/* Our send/receive packet for the FE */
+recv_pkt_t fe_recv_pkt;
+send_pkt_t fe_send_pkt;
 
-int bpm_fe_recv(uint8_t *data, uint32_t *count)
-{
-    return __bpm_recv(transport_fe.ops->bpm_recv, transport_fe.fd, data, count);
-    //return transport_fe.ops->bpm_recv(transport_fe.fd, data, count); // fd is the FE socket
-}
 
 // Command-line handling
 
+void print_usage (FILE* stream, int exit_code) __attribute__((noreturn));
+
 void print_usage (FILE* stream, int exit_code)
 {
     fprintf (stream, "FCS Client program\n");
@@ -319,6 +252,12 @@ void print_usage (FILE* stream, int exit_code)
             "                                     with 0.5 step. Invalid attenuation values\n"
             "                                     will be rounded down to the nearest valid\n"
             "                                     value]\n"
+            "      --autorange  <lo>,<hi>[,<n>] Adjusts the RFFE attenuators, after any\n"
+            "                                    -a/-z, until the ADC peak is between\n"
+            "                                    <lo> and <hi> of full scale, on short ADC\n"
+            "                                    captures [<n>: 1 -> only Attenuator 1,\n"
+            "                                     default 2 -> both]. Prints the result\n"
+            "                                    and the convergence time to stderr\n"
             "  -R  --getfmctemp1              Gets FPGA FMC temparature 1 (near ?)\n"
             "                                    [in degrees celsius (*C)]\n"
             "  -T  --getfmctemp2              Gets FPGA FMC temperature 2 (near ?)\n"
@@ -351,10 +290,91 @@ void print_usage (FILE* stream, int exit_code)
             "  -I  --getddsfreq                Gets FPGA DDS Frequency [in Hertz]\n"
             "  -L  --getsamples                Gets FPGA number of samples of the next acquisition\n"
             "  -C  --getchan                   Gets FPGA data channel of the next acquisition\n"
-            "  -B  --getcurve   <channel>      Gets FPGA curve data of channel <channel_number>\n"
+            "  -B  --getcurve   <channel>[,..] Gets FPGA curve data of channel <channel_number>\n"
             "                                    [<channel> must be one of the following:\n"
             "                                     0 -> ADC; 1-> TBT Amp; 2 -> TBT Pos\n"
             "                                     3 -> FOFB Amp; 4-> FOFB Pos]\n"
+            "                                    [Several channels are read concurrently\n"
+            "                                     if the server takes more connections]\n"
+            "      --curvefile  <pattern>      Writes each curve to <pattern>, with %%d\n"
+            "                                    replaced by the channel [default: stdout,\n"
+            "                                    only for a single channel]\n"
+            "      --acqcycles  <n>            Repeats --startacq and --getcurve <channel>\n"
+            "                                    <n> times [0 -> until Ctrl-C], appending\n"
+            "                                    the data and reporting dead time per cycle\n"
+            "      --acqoverlap                With --acqcycles, starts the next capture while\n"
+            "                                    the current one is read out [needs firmware\n"
+            "                                    that keeps the last capture (double buffer)]\n"
+            "      --acqasync                  Runs --startacq on a second connection and\n"
+            "                                    polls for completion, with a timeout\n"
+            "      --publish    <name>         Publishes Monitoring data (-E or -F) in the\n"
+            "                                    shared memory ring <name> instead of stdout\n"
+            "      --subscribe  <name>         Prints the Monitoring data published in the\n"
+            "                                    shared memory ring <name> [no hostname]\n"
+            "      --decimate   <factor>       Reduces curves and Monitoring data printed by\n"
+            "                                    <factor> before output, for plotting\n"
+            "      --method     <method>       Decimation: minmax [keeps the peaks: 2 rows\n"
+            "                                    per <factor>], lttb or mean [default: minmax]\n"
+            "      --binary                    Writes curves as native doubles, all of\n"
+            "                                    channel 0, then 1, 2 and 3, instead of text\n"
+            "      --scale      <k>[,k1,k2,k3] Multiplies --binary curves by <k>, or each\n"
+            "                                    channel by its own factor [default: 1]\n"
+            "      --computepos <method>       Outputs TBT/FOFB Amp curves (1, 3) and -E\n"
+            "                                    samples as positions (X, Y, Q, Sum), with\n"
+            "                                    the FPGA Kx/Ky/Ksum: dos [delta over sum]\n"
+            "                                    or pds [partial delta over sum]\n"
+            "      --ddc        <rate>         Outputs ADC curves (0) down-converted in\n"
+            "                                    software to TBT or FOFB Amp curves, at\n"
+            "                                    the FPGA ADC clock and DDS frequency\n"
+            "                                    [<rate>: tbt or fofb; amplitudes in ADC\n"
+            "                                     counts]\n"
+            "      --deswitch                  Deswitches ADC curves (0) in software, with\n"
+            "                                    the FPGA divider and phase clocks, before\n"
+            "                                    output or --ddc [RFFE switching on]\n"
+            "      --dswcheck                  Checks --deswitch --ddc against the FPGA:\n"
+            "                                    captures the Amp curve at the --ddc rate\n"
+            "                                    over the same span and compares the\n"
+            "                                    channel shares of the mean amplitudes\n"
+            "                                    [FPGA deswitching on]\n"
+            "      --window     <dly>          Windows ADC curves (0) for --ddc as\n"
+            "                                    --setwdwon does, <dly> ADC clock cycles\n"
+            "                                    after each switching edge [0 to 500,\n"
+            "                                    needs --ddc]\n"
+            "      --tune                      Outputs, instead of TBT Pos curves (2, or 1\n"
+            "                                    with --computepos), the fractional tunes\n"
+            "                                    and amplitudes of X and Y, one line per\n"
+            "                                    curve: <qx> <qy> <ax> <ay>\n"
+            "      --xcorr      <carrier>      Outputs, instead of ADC curves (0), the\n"
+            "                                    delays of the channels to channel A from\n"
+            "                                    their cross-correlation, one line per\n"
+            "                                    curve: <dA> <dB> <dC> <dD> <misfit> [ps]\n"
+            "                                    [<carrier>: RF frequency in Hz, > 0;\n"
+            "                                     RFFE switching off]\n"
+            "      --goertzel   <f>[,f...]     Tracks up to %d lines of the -E or -F\n"
+            "                                    samples, in Hz at the %g Hz polling\n"
+            "                                    rate [higher ones alias], with sliding\n"
+            "                                    DFTs, printing instead of the samples:\n"
+            "                                    <f> <mag0..3> <phase0..3 [rad]>\n"
+            "      --goertzelwin <n>[,<hop>]   Sliding DFT over <n> samples, a line\n"
+            "                                    every <hop> [default: %d, <n>/4]\n"
+            "      --goertzelout <file>        Writes the --goertzel lines to <file>,\n"
+            "                                    the samples still going to stdout\n"
+            "      --summary    <n>            Prints to stderr, at exit, the mean, std,\n"
+            "                                    rms, min, max, p1, p50 and p99 of each\n"
+            "                                    channel of the curves and Monitoring\n"
+            "                                    samples output [<n> > 0: also every <n>\n"
+            "                                    curves or samples]\n"
+            "      --summaryout <file>         Saves the --summary totals to <file>\n"
+            "      --summarymerge              Prints (and with --summaryout saves) the\n"
+            "                                    merge of the summary files given as\n"
+            "                                    arguments [no hostname]\n"
+            "      --index      <dir>          Indexes the captures (.metadata files) under\n"
+            "                                    <dir>, parsing only new or changed ones,\n"
+            "                                    and prints the data files of those passing\n"
+            "                                    the filters given as arguments, oldest\n"
+            "                                    first: <key>[.<item>]<op><value> [<op>:\n"
+            "                                    =, !=, < or >; <item>: of a list, from 1;\n"
+            "                                    no hostname]\n"
             "  -E  --getmonitamp               Gets FPGA Monitoring Ampltitude Sample\n"
             "                                   [This consists of the following:\n"
             "                                    Monit. Amp 0, Amp 1, Amp 2, Amp 3]\n"
@@ -363,7 +383,16 @@ void print_usage (FILE* stream, int exit_code)
             "                                    Monit. X, Y, Q, Sum]\n"
             "  -O  --monittimestamp            Outputs timestamp to be alongside\n"
             "                                   the actual Monitoring data (Amp. or Pos.)\n"
-            );
+            "      --stats                     Dumps latency histograms and byte/error\n"
+            "                                   counters to stderr on exit or SIGUSR1\n"
+            "      --trace      <file>         Records every BSMP frame to <file>\n"
+            "      --replay     <file>         Answers requests with the responses recorded\n"
+            "                                   in <file> instead of connecting to a server\n"
+            "                                   [hostnames are not needed]\n"
+            "      --metrics    <port|path>    Serves monitoring stream metrics in Prometheus\n"
+            "                                   format on 127.0.0.1:<port> or on the UNIX\n"
+            "                                   socket <path> [must contain a '/']\n",
+            GTZ_MAX_FREQS, 1e6/MONIT_POLL_RATE, GTZ_DEFAULT_WIN);
     exit (exit_code);
 }
 
@@ -396,6 +425,7 @@ static struct option long_options[] =
     {"startacq",        no_argument,         NULL, 't'},
     {"setfeatt1",       required_argument,   NULL, 'a'},
     {"setfeatt2",       required_argument,   NULL, 'z'},
+    {"autorange",       required_argument,   NULL, OPT_AUTORANGE},
     {"getfmctemp1",     no_argument,         NULL, 'R'},
     {"getfmctemp2",     no_argument,         NULL, 'T'},
     {"getkx",           no_argument,         NULL, 'X'},
@@ -417,9 +447,37 @@ static struct option long_options[] =
     {"getsamples",      no_argument,         NULL, 'L'},
     {"getchan",         no_argument,         NULL, 'C'},
     {"getcurve",        required_argument,   NULL, 'B'},
+    {"curvefile",       required_argument,   NULL, OPT_CURVEFILE},
+    {"acqcycles",       required_argument,   NULL, OPT_ACQCYCLES},
+    {"acqoverlap",      no_argument,         NULL, OPT_ACQOVERLAP},
+    {"acqasync",        no_argument,         NULL, OPT_ACQASYNC},
+    {"publish",         required_argument,   NULL, OPT_PUBLISH},
+    {"subscribe",       required_argument,   NULL, OPT_SUBSCRIBE},
+    {"decimate",        required_argument,   NULL, OPT_DECIMATE},
+    {"method",          required_argument,   NULL, OPT_METHOD},
+    {"binary",          no_argument,         NULL, OPT_BINARY},
+    {"scale",           required_argument,   NULL, OPT_SCALE},
+    {"computepos",      required_argument,   NULL, OPT_COMPUTEPOS},
+    {"ddc",             required_argument,   NULL, OPT_DDC},
+    {"deswitch",        no_argument,         NULL, OPT_DESWITCH},
+    {"window",          required_argument,   NULL, OPT_WINDOW},
+    {"tune",            no_argument,         NULL, OPT_TUNE},
+    {"xcorr",           required_argument,   NULL, OPT_XCORR},
+    {"goertzel",        required_argument,   NULL, OPT_GOERTZEL},
+    {"goertzelwin",     required_argument,   NULL, OPT_GOERTZELWIN},
+    {"goertzelout",     required_argument,   NULL, OPT_GOERTZELOUT},
+    {"summary",         required_argument,   NULL, OPT_SUMMARY},
+    {"summaryout",      required_argument,   NULL, OPT_SUMMARYOUT},
+    {"summarymerge",    no_argument,         NULL, OPT_SUMMARYMERGE},
+    {"index",           required_argument,   NULL, OPT_INDEX},
+    {"dswcheck",        no_argument,         NULL, OPT_DSWCHECK},
     {"getmonitamp",     no_argument,         NULL, 'E'},
     {"getmonitpos",     no_argument,         NULL, 'F'},
     {"monittimestamp",  no_argument,         NULL, 'O'},
+    {"stats",           no_argument,         NULL, OPT_STATS},
+    {"trace",           required_argument,   NULL, OPT_TRACE},
+    {"replay",          required_argument,   NULL, OPT_REPLAY},
+    {"metrics",         required_argument,   NULL, OPT_METRICS},
     {NULL, 0, NULL, 0}
 };
 
@@ -449,74 +507,6 @@ typedef call_var_t call_func_t;
 /*************** General Functions *****************/
 /***************************************************/
 
-#define BLINK_FUNC_ID           0
-#define BLINK_FUNC_NAME         "blink"
-#define RESET_FUNC_ID           1
-#define RESET_FUNC_NAME         "reset"
-#define GET_FMC_TEMP1_ID        2
-#define GET_FMC_TEMP1_NAME      "get_fmc_temp1"
-#define GET_FMC_TEMP2_ID        3
-#define GET_FMC_TEMP2_NAME      "get_fmc_temp2"
-#define SET_KX_ID               4
-#define SET_KX_NAME             "set_kx"
-#define GET_KX_ID               5
-#define GET_KX_NAME             "get_kx"
-#define SET_KY_ID               6
-#define SET_KY_NAME             "set_ky"
-#define GET_KY_ID               7
-#define GET_KY_NAME             "set_ky"
-#define SET_KSUM_ID             8
-#define SET_KSUM_NAME           "set_ksum"
-#define GET_KSUM_ID             9
-#define GET_KSUM_NAME           "get_ksum"
-#define SET_SW_ON_ID            10
-#define SET_SW_ON_NAME          "set_sw_on"
-#define SET_SW_OFF_ID           11
-#define SET_SW_OFF_NAME         "set_sw_off"
-#define GET_SW_ID               12
-#define GET_SW_NAME             "get_sw"
-#define SET_SW_CLK_EN_ON_ID     13
-#define SET_SW_CLK_EN_ON_NAME   "set_sw_clk_en_on"
-#define SET_SW_CLK_EN_OFF_ID    14
-#define SET_SW_CLK_EN_OFF_NAME  "set_sw_clk_en_off"
-#define GET_SW_CLK_EN_ID        15
-#define GET_SW_CLK_EN_NAME      "get_sw_clk_en"
-#define SET_SW_DIVCLK_ID        16
-#define SET_SW_DIVCLK_NAME      "set_sw_divclk"
-#define GET_SW_DIVCLK_ID        17
-#define GET_SW_DIVCLK_NAME      "get_sw_divclk"
-#define SET_SW_PHASECLK_ID      18
-#define SET_SW_PHASECLK_NAME    "set_sw_phaseclk"
-#define GET_SW_PHASECLK_ID      19
-#define GET_SW_PHASECLK_NAME    "get_sw_phaseclk"
-#define SET_WDW_ON_ID           20
-#define SET_WDW_ON_NAME         "set_wdw_on"
-#define SET_WDW_OFF_ID          21
-#define SET_WDW_OFF_NAME        "set_wdw_off"
-#define GET_WDW_ID              22
-#define GET_WDW_NAME            "get_wdw"
-#define SET_WDW_DLY_ID          23
-#define SET_WDW_DLY_NAME        "set_wdw_dly"
-#define GET_WDW_DLY_ID          24
-#define GET_WDW_DLY_NAME        "get_wdw_dly"
-#define SET_ADCCLK_ID           25
-#define SET_ADCCLK_NAME         "set_adc_clk"
-#define GET_ADCCLK_ID           26
-#define GET_ADCCLK_NAME         "get_adc_clk"
-#define SET_DDSFREQ_ID          27
-#define SET_DDSFREQ_NAME        "set_dds_freq"
-#define GET_DDSFREQ_ID          28
-#define GET_DDSFREQ_NAME        "get_dds_freq"
-#define SET_ACQ_PARAM_ID        29
-#define SET_ACQ_PARAM_NAME      "set_acq_param"
-#define GET_ACQ_SAMPLES_ID      30
-#define GET_ACQ_SAMPLES_NAME    "get_acq_samples"
-#define GET_ACQ_CHAN_ID         31
-#define GET_ACQ_CHAN_NAME       "get_acq_chan"
-#define SET_ACQ_START_ID        32
-#define SET_ACQ_START_NAME      "set_acq_start"
-#define END_ID                  33
-
 static call_func_t call_func[END_ID] =
 {
     {BLINK_FUNC_NAME            , 0, 0, UINT32_T, {0}, {0}},
@@ -558,12 +548,6 @@ static call_func_t call_func[END_ID] =
 /*************** Streaming CURVES ******************/
 /***************************************************/
 
-#define CURVE_MONIT_AMP_ID      0
-#define CURVE_MONIT_AMP_NAME    "monit_amp"
-#define CURVE_MONIT_POS_ID      1
-#define CURVE_MONIT_POS_NAME    "monit_pos"
-#define END_MONIT_ID            2
-
 static call_func_t call_curve_monit[END_MONIT_ID] =
 {
     {CURVE_MONIT_AMP_NAME       , 0, 1, UINT32_T, {0}, {0}},
@@ -590,20 +574,6 @@ static call_func_t call_curve_type[END_CURVE_TYPE_ID] = {
 /***************************************************/
 /*************** On-demand CURVES ******************/
 /***************************************************/
-// We have 5 curves declared in server:
-// 0 -> ADC, 1-> TBTAMP, 2 -> TBTPOS,
-// 3 -> FOFBAMP, 4 -> FOFBPOS
-#define CURVE_ADC_ID            0
-#define CURVE_ADC_NAME          "adc_curve"
-#define CURVE_TBTAMP_ID         1
-#define CURVE_TBTAMP_NAME       "tbtamp_curve"
-#define CURVE_TBTPOS_ID         2
-#define CURVE_TBTPOS_NAME       "tbtpos_curve"
-#define CURVE_FOFBAMP_ID        3
-#define CURVE_FOFBAMP_NAME      "fofbamp_curve"
-#define CURVE_FOFMPOS_ID        4
-#define CURVE_FOFBPOS_NAME      "fofbpos_curve"
-#define END_CURVE_ID            5
 
 static call_func_t call_curve[END_CURVE_ID] = {
     {CURVE_ADC_NAME             , 0, 1, UINT32_T, {0}, {0}},
@@ -634,24 +604,6 @@ static call_func_t call_curve[END_CURVE_ID] = {
 ////    uint8_t read_val[sizeof(uint32_t)*2]; // 2 32-bits variable
 ////};
 
-#define SET_FE_SW_ON_ID         0
-#define SET_FE_SW_ON_NAME       "getset_fe_sw"
-#define SET_FE_SW_OFF_ID        (SET_FE_SW_ON_ID) // They are the same ID in FE server
-#define SET_FE_SW_OFF_NAME      SET_FE_SW_ON_NAME
-#define GET_FE_SW_ID            (SET_FE_SW_ON_ID) // The are the same ID in FE server
-#define GET_FE_SW_NAME          SET_FE_SW_ON_NAME
-//#define GETSET_FE_SW_LVL_ID     1
-//#define GETSET_FE_SW_LVL_NAME   "getset_sw_lvl"
-#define GETSET_FE_ATT1_ID       1
-#define GETSET_FE_ATT1_NAME     "getset_fe_att1"
-#define GETSET_FE_ATT2_ID       2
-#define GETSET_FE_ATT2_NAME     "getset_fe_att2"
-#define GET_FE_TEMP1_ID         3
-#define GET_FE_TEMP1_NAME       "get_fe_temp1"
-#define GET_FE_TEMP2_ID         4
-#define GET_FE_TEMP2_NAME       "get_fe_temp2"
-#define END_FE_ID               5
-
 static call_var_t call_fe_var[END_FE_ID] = {
     {SET_FE_SW_ON_NAME          , 0, 0, UINT8_T, {0}, {0}}, // The set "sw off" and "get sw"
     // are on the same ID in FE server
@@ -665,124 +617,1465 @@ static call_var_t call_fe_var[END_FE_ID] = {
     {GET_FE_TEMP2_NAME          , 0, 0, DOUBLE_T, {0}, {0}}
 };
 
-// Some FE variable values
-#define FE_SW_OFF               0x1
-#define FE_SW_ON                0x3
-// Some FE corection factors
-#define FE_SW_DIV_FACTOR        2
-
 /***************************************************/
 /************ Client Utility Functions *************/
 /***************************************************/
 
-#define NUM_CHANNELS 4
-#define SIZE_16_BYTES sizeof(uint16_t)
-#define SIZE_32_BYTES sizeof(uint32_t)
+int read_bsmp_val(call_var_t *fe_var)
+{
+    // Find out with type of varible this is and printf
+    // the correct string specifier
+    switch (fe_var->type) {
+        case UINT8_T:
+            printf ("%" PRIu8 "\n", *((uint8_t *)fe_var->read_val));
+            break;
+
+        case UINT16_T:
+            printf ("%" PRIu16 "\n", *((uint16_t *)fe_var->read_val));
+            break;
+
+        case UINT32_T:
+            printf ("%" PRIu32 "\n", *((uint32_t *)fe_var->read_val));
+            break;
+
+        case UINT64_T:
+            printf ("%" PRIu64 "\n", *((uint64_t *)fe_var->read_val));
+            break;
+
+        case FLOAT_T:
+            printf ("%f\n", *((float *)fe_var->read_val));
+            break;
+
+        case DOUBLE_T:
+            printf ("%f\n", *((double *)fe_var->read_val));
+            break;
+
+        default:
+            printf ("%" PRIu8 "\n", *((uint8_t *)fe_var->read_val));
+    }
+
+    return 0;
+}
 
-/* Print data composed of 16-bit signed data */
-int print_curve_16 (uint8_t *curve_data, uint32_t len)
+int read_bsmp_val_v(int verbose, call_var_t *fe_var)
 {
-    unsigned int i;
-    for (i = 0; i < len/(SIZE_16_BYTES*NUM_CHANNELS); ++i) {
-        printf ("%d %d %d %d\n",
-                *((int16_t *)curve_data + i*NUM_CHANNELS),
-                *((int16_t *)curve_data + i*NUM_CHANNELS+1),
-                *((int16_t *)curve_data + i*NUM_CHANNELS+2),
-                *((int16_t *)curve_data + i*NUM_CHANNELS+3));
+    PRINTV(verbose, "%s: ", fe_var->name);
+    if (verbose) {
+        read_bsmp_val(fe_var);
     }
 
     return 0;
 }
 
-/* Print data composed of 32-bit signed data */
-int print_curve_32 (uint8_t *curve_data, uint32_t len)
+int read_bsmp_func(call_func_t *func)
 {
-    unsigned int i;
-    //for (i = 0; i < len/4; ++i) {
-    //    printf ("%d\n", *((int32_t *)((uint8_t *)curve_data + i*4)));
-    //}
-    for (i = 0; i < len/(SIZE_32_BYTES*NUM_CHANNELS); ++i) {
-        printf ("%d %d %d %d\n",
-                *((int32_t *)curve_data + i*NUM_CHANNELS),
-                *((int32_t *)curve_data + i*NUM_CHANNELS+1),
-                *((int32_t *)curve_data + i*NUM_CHANNELS+2),
-                *((int32_t *)curve_data + i*NUM_CHANNELS+3));
+    return read_bsmp_val((call_var_t *)func);
+}
+
+int read_bsmp_func_v(int verbose, call_func_t *func)
+{
+    return read_bsmp_val_v(verbose, (call_var_t *)func);
+}
+
+/***************************************************************/
+/*********************** Curve readers *************************/
+/***************************************************************/
+
+/* Sets call_curve[].call for each channel in a "0,1,3" list */
+int parse_curve_list (char *list)
+{
+    char *tok, *end;
+
+    for (tok = strtok (list, ","); tok; tok = strtok (NULL, ",")) {
+        long id = strtol (tok, &end, 10);
+
+        if (end == tok || *end != '\0' || id < 0 || id > END_CURVE_ID-1) {
+            return -1;
+        }
+        call_curve[id].call = 1;
     }
 
     return 0;
 }
 
-int print_stream_curve (int monit_timestamp,
-        plot_values_monit_uint32_t *pval_monit_uint32)
+/* "<k>" (every channel) or "<k0>,<k1>,<k2>,<k3>" */
+static int parse_scale (const char *arg, double *scale)
 {
-    if (monit_timestamp) {
-        printf ("%s ", timestamp_str ());
+    unsigned int n = 0;
+    const char *p = arg;
+    char *end;
+
+    while (n < NUM_CHANNELS) {
+        scale[n++] = strtod (p, &end);
+        if (end == p || (*end != ',' && *end != '\0')) {
+            return -1;
+        }
+        if (*end == '\0') {
+            break;
+        }
+        p = end + 1;
     }
 
-    printf ("%d %d %d %d\n",
-            pval_monit_uint32->ch0,
-            pval_monit_uint32->ch1,
-            pval_monit_uint32->ch2,
-            pval_monit_uint32->ch3);
-    fflush(stdout);
+    if (*end != '\0' || (n != 1 && n != NUM_CHANNELS)) {
+        return -1;
+    }
+
+    for (; n < NUM_CHANNELS; ++n) {
+        scale[n] = scale[0];
+    }
 
     return 0;
 }
 
-int read_bsmp_val(call_var_t *fe_var)
+/* Comma-separated list of up to max numbers. Returns how many, or -1 */
+static int parse_list (const char *arg, double *val, unsigned int max)
 {
-    // Find out with type of varible this is and printf
-    // the correct string specifier
-    switch (fe_var->type) {
-        case UINT8_T:
-            printf ("%" PRIu8 "\n", *((uint8_t *)fe_var->read_val));
-            break;
+    unsigned int n = 0;
+    const char *p = arg;
+    char *end;
 
-        case UINT16_T:
-            printf ("%" PRIu16 "\n", *((uint16_t *)fe_var->read_val));
-            break;
+    do {
+        if (n == max) {
+            return -1;
+        }
+        val[n++] = strtod (p, &end);
+        if (end == p || (*end != ',' && *end != '\0')) {
+            return -1;
+        }
+        p = end + 1;
+    } while (*end != '\0');
 
-        case UINT32_T:
-            printf ("%" PRIu32 "\n", *((uint32_t *)fe_var->read_val));
-            break;
+    return (int) n;
+}
 
-        case UINT64_T:
-            printf ("%" PRIu64 "\n", *((uint64_t *)fe_var->read_val));
-            break;
+/* Output for curve id. stdout unless a --curvefile pattern is given */
+FILE *open_curve_sink (const char *pattern, unsigned int id)
+{
+    char filename[CURVE_FILENAME_LEN];
+    const char *p;
+    FILE *sink;
 
-        case FLOAT_T:
-            printf ("%f\n", *((float *)fe_var->read_val));
-            break;
+    if (pattern == NULL) {
+        return stdout;
+    }
+
+    p = strstr (pattern, "%d");
+    if (p) {
+        snprintf (filename, sizeof filename, "%.*s%u%s", (int) (p - pattern),
+                pattern, id, p + 2);
+    }
+    else {
+        snprintf (filename, sizeof filename, "%s", pattern);
+    }
+
+    sink = fopen (filename, "w");
+    if (!sink) {
+        perror (filename);
+    }
+
+    return sink;
+}
+
+/***************************************************************/
+/************************** Summaries **************************/
+/***************************************************************/
+
+// Curves by id, then the Monitoring streams
+#define SUMMARY_STREAMS         (END_CURVE_ID + END_MONIT_ID)
+
+struct summary_s {
+    struct smry_s *total;
+    struct smry_s *period;          // with --summary <n> > 0
+    uint32_t count;                 // curves or samples in the period
+};
+
+static struct summary_s summaries[SUMMARY_STREAMS];
+// Curves are written from the readout threads too, and several of them
+// can end up as the same stream (-B 1,2 --computepos)
+static pthread_mutex_t summary_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static const char *summary_name (unsigned int stream)
+{
+    return stream < END_CURVE_ID ? call_curve[stream].name :
+        call_curve_monit[stream - END_CURVE_ID].name;
+}
+
+/* Where the data of stream goes, allocated on first use. NULL if out of
+ * memory, the data then left out. Called with summary_lock held */
+static struct smry_s *summary_get (unsigned int stream)
+{
+    struct summary_s *sm = &summaries[stream];
+
+    if (!sm->total && !(sm->total = smry_new ())) {
+        return NULL;
+    }
+    if (summary_every && !sm->period && !(sm->period = smry_new ())) {
+        return NULL;
+    }
+
+    return summary_every ? sm->period : sm->total;
+}
+
+/* One more curve or sample of stream: the period, if over, is printed and
+ * merged into the total. Called with summary_lock held */
+static void summary_count (unsigned int stream)
+{
+    struct summary_s *sm = &summaries[stream];
+    char name[64];
+
+    if (!summary_every || ++sm->count < summary_every) {
+        return;
+    }
+
+    snprintf (name, sizeof name, C "summary %s, last %u %s",
+            summary_name (stream), sm->count,
+            stream < END_CURVE_ID ? "curves" : "samples");
+    smry_print (stderr, sm->period, name);
+    smry_merge (sm->total, sm->period);
+    smry_reset (sm->period);
+    sm->count = 0;
+}
+
+/* Curve data of id, as written: int16 rows for ADC, int32 otherwise */
+static void summary_curve (unsigned int id, const uint8_t *curve_data,
+        uint32_t curve_data_len)
+{
+    struct smry_s *s;
+
+    pthread_mutex_lock (&summary_lock);
+    s = summary_get (id);
+    if (s && id == CURVE_ADC_ID) {
+        smry_add_16 (s, (const int16_t *) curve_data,
+                curve_data_len/(SIZE_16_BYTES*NUM_CHANNELS));
+    }
+    else if (s) {
+        smry_add_32 (s, (const int32_t *) curve_data,
+                curve_data_len/(SIZE_32_BYTES*NUM_CHANNELS));
+    }
+    if (s) {
+        summary_count (id);
+    }
+    pthread_mutex_unlock (&summary_lock);
+}
+
+static void summary_sample (unsigned int monit_id,
+        const plot_values_monit_uint32_t *val)
+{
+    struct smry_s *s;
+
+    pthread_mutex_lock (&summary_lock);
+    s = summary_get (END_CURVE_ID + monit_id);
+    if (s) {
+        smry_add_sample (s, val);
+        summary_count (END_CURVE_ID + monit_id);
+    }
+    pthread_mutex_unlock (&summary_lock);
+}
+
+/* Prints the totals and saves them with --summaryout. Readout threads
+ * still running when the client exits wait for it */
+static void summary_finish (void)
+{
+    FILE *out = NULL;
+    char name[64];
+    unsigned int i;
+
+    if (summary_out && !(out = fopen (summary_out, "wb"))) {
+        perror (summary_out);
+    }
+
+    pthread_mutex_lock (&summary_lock);
+    for (i = 0; i < SUMMARY_STREAMS; ++i) {
+        struct summary_s *sm = &summaries[i];
+
+        if (!sm->total) {
+            continue;
+        }
+        if (sm->period) {
+            smry_merge (sm->total, sm->period);
+        }
+
+        snprintf (name, sizeof name, C "summary %s, total", summary_name (i));
+        smry_print (stderr, sm->total, name);
+        if (out && smry_write (out, sm->total, i) < 0) {
+            fprintf (stderr, C "%s: could not write summary\n", summary_out);
+        }
+
+        smry_free (sm->total);
+        smry_free (sm->period);
+        sm->total = sm->period = NULL;
+    }
+    pthread_mutex_unlock (&summary_lock);
+
+    if (out) {
+        fclose (out);
+    }
+}
+
+/* Merges the summaries saved in files, stream by stream */
+static int summary_merge_files (char **files, int nfiles)
+{
+    struct smry_s *s = smry_new ();
+    uint32_t id;
+    int i, ret, err = 0;
+
+    if (!s) {
+        return -1;
+    }
+
+    for (i = 0; i < nfiles; ++i) {
+        FILE *in = fopen (files[i], "rb");
+
+        if (!in) {
+            perror (files[i]);
+            err = -1;
+            continue;
+        }
+
+        while ((ret = smry_read (in, s, &id)) > 0) {
+            struct smry_s *total;
+
+            pthread_mutex_lock (&summary_lock);
+            total = id < SUMMARY_STREAMS ? summary_get (id) : NULL;
+            if (total) {
+                smry_merge (total, s);
+            }
+            pthread_mutex_unlock (&summary_lock);
+        }
+        if (ret < 0) {
+            fprintf (stderr, C "%s: not a summary file\n", files[i]);
+            err = -1;
+        }
+        fclose (in);
+    }
+
+    smry_free (s);
+    summary_finish ();
+
+    return err;
+}
+
+/***************************************************************/
+/************************* Data index **************************/
+/***************************************************************/
+
+/* Updates the index of dir and prints the captures passing the filters.
+ * Returns -1 on failure */
+static int index_run (const char *dir, char **filters, int nfilters,
+        int verbose)
+{
+    struct dx_filter_s *f = calloc (nfilters ? nfilters : 1, sizeof *f);
+    struct dx_s old, dx;
+    char path[PATH_MAX];
+    uint32_t *rows = NULL, parsed = 0, n, i;
+    uint64_t t0 = stats_now ();
+    int dir_len = (int) strlen (dir);
+    int err = 0, ret;
+
+    if (!f) {
+        perror ("index: calloc");
+        return -1;
+    }
+
+    for (i = 0; i < (uint32_t) nfilters; ++i) {
+        if (dx_filter_parse (&f[i], filters[i]) < 0) {
+            fprintf(stderr, C "%s: not a filter\n", filters[i]);
+            free (f);
+            return -1;
+        }
+    }
+
+    // As dx_scan () takes it, so that no path printed has "//"
+    while (dir_len > 0 && dir[dir_len - 1] == '/') {
+        --dir_len;
+    }
+
+    snprintf (path, sizeof path, "%.*s/%s", dir_len, dir, DX_FILENAME);
+
+    dx_init (&old);
+    dx_init (&dx);
+
+    // A broken index is only rebuilt
+    if ((ret = dx_read (&old, path)) < 0) {
+        fprintf(stderr, C "%s: %s, rebuilding\n", path, strerror (errno));
+    }
+
+    if (dx_scan (&dx, &old, dir, &parsed) < 0) {
+        perror (dir);
+        err = -1;
+        goto out;
+    }
+
+    if ((parsed || dx.n != old.n || ret <= 0) && dx_write (&dx, path) < 0) {
+        // Answered all the same
+        fprintf(stderr, C "%s: could not write index: %s\n", path,
+                strerror (errno));
+    }
+
+    rows = malloc ((dx.n ? dx.n : 1)*sizeof *rows);
+    if (!rows) {
+        perror ("index: malloc");
+        err = -1;
+        goto out;
+    }
+
+    // A capture whose metadata names no data file has nothing to print
+    n = dx_query (&dx, f, nfilters, rows);
+    for (i = 0; i < n; ++i) {
+        if (!dx.data[rows[i]]) {
+            fprintf(stderr, C "%.*s/%s: no data_original_filename, skipped\n",
+                    dir_len, dir, dx_str (&dx, dx.meta[rows[i]]));
+            continue;
+        }
+        printf ("%.*s/%s\n", dir_len, dir, dx_str (&dx, dx.data[rows[i]]));
+    }
+
+    if (verbose) {
+        fprintf(stderr, C "index: %u captures, %u parsed, %u passing, "
+                "%.1f ms\n", dx.n, parsed, n, (stats_now () - t0)/1e6);
+    }
+
+out:
+    free (rows);
+    free (f);
+    dx_free (&old);
+    dx_free (&dx);
+
+    return err;
+}
+
+/***************************************************************/
+/************************ FPGA settings ************************/
+/***************************************************************/
+
+/* Answers of the FPGA get_* functions (32-bit ones) the software stages
+ * work with. Each is read once, after the functions the user called, which
+ * may set it, and shared by every stage that needs it. Exits on failure */
+static uint32_t fpga_setting_val[END_ID];
+static uint8_t fpga_setting_read[END_ID];
+
+static uint32_t fpga_setting (fcs_session_t *fpga, unsigned int id)
+{
+    uint8_t out[BSMP_MAX_MESSAGE];
+
+    if (!fpga_setting_read[id]) {
+        TRY(call_func[id].name, fcs_func_execute_id(fpga, id, NULL, out));
+        memcpy (&fpga_setting_val[id], out, sizeof fpga_setting_val[id]);
+        fpga_setting_read[id] = 1;
+    }
+
+    return fpga_setting_val[id];
+}
+
+/***************************************************************/
+/************************* Auto-ranging ************************/
+/***************************************************************/
+
+/* --autorange over the sessions already open. Returns -1 on failure */
+static int autorange_run (fcs_session_t *fpga, fcs_session_t *fe, int verbose)
+{
+    unsigned int i, n;
+    int err;
+
+    err = ar_run (fpga, fe, &ar);
+    if (err != FCS_OK) {
+        fprintf(stderr, C "autorange: %s\n", fcs_error_str (err));
+        return -1;
+    }
+
+    n = ar.steps < AR_MAX_STEPS ? ar.steps : AR_MAX_STEPS;
+    for (i = 0; verbose && i < n; ++i) {
+        fprintf(stderr, C "autorange step %u: att1 %.1f dB, att2 %.1f dB, "
+                "peak %.1f%%\n", i, ar.step_att[i][0], ar.step_att[i][1],
+                100*ar.step_peak[i]);
+    }
+
+    fprintf(stderr, C "autorange: att1 %.1f dB, att2 %.1f dB, peak %.1f%% "
+            "[%g%% to %g%%], %u steps, %.1f ms%s\n", ar.att[0], ar.att[1],
+            n ? 100*ar.step_peak[n - 1] : 0.0, 100*ar.lo, 100*ar.hi,
+            ar.steps, ar.ns/1e6,
+            ar.status == AR_IN_WINDOW ? "" : ", window not reached");
+
+    return ar.status == AR_IN_WINDOW ? 0 : -1;
+}
+
+/* Widens the samples to 32 bits and reduces them by --decimate. Returns
+ * the rows (*nout of them), to be freed, or NULL if there is no memory */
+static decim_row_t *curve_decimated (unsigned int id, uint8_t *curve_data,
+        uint32_t curve_data_len, uint32_t *nout)
+{
+    uint32_t sample_size = id == CURVE_ADC_ID ? SIZE_16_BYTES : SIZE_32_BYTES;
+    uint32_t npts = curve_data_len/(sample_size*NUM_CHANNELS);
+    uint32_t i;
+    decim_row_t *in = malloc (npts*sizeof *in);
+    decim_row_t *out = malloc (decim_curve_rows (decimate_method,
+                decimate_factor, npts)*sizeof *out);
+
+    if (!in || !out) {
+        free (in);
+        free (out);
+        return NULL;
+    }
+
+    for (i = 0; i < npts; ++i) {
+        if (id == CURVE_ADC_ID) {
+            const int16_t *p = (int16_t *) curve_data + i*NUM_CHANNELS;
+            in[i] = (decim_row_t) {p[0], p[1], p[2], p[3]};
+        }
+        else {
+            memcpy (&in[i], curve_data + i*sizeof *in, sizeof *in);
+        }
+    }
+
+    *nout = decim_curve (decimate_method, decimate_factor, in, npts, out);
+    free (in);
+
+    return out;
+}
+
+/* Positions (--computepos) from amplitude curve id, as int32 rows of
+ * the same length. Returns them, to be freed, or NULL if out of memory */
+static uint8_t *curve_positions (unsigned int id, uint8_t *curve_data,
+        uint32_t curve_data_len)
+{
+    struct soa_s amp = {0, 0, {NULL}}, pos;
+    int32_t *rows = NULL;
+
+    if (soa_from_curve (&amp, id, curve_data, curve_data_len, NULL) < 0) {
+        return NULL;
+    }
+
+    if (soa_alloc (&pos, amp.rows) == 0) {
+        pos_compute (compute_pos, &pos_k, &amp, &pos);
+        rows = malloc ((size_t) amp.rows*NUM_CHANNELS*sizeof *rows);
+        if (rows) {
+            pos_to_rows (&pos, rows);
+        }
+        soa_free (&pos);
+    }
+    soa_free (&amp);
+
+    return (uint8_t *) rows;
+}
+
+/* Amplitudes (--ddc) from ADC curve data, as int32 rows, *len bytes of
+ * them. Returns them, to be freed, or NULL if out of memory */
+static uint8_t *curve_ddc (uint8_t *curve_data, uint32_t *len)
+{
+    struct soa_s adc = {0, 0, {NULL}}, amp;
+    struct ddc_s d = ddc;
+    struct wdw_s w = wdw;
+    int32_t *rows = NULL;
+
+    // Each curve is a capture of its own
+    ddc_reset (&d);
+    wdw_reset (&w);
+
+    if (soa_from_curve (&adc, CURVE_ADC_ID, curve_data, *len, NULL) < 0) {
+        return NULL;
+    }
+
+    if (window_dly >= 0) {
+        wdw_apply (&w, &adc);
+    }
+
+    if (soa_alloc (&amp, ddc_rows (&d, adc.rows)) == 0) {
+        if (ddc_process (&d, &adc, &amp, NULL) >= 0) {
+            rows = malloc ((size_t) amp.rows*NUM_CHANNELS*sizeof *rows);
+        }
+        if (rows) {
+            pos_to_rows (&amp, rows);
+            *len = amp.rows*NUM_CHANNELS*sizeof *rows;
+        }
+        soa_free (&amp);
+    }
+    soa_free (&adc);
+
+    return (uint8_t *) rows;
+}
+
+/* Per channel mean of nrows int32 rows */
+static void rows_mean (const int32_t *rows, uint32_t nrows,
+        double mean[NUM_CHANNELS])
+{
+    uint32_t i;
+    int c;
+
+    for (c = 0; c < NUM_CHANNELS; ++c) {
+        mean[c] = 0;
+    }
+    for (i = 0; i < nrows; ++i) {
+        for (c = 0; c < NUM_CHANNELS; ++c) {
+            mean[c] += rows[i*NUM_CHANNELS + c];
+        }
+    }
+    for (c = 0; c < NUM_CHANNELS && nrows; ++c) {
+        mean[c] /= nrows;
+    }
+}
+
+/* --dswcheck: the FPGA Amp curve at the --ddc rate, captured over the span
+ * of the ADC capture just deswitched, against the software amplitudes.
+ * The FPGA gain differs, so the share of each channel in the sum is
+ * compared. The acquisition parameters are put back. Returns -1 if they
+ * differ by more than DSW_CHECK_TOL or on failure */
+static int dsw_check_run (fcs_session_t *fpga)
+{
+    unsigned int id = ddc_decim == CURVE_TBT_DECIM ? CURVE_TBTAMP_ID : CURVE_FOFBAMP_ID;
+    uint32_t param[2] = {acq_clocks/ddc_decim, id};
+    uint32_t size = fcs_curve_size (fpga, id);
+    uint32_t len = 0;
+    double fpga_amp[NUM_CHANNELS], sw_amp[NUM_CHANNELS];
+    double sw_sum = 0, fpga_sum = 0, worst = 0;
+    uint8_t *data;
+    int c, err, have;
+
+    pthread_mutex_lock (&stage_lock);
+    memcpy (sw_amp, dsw_check_amp, sizeof sw_amp);
+    have = dsw_check_have;
+    pthread_mutex_unlock (&stage_lock);
+
+    if (!have || !param[0]) {
+        fprintf (stderr, C "deswitch check: no software amplitudes\n");
+        return -1;
+    }
+
+    data = malloc (size);
+    if (!data) {
+        perror ("malloc deswitch check");
+        return -1;
+    }
+
+    err = fcs_func_execute_id (fpga, SET_ACQ_PARAM_ID, (uint8_t *) param, NULL);
+    if (!err) {
+        err = fcs_func_execute_id (fpga, SET_ACQ_START_ID, NULL, NULL);
+    }
+    if (!err) {
+        err = fcs_curve_read (fpga, id, data, size, &len);
+    }
+
+    // As it was for the ADC capture
+    param[0] = fpga_setting (fpga, GET_ACQ_SAMPLES_ID);
+    param[1] = fpga_setting (fpga, GET_ACQ_CHAN_ID);
+    if (!err) {
+        err = fcs_func_execute_id (fpga, SET_ACQ_PARAM_ID, (uint8_t *) param, NULL);
+    }
+    if (err) {
+        fprintf (stderr, C "deswitch check: %s\n", fcs_error_str (err));
+        free (data);
+        return -1;
+    }
+
+    len /= SIZE_32_BYTES*NUM_CHANNELS;
+    rows_mean ((const int32_t *) data, len < acq_clocks/ddc_decim ? len :
+            acq_clocks/ddc_decim, fpga_amp);
+    free (data);
+
+    for (c = 0; c < NUM_CHANNELS; ++c) {
+        sw_sum += sw_amp[c];
+        fpga_sum += fpga_amp[c];
+    }
+
+    fprintf (stderr, C "deswitch check against %s, software - FPGA share:",
+            call_curve[id].name);
+    for (c = 0; c < NUM_CHANNELS; ++c) {
+        double d = sw_sum && fpga_sum ?
+            sw_amp[c]/sw_sum - fpga_amp[c]/fpga_sum : 1.0;
+
+        worst = fabs (d) > worst ? fabs (d) : worst;
+        fprintf (stderr, " %+.5f", d);
+    }
+    fprintf (stderr, " (%s)\n", worst <= DSW_CHECK_TOL ? "ok" : "MISMATCH");
+
+    return worst <= DSW_CHECK_TOL ? 0 : -1;
+}
+
+/* Tunes (--tune) of TBT position curve data. The FFT plan is kept from
+ * one curve to the next while their length stays the same */
+static int write_curve_tune (FILE *sink, uint8_t *curve_data,
+        uint32_t curve_data_len)
+{
+    struct soa_s pos = {0, 0, {NULL}};
+    struct tune_s t;
+    uint32_t n;
+
+    if (soa_from_curve (&pos, CURVE_TBTPOS_ID, curve_data, curve_data_len,
+                NULL) < 0) {
+        return -1;
+    }
+
+    n = tune_fft_size (pos.rows);
+    if (!n) {
+        fprintf (stderr, C "%u turns are too few for tunes\n", pos.rows);
+        soa_free (&pos);
+        return -1;
+    }
+
+    pthread_mutex_lock (&stage_lock);
+    if (tune_plan.n != n) {
+        tune_plan_free (&tune_plan);
+        if (tune_plan_init (&tune_plan, n) < 0) {
+            pthread_mutex_unlock (&stage_lock);
+            soa_free (&pos);
+            return -1;
+        }
+    }
+
+    tune_estimate (&tune_plan, pos.ch[0], pos.ch[1], &t);
+    pthread_mutex_unlock (&stage_lock);
+    fprintf (sink, "%.6f %.6f %.1f %.1f\n", t.q[0], t.q[1], t.amp[0],
+            t.amp[1]);
+    soa_free (&pos);
+
+    return 0;
+}
+
+/* Channel delays (--xcorr) of ADC curve data. The FFTs are kept from one
+ * curve to the next while their length stays the same */
+static int write_curve_xcorr (FILE *sink, uint8_t *curve_data,
+        uint32_t curve_data_len)
+{
+    struct soa_s adc = {0, 0, {NULL}};
+    struct xc_result_s r;
+    uint32_t n;
+
+    if (soa_from_curve (&adc, CURVE_ADC_ID, curve_data, curve_data_len,
+                NULL) < 0) {
+        return -1;
+    }
+
+    n = xc_size (adc.rows);
+    if (!n) {
+        fprintf (stderr, C "%u samples are too few to correlate\n", adc.rows);
+        soa_free (&adc);
+        return -1;
+    }
+
+    pthread_mutex_lock (&stage_lock);
+    if (xc.n != n) {
+        xc_free (&xc);
+        if (xc_init (&xc, n) < 0) {
+            pthread_mutex_unlock (&stage_lock);
+            soa_free (&adc);
+            return -1;
+        }
+    }
+
+    xc_estimate (&xc, &adc, &r);
+    pthread_mutex_unlock (&stage_lock);
+    fprintf (sink, "%.2f %.2f %.2f %.2f %.2f\n", r.delay[0]*xcorr_lag_ps,
+            r.delay[1]*xcorr_lag_ps, r.delay[2]*xcorr_lag_ps,
+            r.delay[3]*xcorr_lag_ps, r.residual*fabs (xcorr_lag_ps));
+    soa_free (&adc);
+
+    return 0;
+}
+
+/* Writes the channels, de-interleaved and scaled, as doubles (--binary) */
+static int write_curve_binary (FILE *sink, unsigned int id,
+        uint8_t *curve_data, uint32_t curve_data_len)
+{
+    struct soa_s soa = {0, 0, {NULL}};
+    int err;
+
+    if (decimate_factor > 1) {
+        uint32_t nout;
+        decim_row_t *rows = curve_decimated (id, curve_data, curve_data_len,
+                &nout);
+
+        err = !rows || soa_alloc (&soa, nout) < 0 ? -1 : 0;
+        if (!err) {
+            soa_deinterleave_32 ((int32_t *) rows, nout, curve_scale, soa.ch);
+            soa.rows = nout;
+        }
+        free (rows);
+    }
+    else {
+        err = soa_from_curve (&soa, id, curve_data, curve_data_len, curve_scale);
+    }
+
+    if (!err) {
+        err = soa_write (sink, &soa);
+    }
+    soa_free (&soa);
+
+    return err;
+}
+
+void write_curve (FILE *sink, unsigned int id, uint8_t *curve_data,
+        uint32_t curve_data_len)
+{
+    uint32_t sample_size = id == CURVE_ADC_ID ? SIZE_16_BYTES : SIZE_32_BYTES;
+    uint64_t t0 = stats_now ();
+    decim_row_t *rows = NULL;
+    uint8_t *pos_data = NULL;
+    uint8_t *ddc_data = NULL;
+    uint32_t nout;
+
+    // The curve buffer is larger than a capture. The analysis stages only
+    // take the rows of the last one, plain output the whole buffer
+    if (acq_clocks && id < END_CURVE_ID &&
+            acq_clocks/curve_decim[id]*sample_size*NUM_CHANNELS < curve_data_len) {
+        curve_data_len = acq_clocks/curve_decim[id]*sample_size*NUM_CHANNELS;
+    }
+
+    // Of the samples as captured, instead of any other output
+    if (xcorr_carrier > 0 && id == CURVE_ADC_ID) {
+        if (write_curve_xcorr (sink, curve_data, curve_data_len) < 0) {
+            fprintf (stderr, C "curve %u: could not correlate\n", id);
+        }
+        fflush (sink);
+        stats_record (STATS_EP_LOCAL, STATS_OP_OUTPUT, t0, 0);
+        return;
+    }
+
+    // In place, each curve a capture of its own
+    if (deswitch && id == CURVE_ADC_ID) {
+        struct dsw_s d = dsw;
+
+        dsw_reset (&d);
+        dsw_apply_16 (&d, (int16_t *) curve_data,
+                curve_data_len/(SIZE_16_BYTES*NUM_CHANNELS));
+    }
+
+    // Then handled as the amplitude curve at that rate
+    if (ddc_decim && id == CURVE_ADC_ID) {
+        ddc_data = curve_ddc (curve_data, &curve_data_len);
+        if (!ddc_data) {
+            fprintf (stderr, C "curve %u: could not down-convert\n", id);
+            return;
+        }
+        curve_data = ddc_data;
+        id = ddc_decim == CURVE_TBT_DECIM ? CURVE_TBTAMP_ID : CURVE_FOFBAMP_ID;
+
+        if (dsw_check) {
+            pthread_mutex_lock (&stage_lock);
+            rows_mean ((const int32_t *) curve_data,
+                    curve_data_len/(SIZE_32_BYTES*NUM_CHANNELS), dsw_check_amp);
+            dsw_check_have = 1;
+            pthread_mutex_unlock (&stage_lock);
+        }
+    }
+
+    // Then written as the matching position curve (32 bits)
+    if (compute_pos >= 0 && (id == CURVE_TBTAMP_ID || id == CURVE_FOFBAMP_ID)) {
+        pos_data = curve_positions (id, curve_data, curve_data_len);
+        if (!pos_data) {
+            fprintf (stderr, C "curve %u: no memory for positions\n", id);
+            free (ddc_data);
+            return;
+        }
+        curve_data = pos_data;
+        id = id == CURVE_TBTAMP_ID ? CURVE_TBTPOS_ID : CURVE_FOFMPOS_ID;
+    }
+
+    if (summary) {
+        summary_curve (id, curve_data, curve_data_len);
+    }
+
+    if (tune && id == CURVE_TBTPOS_ID) {
+        if (write_curve_tune (sink, curve_data, curve_data_len) < 0) {
+            fprintf (stderr, C "curve %u: could not estimate tunes\n", id);
+        }
+    }
+    else if (curve_binary) {
+        if (write_curve_binary (sink, id, curve_data, curve_data_len) < 0) {
+            fprintf (stderr, C "curve %u: could not write binary data\n", id);
+        }
+    }
+    // Nothing, rather than rows of another rate, if there is no memory
+    else if (decimate_factor > 1) {
+        rows = curve_decimated (id, curve_data, curve_data_len, &nout);
+        if (!rows) {
+            fprintf (stderr, C "curve %u: no memory to decimate\n", id);
+        }
+        else {
+            fprint_curve_32 (sink, (uint8_t *) rows, nout*sizeof *rows);
+            free (rows);
+        }
+    }
+    else if (id == CURVE_ADC_ID) {
+        fprint_curve_16 (sink, curve_data, curve_data_len);
+    }
+    else {
+        fprint_curve_32 (sink, curve_data, curve_data_len);
+    }
+    fflush (sink);
+    free (pos_data);
+    free (ddc_data);
+
+    stats_record (STATS_EP_LOCAL, STATS_OP_OUTPUT, t0, 0);
+}
+
+/* Prints a Monitoring sample or, with --decimate (decim not NULL), the
+ * reduced rows it completes */
+static void write_monit (struct decim_stream_s *decim,
+        const struct timespec *tsp, const plot_values_monit_uint32_t *val)
+{
+    plot_values_monit_uint32_t rows[DECIM_MAX_ROWS];
+    unsigned int i, n;
+
+    if (!decim) {
+        print_stream_curve_at (tsp, val);
+        return;
+    }
+
+    n = decim_stream_push (decim, val, rows);
+    for (i = 0; i < n; ++i) {
+        print_stream_curve_at (tsp, &rows[i]);
+    }
+}
+
+/* Prints the --goertzel lines a Monitoring sample completes */
+static void write_goertzel (FILE *sink, struct gtz_s *gtz,
+        const struct timespec *tsp, const plot_values_monit_uint32_t *val)
+{
+    struct gtz_line_s lines[GTZ_MAX_FREQS];
+    unsigned int i, c, n;
+
+    n = gtz_push (gtz, val, lines);
+    for (i = 0; i < n; ++i) {
+        if (tsp) {
+            fprintf (sink, "%s ", timestamp_str_at (tsp));
+        }
+        fprintf (sink, "%g", lines[i].freq*1e6/MONIT_POLL_RATE);
+        for (c = 0; c < NUM_CHANNELS; ++c) {
+            fprintf (sink, " %.1f", lines[i].mag[c]);
+        }
+        for (c = 0; c < NUM_CHANNELS; ++c) {
+            fprintf (sink, " %.4f", lines[i].phase[c]);
+        }
+        fprintf (sink, "\n");
+    }
+
+    if (n) {
+        fflush (sink);
+    }
+}
+
+/* Where the Monitoring samples go */
+struct monit_out_s {
+    fcs_session_t *session;
+    struct decim_stream_s *decim;   // NULL -> full rate
+    struct monit_shm_s *shm;        // NULL -> stdout
+    struct gtz_s *gtz;              // --goertzel, NULL if off
+    FILE *gtz_sink;                 // stdout -> instead of the samples
+    uint64_t missed_deadlines;      // of the session, already in the metrics
+    int replay;
+    int to_pos;                     // amplitudes to positions (--computepos)
+    unsigned int monit_id;          // of the samples output
+};
+
+static int monit_out_sample (void *arg, const struct fcs_monit_sample_s *sample,
+        const struct timespec *ts)
+{
+    struct monit_out_s *out = arg;
+    plot_values_monit_uint32_t amp, pos;
+    const plot_values_monit_uint32_t *val = &amp;
+    uint64_t t0 = stats_now ();
+
+    memcpy (&amp, sample, sizeof amp);
+    metrics_sample (t0);
+    for (; out->missed_deadlines < fcs_missed_deadlines (out->session);
+            ++out->missed_deadlines) {
+        metrics_missed_deadline ();
+    }
+
+    if (out->to_pos) {
+        pos_sample (compute_pos, &pos_k, val, &pos);
+        val = &pos;
+    }
+
+    if (out->gtz) {
+        write_goertzel (out->gtz_sink, out->gtz, monit_timestamp ? ts : NULL, val);
+    }
+
+    if (summary) {
+        summary_sample (out->monit_id, val);
+    }
+
+    // Output Curve to stdout or to the subscribers
+    if (out->shm) {
+        monit_shm_publish (out->shm, val, ts);
+    }
+    else if (!out->gtz || out->gtz_sink != stdout) {
+        write_monit (out->decim, monit_timestamp ? ts : NULL, val);
+    }
+    stats_record (STATS_EP_LOCAL, STATS_OP_OUTPUT, t0, 0);
+
+    if (_dump_stats) {
+        _dump_stats = 0;
+        stats_dump (stderr);
+    }
+
+    // A replay ends with the trace
+    return _interrupted || (out->replay && replay_done ());
+}
+
+struct curve_job_s {
+    unsigned int id;
+    char *hostname;
+    FILE *sink;
+    pthread_t thread;
+    int started;
+    int done;                       // curve read and written
+};
+
+/* Reads one curve over a session of its own. If the server does not
+ * take it (or does not answer in time), done stays 0 and the curve is read
+ * over the main session instead */
+void *curve_job_run (void *arg)
+{
+    struct curve_job_s *job = arg;
+    fcs_session_t *session;
+    uint8_t *curve_data;
+    uint32_t curve_data_size, curve_data_len;
+
+    session = fcs_open (FCS_EP_FPGA, FCS_DEV_ETHERNET, job->hostname,
+            CURVE_CONN_TIMEOUT);
+    if (!session) {
+        return NULL;
+    }
+
+    curve_data_size = fcs_curve_size (session, job->id);
+    curve_data = malloc(curve_data_size);
+    if (!curve_data) {
+        goto exit_close;
+    }
+
+    if (fcs_curve_read (session, job->id, curve_data, curve_data_size,
+                &curve_data_len) == FCS_OK) {
+        DEBUGP(C" Got %d bytes of curve #%d (concurrent)\n", curve_data_len, job->id);
+        write_curve (job->sink, job->id, curve_data, curve_data_len);
+        job->done = 1;
+    }
+
+    free (curve_data);
+exit_close:
+    fcs_close (session);
+    return NULL;
+}
+
+/***************************************************************/
+/****************** Asynchronous acquisition *******************/
+/***************************************************************/
+
+#define ACQ_POLL_MIN            1000000 // ns
+#define ACQ_POLL_MAX            1000000000 // ns
+#define ACQ_TIMEOUT_FACTOR      4 // of the expected capture time
+#define ACQ_TIMEOUT_MARGIN      10000000000ULL // ns
+#define ACQ_WAIT_SLICE          100000000 // ns, to notice SIGINT while waiting
+
+/* set_acq_start only answers when the capture is complete, so it runs on
+ * a session of its own and the main session stays free meanwhile */
+struct acq_async_s {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    pthread_t thread;
+    char *hostname;
+    uint64_t t_start;
+    uint64_t expected_ns;           // capture time from npts and data rate
+    int done;
+    int failed;
+    int no_session;                 // the server refused a second session
+    int abort;                      // give up: set_acq_start is not sent
+};
+
+/* Capture time of npts samples of curve chan */
+uint64_t acq_expected_ns (uint32_t npts, uint32_t chan, uint32_t adc_clk)
+{
+    if (chan >= END_CURVE_ID || adc_clk == 0) {
+        return 0;
+    }
+
+    return (uint64_t) ((double) npts * curve_decim[chan] / adc_clk * 1e9);
+}
+
+void *acq_async_run (void *arg)
+{
+    struct acq_async_s *acq = arg;
+    fcs_session_t *session;
+    int err = FCS_ERR_CONNECT;
+
+    session = fcs_open (FCS_EP_FPGA, FCS_DEV_ETHERNET, acq->hostname, 0);
+    int no_session = session == NULL;
+
+    if (!no_session) {
+        pthread_mutex_lock (&acq->lock);
+        int abort = acq->abort;
+        pthread_mutex_unlock (&acq->lock);
+
+        if (!abort) {
+            err = fcs_func_execute_id (session, SET_ACQ_START_ID, NULL, NULL);
+        }
+        fcs_close (session);
+    }
+
+    pthread_mutex_lock (&acq->lock);
+    acq->done = 1;
+    acq->failed = err != FCS_OK;
+    acq->no_session = no_session;
+    pthread_cond_broadcast (&acq->cond);
+    pthread_mutex_unlock (&acq->lock);
+
+    return NULL;
+}
+
+/* Starts an acquisition that is expected to take expected_ns */
+int acq_start_async (struct acq_async_s *acq, char *hostname,
+        uint64_t expected_ns)
+{
+    memset (acq, 0, sizeof *acq);
+    pthread_mutex_init (&acq->lock, NULL);
+    pthread_cond_init (&acq->cond, NULL);
+    acq->hostname = hostname;
+    acq->expected_ns = expected_ns;
+    acq->t_start = stats_now ();
+
+    return pthread_create (&acq->thread, NULL, acq_async_run, acq) ? -1 : 0;
+}
+
+/* 1 if the acquisition is complete, 0 if running, -1 if it failed */
+int acq_poll (struct acq_async_s *acq)
+{
+    int ret;
+
+    pthread_mutex_lock (&acq->lock);
+    ret = acq->done ? (acq->failed ? -1 : 1) : 0;
+    pthread_mutex_unlock (&acq->lock);
+
+    return ret;
+}
+
+/* Gives up the acquisition: SIGUSR2 fails the set_acq_start the thread
+ * is blocked in, until the thread is done. Then joins it */
+void acq_abort (struct acq_async_s *acq)
+{
+    pthread_mutex_lock (&acq->lock);
+    acq->abort = 1;
+    while (!acq->done) {
+        struct timespec ts;
+
+        pthread_kill (acq->thread, SIGUSR2);
+        clock_gettime (CLOCK_REALTIME, &ts);
+        ts.tv_nsec += ACQ_WAIT_SLICE;
+        ts.tv_sec += ts.tv_nsec / 1000000000;
+        ts.tv_nsec %= 1000000000;
+        pthread_cond_timedwait (&acq->cond, &acq->lock, &ts);
+    }
+    pthread_mutex_unlock (&acq->lock);
+
+    pthread_join (acq->thread, NULL);
+}
+
+/* Waits for the acquisition, returning as soon as it completes. Meanwhile
+ * the server is polled (get_acq_samples over fpga) so that a BPM that
+ * died mid-capture is noticed: first when the capture should be nearly
+ * done, then backing off exponentially from 1/32 of the capture time.
+ * The acquisition is given up if interrupted, if the server does not
+ * answer the poll or set_acq_start in time. Returns -1 then, or if the
+ * acquisition failed */
+int acq_wait (struct acq_async_s *acq, fcs_session_t *fpga, int verbose)
+{
+    uint64_t next_poll = acq->t_start + acq->expected_ns - acq->expected_ns/8;
+    uint64_t interval = acq->expected_ns/32;
+    uint64_t deadline = acq->t_start + ACQ_TIMEOUT_FACTOR*acq->expected_ns +
+        ACQ_TIMEOUT_MARGIN;
+    int ret;
+
+    interval = interval < ACQ_POLL_MIN ? ACQ_POLL_MIN : interval;
+    interval = interval > ACQ_POLL_MAX ? ACQ_POLL_MAX : interval;
+
+    while ((ret = acq_poll (acq)) == 0) {
+        uint64_t now = stats_now ();
+        uint64_t wake = next_poll < deadline ? next_poll : deadline;
+        struct timespec ts;
+
+        if (_interrupted) {
+            acq_abort (acq);
+            return -1;
+        }
+
+        if (now >= deadline) {
+            fprintf(stderr, C "%s: no answer after %.3f s\n", SET_ACQ_START_NAME,
+                    (now - acq->t_start)/1e9);
+            acq_abort (acq);
+            return -1;
+        }
+
+        if (now >= next_poll) {
+            uint32_t samples;
+            int err = fcs_func_execute_id (fpga, GET_ACQ_SAMPLES_ID, NULL,
+                    &samples);
+
+            if (err) {
+                if (!_interrupted) {
+                    fprintf(stderr, C "%s: %s while acquiring\n",
+                            GET_ACQ_SAMPLES_NAME, fcs_error_str (err));
+                }
+                acq_abort (acq);
+                return -1;
+            }
+            // stdout may be carrying curve data
+            if (verbose) {
+                fprintf(stderr, C "acquiring: %.0f%% of the expected time\n",
+                        acq->expected_ns ? 100.0*(now - acq->t_start)/acq->expected_ns : 0.0);
+            }
+
+            next_poll = now + interval;
+            interval = interval*2 > ACQ_POLL_MAX ? ACQ_POLL_MAX : interval*2;
+            continue;
+        }
+
+        // Wake up on completion, the next poll, or to check for SIGINT
+        wake = wake - now > ACQ_WAIT_SLICE ? now + ACQ_WAIT_SLICE : wake;
+        clock_gettime (CLOCK_REALTIME, &ts);
+        ts.tv_nsec += wake - now;
+        ts.tv_sec += ts.tv_nsec / 1000000000;
+        ts.tv_nsec %= 1000000000;
+
+        pthread_mutex_lock (&acq->lock);
+        if (!acq->done) {
+            pthread_cond_timedwait (&acq->cond, &acq->lock, &ts);
+        }
+        pthread_mutex_unlock (&acq->lock);
+    }
+
+    pthread_join (acq->thread, NULL);
+    if (verbose) {
+        fprintf(stderr, C "acquisition done in %.3f ms (expected %.3f ms)\n",
+                (stats_now () - acq->t_start)/1e6, acq->expected_ns/1e6);
+    }
+
+    return ret < 0 ? -1 : 0;
+}
+
+/***************************************************************/
+/******************** Cyclic acquisition ***********************/
+/***************************************************************/
+
+#define ACQ_HIST                4 // cycles of timestamps kept
+
+struct acq_cycle_s {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    char *hostname;
+    uint32_t cycles;                // 0 -> until interrupted
+    uint32_t armed;                 // cycles the control may start
+    uint32_t ready;                 // cycles captured
+    int failed;
+    int stop;
+    uint64_t t_arm[ACQ_HIST];       // set_acq_start sent
+    uint64_t t_done[ACQ_HIST];      // set_acq_start answered: data captured
+};
+
+/* Starts capture n and waits for it to complete */
+int acq_arm (struct acq_cycle_s *acq, fcs_session_t *session, uint32_t n)
+{
+    uint64_t t0 = stats_now ();
+    int err = fcs_func_execute_id (session, SET_ACQ_START_ID, NULL, NULL);
+    int ret;
+
+    pthread_mutex_lock (&acq->lock);
+    acq->t_arm[n % ACQ_HIST] = t0;
+    acq->t_done[n % ACQ_HIST] = stats_now ();
+    if (err) {
+        // Interrupting breaks the wait for the capture on purpose
+        if (!_interrupted) {
+            fprintf(stderr, C "%s: %s\n", SET_ACQ_START_NAME, fcs_error_str (err));
+        }
+        acq->failed = 1;
+    }
+    else {
+        acq->ready = n + 1;
+    }
+    ret = acq->failed ? -1 : 0;
+    pthread_cond_broadcast (&acq->cond);
+    pthread_mutex_unlock (&acq->lock);
+
+    return ret;
+}
+
+/* Re-arms the acquisition over its own session as soon as the reader
+ * allows it, so that set_acq_start blocking does not hold the readout */
+void *acq_control_run (void *arg)
+{
+    struct acq_cycle_s *acq = arg;
+    fcs_session_t *session;
+    uint32_t n;
+
+    session = fcs_open (FCS_EP_FPGA, FCS_DEV_ETHERNET, acq->hostname, 0);
+    if (!session) {
+        fprintf(stderr, C "no extra session for acquisition control\n");
+        pthread_mutex_lock (&acq->lock);
+        acq->failed = 1;
+        pthread_cond_broadcast (&acq->cond);
+        pthread_mutex_unlock (&acq->lock);
+        return NULL;
+    }
+
+    for (n = 0; !acq->cycles || n < acq->cycles; ++n) {
+        int stop;
+
+        pthread_mutex_lock (&acq->lock);
+        while (acq->armed <= n && !acq->stop) {
+            pthread_cond_wait (&acq->cond, &acq->lock);
+        }
+        stop = acq->stop;
+        pthread_mutex_unlock (&acq->lock);
 
-        case DOUBLE_T:
-            printf ("%f\n", *((double *)fe_var->read_val));
+        if (stop || _interrupted || acq_arm (acq, session, n) < 0) {
             break;
-
-        default:
-            printf ("%" PRIu8 "\n", *((uint8_t *)fe_var->read_val));
+        }
     }
 
-    return 0;
+    fcs_close (session);
+    return NULL;
 }
 
-int read_bsmp_val_v(int verbose, call_var_t *fe_var)
+/* Waits for capture n. Returns -1 on failure or interruption */
+int acq_wait_ready (struct acq_cycle_s *acq, uint32_t n)
 {
-    PRINTV(verbose, "%s: ", fe_var->name);
-    if (verbose) {
-        read_bsmp_val(fe_var);
+    int ret = 0;
+
+    pthread_mutex_lock (&acq->lock);
+    while (acq->ready <= n && !acq->failed && !_interrupted) {
+        struct timespec ts;
+
+        clock_gettime (CLOCK_REALTIME, &ts);
+        ts.tv_nsec += ACQ_WAIT_SLICE;
+        ts.tv_sec += ts.tv_nsec / 1000000000;
+        ts.tv_nsec %= 1000000000;
+        pthread_cond_timedwait (&acq->cond, &acq->lock, &ts);
+    }
+    if (acq->ready <= n) {
+        ret = -1;
     }
+    pthread_mutex_unlock (&acq->lock);
 
-    return 0;
+    return ret;
 }
 
-int read_bsmp_func(call_func_t *func)
+/* Lets the control thread start capture n */
+void acq_allow (struct acq_cycle_s *acq, uint32_t n)
 {
-    return read_bsmp_val((call_var_t *)func);
+    pthread_mutex_lock (&acq->lock);
+    if (n + 1 > acq->armed) {
+        acq->armed = n + 1;
+    }
+    pthread_cond_broadcast (&acq->cond);
+    pthread_mutex_unlock (&acq->lock);
 }
 
-int read_bsmp_func_v(int verbose, call_func_t *func)
+/* Repeats acquisition and readout of curve, appending every cycle to sink.
+ * With overlap, the firmware is trusted to keep capture n readable while
+ * n+1 is captured (double buffering): n+1 is started once the first block
+ * of n has been read, which latches it. Without it, n+1 is only started
+ * after n has been read out. The gap between the end of a capture and the
+ * start of the next one is reported as dead time */
+int acq_cycle_loop (char *hostname, uint32_t cycles, int overlap,
+        fcs_session_t *session, unsigned int id, FILE *sink)
 {
-    return read_bsmp_val_v(verbose, (call_var_t *)func);
+    uint32_t curve_data_size = fcs_curve_size (session, id);
+    uint32_t block_size = fcs_curve_block_size (session, id);
+    uint32_t nblocks = block_size ? (curve_data_size + block_size - 1)/block_size : 0;
+    struct acq_cycle_s acq;
+    pthread_t control;
+    uint8_t *curve_data = malloc(curve_data_size);
+    uint64_t capture_sum = 0, dead_sum = 0;
+    uint32_t n;
+
+    if (!curve_data) {
+        perror ("malloc curve data");
+        return -1;
+    }
+
+    memset (&acq, 0, sizeof acq);
+    pthread_mutex_init (&acq.lock, NULL);
+    pthread_cond_init (&acq.cond, NULL);
+    acq.hostname = hostname;
+    acq.cycles = cycles;
+
+    if (overlap) {
+        acq.armed = 1;
+        if (pthread_create (&control, NULL, acq_control_run, &acq) != 0) {
+            fprintf(stderr, C "cannot start acquisition control thread\n");
+            free (curve_data);
+            return -1;
+        }
+    }
+
+    for (n = 0; (!cycles || n < cycles) && !_interrupted; ++n) {
+        uint64_t t0, t_read, capture, dead = 0;
+        uint32_t curve_data_len = 0;
+        uint16_t block, len;
+        int err = FCS_OK;
+
+        if (overlap ? acq_wait_ready (&acq, n) :
+                acq_arm (&acq, session, n)) {
+            break;
+        }
+
+        t0 = stats_now ();
+        for (block = 0; block < nblocks && !err; ++block) {
+            err = fcs_curve_read_block (session, id, block,
+                    curve_data + curve_data_len, &len);
+            curve_data_len += len;
+
+            // The first block latches cycle n, the next one can start
+            if (overlap && block == 0 && (!cycles || n + 1 < cycles)) {
+                acq_allow (&acq, n + 1);
+            }
+        }
+        stats_record (STATS_EP_FPGA, STATS_OP_READ_CURVE, t0, err);
+        if (err) {
+            fprintf(stderr, C "%s: %s\n", call_curve[id].name, fcs_error_str(err));
+            pthread_mutex_lock (&acq.lock);
+            acq.failed = 1;
+            pthread_mutex_unlock (&acq.lock);
+            break;
+        }
+        t_read = stats_now () - t0;
+
+        write_curve (sink, id, curve_data, curve_data_len);
+
+        pthread_mutex_lock (&acq.lock);
+        capture = acq.t_done[n % ACQ_HIST] - acq.t_arm[n % ACQ_HIST];
+        if (n > 0) {
+            dead = acq.t_arm[n % ACQ_HIST] - acq.t_done[(n - 1) % ACQ_HIST];
+        }
+        fprintf (stderr, C "cycle %u: capture %.3f ms, readout %.3f ms, "
+                "dead %.3f ms (%.1f%%)%s\n", n, capture/1e6, t_read/1e6,
+                dead/1e6, dead + capture ? 100.0*dead/(dead + capture) : 0.0,
+                acq.ready > n + 1 ? ", readout overran the next capture" : "");
+        pthread_mutex_unlock (&acq.lock);
+
+        capture_sum += capture;
+        dead_sum += dead;
+    }
+
+    if (n > 1) {
+        fprintf (stderr, C "%u cycles: dead time %.3f ms per cycle, "
+                "%.1f%% of the time\n", n, dead_sum/1e6/(n - 1),
+                100.0*dead_sum/(dead_sum + capture_sum));
+    }
+
+    if (overlap) {
+        pthread_mutex_lock (&acq.lock);
+        acq.stop = 1;
+        pthread_cond_broadcast (&acq.cond);
+        pthread_mutex_unlock (&acq.lock);
+
+        // SIGINT fails the set_acq_start the control thread may be
+        // blocked in (no SA_RESTART), instead of waiting for the capture
+        if (_interrupted) {
+            pthread_kill (control, SIGINT);
+        }
+        pthread_join (control, NULL);
+    }
+
+    free (curve_data);
+    return acq.failed ? -1 : 0;
 }
 
 int main(int argc, char *argv[])
@@ -793,14 +2086,30 @@ int main(int argc, char *argv[])
     //int yes = 1;
 
     int verbose = 0;
-    int ch;
+    int stats = 0;
+    int status = -1;                // until every step asked for is done
+    char *trace_file = NULL;
+    char *replay_file = NULL;
+    char *metrics_addr = NULL;
+    int summary_merge = 0;
+    char *index_dir = NULL;
+    double gtz_param[2];
+    double ar_param[3];
+    int ch, n;
 
     // Acquitision parameters check
     int acq_samples_set = 0;
     uint32_t acq_samples_val = 0;
     int acq_chan_set = 0;
     uint32_t acq_chan_val = 0;
-    uint32_t acq_curve_chan = 0;
+    char *curve_file = NULL;
+    unsigned int ncurves = 0;
+    int acq_cyclic = 0;
+    uint32_t acq_cycles = 0;
+    int acq_overlap = 0;
+    int acq_async = 0;
+    char *publish_name = NULL;
+    char *subscribe_name = NULL;
 
     program_name = argv[0];
 
@@ -968,6 +2277,18 @@ int main(int argc, char *argv[])
                 *((double *)call_fe_var[GETSET_FE_ATT2_ID].write_val) = (double) atof(optarg);
                 need_fe_hostname = 1;
                 break;
+                // Closed-loop RFFE attenuation
+            case OPT_AUTORANGE:
+                n = parse_list (optarg, ar_param, 3);
+                if (n < 2 || ar_init (&ar, ar_param[0], ar_param[1],
+                            n == 3 ? (unsigned int) ar_param[2] : 2) < 0) {
+                    fprintf(stderr, "%s: --autorange takes <lo>,<hi> [0 < <lo> < <hi> < 1] and an optional <n> [1 or 2]!\n", program_name);
+                    return -1;
+                }
+                autorange = 1;
+                need_hostname = 1;
+                need_fe_hostname = 1;
+                break;
                 // Get FMC temp1
             case 'R':
                 call_func[GET_FMC_TEMP1_ID].call = 1;
@@ -1076,7 +2397,10 @@ int main(int argc, char *argv[])
                 // Get Curve
             case 'B':
                 call_curve_type[ANY_CURVE_TYPE_ID].call = 1;
-                acq_curve_chan = (uint32_t) atoi(optarg);
+                if (parse_curve_list (optarg) < 0) {
+                    fprintf(stderr, "%s: Specified curve ID invalid. It must be between %d and %d!\n", program_name, CURVE_ADC_ID, END_CURVE_ID-1);
+                    return -1;
+                }
                 /**((uint32_t *)call_curve[GET_CURVE_ID].write_val) = (uint32_t) atoi(optarg);*/
                 need_hostname = 1;
                 break;
@@ -1093,6 +2417,156 @@ int main(int argc, char *argv[])
             case 'O':
                 monit_timestamp = 1;
                 break;
+                // Dump instrumentation on exit or SIGUSR1
+            case OPT_STATS:
+                stats = 1;
+                break;
+                // Record BSMP frames
+            case OPT_TRACE:
+                trace_file = optarg;
+                break;
+                // Replay recorded BSMP frames
+            case OPT_REPLAY:
+                replay_file = optarg;
+                break;
+                // Serve streaming metrics
+            case OPT_METRICS:
+                metrics_addr = optarg;
+                break;
+                // Per-curve output files
+            case OPT_CURVEFILE:
+                curve_file = optarg;
+                break;
+                // Cyclic acquisition
+            case OPT_ACQCYCLES:
+                acq_cyclic = 1;
+                acq_cycles = (uint32_t) atoi(optarg);
+                break;
+            case OPT_ACQOVERLAP:
+                acq_overlap = 1;
+                break;
+            case OPT_ACQASYNC:
+                acq_async = 1;
+                break;
+                // Monitoring data through shared memory
+            case OPT_PUBLISH:
+                publish_name = optarg;
+                break;
+            case OPT_SUBSCRIBE:
+                subscribe_name = optarg;
+                break;
+                // Plot-oriented downsampling
+            case OPT_DECIMATE:
+                decimate_factor = (uint32_t) atoi(optarg);
+                break;
+            case OPT_METHOD:
+                decimate_method = decim_method (optarg);
+                if (decimate_method < 0) {
+                    fprintf(stderr, "%s: Decimation method must be minmax, lttb or mean!\n", program_name);
+                    return -1;
+                }
+                break;
+                // Per-channel doubles
+            case OPT_BINARY:
+                curve_binary = 1;
+                break;
+            case OPT_SCALE:
+                if (parse_scale (optarg, curve_scale) < 0) {
+                    fprintf(stderr, "%s: --scale takes 1 or %d factors!\n", program_name, NUM_CHANNELS);
+                    return -1;
+                }
+                break;
+                // Positions from amplitudes
+            case OPT_COMPUTEPOS:
+                compute_pos = pos_method (optarg);
+                if (compute_pos < 0) {
+                    fprintf(stderr, "%s: Position method must be dos or pds!\n", program_name);
+                    return -1;
+                }
+                need_hostname = 1;
+                break;
+                // Software down-conversion of ADC curves
+            case OPT_DDC:
+                if (strcmp (optarg, "tbt") == 0) {
+                    ddc_decim = CURVE_TBT_DECIM;
+                }
+                else if (strcmp (optarg, "fofb") == 0) {
+                    ddc_decim = CURVE_FOFB_DECIM;
+                }
+                else {
+                    fprintf(stderr, "%s: DDC rate must be tbt or fofb!\n", program_name);
+                    return -1;
+                }
+                need_hostname = 1;
+                break;
+            case OPT_DESWITCH:
+                deswitch = 1;
+                need_hostname = 1;
+                break;
+            case OPT_TUNE:
+                tune = 1;
+                need_hostname = 1;
+                break;
+            case OPT_XCORR:
+                xcorr_carrier = atof (optarg);
+                // The IF would not scale the lags of an undersampled carrier
+                if (!(xcorr_carrier > 0)) {
+                    fprintf(stderr, "%s: --xcorr takes the RF carrier frequency [Hz, > 0]!\n", program_name);
+                    return -1;
+                }
+                need_hostname = 1;
+                break;
+                // Line tracking on the Monitoring stream
+            case OPT_GOERTZEL:
+                n = parse_list (optarg, gtz_freq, GTZ_MAX_FREQS);
+                if (n < 1) {
+                    fprintf(stderr, "%s: --goertzel takes 1 to %d frequencies!\n", program_name, GTZ_MAX_FREQS);
+                    return -1;
+                }
+                gtz_nfreqs = (unsigned int) n;
+                break;
+            case OPT_GOERTZELWIN:
+                n = parse_list (optarg, gtz_param, 2);
+                // Negated, so NaN fails too; the casts need the bound
+                if (n < 1 || !(gtz_param[0] >= 2 && gtz_param[0] <= UINT32_MAX) ||
+                        (n == 2 && !(gtz_param[1] >= 1 && gtz_param[1] <= UINT32_MAX))) {
+                    fprintf(stderr, "%s: --goertzelwin takes <n> [2 to %" PRIu32 "] and an optional <hop> [1 to %" PRIu32 "]!\n",
+                            program_name, UINT32_MAX, UINT32_MAX);
+                    return -1;
+                }
+                gtz_win = (uint32_t) gtz_param[0];
+                gtz_hop = n == 2 ? (uint32_t) gtz_param[1] : 0;
+                break;
+            case OPT_GOERTZELOUT:
+                gtz_out = optarg;
+                break;
+                // Per-channel statistics
+            case OPT_SUMMARY:
+                summary = 1;
+                summary_every = (uint32_t) atoi(optarg);
+                break;
+            case OPT_SUMMARYOUT:
+                summary_out = optarg;
+                break;
+            case OPT_SUMMARYMERGE:
+                summary_merge = 1;
+                break;
+                // Captures saved by the aut-tests scripts
+            case OPT_INDEX:
+                index_dir = optarg;
+                break;
+            case OPT_DSWCHECK:
+                dsw_check = 1;
+                need_hostname = 1;
+                break;
+            case OPT_WINDOW:
+                window_dly = atoi (optarg);
+                if (window_dly < 0 || window_dly > WDW_DLY_MAX) {
+                    fprintf(stderr, "%s: Window delay must be between 0 and %d!\n", program_name, WDW_DLY_MAX);
+                    return -1;
+                }
+                need_hostname = 1;
+                break;
             case ':':
             case '?':   /* The user specified an invalid option.  */
                 print_usage (stderr, 1);
@@ -1105,12 +2579,12 @@ int main(int argc, char *argv[])
     }
 
     // Options checking!
-    if (need_hostname && hostname == NULL) {
+    if (need_hostname && hostname == NULL && replay_file == NULL) {
         fprintf(stderr, "%s: FPGA hostname not set!\n", program_name);
         print_usage(stderr, 1);
     }
 
-    if (need_fe_hostname && fe_hostname == NULL) {
+    if (need_fe_hostname && fe_hostname == NULL && replay_file == NULL) {
         fprintf(stderr, "%s: RFFE hostname not set!\n", program_name);
         print_usage(stderr, 1);
     }
@@ -1128,14 +2602,47 @@ int main(int argc, char *argv[])
         *((uint32_t *)call_func[SET_ACQ_PARAM_ID].write_val + 1) = acq_chan_val;
     }
 
-    // Check for acq_curve_chan bounds
-    if (call_curve_type[ANY_CURVE_TYPE_ID].call) {
-        if (acq_curve_chan > END_CURVE_ID-1) {//0 -> adc, tbtamp, tbtpos, fofbamp, 4-> fofbpos
-            fprintf(stderr, "%s: Specified curve ID invalid. It must be between %d and %d!\n", program_name, CURVE_ADC_ID, END_CURVE_ID-1);
+    // The window only shapes what the DDC filters
+    if (window_dly >= 0 && !ddc_decim) {
+        fprintf(stderr, "%s: --window needs --ddc!\n", program_name);
+        return -1;
+    }
+
+    if (dsw_check && (!deswitch || !ddc_decim || !call_curve[CURVE_ADC_ID].call)) {
+        fprintf(stderr, "%s: --dswcheck needs --deswitch, --ddc and the ADC curve (-B 0)!\n", program_name);
+        return -1;
+    }
+
+    // Several curves can not share stdout
+    for (unsigned int c = 0; c < ARRAY_SIZE(call_curve); ++c) {
+        ncurves += call_curve[c].call;
+    }
+
+    if (ncurves > 1 && (curve_file == NULL || strstr (curve_file, "%d") == NULL)) {
+        fprintf(stderr, "%s: Several curves need --curvefile with %%d in it!\n", program_name);
+        return -1;
+    }
+
+    // The cycle loop starts the acquisitions itself
+    if (acq_cyclic) {
+        if (ncurves != 1) {
+            fprintf(stderr, "%s: --acqcycles needs exactly one --getcurve channel!\n", program_name);
             return -1;
         }
+        call_func[SET_ACQ_START_ID].call = 0;
+    }
+    else if (acq_overlap) {
+        fprintf(stderr, "%s: --acqoverlap needs --acqcycles!\n", program_name);
+        return -1;
+    }
 
-        call_curve[acq_curve_chan].call = 1;
+    // Started after the other functions, as set_acq_start has the last ID.
+    // Trace and replay only follow one session
+    if (acq_async && call_func[SET_ACQ_START_ID].call && !trace_file && !replay_file) {
+        call_func[SET_ACQ_START_ID].call = 0;
+    }
+    else {
+        acq_async = 0;
     }
 
     // Setup sigint signal handler
@@ -1150,6 +2657,85 @@ int main(int argc, char *argv[])
         exit (0);
     }
 
+    // Wakes up the acquisition thread. No SA_RESTART, so that it fails
+    act.sa_sigaction = sigusr2_handler;
+
+    if (sigaction (SIGUSR2, &act, NULL) != 0) {
+        perror ("sigaction");
+        exit (0);
+    }
+
+    if (stats) {
+        // Restart blocking send/recv instead of failing the transaction
+        act.sa_sigaction = sigusr1_handler;
+        act.sa_flags = SA_SIGINFO | SA_RESTART;
+
+        if (sigaction (SIGUSR1, &act, NULL) != 0) {
+            perror ("sigaction");
+            exit (0);
+        }
+
+        // TRY () exits directly, so dump from an exit handler
+        atexit (stats_dump_exit);
+    }
+
+    // Summaries saved by other runs
+    if (summary_merge) {
+        summary_every = 0;
+        return summary_merge_files (argv + optind, argc - optind) < 0 ? 1 : 0;
+    }
+
+    // Captures saved by other runs, filtered
+    if (index_dir) {
+        return index_run (index_dir, argv + optind, argc - optind, verbose) < 0 ? 1 : 0;
+    }
+
+    // Totals printed however the client exits
+    if (summary) {
+        atexit (summary_finish);
+    }
+
+    // Subscribers are told, and the ring removed, on exit () too
+    if (publish_name) {
+        atexit (monit_shm_close_exit);
+    }
+
+    // Read the Monitoring data another client publishes
+    if (subscribe_name) {
+        struct decim_stream_s decim;
+        struct monit_shm_s shm;
+        plot_values_monit_uint32_t val;
+        struct timespec ts;
+        uint64_t samples = 0;
+        int ret = 0;
+
+        if (monit_shm_subscribe (&shm, subscribe_name) < 0) {
+            exit (1);
+        }
+
+        if (decimate_factor > 1 &&
+                decim_stream_init (&decim, decimate_method, decimate_factor,
+                    shm.curve_id == CURVE_MONIT_AMP_ID) < 0) {
+            exit (1);
+        }
+
+        while (!_interrupted && (ret = monit_shm_read (&shm, &val, &ts)) >= 0) {
+            if (ret > 0) {
+                write_monit (decimate_factor > 1 ? &decim : NULL,
+                        monit_timestamp ? &ts : NULL, &val);
+                ++samples;
+            }
+        }
+
+        fprintf (stderr, C "%" PRIu64 " samples read, %" PRIu64 " dropped%s\n",
+                samples, shm.dropped, ret < 0 ? ", publisher closed" : "");
+        monit_shm_close (&shm);
+        if (decimate_factor > 1) {
+            decim_stream_free (&decim);
+        }
+        return 0;
+    }
+
     // Socket specific part
 
     // Initilize connection to FPGA and FE
@@ -1158,67 +2744,44 @@ int main(int argc, char *argv[])
     /******** Init Connection and BSMP library *********/
     /***************************************************/
 
-    bsmp_client_t *fe_client = NULL;
-    enum bsmp_err err;
+    fcs_session_t *fpga = NULL;
+    fcs_session_t *fe = NULL;
+    enum fcs_dev_e dev = FCS_DEV_ETHERNET;
+    //enum fcs_dev_e fe_dev = FCS_DEV_SERIAL_RS232;
 
     /* Initilize structures */
-    bpm_init (ETHERNET_DEV, &transport_fpga);
-    bpm_init (ETHERNET_DEV, &transport_fe);
-    //bpm_init (SERIAL_RS232_DEV, &transport_fe);
-
-    if(need_fe_hostname) {
-        int *fd = &transport_fe.fd;
-        int fe_conn_err = transport_fe.ops->bpm_connection(fd, fe_hostname, FE_PORT);
-
-        if (fe_conn_err < 0) {
-            fprintf(stderr, "Error connecting to FE server\n");
-            goto exit_fe_conn;
+    if (replay_file) {
+        if (replay_open (replay_file) < 0) {
+            exit (1);
         }
+        dev = FCS_DEV_REPLAY;
+    }
 
-        // Create a new client FE instance
-        fe_client = bsmp_client_new(bpm_fe_send, bpm_fe_recv);
+    if (trace_file && trace_open (trace_file) < 0) {
+        exit (1);
+    }
 
-        if(!fe_client) {
-            fprintf(stderr, "Error allocating FE BSMP instance\n");
-            goto exit_fe_close;
-        }
+    if (metrics_addr && metrics_start (metrics_addr) < 0) {
+        exit (1);
+    }
 
-        DEBUGP ("BSMP FE created!\n");
+    if(need_fe_hostname) {
+        fe = fcs_open (FCS_EP_FE, dev, fe_hostname, 0);
 
-        if((err = bsmp_client_init(fe_client))) {
-            fprintf(stderr, "bsmp_client_init (FE): %s\n", bsmp_error_str(err));
-            goto exit_fe_destroy;
+        if (!fe) {
+            fprintf(stderr, "Error connecting to FE server\n");
+            goto exit_close;
         }
 
         DEBUGP ("BSMP FE initilized!\n");
     }
 
-    bsmp_client_t *client = NULL;
-
     if(need_hostname){
-        int *fd = &transport_fpga.fd;
-        int conn_err = transport_fpga.ops->bpm_connection(fd,
-                hostname, PORT);
+        fpga = fcs_open (FCS_EP_FPGA, dev, hostname, 0);
 
-        if (conn_err < 0) {
+        if (!fpga) {
             fprintf(stderr, "Error connecting to FPGA server\n");
-            goto exit_fpga_conn;
-        }
-
-        // Create a new client instance
-        client = bsmp_client_new(bpm_fpga_send, bpm_fpga_recv);
-
-        if(!client) {
-            fprintf(stderr, "Error allocating FPGA BSMP instance\n");
-            goto exit_fpga_close;
-        }
-
-        DEBUGP ("FPGA BSMP instance created!\n");
-
-        // Initialize the client instance (communication must be already working)
-        if((err = bsmp_client_init(client))) {
-            fprintf(stderr, "bsmp_client_init (FPGA): %s\n", bsmp_error_str(err));
-            goto exit_fpga_destroy;
+            goto exit_close;
         }
 
         DEBUGP ("FPGA BSMP initilized!\n");
@@ -1227,62 +2790,35 @@ int main(int argc, char *argv[])
     /***************************************************/
     /***************** Get BSMP handlers ***************/
     /***************************************************/
-    struct bsmp_func_info_list *fe_funcs;
-    struct bsmp_var_info_list *fe_vars;
     unsigned int i;
 
     if(need_fe_hostname){
-
-        TRY("funcs_fpga_list", bsmp_get_funcs_list(fe_client, &fe_funcs));
-
-        // Get FE list of functions
-        DEBUGP("\n"C"Server FE has %d Functions(s):\n", fe_funcs->count);
-        for(i = 0; i < fe_funcs->count; ++i) {
-            DEBUGP(C" ID[%d] INPUT[%2d bytes] OUTPUT[%2d bytes]\n",
-                    fe_funcs->list[i].id,
-                    fe_funcs->list[i].input_size,
-                    fe_funcs->list[i].output_size);
-        }
-
-        TRY("vars_fe_list", bsmp_get_vars_list(fe_client, &fe_vars));
-
         // Get FE list of variables
-        DEBUGP(C"Server FE has %d Variable(s):\n", fe_vars->count);
-        for(i = 0; i < fe_vars->count; ++i) {
-            DEBUGP(C" ID[%d] SIZE[%2d] %s\n",
-                    fe_vars->list[i].id,
-                    fe_vars->list[i].size,
-                    fe_vars->list[i].writable ? "WRITABLE " : "READ-ONLY");
+        DEBUGP("\n"C"Server FE variables:\n");
+        for(i = 0; i < END_FE_ID; ++i) {
+            DEBUGP(C" ID[%d] SIZE[%2d] %s\n", i,
+                    fcs_var_size(fe, fcs_var_name(i)), fcs_var_name(i));
         }
     }
 
-    struct bsmp_func_info_list *funcs;
-    struct bsmp_curve_info_list *curves;
-
     if(need_hostname){
-
-        TRY("funcs_fpga_list", bsmp_get_funcs_list(client, &funcs));
+        uint32_t input_size, output_size;
 
         // Get FPGA list of functions
-        DEBUGP("\n"C"Server FPGA has %d Functions(s):\n", funcs->count);
-
-        for(i = 0; i < funcs->count; ++i) {
-            DEBUGP(C" ID[%d] INPUT[%2d bytes] OUTPUT[%2d bytes]\n",
-                    funcs->list[i].id,
-                    funcs->list[i].input_size,
-                    funcs->list[i].output_size);
+        DEBUGP("\n"C"Server FPGA functions:\n");
+        for(i = 0; i < END_ID; ++i) {
+            if (fcs_func_size(fpga, i, &input_size, &output_size) == FCS_OK) {
+                DEBUGP(C" ID[%d] INPUT[%2d bytes] OUTPUT[%2d bytes] %s\n", i,
+                        input_size, output_size, fcs_func_name(i));
+            }
         }
 
         // Get FPGA list of curves
-        TRY("curves_list", bsmp_get_curves_list(client, &curves));
-
-        DEBUGP("\n"C"Server FPGA has %d Curve(s):\n", curves->count);
-        for(i = 0; i < curves->count; ++i) {
-            DEBUGP(C" ID[%d] BLOCKS[%3d (%5d bytes each)] %s\n",
-                    curves->list[i].id,
-                    curves->list[i].nblocks,
-                    curves->list[i].block_size,
-                    curves->list[i].writable ? "WRITABLE" : "READ-ONLY");
+        DEBUGP("\n"C"Server FPGA curves:\n");
+        for(i = 0; i < END_CURVE_ID + END_MONIT_ID; ++i) {
+            DEBUGP(C" ID[%d] %7u bytes (%5u bytes each block) %s\n", i,
+                    fcs_curve_size(fpga, i), fcs_curve_block_size(fpga, i),
+                    fcs_curve_name(i));
         }
     }
 
@@ -1292,22 +2828,21 @@ int main(int argc, char *argv[])
     if (need_fe_hostname) {
         // Call all the FE variables the user specified with its parameters
         DEBUGP("\n");
-        struct bsmp_var_info *fe_var_name;// = &fe_vars->list[0];
 
         for (i = 0; i < ARRAY_SIZE(call_fe_var); ++i) {
             if (call_fe_var[i].call) {
-                fe_var_name = &fe_vars->list[i];
-
                 if (call_fe_var[i].rw) { // Read variable
                     DEBUGP ("calling %s variable for reading!\n", call_fe_var[i].name);
-                    TRY(call_fe_var[i].name, bsmp_read_var(fe_client, fe_var_name, call_fe_var[i].read_val));
+                    TRY(call_fe_var[i].name, fcs_var_read(fe, call_fe_var[i].name,
+                                call_fe_var[i].read_val));
                 }
                 else { // write variable
                     //DEBUGP ("calling %s variable for writing with value 0x%x!\n", call_fe_var[i].name,
                     //        *((uint32_t *)call_fe_var[i].write_val));
                     DEBUGP ("calling %s variable for writing with value %f!\n", call_fe_var[i].name,
                             *((double *)call_fe_var[i].write_val));
-                    TRY(call_fe_var[i].name, bsmp_write_var(fe_client, fe_var_name, call_fe_var[i].write_val));
+                    TRY(call_fe_var[i].name, fcs_var_write(fe, call_fe_var[i].name,
+                                call_fe_var[i].write_val));
                 }
             }
         }
@@ -1326,15 +2861,18 @@ int main(int argc, char *argv[])
     }
 
     if (need_hostname) {
-        struct bsmp_func_info *func;
-        uint8_t func_error;
+
+        // Before any acquisition the user asked for, which then runs with
+        // the attenuation found
+        if (autorange && autorange_run (fpga, fe, verbose) < 0) {
+            goto exit_close;
+        }
 
         // Call all the FPGA functions the user specified with its parameters
         for (i = 0; i < ARRAY_SIZE(call_func); ++i) {
             if (call_func[i].call) {
-                func = &funcs->list[i];
-                TRY((call_func[i].name), bsmp_func_execute(client, func,
-                            &func_error, call_func[i].write_val, call_func[i].read_val));
+                TRY((call_func[i].name), fcs_func_execute_id(fpga, i,
+                            call_func[i].write_val, call_func[i].read_val));
             }
         }
 
@@ -1350,80 +2888,318 @@ int main(int argc, char *argv[])
             }
         }
 
+        // Position gains
+        if (compute_pos >= 0) {
+            uint32_t kx = fpga_setting (fpga, GET_KX_ID);
+            uint32_t ky = fpga_setting (fpga, GET_KY_ID);
+            uint32_t ksum = fpga_setting (fpga, GET_KSUM_ID);
+
+            pos_k_init (&pos_k, kx, ky, ksum);
+            DEBUGP(C"Positions by %s with Kx %u, Ky %u, Ksum %u\n",
+                    pos_method_name (compute_pos), kx, ky, ksum);
+        }
+
+        // Down-conversion parameters
+        if (ddc_decim) {
+            uint32_t adc_clk = fpga_setting (fpga, GET_ADCCLK_ID);
+            uint32_t dds_freq = fpga_setting (fpga, GET_DDSFREQ_ID);
+
+            if (ddc_init (&ddc, adc_clk, dds_freq, ddc_decim, DDC_ORDER) < 0) {
+                fprintf (stderr, C "cannot down-convert with ADC clock %u Hz, "
+                        "DDS %u Hz\n", adc_clk, dds_freq);
+                goto exit_close;
+            }
+            DEBUGP(C"DDC of ADC curves at %u Hz, DDS %u Hz, decimation %u\n",
+                    adc_clk, dds_freq, ddc_decim);
+        }
+
+        // Lags of the aliased carrier to delays at the RF one
+        if (xcorr_carrier > 0) {
+            uint32_t adc_clk = fpga_setting (fpga, GET_ADCCLK_ID);
+
+            if (!adc_clk) {
+                fprintf (stderr, C "cannot correlate with no ADC clock\n");
+                goto exit_close;
+            }
+            xcorr_lag_ps = 1e12*xc_lag_time (adc_clk, xcorr_carrier);
+            DEBUGP(C"Channel delays at %g ps per sample of lag\n", xcorr_lag_ps);
+        }
+
+        // Switching as the FPGA has it, read back
+        if (deswitch || window_dly >= 0) {
+            uint32_t divclk = fpga_setting (fpga, GET_SW_DIVCLK_ID);
+            uint32_t phaseclk = fpga_setting (fpga, GET_SW_PHASECLK_ID);
+
+            if (dsw_init (&dsw, divclk, phaseclk) < 0 || (window_dly >= 0 &&
+                        wdw_init (&wdw, divclk, phaseclk, window_dly, WDW_ALPHA) < 0)) {
+                fprintf (stderr, C "cannot deswitch or window with divider "
+                        "clock %u\n", divclk);
+                goto exit_close;
+            }
+            DEBUGP(C"Switching every %u clocks, phase %u\n", dsw.period,
+                    phaseclk);
+        }
+
+        // Acquisition on a session of its own, readout as soon as it is done
+        if (acq_async) {
+            struct acq_async_s acq;
+            uint32_t npts = fpga_setting (fpga, GET_ACQ_SAMPLES_ID);
+            uint32_t chan = fpga_setting (fpga, GET_ACQ_CHAN_ID);
+            uint32_t adc_clk = fpga_setting (fpga, GET_ADCCLK_ID);
+
+            if (acq_start_async (&acq, hostname,
+                        acq_expected_ns (npts, chan, adc_clk)) < 0) {
+                fprintf(stderr, C "cannot start acquisition thread\n");
+                goto exit_close;
+            }
+            if (acq_wait (&acq, fpga, verbose) < 0) {
+                // Given up (and reported) or interrupted
+                if (acq.abort) {
+                    goto exit_close;
+                }
+                if (!acq.no_session) {
+                    fprintf(stderr, C "%s: acquisition failed\n", SET_ACQ_START_NAME);
+                    goto exit_close;
+                }
+
+                // Server takes a single connection: block on it instead
+                TRY(SET_ACQ_START_NAME, fcs_func_execute_id(fpga, SET_ACQ_START_ID,
+                            NULL, NULL));
+            }
+        }
+
+        // Rows captured, as the span of the capture over the channel
+        // decimation, for the stages that analyse them
+        if (ncurves && (summary || tune || xcorr_carrier > 0 || ddc_decim)) {
+            uint32_t chan = fpga_setting (fpga, GET_ACQ_CHAN_ID);
+
+            if (chan < END_CURVE_ID) {
+                acq_clocks = (uint64_t) fpga_setting (fpga, GET_ACQ_SAMPLES_ID)*
+                    curve_decim[chan];
+            }
+        }
+
+        // Acquire and read out the (single) specified curve in cycles
+        if (acq_cyclic) {
+            for (i = 0; !call_curve[i].call; ++i);
+
+            FILE *sink = open_curve_sink (curve_file, i);
+            if (!sink) {
+                goto exit_close;
+            }
+
+            // Trace and replay only follow one session
+            if (acq_overlap && (trace_file || replay_file)) {
+                fprintf(stderr, C "--acqoverlap ignored with --trace/--replay\n");
+                acq_overlap = 0;
+            }
+
+            int err = acq_cycle_loop (hostname, acq_cycles, acq_overlap, fpga, i, sink);
+
+            if (sink != stdout) {
+                fclose (sink);
+            }
+            // Ctrl-C also fails the capture it cuts short
+            if (err < 0 && !_interrupted) {
+                goto exit_close;
+            }
+            call_curve[i].call = 0;
+        }
+
         // Call specified curves
-        struct bsmp_curve_info *curve;
+        struct curve_job_s curve_jobs[END_CURVE_ID];
         uint8_t *curve_data = NULL;
+        uint32_t curve_data_size = 0;
         uint32_t curve_data_len;
+        unsigned int njobs = 0;
+
         for (i = 0; i < ARRAY_SIZE(call_curve); ++i) {
             if (call_curve[i].call) {
+                struct curve_job_s *job = &curve_jobs[njobs++];
+
+                memset (job, 0, sizeof *job);
+                job->id = i;
+                job->hostname = hostname;
+                job->sink = open_curve_sink (curve_file, i);
+                if (!job->sink) {
+                    --njobs;
+                    break;
+                }
+
+                if (fcs_curve_size (fpga, i) > curve_data_size) {
+                    curve_data_size = fcs_curve_size (fpga, i);
+                }
+            }
+        }
+
+        // A single buffer, sized for the largest curve, for the main session
+        if (i == ARRAY_SIZE(call_curve) && njobs) {
+            curve_data = malloc(curve_data_size);
+            /* Potential failure can happen here if large buffer is requested!! */
+            if (!curve_data) {
+                perror ("malloc curve data");
+            }
+        }
+
+        // Nothing is read unless every sink and the buffer are there
+        if (i < ARRAY_SIZE(call_curve) || (njobs && !curve_data)) {
+            for (i = 0; i < njobs; ++i) {
+                if (curve_jobs[i].sink != stdout) {
+                    fclose (curve_jobs[i].sink);
+                }
+            }
+            goto exit_close;
+        }
+
+        // All but the first curve go over extra connections while the
+        // first is read here. Trace and replay only follow one session
+        if (!trace_file && !replay_file) {
+            for (i = 1; i < njobs; ++i) {
+                curve_jobs[i].started = pthread_create (&curve_jobs[i].thread,
+                        NULL, curve_job_run, &curve_jobs[i]) == 0;
+            }
+        }
+
+        for (i = 0; i < njobs; ++i) {
+            struct curve_job_s *job = &curve_jobs[i];
+
+            if (job->started) {
+                pthread_join (job->thread, NULL);
+            }
+
+            if (!job->done) {
                 // Requesting curve
-                DEBUGP(C"Requesting curve #%d\n", i);
+                DEBUGP(C"Requesting curve #%d\n", job->id);
 
-                curve = &curves->list[i];
-                curve_data = malloc(curve->block_size*curve->nblocks);
-                /* Potential failure can happen here if large buffer is requested!! */
-                TRY("malloc curve data", !curve_data);
-                TRY((call_curve[i].name), bsmp_read_curve(client, curve,
-                            curve_data, &curve_data_len));
+                TRY((call_curve[job->id].name), fcs_curve_read(fpga, job->id,
+                            curve_data, curve_data_size, &curve_data_len));
 
                 DEBUGP(C" Got %d bytes of curve\n", curve_data_len);
-                if (i == CURVE_ADC_ID)
-                    print_curve_16 (curve_data, curve_data_len);
-                else
-                    print_curve_32 (curve_data, curve_data_len);
+                write_curve (job->sink, job->id, curve_data, curve_data_len);
+            }
 
+            if (job->sink != stdout) {
+                fclose (job->sink);
             }
         }
 
+        // The deswitched ADC capture is out: now the FPGA one to compare
+        if (dsw_check && dsw_check_run (fpga) < 0) {
+            free (curve_data);
+            goto exit_close;
+        }
+
         // Poll to infinity the Monit. Functions if called
         for (i = 0; i < ARRAY_SIZE(call_curve_monit); ++i) {
             if (call_curve_monit[i].call) {
+                int to_pos = compute_pos >= 0 && i == CURVE_MONIT_AMP_ID;
+                struct monit_out_s out = {fpga, NULL, NULL, NULL, stdout, 0,
+                    replay_file != NULL, to_pos, to_pos ? CURVE_MONIT_POS_ID : i};
+                struct decim_stream_s decim;
+                struct monit_shm_s shm;
+                struct gtz_s gtz;
+
                 DEBUGP(C"Requesting curve #%d\n", END_CURVE_ID+i);
-                curve = &curves->list[END_CURVE_ID+i];// These are just after the regular functions
-                //curve_data = malloc(curve->block_size*curve->nblocks);
-                while (!_interrupted) {
-                    unsigned int j;
-                    for (j = 0; j < PLOT_BUFFER_LEN && !_interrupted; ++j) { // in 4 * 32-bit words
-                        TRY((call_curve_monit[i].name), bsmp_read_curve(client, curve,
-                                    (uint8_t *)(pval_monit_uint32 + j), &curve_data_len));
-
-                        // Output Curve to stdout
-                        print_stream_curve (monit_timestamp,
-                                &pval_monit_uint32[j]);
-                        //printf ("%s %d %d %d %d\n",
-                        //        pval_monit_uint32[j].ch0,
-                        //        pval_monit_uint32[j].ch1,
-                        //        pval_monit_uint32[j].ch2,
-                        //        pval_monit_uint32[j].ch3,
-                        //        timestamp_str());
-                        ////printf ("%d\n\r", pval_monit_uint32[j].ch0);
-                        //fflush(stdout);
-
-                        // Can this update rate cause problems for gnuplot?
-                        usleep (MONIT_POLL_RATE); /* 10 Hz update */
 
+                if (!publish_name && decimate_factor > 1) {
+                    if (decim_stream_init (&decim, decimate_method, decimate_factor,
+                                out.monit_id == CURVE_MONIT_AMP_ID) < 0) {
+                        goto exit_close;
+                    }
+                    out.decim = &decim;
+                }
+
+                if (gtz_nfreqs) {
+                    double freq[GTZ_MAX_FREQS];
+                    unsigned int k;
+
+                    // Hz to cycles/sample
+                    for (k = 0; k < gtz_nfreqs; ++k) {
+                        freq[k] = gtz_freq[k]*MONIT_POLL_RATE/1e6;
+                    }
+                    if (gtz_init (&gtz, gtz_nfreqs, freq, gtz_win,
+                                gtz_hop ? gtz_hop : (gtz_win + 3)/4) < 0) {
+                        goto exit_close;
+                    }
+                    if (gtz_out && !(out.gtz_sink = fopen (gtz_out, "w"))) {
+                        perror (gtz_out);
+                        gtz_free (&gtz);
+                        goto exit_close;
+                    }
+                    out.gtz = &gtz;
+                }
+
+                // Last, so that nothing fails with the ring published
+                if (publish_name) {
+                    if (monit_shm_publish_open (&shm, publish_name, out.monit_id) < 0) {
+                        if (out.gtz) {
+                            if (out.gtz_sink != stdout) {
+                                fclose (out.gtz_sink);
+                            }
+                            gtz_free (&gtz);
+                        }
+                        goto exit_close;
                     }
+                    out.shm = &shm;
+                    shm_published = &shm;
+                }
+
+                metrics_set_period ((uint64_t) MONIT_POLL_RATE*1000);
+
+                // Keep streaming across server restarts and link drops.
+                // Replay as fast as possible
+                while (!_interrupted && !(replay_file && replay_done ())) {
+                    int err = fcs_monit_stream (fpga, i, replay_file ? 0 : MONIT_POLL_RATE,
+                            monit_out_sample, &out);
+
+                    if (err == FCS_OK || _interrupted) {
+                        break;
+                    }
+
+                    // Reconnecting only helps a broken link
+                    if (replay_file || !fcs_error_link (err)) {
+                        fprintf(stderr, C "%s: %s\n", call_curve_monit[i].name,
+                                fcs_error_str(err));
+                        break;
+                    }
+
+                    fprintf(stderr, C "%s: %s. Reconnecting\n",
+                            call_curve_monit[i].name, fcs_error_str(err));
+                    if (fcs_reconnect (fpga, &_interrupted) != FCS_OK) {
+                        break;
+                    }
+                    metrics_reconnect ();
+                }
+
+                // Subscribers see the stream end
+                if (out.shm) {
+                    shm_published = NULL;
+                    monit_shm_close (&shm);
+                }
+                if (out.decim) {
+                    decim_stream_free (&decim);
+                }
+                if (out.gtz) {
+                    if (out.gtz_sink != stdout) {
+                        fclose (out.gtz_sink);
+                    }
+                    gtz_free (&gtz);
                 }
             }
         }
         free (curve_data);
     }
-
-exit_fpga_destroy:
-    bsmp_client_destroy(client);
-    DEBUGP("BSMP FPGA deallocated\n");
-exit_fpga_close:
-    close (transport_fpga.fd);
-    DEBUGP("Socket FPGA closed\n");
-exit_fpga_conn:
-exit_fe_destroy:
-    bsmp_client_destroy (fe_client);
-    DEBUGP("BSMP FE deallocated\n");
-exit_fe_close:
-    close (transport_fe.fd);
-    DEBUGP("Socket FE closed\n");
-exit_fe_conn:
+    status = 0;
+
+exit_close:
+    ddc_free (&ddc);
+    wdw_free (&wdw);
+    tune_plan_free (&tune_plan);
+    xc_free (&xc);
+    fcs_close (fpga);
+    fcs_close (fe);
+    DEBUGP("BSMP sessions closed\n");
     free (hostname);
     free (fe_hostname);
-    return 0;
+    return status;
 }
@@ -29,4 +29,140 @@ struct _send_pkt_t {
 
 typedef struct _send_pkt_t send_pkt_t;
 
+// BSMP entity IDs as exported by the FPGA and RFFE servers. These are
+// shared between the client and the mock server (mock/bpm_mock.c)
+
+/***************************************************/
+/*************** General Functions *****************/
+/***************************************************/
+
+#define BLINK_FUNC_ID           0
+#define BLINK_FUNC_NAME         "blink"
+#define RESET_FUNC_ID           1
+#define RESET_FUNC_NAME         "reset"
+#define GET_FMC_TEMP1_ID        2
+#define GET_FMC_TEMP1_NAME      "get_fmc_temp1"
+#define GET_FMC_TEMP2_ID        3
+#define GET_FMC_TEMP2_NAME      "get_fmc_temp2"
+#define SET_KX_ID               4
+#define SET_KX_NAME             "set_kx"
+#define GET_KX_ID               5
+#define GET_KX_NAME             "get_kx"
+#define SET_KY_ID               6
+#define SET_KY_NAME             "set_ky"
+#define GET_KY_ID               7
+#define GET_KY_NAME             "get_ky"
+#define SET_KSUM_ID             8
+#define SET_KSUM_NAME           "set_ksum"
+#define GET_KSUM_ID             9
+#define GET_KSUM_NAME           "get_ksum"
+#define SET_SW_ON_ID            10
+#define SET_SW_ON_NAME          "set_sw_on"
+#define SET_SW_OFF_ID           11
+#define SET_SW_OFF_NAME         "set_sw_off"
+#define GET_SW_ID               12
+#define GET_SW_NAME             "get_sw"
+#define SET_SW_CLK_EN_ON_ID     13
+#define SET_SW_CLK_EN_ON_NAME   "set_sw_clk_en_on"
+#define SET_SW_CLK_EN_OFF_ID    14
+#define SET_SW_CLK_EN_OFF_NAME  "set_sw_clk_en_off"
+#define GET_SW_CLK_EN_ID        15
+#define GET_SW_CLK_EN_NAME      "get_sw_clk_en"
+#define SET_SW_DIVCLK_ID        16
+#define SET_SW_DIVCLK_NAME      "set_sw_divclk"
+#define GET_SW_DIVCLK_ID        17
+#define GET_SW_DIVCLK_NAME      "get_sw_divclk"
+#define SET_SW_PHASECLK_ID      18
+#define SET_SW_PHASECLK_NAME    "set_sw_phaseclk"
+#define GET_SW_PHASECLK_ID      19
+#define GET_SW_PHASECLK_NAME    "get_sw_phaseclk"
+#define SET_WDW_ON_ID           20
+#define SET_WDW_ON_NAME         "set_wdw_on"
+#define SET_WDW_OFF_ID          21
+#define SET_WDW_OFF_NAME        "set_wdw_off"
+#define GET_WDW_ID              22
+#define GET_WDW_NAME            "get_wdw"
+#define SET_WDW_DLY_ID          23
+#define SET_WDW_DLY_NAME        "set_wdw_dly"
+#define GET_WDW_DLY_ID          24
+#define GET_WDW_DLY_NAME        "get_wdw_dly"
+#define SET_ADCCLK_ID           25
+#define SET_ADCCLK_NAME         "set_adc_clk"
+#define GET_ADCCLK_ID           26
+#define GET_ADCCLK_NAME         "get_adc_clk"
+#define SET_DDSFREQ_ID          27
+#define SET_DDSFREQ_NAME        "set_dds_freq"
+#define GET_DDSFREQ_ID          28
+#define GET_DDSFREQ_NAME        "get_dds_freq"
+#define SET_ACQ_PARAM_ID        29
+#define SET_ACQ_PARAM_NAME      "set_acq_param"
+#define GET_ACQ_SAMPLES_ID      30
+#define GET_ACQ_SAMPLES_NAME    "get_acq_samples"
+#define GET_ACQ_CHAN_ID         31
+#define GET_ACQ_CHAN_NAME       "get_acq_chan"
+#define SET_ACQ_START_ID        32
+#define SET_ACQ_START_NAME      "set_acq_start"
+#define END_ID                  33
+
+/***************************************************/
+/*************** Streaming CURVES ******************/
+/***************************************************/
+
+#define CURVE_MONIT_AMP_ID      0
+#define CURVE_MONIT_AMP_NAME    "monit_amp"
+#define CURVE_MONIT_POS_ID      1
+#define CURVE_MONIT_POS_NAME    "monit_pos"
+#define END_MONIT_ID            2
+
+/***************************************************/
+/*************** On-demand CURVES ******************/
+/***************************************************/
+// We have 5 curves declared in server:
+// 0 -> ADC, 1-> TBTAMP, 2 -> TBTPOS,
+// 3 -> FOFBAMP, 4 -> FOFBPOS
+#define CURVE_ADC_ID            0
+#define CURVE_ADC_NAME          "adc_curve"
+#define CURVE_TBTAMP_ID         1
+#define CURVE_TBTAMP_NAME       "tbtamp_curve"
+#define CURVE_TBTPOS_ID         2
+#define CURVE_TBTPOS_NAME       "tbtpos_curve"
+#define CURVE_FOFBAMP_ID        3
+#define CURVE_FOFBAMP_NAME      "fofbamp_curve"
+#define CURVE_FOFMPOS_ID        4
+#define CURVE_FOFBPOS_NAME      "fofbpos_curve"
+#define END_CURVE_ID            5
+
+// Data rate decimation of the curves relative to the ADC clock
+#define CURVE_ADC_DECIM         1
+#define CURVE_TBT_DECIM         35
+#define CURVE_FOFB_DECIM        1000
+
+/***************************************************/
+/*************** RFFE Functions * ******************/
+/***************************************************/
+
+#define SET_FE_SW_ON_ID         0
+#define SET_FE_SW_ON_NAME       "getset_fe_sw"
+#define SET_FE_SW_OFF_ID        (SET_FE_SW_ON_ID) // They are the same ID in FE server
+#define SET_FE_SW_OFF_NAME      SET_FE_SW_ON_NAME
+#define GET_FE_SW_ID            (SET_FE_SW_ON_ID) // The are the same ID in FE server
+#define GET_FE_SW_NAME          SET_FE_SW_ON_NAME
+//#define GETSET_FE_SW_LVL_ID     1
+//#define GETSET_FE_SW_LVL_NAME   "getset_sw_lvl"
+#define GETSET_FE_ATT1_ID       1
+#define GETSET_FE_ATT1_NAME     "getset_fe_att1"
+#define GETSET_FE_ATT2_ID       2
+#define GETSET_FE_ATT2_NAME     "getset_fe_att2"
+#define GET_FE_TEMP1_ID         3
+#define GET_FE_TEMP1_NAME       "get_fe_temp1"
+#define GET_FE_TEMP2_ID         4
+#define GET_FE_TEMP2_NAME       "get_fe_temp2"
+#define END_FE_ID               5
+
+// Some FE variable values
+#define FE_SW_OFF               0x1
+#define FE_SW_ON                0x3
+// Some FE corection factors
+#define FE_SW_DIV_FACTOR        2
+
 #endif
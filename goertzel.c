@@ -0,0 +1,122 @@
+// Sliding DFT (Goertzel) filter bank on the Monitoring stream
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "goertzel.h"
+
+int gtz_init (struct gtz_s *g, unsigned int nfreqs, const double *freq,
+        uint32_t win, uint32_t hop)
+{
+    unsigned int k;
+
+    memset (g, 0, sizeof *g);
+
+    if (!nfreqs || nfreqs > GTZ_MAX_FREQS || win < 2 || !hop) {
+        return -1;
+    }
+
+    g->hist = calloc (win, sizeof *g->hist);
+    if (!g->hist) {
+        perror ("gtz: calloc");
+        return -1;
+    }
+
+    g->nfreqs = nfreqs;
+    g->win = win;
+    g->hop = hop;
+
+    for (k = 0; k < nfreqs; ++k) {
+        // Lines above Nyquist show up at their alias
+        double w = fabs (freq[k] - floor (freq[k] + 0.5));
+
+        g->freq[k] = w;
+        g->c1[k] = cos (2*M_PI*w);
+        g->s1[k] = sin (2*M_PI*w);
+        g->cw[k] = cos (2*M_PI*w*win);
+        g->sw[k] = sin (2*M_PI*w*win);
+    }
+
+    return 0;
+}
+
+void gtz_free (struct gtz_s *g)
+{
+    free (g->hist);
+    g->hist = NULL;
+}
+
+/* X of every frequency summed again from the history, newest first */
+static void gtz_resync (struct gtz_s *g)
+{
+    unsigned int k;
+    uint32_t m;
+
+    for (k = 0; k < g->nfreqs; ++k) {
+        gtz_v4d_t re = {0}, im = {0};
+        double c = 1, s = 0;
+
+        for (m = 0; m < g->win; ++m) {
+            const gtz_v4d_t *x = &g->hist[(g->pos + g->win - 1 - m) % g->win];
+            double t = c*g->c1[k] - s*g->s1[k];
+
+            re += *x*c;
+            im += *x*s;
+            s = s*g->c1[k] + c*g->s1[k];
+            c = t;
+        }
+
+        g->re[k] = re;
+        g->im[k] = im;
+    }
+}
+
+static void gtz_line (const struct gtz_s *g, unsigned int k,
+        struct gtz_line_s *line)
+{
+    unsigned int c;
+
+    line->freq = g->freq[k];
+    for (c = 0; c < NUM_CHANNELS; ++c) {
+        // DC and Nyquist do not split between two bins
+        double scale = g->freq[k] == 0 || g->freq[k] == 0.5 ? 1.0 : 2.0;
+
+        line->mag[c] = scale*hypot (g->re[k][c], g->im[k][c])/g->win;
+        line->phase[c] = atan2 (g->im[k][c], g->re[k][c]);
+    }
+}
+
+unsigned int gtz_push (struct gtz_s *g, const plot_values_monit_uint32_t *val,
+        struct gtz_line_s *out)
+{
+    gtz_v4d_t x = {(int32_t) val->ch0, (int32_t) val->ch1,
+        (int32_t) val->ch2, (int32_t) val->ch3};
+    gtz_v4d_t old = g->hist[g->pos];
+    unsigned int k;
+
+    for (k = 0; k < g->nfreqs; ++k) {
+        gtz_v4d_t re = g->re[k], im = g->im[k];
+
+        g->re[k] = x + re*g->c1[k] - im*g->s1[k] - old*g->cw[k];
+        g->im[k] = re*g->s1[k] + im*g->c1[k] - old*g->sw[k];
+    }
+
+    g->hist[g->pos] = x;
+    g->pos = (g->pos + 1) % g->win;
+    ++g->n;
+
+    if (g->pos == 0) {
+        gtz_resync (g);
+    }
+
+    if (g->n < g->win || (g->n - g->win) % g->hop) {
+        return 0;
+    }
+
+    for (k = 0; k < g->nfreqs; ++k) {
+        gtz_line (g, k, &out[k]);
+    }
+
+    return g->nfreqs;
+}
@@ -0,0 +1,56 @@
+#ifndef _GOERTZEL_H_
+#define _GOERTZEL_H_
+
+#include <inttypes.h>
+
+#include "output.h"
+
+/* Bank of sliding DFT (Goertzel) filters on a 4-channel stream. For each
+ * frequency w [cycles/sample] the DFT of the last win samples is updated
+ * with every sample, in O(1) per frequency:
+ *  X(n) = x(n) + e^(j2pi*w)*X(n-1) - e^(j2pi*w*win)*x(n-win)
+ * with the phase taken at the newest sample. Rounding does not build up:
+ * each time the history wraps, X is summed again from it. Every hop
+ * samples, once win are in, a line per frequency is out. The four
+ * channels are processed together as one SIMD vector */
+#define GTZ_MAX_FREQS           8
+#define GTZ_DEFAULT_WIN         64 // samples
+
+typedef double gtz_v4d_t __attribute__ ((vector_size (NUM_CHANNELS*sizeof (double))));
+
+struct gtz_s {
+    unsigned int nfreqs;
+    double freq[GTZ_MAX_FREQS];     // cycles/sample
+    uint32_t win;
+    uint32_t hop;
+    double c1[GTZ_MAX_FREQS];       // e^(j2pi*w)
+    double s1[GTZ_MAX_FREQS];
+    double cw[GTZ_MAX_FREQS];       // e^(j2pi*w*win)
+    double sw[GTZ_MAX_FREQS];
+    gtz_v4d_t re[GTZ_MAX_FREQS];
+    gtz_v4d_t im[GTZ_MAX_FREQS];
+    gtz_v4d_t *hist;                // last win samples, a ring
+    uint32_t pos;                   // ring index of the oldest sample
+    uint64_t n;                     // samples so far
+};
+
+/* The line of one frequency: amplitude of a sinusoid at it and its phase
+ * at the newest sample [rad], per channel */
+struct gtz_line_s {
+    double freq;                    // cycles/sample
+    double mag[NUM_CHANNELS];
+    double phase[NUM_CHANNELS];
+};
+
+/* freq in cycles/sample, folded into [0, 0.5]. Returns -1 on bad
+ * parameters or if out of memory */
+int gtz_init (struct gtz_s *g, unsigned int nfreqs, const double *freq,
+        uint32_t win, uint32_t hop);
+void gtz_free (struct gtz_s *g);
+
+/* Adds a sample (monitoring words are signed). Returns the number of
+ * lines written to out: 0, or nfreqs when an output is due */
+unsigned int gtz_push (struct gtz_s *g, const plot_values_monit_uint32_t *val,
+        struct gtz_line_s *out);
+
+#endif
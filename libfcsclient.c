@@ -0,0 +1,760 @@
+// In-process FCS client: transport, BSMP sessions and readers
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#include "libfcsclient.h"
+#include "fcs_client.h"
+#include "output.h"
+#include "stats.h"
+#include "transport/transport.h"
+#include "transport/ethernet.h"
+#include "transport/serial_rs232.h"
+#include "transport/replay.h"
+#include "trace.h"
+#include "debug.h"
+
+#define PACKET_SIZE             BSMP_MAX_MESSAGE
+#define PACKET_HEADER           BSMP_HEADER_SIZE
+
+#define ARRAY_SIZE(x) (sizeof(x) / sizeof((x)[0]))
+
+struct fcs_session_s {
+    enum fcs_ep_e ep;
+    enum fcs_dev_e dev;
+    char hostname[FCS_HOSTNAME_LEN];
+    int timeout;                    // sec, on every receive. 0 -> none
+    unsigned int slot;              // of the BSMP callbacks
+    struct transport_s transport;
+    bsmp_client_t *client;
+    struct bsmp_func_info_list *funcs;
+    struct bsmp_var_info_list *vars;
+    struct bsmp_curve_info_list *curves;
+    uint8_t func_error;             // of the last function executed
+    uint64_t missed_deadlines;      // fcs_monit_stream () polls started late
+};
+
+// The public header does without the client's own headers
+_Static_assert ((int) FCS_EP_FPGA == STATS_EP_FPGA && (int) FCS_EP_FE == STATS_EP_FE,
+        "endpoints are the stats ones");
+_Static_assert (FCS_MONIT_AMP == CURVE_MONIT_AMP_ID &&
+        FCS_MONIT_POS == CURVE_MONIT_POS_ID, "Monitoring curves");
+_Static_assert (sizeof (struct fcs_monit_sample_s) ==
+        sizeof (plot_values_monit_uint32_t), "Monitoring samples");
+
+static const char *fcs_func_names[END_ID] = {
+    BLINK_FUNC_NAME, RESET_FUNC_NAME, GET_FMC_TEMP1_NAME, GET_FMC_TEMP2_NAME,
+    SET_KX_NAME, GET_KX_NAME, SET_KY_NAME, GET_KY_NAME, SET_KSUM_NAME,
+    GET_KSUM_NAME, SET_SW_ON_NAME, SET_SW_OFF_NAME, GET_SW_NAME,
+    SET_SW_CLK_EN_ON_NAME, SET_SW_CLK_EN_OFF_NAME, GET_SW_CLK_EN_NAME,
+    SET_SW_DIVCLK_NAME, GET_SW_DIVCLK_NAME, SET_SW_PHASECLK_NAME,
+    GET_SW_PHASECLK_NAME, SET_WDW_ON_NAME, SET_WDW_OFF_NAME, GET_WDW_NAME,
+    SET_WDW_DLY_NAME, GET_WDW_DLY_NAME, SET_ADCCLK_NAME, GET_ADCCLK_NAME,
+    SET_DDSFREQ_NAME, GET_DDSFREQ_NAME, SET_ACQ_PARAM_NAME,
+    GET_ACQ_SAMPLES_NAME, GET_ACQ_CHAN_NAME, SET_ACQ_START_NAME
+};
+
+/* Bytes of input and output of each function, those of the callers'
+ * buffers. A server declaring others is not this protocol */
+static const uint8_t fcs_func_sizes[END_ID][2] = {
+    {0, 0}, {0, 0}, {0, 8}, {0, 8},         // blink, reset, FMC temps
+    {4, 0}, {0, 4}, {4, 0}, {0, 4},         // Kx, Ky
+    {4, 0}, {0, 4},                         // Ksum
+    {0, 0}, {0, 0}, {0, 4},                 // switching
+    {0, 0}, {0, 0}, {0, 4},                 // switching clock
+    {4, 0}, {0, 4}, {4, 0}, {0, 4},         // divider, phase clocks
+    {0, 0}, {0, 0}, {0, 4}, {4, 0}, {0, 4}, // windowing
+    {4, 0}, {0, 4}, {4, 0}, {0, 4},         // ADC clock, DDS frequency
+    {8, 0}, {0, 4}, {0, 4}, {0, 0}          // acquisition
+};
+
+// The switching variable is a single one in the FE server
+static const char *fcs_var_names[END_FE_ID] = {
+    SET_FE_SW_ON_NAME, GETSET_FE_ATT1_NAME, GETSET_FE_ATT2_NAME,
+    GET_FE_TEMP1_NAME, GET_FE_TEMP2_NAME
+};
+
+static const char *fcs_curve_names[END_CURVE_ID + END_MONIT_ID] = {
+    CURVE_ADC_NAME, CURVE_TBTAMP_NAME, CURVE_TBTPOS_NAME, CURVE_FOFBAMP_NAME,
+    CURVE_FOFBPOS_NAME, CURVE_MONIT_AMP_NAME, CURVE_MONIT_POS_NAME
+};
+
+/***************************************************************/
+/*************************** Framing ***************************/
+/***************************************************************/
+
+static void print_packet (char* pre, uint8_t *data, uint32_t size)
+{
+#ifdef DEBUG
+    printf("%s: [", pre);
+
+    if(size < 32)
+    {
+        unsigned int i;
+        for(i = 0; i < size; ++i)
+            printf("%02X ", data[i]);
+        printf("]\n");
+    }
+    else
+        printf("%d bytes ]\n", size);
+#else
+    (void) pre;
+    (void) data;
+    (void) size;
+#endif
+}
+
+static int fcs_frame_send (enum stats_ep_e ep, int (*send_f)(int, uint8_t *, uint32_t *), int fd, uint8_t *data, uint32_t *count)
+{
+    uint8_t  packet[BSMP_MAX_MESSAGE];
+    uint32_t packet_size = *count;
+    uint32_t len = *count;
+    uint64_t t0 = stats_now ();
+
+    memcpy (packet, data, *count);
+
+    print_packet("SEND()", packet, packet_size);
+
+    if (!send_f) {
+        fprintf(stderr, "recv function not implemented!\n");
+        return -1;
+    }
+
+    int ret = send_f(fd, packet, &len);
+    DEBUGP ("bpm_send(%d): %d bytes sent!\n", fd, len);
+
+    stats_bytes (ep, len, 0);
+    stats_record (ep, STATS_OP_SEND, t0, len != packet_size);
+
+    if(len != packet_size) {
+        if(ret < 0)
+            perror("send");
+        return -1;
+    }
+
+    trace_frame (ep, TRACE_DIR_TX, packet, packet_size);
+
+    return 0;
+}
+
+static int fcs_frame_recv (enum stats_ep_e ep, int (*recv_f)(int, uint8_t *, uint32_t *), int fd, uint8_t *data, uint32_t *count)
+{
+    uint8_t packet[PACKET_SIZE] = {0};
+    uint32_t packet_size;
+    uint32_t len = PACKET_HEADER;
+    uint64_t t0 = stats_now ();
+
+    if (!recv_f) {
+        fprintf(stderr, "recv function not implemented!\n");
+        return -1;
+    }
+
+    int ret = recv_f(fd, packet, &len);
+    stats_bytes (ep, 0, len);
+    if(len != PACKET_HEADER) {
+        stats_record (ep, STATS_OP_RECV, t0, 1);
+        if(ret < 0)
+            perror("recv");
+        return -1;
+    }
+
+    DEBUGP ("bpm_recv(%d): received %d bytes (header)!\n", fd, PACKET_HEADER);
+
+    //uint32_t remaining = (packet[2] << 8) + packet[3];
+    uint32_t remaining = (packet[1] << 8) + packet[2];
+    len = remaining;
+
+    DEBUGP ("bpm_recv(%d): %d bytes to recv!\n", fd, remaining);
+
+    ret = recv_f(fd, packet + PACKET_HEADER, &len);
+    stats_bytes (ep, 0, len);
+    if(len != remaining) {
+        stats_record (ep, STATS_OP_RECV, t0, 1);
+        if(ret < 0)
+            perror("recv");
+        return -1;
+    }
+
+    stats_record (ep, STATS_OP_RECV, t0, 0);
+
+    DEBUGP("bpm_recv(%d) received payload!\n", fd);
+
+    packet_size = PACKET_HEADER + remaining;
+
+    print_packet("RECV", packet, packet_size);
+    trace_frame (ep, TRACE_DIR_RX, packet, packet_size);
+
+    *count = packet_size;
+    memcpy(data, packet, *count);
+
+    return 0;
+}
+
+/***************************************************************/
+/*********************** BSMP callbacks ************************/
+/***************************************************************/
+
+/* The BSMP callbacks take no context, so every open session gets a slot
+ * with a pair of callbacks of its own */
+static fcs_session_t *fcs_slots[FCS_MAX_SESSIONS];
+static pthread_mutex_t fcs_slots_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int fcs_slot_send (unsigned int slot, uint8_t *data, uint32_t *count)
+{
+    fcs_session_t *s = fcs_slots[slot];
+
+    return fcs_frame_send ((enum stats_ep_e) s->ep, s->transport.ops->bpm_send,
+            s->transport.fd, data, count);
+}
+
+static int fcs_slot_recv (unsigned int slot, uint8_t *data, uint32_t *count)
+{
+    fcs_session_t *s = fcs_slots[slot];
+
+    return fcs_frame_recv ((enum stats_ep_e) s->ep, s->transport.ops->bpm_recv,
+            s->transport.fd, data, count);
+}
+
+#define FCS_SLOT(n) \
+    static int fcs_slot_send_##n (uint8_t *data, uint32_t *count) \
+    { return fcs_slot_send (n, data, count); } \
+    static int fcs_slot_recv_##n (uint8_t *data, uint32_t *count) \
+    { return fcs_slot_recv (n, data, count); }
+
+FCS_SLOT(0)  FCS_SLOT(1)  FCS_SLOT(2)  FCS_SLOT(3)
+FCS_SLOT(4)  FCS_SLOT(5)  FCS_SLOT(6)  FCS_SLOT(7)
+FCS_SLOT(8)  FCS_SLOT(9)  FCS_SLOT(10) FCS_SLOT(11)
+FCS_SLOT(12) FCS_SLOT(13) FCS_SLOT(14) FCS_SLOT(15)
+
+#define FCS_SLOT_OPS(n) {fcs_slot_send_##n, fcs_slot_recv_##n}
+
+static const struct {
+    bsmp_comm_func_t send;
+    bsmp_comm_func_t recv;
+} fcs_slot_ops[] = {
+    FCS_SLOT_OPS(0),  FCS_SLOT_OPS(1),  FCS_SLOT_OPS(2),  FCS_SLOT_OPS(3),
+    FCS_SLOT_OPS(4),  FCS_SLOT_OPS(5),  FCS_SLOT_OPS(6),  FCS_SLOT_OPS(7),
+    FCS_SLOT_OPS(8),  FCS_SLOT_OPS(9),  FCS_SLOT_OPS(10), FCS_SLOT_OPS(11),
+    FCS_SLOT_OPS(12), FCS_SLOT_OPS(13), FCS_SLOT_OPS(14), FCS_SLOT_OPS(15)
+};
+
+_Static_assert (ARRAY_SIZE(fcs_slot_ops) == FCS_MAX_SESSIONS,
+        "a callback pair is needed for every session");
+
+static int fcs_slot_get (fcs_session_t *s)
+{
+    unsigned int i;
+
+    pthread_mutex_lock (&fcs_slots_lock);
+    for (i = 0; i < FCS_MAX_SESSIONS && fcs_slots[i]; ++i);
+    if (i < FCS_MAX_SESSIONS) {
+        fcs_slots[i] = s;
+        s->slot = i;
+    }
+    pthread_mutex_unlock (&fcs_slots_lock);
+
+    return i < FCS_MAX_SESSIONS ? 0 : -1;
+}
+
+static void fcs_slot_put (fcs_session_t *s)
+{
+    pthread_mutex_lock (&fcs_slots_lock);
+    fcs_slots[s->slot] = NULL;
+    pthread_mutex_unlock (&fcs_slots_lock);
+}
+
+/***************************************************************/
+/*************************** Sessions **************************/
+/***************************************************************/
+
+static void fcs_transport_init (enum fcs_dev_e dev, struct transport_s *transport)
+{
+    switch (dev) {
+        case FCS_DEV_SERIAL_RS232:
+            transport->ops = &serial_rs232_ops;
+            break;
+
+        case FCS_DEV_REPLAY:
+            transport->ops = &replay_ops;
+            break;
+
+        // Ethernet is default
+        default:
+            transport->ops = &ethernet_ops;
+    }
+}
+
+static char *fcs_port (fcs_session_t *s)
+{
+    return s->ep == FCS_EP_FE ? FCS_FE_PORT : FCS_FPGA_PORT;
+}
+
+/* The lists belong to the client, so they go with it */
+static void fcs_disconnect (fcs_session_t *s)
+{
+    if (s->client) {
+        bsmp_client_destroy (s->client);
+        s->client = NULL;
+        close (s->transport.fd);
+    }
+
+    s->funcs = NULL;
+    s->vars = NULL;
+    s->curves = NULL;
+}
+
+/* Connects the transport and sets the BSMP session up over it */
+static int fcs_connect (fcs_session_t *s)
+{
+    struct timeval tv = {s->timeout, 0};
+
+    if (s->transport.ops->bpm_connection(&s->transport.fd, s->hostname,
+                fcs_port (s)) < 0) {
+        return FCS_ERR_CONNECT;
+    }
+
+    // Bounds every receive, so a server that accepts but never serves
+    // the connection is detected
+    if (s->timeout && s->dev == FCS_DEV_ETHERNET) {
+        setsockopt (s->transport.fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof tv);
+    }
+
+    s->client = bsmp_client_new(fcs_slot_ops[s->slot].send,
+            fcs_slot_ops[s->slot].recv);
+    if (!s->client) {
+        close (s->transport.fd);
+        return FCS_ERR_CONNECT;
+    }
+
+    if (bsmp_client_init(s->client) ||
+            bsmp_get_funcs_list(s->client, &s->funcs) ||
+            bsmp_get_vars_list(s->client, &s->vars) ||
+            bsmp_get_curves_list(s->client, &s->curves)) {
+        fcs_disconnect (s);
+        return FCS_ERR_CONNECT;
+    }
+
+    return FCS_OK;
+}
+
+fcs_session_t *fcs_open (enum fcs_ep_e ep, enum fcs_dev_e dev,
+        const char *hostname, int timeout)
+{
+    fcs_session_t *s = calloc (1, sizeof *s);
+
+    if (!s) {
+        perror ("fcs_open: calloc");
+        return NULL;
+    }
+
+    s->ep = ep;
+    s->dev = dev;
+    s->timeout = timeout;
+    snprintf (s->hostname, sizeof s->hostname, "%s", hostname ? hostname : "");
+    fcs_transport_init (dev, &s->transport);
+
+    if (fcs_slot_get (s) < 0) {
+        fprintf (stderr, "fcs_open: more than %d sessions\n", FCS_MAX_SESSIONS);
+        free (s);
+        return NULL;
+    }
+
+    if (fcs_connect (s) != FCS_OK) {
+        DEBUGP ("fcs_open: no BSMP session with %s:%s\n", s->hostname,
+                fcs_port (s));
+        fcs_slot_put (s);
+        free (s);
+        return NULL;
+    }
+
+    trace_frame ((enum stats_ep_e) ep, TRACE_DIR_CONNECT, (uint8_t *) fcs_port (s),
+            strlen (fcs_port (s)));
+    DEBUGP ("fcs_open: session %u with %s:%s\n", s->slot, s->hostname, fcs_port (s));
+
+    return s;
+}
+
+void fcs_close (fcs_session_t *s)
+{
+    if (!s) {
+        return;
+    }
+
+    fcs_disconnect (s);
+    fcs_slot_put (s);
+    free (s);
+}
+
+int fcs_reconnect (fcs_session_t *s, volatile sig_atomic_t *stop)
+{
+    useconds_t delay = FCS_RECONNECT_MIN_DELAY;
+
+    fcs_disconnect (s);
+
+    while (!stop || !*stop) {
+        if (fcs_connect (s) == FCS_OK) {
+            return FCS_OK;
+        }
+
+        usleep (delay);
+        delay = delay*2 > FCS_RECONNECT_MAX_DELAY ? FCS_RECONNECT_MAX_DELAY : delay*2;
+    }
+
+    return FCS_ERR_INTERRUPTED;
+}
+
+bsmp_client_t *fcs_bsmp (fcs_session_t *s)
+{
+    return s ? s->client : NULL;
+}
+
+const char *fcs_hostname (const fcs_session_t *s)
+{
+    return s->hostname;
+}
+
+uint64_t fcs_missed_deadlines (const fcs_session_t *s)
+{
+    return s->missed_deadlines;
+}
+
+/***************************************************************/
+/**************************** Names ****************************/
+/***************************************************************/
+
+static int fcs_find (const char **names, unsigned int count, const char *name)
+{
+    unsigned int i;
+
+    for (i = 0; i < count; ++i) {
+        if (strcmp (names[i], name) == 0) {
+            return i;
+        }
+    }
+
+    return FCS_ERR_NAME;
+}
+
+int fcs_func_id (const char *name)
+{
+    return fcs_find (fcs_func_names, ARRAY_SIZE(fcs_func_names), name);
+}
+
+int fcs_var_id (const char *name)
+{
+    return fcs_find (fcs_var_names, ARRAY_SIZE(fcs_var_names), name);
+}
+
+int fcs_curve_id (const char *name)
+{
+    return fcs_find (fcs_curve_names, ARRAY_SIZE(fcs_curve_names), name);
+}
+
+const char *fcs_func_name (unsigned int id)
+{
+    return id < ARRAY_SIZE(fcs_func_names) ? fcs_func_names[id] : NULL;
+}
+
+const char *fcs_var_name (unsigned int id)
+{
+    return id < ARRAY_SIZE(fcs_var_names) ? fcs_var_names[id] : NULL;
+}
+
+const char *fcs_curve_name (unsigned int id)
+{
+    return id < ARRAY_SIZE(fcs_curve_names) ? fcs_curve_names[id] : NULL;
+}
+
+/***************************************************************/
+/************************ Entity access ************************/
+/***************************************************************/
+
+int fcs_func_execute_id (fcs_session_t *s, unsigned int id, const void *input,
+        void *output)
+{
+    uint8_t in[BSMP_MAX_MESSAGE] = {0};
+    uint8_t out[BSMP_MAX_MESSAGE];
+    struct bsmp_func_info *func;
+    enum bsmp_err err;
+
+    if (!s->client) {
+        return FCS_ERR_CONNECT;
+    }
+
+    if (id >= s->funcs->count || id >= END_ID) {
+        return FCS_ERR_NAME;
+    }
+
+    // libbsmp takes non-const buffers of the declared sizes
+    func = &s->funcs->list[id];
+    if (func->input_size != fcs_func_sizes[id][0] ||
+            func->output_size != fcs_func_sizes[id][1]) {
+        DEBUGP ("fcs_func_execute_id: %s takes %u and returns %u bytes, "
+                "not %u and %u\n", fcs_func_names[id], func->input_size,
+                func->output_size, fcs_func_sizes[id][0], fcs_func_sizes[id][1]);
+        return FCS_ERR_SIZE;
+    }
+    if (input) {
+        memcpy (in, input, func->input_size);
+    }
+
+    err = STATS_TIMED((enum stats_ep_e) s->ep, STATS_OP_FUNC_EXECUTE,
+            bsmp_func_execute(s->client, func, &s->func_error, in, out));
+    if (err) {
+        return err;
+    }
+
+    if (output) {
+        memcpy (output, out, func->output_size);
+    }
+
+    return s->func_error ? FCS_ERR_FUNC : FCS_OK;
+}
+
+int fcs_func_size (fcs_session_t *s, unsigned int id, uint32_t *input_size,
+        uint32_t *output_size)
+{
+    if (!s->client) {
+        return FCS_ERR_CONNECT;
+    }
+
+    if (id >= s->funcs->count) {
+        return FCS_ERR_NAME;
+    }
+
+    *input_size = s->funcs->list[id].input_size;
+    *output_size = s->funcs->list[id].output_size;
+
+    return FCS_OK;
+}
+
+int fcs_func_execute (fcs_session_t *s, const char *name, const void *input,
+        void *output)
+{
+    int id = fcs_func_id (name);
+
+    return id < 0 ? id : fcs_func_execute_id (s, id, input, output);
+}
+
+int fcs_var_read (fcs_session_t *s, const char *name, void *val)
+{
+    int id = fcs_var_id (name);
+
+    if (!s->client) {
+        return FCS_ERR_CONNECT;
+    }
+
+    if (id < 0 || (uint32_t) id >= s->vars->count) {
+        return FCS_ERR_NAME;
+    }
+
+    return STATS_TIMED((enum stats_ep_e) s->ep, STATS_OP_READ_VAR,
+            bsmp_read_var(s->client, &s->vars->list[id], val));
+}
+
+int fcs_var_write (fcs_session_t *s, const char *name, const void *val)
+{
+    uint8_t buf[BSMP_MAX_MESSAGE];
+    int id = fcs_var_id (name);
+
+    if (!s->client) {
+        return FCS_ERR_CONNECT;
+    }
+
+    if (id < 0 || (uint32_t) id >= s->vars->count) {
+        return FCS_ERR_NAME;
+    }
+
+    memcpy (buf, val, s->vars->list[id].size);
+
+    return STATS_TIMED((enum stats_ep_e) s->ep, STATS_OP_WRITE_VAR,
+            bsmp_write_var(s->client, &s->vars->list[id], buf));
+}
+
+int fcs_var_size (fcs_session_t *s, const char *name)
+{
+    int id = fcs_var_id (name);
+
+    if (!s->client) {
+        return FCS_ERR_CONNECT;
+    }
+
+    if (id < 0 || (uint32_t) id >= s->vars->count) {
+        return FCS_ERR_NAME;
+    }
+
+    return s->vars->list[id].size;
+}
+
+uint32_t fcs_curve_size (fcs_session_t *s, unsigned int id)
+{
+    if (!s->client || id >= s->curves->count) {
+        return 0;
+    }
+
+    return s->curves->list[id].block_size*s->curves->list[id].nblocks;
+}
+
+int fcs_curve_read (fcs_session_t *s, unsigned int id, uint8_t *buf,
+        uint32_t size, uint32_t *len)
+{
+    uint32_t curve_size;
+
+    if (!s->client) {
+        return FCS_ERR_CONNECT;
+    }
+
+    curve_size = fcs_curve_size (s, id);
+    if (curve_size == 0) {
+        return FCS_ERR_NAME;
+    }
+
+    // libbsmp writes up to the declared size
+    if (size < curve_size) {
+        return FCS_ERR_SIZE;
+    }
+
+    return STATS_TIMED((enum stats_ep_e) s->ep, STATS_OP_READ_CURVE,
+            bsmp_read_curve(s->client, &s->curves->list[id], buf, len));
+}
+
+uint32_t fcs_curve_block_size (fcs_session_t *s, unsigned int id)
+{
+    if (!s->client || id >= s->curves->count) {
+        return 0;
+    }
+
+    return s->curves->list[id].block_size;
+}
+
+int fcs_curve_read_block (fcs_session_t *s, unsigned int id, uint16_t block,
+        uint8_t *buf, uint16_t *len)
+{
+    if (!s->client) {
+        return FCS_ERR_CONNECT;
+    }
+
+    if (id >= s->curves->count || block >= s->curves->list[id].nblocks) {
+        return FCS_ERR_NAME;
+    }
+
+    return bsmp_request_curve_block (s->client, &s->curves->list[id], block,
+            buf, len);
+}
+
+/***************************************************************/
+/************************** Streaming **************************/
+/***************************************************************/
+
+/* Sleeps until the next poll deadline. Deadlines are absolute, so the
+ * read and callback times do not add up to the poll period. If we are
+ * late, the deadline is counted as missed and the schedule restarts */
+static void fcs_monit_wait (fcs_session_t *s, struct timespec *deadline,
+        uint32_t period_us)
+{
+    struct timespec now;
+    uint64_t next_ns, now_ns;
+
+    deadline->tv_nsec += (period_us % 1000000)*1000;
+    deadline->tv_sec += period_us/1000000 + deadline->tv_nsec/1000000000;
+    deadline->tv_nsec %= 1000000000;
+
+    clock_gettime (CLOCK_MONOTONIC, &now);
+    next_ns = (uint64_t) deadline->tv_sec*1000000000 + deadline->tv_nsec;
+    now_ns = (uint64_t) now.tv_sec*1000000000 + now.tv_nsec;
+
+    if (now_ns > next_ns) {
+        s->missed_deadlines++;
+        *deadline = now;
+        return;
+    }
+
+    // EINTR (SIGINT, SIGUSR1) just ends the wait early
+    clock_nanosleep (CLOCK_MONOTONIC, TIMER_ABSTIME, deadline, NULL);
+}
+
+int fcs_monit_stream (fcs_session_t *s, unsigned int monit_id,
+        uint32_t period_us, fcs_monit_cb_t cb, void *arg)
+{
+    unsigned int id = END_CURVE_ID + monit_id;
+    struct fcs_monit_sample_s val;
+    struct timespec deadline, ts;
+    uint32_t size, len;
+    uint8_t *buf;
+    int err;
+
+    if (!s->client) {
+        return FCS_ERR_CONNECT;
+    }
+
+    if (monit_id >= END_MONIT_ID || id >= s->curves->count) {
+        return FCS_ERR_NAME;
+    }
+
+    // A sample, but libbsmp may write up to the declared curve size
+    size = fcs_curve_size (s, id);
+    buf = malloc (size > sizeof val ? size : sizeof val);
+    if (!buf) {
+        return BSMP_ERR_OUT_OF_MEMORY;
+    }
+
+    clock_gettime (CLOCK_MONOTONIC, &deadline);
+
+    for (;;) {
+        err = STATS_TIMED((enum stats_ep_e) s->ep, STATS_OP_READ_CURVE,
+                bsmp_read_curve(s->client, &s->curves->list[id], buf, &len));
+        if (err) {
+            break;
+        }
+
+        // A block short of a sample is not one
+        if (len < sizeof val) {
+            err = FCS_ERR_SIZE;
+            break;
+        }
+
+        memcpy (&val, buf, sizeof val);
+        clock_gettime (CLOCK_REALTIME, &ts);
+        if (cb (arg, &val, &ts)) {
+            break;
+        }
+
+        if (period_us) {
+            fcs_monit_wait (s, &deadline, period_us);
+        }
+    }
+
+    free (buf);
+
+    return err;
+}
+
+int fcs_error_link (int err)
+{
+    return err == FCS_ERR_CONNECT || err == BSMP_ERR_COMM;
+}
+
+const char *fcs_error_str (int err)
+{
+    switch (err) {
+        case FCS_OK:
+            return "Success";
+        case FCS_ERR_CONNECT:
+            return "Connection failed";
+        case FCS_ERR_NAME:
+            return "No such function, variable or curve";
+        case FCS_ERR_SIZE:
+            return "Buffer too small or size mismatch";
+        case FCS_ERR_FUNC:
+            return "Function returned an error";
+        case FCS_ERR_INTERRUPTED:
+            return "Interrupted";
+        default:
+            return bsmp_error_str((enum bsmp_err) err);
+    }
+}
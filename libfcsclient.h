@@ -0,0 +1,116 @@
+#ifndef _LIBFCSCLIENT_H_
+#define _LIBFCSCLIENT_H_
+
+#include <signal.h>
+#include <time.h>
+#include <inttypes.h>
+
+#include <bsmp/client.h>
+
+/* In-process client API (libfcsclient.a/.so). A session is one BSMP
+ * connection to the FPGA or the RFFE server. Sessions are independent, but
+ * a session must only be used by one thread at a time. This header is all
+ * a program linking the library needs */
+#define FCS_FPGA_PORT           "8080"
+#define FCS_FE_PORT             "6791"
+#define FCS_MAX_SESSIONS        16 // open at the same time
+#define FCS_HOSTNAME_LEN        256
+#define FCS_RECONNECT_MIN_DELAY 100000 // usec
+#define FCS_RECONNECT_MAX_DELAY 5000000 // usec
+
+/* Monitoring curves, for fcs_monit_stream () */
+#define FCS_MONIT_AMP           0
+#define FCS_MONIT_POS           1
+
+enum fcs_ep_e {
+    FCS_EP_FPGA = 0,
+    FCS_EP_FE
+};
+
+enum fcs_dev_e {
+    FCS_DEV_ETHERNET = 0,
+    FCS_DEV_SERIAL_RS232,
+    FCS_DEV_REPLAY                  // frames from replay_open ()
+};
+
+/* Besides these, functions return BSMP errors (enum bsmp_err, > 0). After
+ * a failed fcs_reconnect (), they return FCS_ERR_CONNECT */
+#define FCS_OK                  0
+#define FCS_ERR_CONNECT         -1 // connection or BSMP session setup failed
+#define FCS_ERR_NAME            -2 // no such function, variable or curve
+#define FCS_ERR_SIZE            -3 // caller buffer too small, a short sample,
+                                   // or a function of other sizes
+#define FCS_ERR_FUNC            -4 // the function returned an error code
+#define FCS_ERR_INTERRUPTED     -5
+
+typedef struct fcs_session_s fcs_session_t;
+
+/* A Monitoring sample: A, B, C, D or X, Y, Q, Sum */
+struct fcs_monit_sample_s {
+    uint32_t ch0;
+    uint32_t ch1;
+    uint32_t ch2;
+    uint32_t ch3;
+};
+
+/* Called with every monitoring sample. A non-zero return stops the stream */
+typedef int (*fcs_monit_cb_t) (void *arg, const struct fcs_monit_sample_s *val,
+        const struct timespec *ts);
+
+/* Returns NULL on failure */
+fcs_session_t *fcs_open (enum fcs_ep_e ep, enum fcs_dev_e dev,
+        const char *hostname, int timeout);
+void fcs_close (fcs_session_t *s);
+/* Reconnects, backing off exponentially, until it works or *stop is set */
+int fcs_reconnect (fcs_session_t *s, volatile sig_atomic_t *stop);
+/* For direct libbsmp calls. NULL while disconnected */
+bsmp_client_t *fcs_bsmp (fcs_session_t *s);
+const char *fcs_hostname (const fcs_session_t *s);
+/* fcs_monit_stream () polls started late, over the session */
+uint64_t fcs_missed_deadlines (const fcs_session_t *s);
+
+/* Name <-> ID. IDs are those the servers list entities by; monitoring
+ * curves come after the on-demand ones */
+int fcs_func_id (const char *name);
+int fcs_var_id (const char *name);
+int fcs_curve_id (const char *name);
+const char *fcs_func_name (unsigned int id);
+const char *fcs_var_name (unsigned int id);
+const char *fcs_curve_name (unsigned int id);
+
+/* input and output hold as many bytes as the function takes and returns
+ * (4 per argument, 8 for the FMC temperatures); either can be NULL if
+ * there are none. A server declaring other sizes gets FCS_ERR_SIZE */
+int fcs_func_execute (fcs_session_t *s, const char *name, const void *input,
+        void *output);
+int fcs_func_execute_id (fcs_session_t *s, unsigned int id, const void *input,
+        void *output);
+/* Bytes of input and output of function id */
+int fcs_func_size (fcs_session_t *s, unsigned int id, uint32_t *input_size,
+        uint32_t *output_size);
+int fcs_var_read (fcs_session_t *s, const char *name, void *val);
+int fcs_var_write (fcs_session_t *s, const char *name, const void *val);
+/* Bytes of the variable, or an error (< 0) */
+int fcs_var_size (fcs_session_t *s, const char *name);
+
+/* Largest curve id can be, in bytes. 0 if there is no such curve */
+uint32_t fcs_curve_size (fcs_session_t *s, unsigned int id);
+int fcs_curve_read (fcs_session_t *s, unsigned int id, uint8_t *buf,
+        uint32_t size, uint32_t *len);
+/* Bytes of each block of curve id, 0 if there is no such curve */
+uint32_t fcs_curve_block_size (fcs_session_t *s, unsigned int id);
+/* One block, for reading only part of a curve or acting between blocks.
+ * buf holds a block */
+int fcs_curve_read_block (fcs_session_t *s, unsigned int id, uint16_t block,
+        uint8_t *buf, uint16_t *len);
+
+/* Reads monitoring curve monit_id (FCS_MONIT_*) every period_us
+ * (0 -> back to back) until cb stops it (returns FCS_OK) or a read fails */
+int fcs_monit_stream (fcs_session_t *s, unsigned int monit_id,
+        uint32_t period_us, fcs_monit_cb_t cb, void *arg);
+
+/* Non-zero if err is of the connection, which fcs_reconnect () may fix */
+int fcs_error_link (int err);
+const char *fcs_error_str (int err);
+
+#endif
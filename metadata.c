@@ -0,0 +1,433 @@
+// Experiment metadata: parsing, typed values and rendering
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "metadata.h"
+
+#define MD_MIN_CAP              64 // entries
+
+void md_init (struct md_s *md)
+{
+    memset (md, 0, sizeof *md);
+}
+
+void md_free (struct md_s *md)
+{
+    uint32_t i;
+
+    for (i = 0; i < md->n; ++i) {
+        free (md->entry[i].value);
+    }
+    free (md->pool);
+    free (md->entry);
+    free (md->order);
+    free (md->hash);
+    memset (md, 0, sizeof *md);
+}
+
+const char *md_key (const struct md_s *md, const struct md_entry_s *e)
+{
+    return md->pool + e->key;
+}
+
+const struct md_entry_s *md_sorted (const struct md_s *md, uint32_t i)
+{
+    return &md->entry[md->order[i]];
+}
+
+/***************************************************************/
+/************************* Key table ***************************/
+/***************************************************************/
+
+/* FNV-1a */
+uint32_t md_hash (const char *key, uint32_t len)
+{
+    uint32_t h = 2166136261u, i;
+
+    for (i = 0; i < len; ++i) {
+        h = (h ^ (uint8_t) key[i])*16777619u;
+    }
+
+    return h;
+}
+
+/* Slot of key: its entry, or the empty one it would take */
+static uint32_t md_slot (const struct md_s *md, const char *key, uint32_t len)
+{
+    uint32_t mask = md->hash_cap - 1, s = md_hash (key, len) & mask;
+
+    while (md->hash[s]) {
+        const struct md_entry_s *e = &md->entry[md->hash[s] - 1];
+
+        if (e->key_len == len && !memcmp (md->pool + e->key, key, len)) {
+            break;
+        }
+        s = (s + 1) & mask;
+    }
+
+    return s;
+}
+
+static int md_grow (struct md_s *md)
+{
+    uint32_t cap = md->cap ? 2*md->cap : MD_MIN_CAP, i;
+    struct md_entry_s *entry;
+    uint32_t *order, *hash;
+
+    entry = realloc (md->entry, cap*sizeof *entry);
+    if (entry) {
+        md->entry = entry;
+    }
+    order = realloc (md->order, cap*sizeof *order);
+    if (order) {
+        md->order = order;
+    }
+    hash = calloc (4*cap, sizeof *hash);
+    if (!entry || !order || !hash) {
+        free (hash);
+        return -1;
+    }
+
+    free (md->hash);
+    md->hash = hash;
+    md->hash_cap = 4*cap;
+    md->cap = cap;
+
+    for (i = 0; i < md->n; ++i) {
+        const struct md_entry_s *e = &md->entry[i];
+
+        md->hash[md_slot (md, md->pool + e->key, e->key_len)] = i + 1;
+    }
+
+    return 0;
+}
+
+static int md_intern (struct md_s *md, const char *key, uint32_t len,
+        uint32_t *off)
+{
+    if (md->pool_len + len + 1 > md->pool_cap) {
+        uint32_t cap = md->pool_cap ? md->pool_cap : 1024;
+        char *pool;
+
+        while (md->pool_len + len + 1 > cap) {
+            cap *= 2;
+        }
+        pool = realloc (md->pool, cap);
+        if (!pool) {
+            return -1;
+        }
+        md->pool = pool;
+        md->pool_cap = cap;
+    }
+
+    *off = md->pool_len;
+    memcpy (md->pool + md->pool_len, key, len);
+    md->pool[md->pool_len + len] = '\0';
+    md->pool_len += len + 1;
+
+    return 0;
+}
+
+static int md_cmp (const char *a, uint32_t alen, const char *b, uint32_t blen)
+{
+    int c = memcmp (a, b, alen < blen ? alen : blen);
+
+    return c ? c : (alen > blen) - (alen < blen);
+}
+
+int md_number (const char *text, double *num, char *unit)
+{
+    const char *p = text;
+    char *end;
+    size_t n;
+
+    if (!(isdigit ((unsigned char) *p) || *p == '-' || *p == '+' || *p == '.')) {
+        return 0;
+    }
+
+    *num = strtod (p, &end);
+    if (end == p) {
+        return 0;
+    }
+
+    for (p = end; *p == ' ' || *p == '\t'; ++p);
+    for (n = 0; isalpha ((unsigned char) p[n]) || p[n] == '%'; ++n);
+    if (p[n] != '\0' || n >= MD_UNIT_LEN) {
+        return 0;
+    }
+
+    memcpy (unit, p, n);
+    unit[n] = '\0';
+
+    return 1;
+}
+
+static void md_type (struct md_entry_s *e)
+{
+    e->type = md_number (e->value, &e->num, e->unit) ? MD_NUMBER : MD_TEXT;
+    if (e->type == MD_TEXT) {
+        e->num = 0;
+        e->unit[0] = '\0';
+    }
+}
+
+static int md_set_n (struct md_s *md, const char *key, uint32_t klen,
+        const char *value, size_t vlen)
+{
+    struct md_entry_s *e;
+    uint32_t s, lo, hi;
+    char *v = malloc (vlen + 1);
+
+    if (!v) {
+        return -1;
+    }
+    memcpy (v, value, vlen);
+    v[vlen] = '\0';
+
+    if (md->hash_cap) {
+        s = md_slot (md, key, klen);
+        if (md->hash[s]) {
+            e = &md->entry[md->hash[s] - 1];
+            free (e->value);
+            e->value = v;
+            md_type (e);
+            return 0;
+        }
+    }
+
+    if (md->n == md->cap && md_grow (md) < 0) {
+        free (v);
+        return -1;
+    }
+
+    e = &md->entry[md->n];
+    if (md_intern (md, key, klen, &e->key) < 0) {
+        free (v);
+        return -1;
+    }
+    e->key_len = klen;
+    e->value = v;
+    md_type (e);
+
+    // Into the key order, after the keys below it
+    for (lo = 0, hi = md->n; lo < hi;) {
+        uint32_t mid = (lo + hi)/2;
+        const struct md_entry_s *m = &md->entry[md->order[mid]];
+
+        if (md_cmp (md->pool + m->key, m->key_len, key, klen) < 0) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+    memmove (md->order + lo + 1, md->order + lo,
+            (md->n - lo)*sizeof *md->order);
+    md->order[lo] = md->n;
+
+    md->hash[md_slot (md, key, klen)] = ++md->n;
+
+    return 0;
+}
+
+int md_set (struct md_s *md, const char *key, const char *value)
+{
+    return md_set_n (md, key, strlen (key), value, strlen (value));
+}
+
+const struct md_entry_s *md_get (const struct md_s *md, const char *key)
+{
+    uint32_t s;
+
+    if (!md->hash_cap) {
+        return NULL;
+    }
+
+    s = md_slot (md, key, strlen (key));
+
+    return md->hash[s] ? &md->entry[md->hash[s] - 1] : NULL;
+}
+
+/***************************************************************/
+/*************************** Parsing ***************************/
+/***************************************************************/
+
+/* [*b, *e) without the blanks around it */
+static void md_strip (const char **b, const char **e)
+{
+    while (*b < *e && isspace ((unsigned char) **b)) {
+        ++*b;
+    }
+    while (*e > *b && isspace ((unsigned char) (*e)[-1])) {
+        --*e;
+    }
+}
+
+int md_parse (struct md_s *md, const char *text, size_t len)
+{
+    const char *line = text, *end = text + len;
+
+    while (line < end) {
+        const char *eol = memchr (line, '\n', end - line);
+        const char *stop, *eq, *kb, *ke, *vb, *ve;
+
+        eol = eol ? eol : end;
+        stop = memchr (line, MD_COMMENT_CHAR, eol - line);
+        stop = stop ? stop : eol;
+        eq = memchr (line, MD_OPTION_CHAR, stop - line);
+
+        if (eq) {
+            kb = line;
+            ke = eq;
+            vb = eq + 1;
+            ve = stop;
+            md_strip (&kb, &ke);
+            md_strip (&vb, &ve);
+            if (md_set_n (md, kb, ke - kb, vb, ve - vb) < 0) {
+                return -1;
+            }
+        }
+
+        line = eol + 1;
+    }
+
+    return 0;
+}
+
+int md_load (struct md_s *md, const char *path)
+{
+    FILE *f = fopen (path, "rb");
+    char *text = NULL;
+    size_t len = 0, cap = 0, n;
+    int err = 0;
+
+    if (!f) {
+        return -1;
+    }
+
+    do {
+        if (len == cap) {
+            char *t = realloc (text, cap = cap ? 2*cap : 4096);
+
+            if (!t) {
+                err = -1;
+                break;
+            }
+            text = t;
+        }
+        n = fread (text + len, 1, cap - len, f);
+        len += n;
+    } while (n);
+
+    if (ferror (f)) {
+        err = -1;
+    }
+    fclose (f);
+
+    if (!err) {
+        err = md_parse (md, text, len);
+    }
+    free (text);
+
+    return err;
+}
+
+/***************************************************************/
+/************************** Rendering **************************/
+/***************************************************************/
+
+static char *md_line (char *p, const struct md_s *md,
+        const struct md_entry_s *e)
+{
+    size_t vlen = strlen (e->value);
+
+    memcpy (p, md->pool + e->key, e->key_len);
+    p += e->key_len;
+    memcpy (p, " = ", 3);
+    p += 3;
+    memcpy (p, e->value, vlen);
+    p += vlen;
+    *p++ = '\n';
+
+    return p;
+}
+
+char *md_render (const struct md_s *md, const struct md_s *extra,
+        size_t *len)
+{
+    uint32_t i = 0, j = 0, nx = extra ? extra->n : 0;
+    size_t size = 1;
+    char *text, *p;
+
+    for (i = 0; i < md->n; ++i) {
+        size += md->entry[i].key_len + 4 + strlen (md->entry[i].value);
+    }
+    for (j = 0; j < nx; ++j) {
+        size += extra->entry[j].key_len + 4 + strlen (extra->entry[j].value);
+    }
+
+    text = malloc (size);
+    if (!text) {
+        return NULL;
+    }
+
+    // Both already sorted: merged
+    for (i = 0, j = 0, p = text; i < md->n || j < nx;) {
+        const struct md_entry_s *a = i < md->n ? md_sorted (md, i) : NULL;
+        const struct md_entry_s *b = j < nx ? md_sorted (extra, j) : NULL;
+        int c = !a ? 1 : !b ? -1 : md_cmp (md->pool + a->key, a->key_len,
+                extra->pool + b->key, b->key_len);
+
+        if (c < 0) {
+            p = md_line (p, md, a);
+            ++i;
+        }
+        else {
+            p = md_line (p, extra, b);
+            i += c == 0;
+            ++j;
+        }
+    }
+    *p = '\0';
+
+    *len = p - text;
+    return text;
+}
+
+int md_write (const struct md_s *md, const struct md_s *extra,
+        const char *path)
+{
+    size_t len, off = 0;
+    char *text = md_render (md, extra, &len);
+    ssize_t n = 0;
+    int fd, err;
+
+    if (!text) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    fd = open (path, O_WRONLY | O_CREAT | O_EXCL, 0666);
+    if (fd < 0) {
+        free (text);
+        return -1;
+    }
+
+    while (off < len && (n = write (fd, text + off, len - off)) > 0) {
+        off += n;
+    }
+    err = off < len ? (n < 0 ? errno : EIO) : 0;
+
+    free (text);
+    if (close (fd) < 0 && !err) {
+        err = errno;
+    }
+
+    errno = err;
+    return err ? -1 : 0;
+}
@@ -0,0 +1,78 @@
+#ifndef _METADATA_H_
+#define _METADATA_H_
+
+#include <stddef.h>
+#include <inttypes.h>
+
+/* Experiment metadata: "key = value" lines, '#' starting a comment, as in
+ * the .metadata templates of scripts/aut-tests. Keys are interned in one
+ * pool and found through a hash table; entries keep their index, and a
+ * separate order array keeps them sorted by key, so the file is rendered
+ * without sorting. Values of the form "<number> [<unit>]" (476066000 Hz,
+ * -10 dBm, 20 ps, 250 mA) are also kept parsed.
+ *
+ * A template is parsed once; each run sets the keys that change over it
+ * and renders, with the keys of that run only (an extra md_s, which wins
+ * over it), into one buffer written with a single write */
+#define MD_COMMENT_CHAR         '#'
+#define MD_OPTION_CHAR          '='
+#define MD_UNIT_LEN             8
+
+enum md_type_e {
+    MD_TEXT = 0,
+    MD_NUMBER                       // num, and unit if any ("" if not)
+};
+
+struct md_entry_s {
+    uint32_t key;                   // offset in the key pool
+    uint32_t key_len;
+    char *value;
+    enum md_type_e type;
+    double num;
+    char unit[MD_UNIT_LEN];
+};
+
+struct md_s {
+    char *pool;                     // keys, '\0'-terminated
+    uint32_t pool_len;
+    uint32_t pool_cap;
+    struct md_entry_s *entry;       // in order of insertion
+    uint32_t *order;                // entry indices, sorted by key
+    uint32_t n;
+    uint32_t cap;
+    uint32_t *hash;                 // entry index + 1, 0 -> empty
+    uint32_t hash_cap;              // a power of two, > 2*cap
+};
+
+void md_init (struct md_s *md);
+void md_free (struct md_s *md);
+
+/* Lines of text; later keys replace earlier ones. Returns -1 if out of
+ * memory */
+int md_parse (struct md_s *md, const char *text, size_t len);
+/* Returns -1 with errno set if the file cannot be read */
+int md_load (struct md_s *md, const char *path);
+
+const struct md_entry_s *md_get (const struct md_s *md, const char *key);
+const char *md_key (const struct md_s *md, const struct md_entry_s *e);
+/* i-th entry in key order */
+const struct md_entry_s *md_sorted (const struct md_s *md, uint32_t i);
+
+/* "<number> [<unit>]": 1 with num and unit (MD_UNIT_LEN, "" if none)
+ * set, or 0 if text is not one */
+int md_number (const char *text, double *num, char *unit);
+/* Hash of the len bytes of key, as the key table uses it */
+uint32_t md_hash (const char *key, uint32_t len);
+
+/* Adds key or replaces its value. Returns -1 if out of memory */
+int md_set (struct md_s *md, const char *key, const char *value);
+
+/* "key = value\n" lines of md and extra (NULL: none) by key, extra
+ * winning. Returns the text, to be freed, or NULL if out of memory */
+char *md_render (const struct md_s *md, const struct md_s *extra,
+        size_t *len);
+/* Renders to a new file: fails (-1, errno EEXIST) if it exists */
+int md_write (const struct md_s *md, const struct md_s *extra,
+        const char *path);
+
+#endif
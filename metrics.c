@@ -0,0 +1,353 @@
+// Prometheus metrics endpoint for the monitoring stream
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "metrics.h"
+#include "stats.h"
+#include "debug.h"
+
+static struct metrics_s metrics;
+static int metrics_fd = -1;
+static pthread_t metrics_thread;
+
+static const double metrics_quantiles[] = {0.5, 0.9, 0.99, 0.999};
+
+#define LOAD(x)     __atomic_load_n (&(x), __ATOMIC_RELAXED)
+#define STORE(x, v) __atomic_store_n (&(x), (v), __ATOMIC_RELAXED)
+#define INC(x)      __atomic_fetch_add (&(x), 1, __ATOMIC_RELAXED)
+
+/***************************************************************/
+/******************** Polling thread side **********************/
+/***************************************************************/
+
+void metrics_set_period (uint64_t period_ns)
+{
+    STORE (metrics.poll_period_ns, period_ns);
+}
+
+/* Only the polling thread writes the interval estimate */
+void metrics_sample (uint64_t now_ns)
+{
+    uint64_t last = LOAD (metrics.last_sample_ns);
+    uint64_t ewma = LOAD (metrics.interval_ewma_ns);
+
+    if (last != 0) {
+        int64_t delta = (int64_t) (now_ns - last) - (int64_t) ewma;
+
+        ewma = ewma == 0 ? now_ns - last :
+            (uint64_t) ((int64_t) ewma + delta/(1 << METRICS_EWMA_SHIFT));
+        STORE (metrics.interval_ewma_ns, ewma);
+    }
+
+    STORE (metrics.last_sample_ns, now_ns);
+    INC (metrics.samples);
+}
+
+void metrics_missed_deadline (void)
+{
+    INC (metrics.missed_deadlines);
+}
+
+void metrics_reconnect (void)
+{
+    INC (metrics.reconnects);
+}
+
+/***************************************************************/
+/*********************** Serving thread ************************/
+/***************************************************************/
+
+static void metrics_render (FILE *f)
+{
+    uint64_t now = stats_now ();
+    uint64_t last = LOAD (metrics.last_sample_ns);
+    uint64_t interval = LOAD (metrics.interval_ewma_ns);
+    unsigned int ep, op, q;
+
+    // A stalled stream must show up as a falling rate
+    if (last != 0 && now - last > interval) {
+        interval = now - last;
+    }
+
+    fprintf (f, "# HELP fcs_uptime_seconds Time since the client started.\n"
+            "# TYPE fcs_uptime_seconds gauge\n"
+            "fcs_uptime_seconds %.3f\n", (now - metrics.start_ns)/1e9);
+    fprintf (f, "# HELP fcs_monit_samples_total Monitoring samples read.\n"
+            "# TYPE fcs_monit_samples_total counter\n"
+            "fcs_monit_samples_total %" PRIu64 "\n", LOAD (metrics.samples));
+    fprintf (f, "# HELP fcs_monit_sample_rate_hz Smoothed monitoring sample rate.\n"
+            "# TYPE fcs_monit_sample_rate_hz gauge\n"
+            "fcs_monit_sample_rate_hz %.3f\n", interval ? 1e9/interval : 0.0);
+    fprintf (f, "# HELP fcs_monit_poll_period_seconds Configured poll period.\n"
+            "# TYPE fcs_monit_poll_period_seconds gauge\n"
+            "fcs_monit_poll_period_seconds %.6f\n",
+            LOAD (metrics.poll_period_ns)/1e9);
+    fprintf (f, "# HELP fcs_monit_missed_deadlines_total Polls started after their deadline.\n"
+            "# TYPE fcs_monit_missed_deadlines_total counter\n"
+            "fcs_monit_missed_deadlines_total %" PRIu64 "\n",
+            LOAD (metrics.missed_deadlines));
+    fprintf (f, "# HELP fcs_reconnects_total FPGA reconnections.\n"
+            "# TYPE fcs_reconnects_total counter\n"
+            "fcs_reconnects_total %" PRIu64 "\n", LOAD (metrics.reconnects));
+
+    fprintf (f, "# HELP fcs_bsmp_latency_seconds Operation latency.\n"
+            "# TYPE fcs_bsmp_latency_seconds summary\n");
+    for (ep = 0; ep < STATS_EP_END; ++ep) {
+        for (op = 0; op < STATS_OP_END; ++op) {
+            const struct stats_hist_s *h = stats_hist (ep, op);
+            uint64_t count = __atomic_load_n (&h->count, __ATOMIC_ACQUIRE);
+
+            if (count == 0) {
+                continue;
+            }
+
+            for (q = 0; q < sizeof metrics_quantiles/sizeof metrics_quantiles[0]; ++q) {
+                fprintf (f, "fcs_bsmp_latency_seconds{endpoint=\"%s\",op=\"%s\","
+                        "quantile=\"%g\"} %.9f\n", stats_ep_name (ep),
+                        stats_op_name (op), metrics_quantiles[q],
+                        stats_quantile (h, metrics_quantiles[q])/1e9);
+            }
+            fprintf (f, "fcs_bsmp_latency_seconds_sum{endpoint=\"%s\",op=\"%s\"} %.9f\n",
+                    stats_ep_name (ep), stats_op_name (op), LOAD (h->sum_ns)/1e9);
+            fprintf (f, "fcs_bsmp_latency_seconds_count{endpoint=\"%s\",op=\"%s\"} %"
+                    PRIu64 "\n", stats_ep_name (ep), stats_op_name (op), count);
+        }
+    }
+
+    fprintf (f, "# HELP fcs_bsmp_errors_total Failed operations.\n"
+            "# TYPE fcs_bsmp_errors_total counter\n");
+    for (ep = 0; ep < STATS_EP_LOCAL; ++ep) {
+        fprintf (f, "fcs_bsmp_errors_total{endpoint=\"%s\"} %" PRIu64 "\n",
+                stats_ep_name (ep), LOAD (stats_counters (ep)->errors));
+    }
+
+    fprintf (f, "# HELP fcs_bytes_sent_total Bytes sent.\n"
+            "# TYPE fcs_bytes_sent_total counter\n");
+    for (ep = 0; ep < STATS_EP_LOCAL; ++ep) {
+        fprintf (f, "fcs_bytes_sent_total{endpoint=\"%s\"} %" PRIu64 "\n",
+                stats_ep_name (ep), LOAD (stats_counters (ep)->bytes_sent));
+    }
+
+    fprintf (f, "# HELP fcs_bytes_received_total Bytes received.\n"
+            "# TYPE fcs_bytes_received_total counter\n");
+    for (ep = 0; ep < STATS_EP_LOCAL; ++ep) {
+        fprintf (f, "fcs_bytes_received_total{endpoint=\"%s\"} %" PRIu64 "\n",
+                stats_ep_name (ep), LOAD (stats_counters (ep)->bytes_recv));
+    }
+}
+
+static int metrics_sendall (int fd, const char *buf, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = send (fd, buf, len, MSG_NOSIGNAL);
+
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+
+        buf += n;
+        len -= n;
+    }
+
+    return 0;
+}
+
+static void metrics_serve (int fd)
+{
+    char req[METRICS_REQ_SIZE];
+    size_t used = 0;
+    char *body = NULL;
+    size_t body_len = 0;
+    char hdr[256];
+    int found;
+    FILE *f;
+
+    // Headers are not needed, but wait for them so the client is not reset
+    while (used < sizeof req - 1) {
+        ssize_t n = recv (fd, req + used, sizeof req - 1 - used, 0);
+
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+
+        used += n;
+        req[used] = '\0';
+        if (strstr (req, "\r\n\r\n") || strstr (req, "\n\n")) {
+            break;
+        }
+    }
+    req[used] = '\0';
+
+    found = strncmp (req, "GET /metrics", 12) == 0 ||
+        strncmp (req, "GET / ", 6) == 0;
+
+    if (!found) {
+        const char *nf = "HTTP/1.0 404 Not Found\r\nContent-Length: 0\r\n"
+            "Connection: close\r\n\r\n";
+        metrics_sendall (fd, nf, strlen (nf));
+        return;
+    }
+
+    f = open_memstream (&body, &body_len);
+    if (!f) {
+        return;
+    }
+    metrics_render (f);
+    fclose (f);
+
+    snprintf (hdr, sizeof hdr, "HTTP/1.0 200 OK\r\n"
+            "Content-Type: text/plain; version=0.0.4\r\n"
+            "Content-Length: %zu\r\nConnection: close\r\n\r\n", body_len);
+
+    if (metrics_sendall (fd, hdr, strlen (hdr)) == 0) {
+        metrics_sendall (fd, body, body_len);
+    }
+
+    free (body);
+}
+
+static void *metrics_loop (void *arg)
+{
+    struct timeval tv = {METRICS_IO_TIMEOUT, 0};
+
+    (void) arg;
+
+    for (;;) {
+        int fd = accept (metrics_fd, NULL, NULL);
+
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            perror ("metrics: accept");
+            return NULL;
+        }
+
+        // A stuck scraper must not hold the endpoint forever
+        setsockopt (fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof tv);
+        setsockopt (fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof tv);
+
+        metrics_serve (fd);
+        close (fd);
+    }
+
+    return NULL;
+}
+
+static int metrics_listen_unix (const char *path)
+{
+    struct sockaddr_un addr;
+    int fd;
+
+    if (strlen (path) >= sizeof addr.sun_path) {
+        fprintf (stderr, "metrics: socket path too long: %s\n", path);
+        return -1;
+    }
+
+    fd = socket (AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror ("metrics: socket");
+        return -1;
+    }
+
+    memset (&addr, 0, sizeof addr);
+    addr.sun_family = AF_UNIX;
+    strcpy (addr.sun_path, path);
+    unlink (path); // stale socket from a previous run
+
+    if (bind (fd, (struct sockaddr *) &addr, sizeof addr) < 0) {
+        perror ("metrics: bind");
+        close (fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+static int metrics_listen_tcp (const char *port)
+{
+    struct sockaddr_in addr;
+    int yes = 1;
+    int fd;
+    char *end;
+    long p = strtol (port, &end, 10);
+
+    if (*end != '\0' || p <= 0 || p > 65535) {
+        fprintf (stderr, "metrics: invalid port: %s\n", port);
+        return -1;
+    }
+
+    fd = socket (AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror ("metrics: socket");
+        return -1;
+    }
+
+    setsockopt (fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof yes);
+
+    memset (&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons ((uint16_t) p);
+    inet_pton (AF_INET, METRICS_LISTEN_ADDR, &addr.sin_addr);
+
+    if (bind (fd, (struct sockaddr *) &addr, sizeof addr) < 0) {
+        perror ("metrics: bind");
+        close (fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+int metrics_start (const char *where)
+{
+    sigset_t all, old;
+    int err;
+
+    metrics.start_ns = stats_now ();
+
+    metrics_fd = strchr (where, '/') ? metrics_listen_unix (where) :
+        metrics_listen_tcp (where);
+    if (metrics_fd < 0) {
+        return -1;
+    }
+
+    if (listen (metrics_fd, METRICS_BACKLOG) < 0) {
+        perror ("metrics: listen");
+        close (metrics_fd);
+        return -1;
+    }
+
+    // Signals (SIGINT, SIGUSR1) are for the polling thread
+    sigfillset (&all);
+    pthread_sigmask (SIG_SETMASK, &all, &old);
+    err = pthread_create (&metrics_thread, NULL, metrics_loop, NULL);
+    pthread_sigmask (SIG_SETMASK, &old, NULL);
+
+    if (err) {
+        fprintf (stderr, "metrics: pthread_create: %s\n", strerror (err));
+        close (metrics_fd);
+        return -1;
+    }
+
+    pthread_detach (metrics_thread);
+    DEBUGP ("metrics: serving on %s\n", where);
+
+    return 0;
+}
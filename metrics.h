@@ -0,0 +1,32 @@
+#ifndef _METRICS_H_
+#define _METRICS_H_
+
+#include <inttypes.h>
+
+/* Monitoring stream health, served in Prometheus text format by a
+ * separate thread. The polling loop only does relaxed atomic updates */
+#define METRICS_LISTEN_ADDR     "127.0.0.1"
+#define METRICS_BACKLOG         4
+#define METRICS_REQ_SIZE        1024
+#define METRICS_IO_TIMEOUT      1 // sec, per scrape
+#define METRICS_EWMA_SHIFT      3 // weight of a new interval is 1/2^3
+
+struct metrics_s {
+    uint64_t samples;               // monitoring samples read
+    uint64_t missed_deadlines;      // polls started after their deadline
+    uint64_t reconnects;            // FPGA reconnections
+    uint64_t poll_period_ns;        // configured poll period
+    uint64_t interval_ewma_ns;      // smoothed time between samples
+    uint64_t last_sample_ns;
+    uint64_t start_ns;
+};
+
+/* Serves metrics on "<port>" (TCP, on METRICS_LISTEN_ADDR) or on
+ * "<path>" (UNIX socket, when it contains a '/') from a new thread */
+int metrics_start (const char *where);
+void metrics_set_period (uint64_t period_ns);
+void metrics_sample (uint64_t now_ns);
+void metrics_missed_deadline (void);
+void metrics_reconnect (void);
+
+#endif
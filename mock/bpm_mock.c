@@ -0,0 +1,1222 @@
+// Mock BPM FPGA/RFFE BSMP servers. Exports the same functions, variables
+// and curves as the real crate, filled with synthetic beam data, so the
+// client can be exercised (and benchmarked) without hardware
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <getopt.h>
+#include <signal.h>
+#include <time.h>
+#include <math.h>
+#include <pthread.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "bpm_mock.h"
+#include "transport/transport.h"
+#include "transport/ethernet.h"
+#include "revision.h"
+#include "debug.h"
+
+#define M "MOCK: "
+
+#define ARRAY_SIZE(x) (sizeof(x) / sizeof((x)[0]))
+#define NUM_CHANNELS 4
+
+/* BSMP command codes we need to peek at */
+#define BSMP_CMD_FUNC_EXECUTE   0x50
+#define BSMP_CMD_ERR_MALFORMED  0xE1
+
+const char* program_name;
+
+static struct mock_config_s cfg = {
+    .fpga_port = NULL,
+    .fe_port = NULL,
+    .samples = MOCK_DEFAULT_SAMPLES,
+    .block_size = MOCK_DEFAULT_BLOCK_SIZE,
+    .latency_usec = 0,
+    .jitter_usec = 0,
+    .bandwidth = 0,
+    .fault = MOCK_FAULT_NONE,
+    .fault_rate = 0.0,
+    .acq_time_scale = 1.0,
+    .sig_level = 10.0,
+    .cable_delay_ps = {0, 10, 5, 20},
+    .double_buffer = 0,
+    .verbose = 0
+};
+
+static const char *fault_names[MOCK_FAULT_END] = {
+    "none", "drop", "corrupt", "error", "stall"
+};
+
+/***************************************************************/
+/*********************** Device state **************************/
+/***************************************************************/
+
+static struct mock_state_s {
+    pthread_mutex_t lock;
+    // FPGA registers
+    uint32_t kx;
+    uint32_t ky;
+    uint32_t ksum;
+    uint32_t sw;                    // 0x1 no switching, 0x3 switching
+    uint32_t sw_clk_en;
+    uint32_t sw_divclk;
+    uint32_t sw_phaseclk;
+    uint32_t wdw;
+    uint32_t wdw_dly;
+    uint32_t adc_clk;
+    uint32_t dds_freq;
+    uint32_t acq_samples;
+    uint32_t acq_chan;
+    // Acquisition engine
+    struct timespec acq_done;       // completion time of the last start
+    int acq_pending;                // back buffer waiting to be latched
+    uint32_t acq_pending_chan;      // channel that back buffer belongs to
+    // RFFE variables
+    uint8_t fe_sw;
+    double fe_att1;
+    double fe_att2;
+    double fe_temp1;
+    double fe_temp2;
+} st = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .kx = MOCK_KX,
+    .ky = MOCK_KY,
+    .ksum = MOCK_KSUM,
+    .sw = FE_SW_OFF,
+    .adc_clk = MOCK_ADC_CLK,
+    .dds_freq = MOCK_DDS_FREQ,
+    .acq_samples = MOCK_DEFAULT_SAMPLES,
+    .fe_sw = FE_SW_OFF,
+    .fe_att1 = 15.0,
+    .fe_att2 = 15.0,
+    .fe_temp1 = 38.5,
+    .fe_temp2 = 39.25
+};
+
+/* Per RF path gain mismatch that switching/deswitching is meant to remove */
+static const double path_gain[NUM_CHANNELS] = {1.00, 1.03, 0.97, 1.01};
+
+/* Sample size (all four channels) of each on-demand curve */
+static const uint32_t curve_sample_size[END_CURVE_ID] = {
+    NUM_CHANNELS*sizeof(int16_t),   // ADC
+    NUM_CHANNELS*sizeof(int32_t),   // TBT Amp
+    NUM_CHANNELS*sizeof(int32_t),   // TBT Pos
+    NUM_CHANNELS*sizeof(int32_t),   // FOFB Amp
+    NUM_CHANNELS*sizeof(int32_t)    // FOFB Pos
+};
+
+/* Decimation of each on-demand curve relative to the ADC clock */
+static const uint32_t curve_decim[END_CURVE_ID] = {
+    1, MOCK_TBT_DECIM, MOCK_TBT_DECIM, MOCK_FOFB_DECIM, MOCK_FOFB_DECIM
+};
+
+struct mock_curve_buf_s {
+    uint8_t *front;                 // what BSMP clients read
+    uint8_t *back;                  // what the acquisition engine fills
+};
+
+static struct mock_curve_buf_s curve_buf[END_CURVE_ID];
+
+/***************************************************************/
+/********************** Utility functions **********************/
+/***************************************************************/
+
+static uint64_t xorshift64 (uint64_t *s)
+{
+    *s ^= *s << 13;
+    *s ^= *s >> 7;
+    *s ^= *s << 17;
+    return *s;
+}
+
+/* Uniform in [0, 1) */
+static double rng_uniform (uint64_t *s)
+{
+    return (xorshift64 (s) >> 11) * (1.0/9007199254740992.0);
+}
+
+/* Approximately normal with unit variance (Irwin-Hall with 4 terms) */
+static double rng_gauss (uint64_t *s)
+{
+    return (rng_uniform (s) + rng_uniform (s) + rng_uniform (s) +
+            rng_uniform (s) - 2.0) * 1.7320508075688772;
+}
+
+static void ts_add_usec (struct timespec *ts, uint64_t usec)
+{
+    ts->tv_sec += usec / 1000000;
+    ts->tv_nsec += (usec % 1000000) * 1000;
+    if (ts->tv_nsec >= 1000000000) {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000;
+    }
+}
+
+static int ts_after (struct timespec *a, struct timespec *b)
+{
+    return a->tv_sec > b->tv_sec ||
+        (a->tv_sec == b->tv_sec && a->tv_nsec >= b->tv_nsec);
+}
+
+static void sleep_usec (uint64_t usec)
+{
+    struct timespec ts = {usec / 1000000, (usec % 1000000) * 1000};
+    while (nanosleep (&ts, &ts) == -1 && errno == EINTR);
+}
+
+static int32_t clip32 (double v)
+{
+    if (v > INT32_MAX) return INT32_MAX;
+    if (v < INT32_MIN) return INT32_MIN;
+    return (int32_t) lrint (v);
+}
+
+static int16_t clip16 (double v)
+{
+    if (v > INT16_MAX) return INT16_MAX;
+    if (v < INT16_MIN) return INT16_MIN;
+    return (int16_t) lrint (v);
+}
+
+/***************************************************************/
+/*********************** Beam model ****************************/
+/***************************************************************/
+
+/* ADC peak level, in counts, given the current RFFE attenuation */
+static double adc_level (void)
+{
+    return INT16_MAX * pow (10.0, (cfg.sig_level - st.fe_att1 -
+                st.fe_att2)/20.0);
+}
+
+/* Button amplitudes (relative, sum 1.0) for a beam at x, y [nm]. This is
+ * the inverse of the delta-over-sum used by the FPGA:
+ * X = Kx*((A+D)-(B+C))/S, Y = Ky*((A+B)-(C+D))/S, Q = ((A+C)-(B+D))/S */
+static void beam_buttons (double x, double y, double amp[NUM_CHANNELS])
+{
+    double u = x / MOCK_KX;
+    double v = y / MOCK_KY;
+
+    amp[0] = (1.0 + u + v) / 4.0;
+    amp[1] = (1.0 - u + v) / 4.0;
+    amp[2] = (1.0 - u - v) / 4.0;
+    amp[3] = (1.0 + u - v) / 4.0;
+}
+
+/* Position at turn n: closed orbit plus a driven betatron oscillation */
+static void beam_position_tbt (double n, double *x, double *y)
+{
+    *x = 150000.0 + 80000.0*cos (2*M_PI*MOCK_TUNE_X*n);
+    *y = -60000.0 + 50000.0*cos (2*M_PI*MOCK_TUNE_Y*n + 0.7);
+}
+
+/* Position at time t [s] once betatron motion is averaged out: closed
+ * orbit plus slow (mains-like) vibrations */
+static void beam_position_slow (double t, double *x, double *y)
+{
+    *x = 150000.0 + 2000.0*sin (2*M_PI*60.0*t) + 500.0*sin (2*M_PI*7.3*t);
+    *y = -60000.0 + 1500.0*sin (2*M_PI*60.0*t + 1.1);
+}
+
+/* Baseband amplitudes (A, B, C, D) the FPGA delivers for antenna signals
+ * sig. With deswitching on, both paths of each antenna are averaged and the
+ * gain mismatch cancels; with it off, crossed antennas are mixed */
+static void baseband_amp (const double sig[NUM_CHANNELS],
+        double a[NUM_CHANNELS], double level, uint64_t *seed)
+{
+    int c;
+
+    for (c = 0; c < NUM_CHANNELS; ++c) {
+        int o = (c + 2) % NUM_CHANNELS;
+
+        if (st.fe_sw != FE_SW_ON) {
+            a[c] = sig[c]*path_gain[c];
+        }
+        else if (st.sw == FE_SW_ON) {
+            a[c] = sig[c]*(path_gain[c] + path_gain[o])/2.0;
+        }
+        else {
+            a[c] = (sig[c] + sig[o])*path_gain[c]/2.0;
+        }
+
+        a[c] = 4.0*level*a[c] + 20.0*rng_gauss (seed);
+    }
+}
+
+/* Ksum is FIX25_24: 25 bits, two's complement, 24 of them fraction */
+static double ksum_value (void)
+{
+    uint32_t k = st.ksum & ((1u << 25) - 1);
+
+    return ((double) k - (k & (1u << 24) ? (double) (1u << 25) : 0))/(1 << 24);
+}
+
+/* One 4-channel baseband sample for a beam at x, y: amplitudes or, if pos
+ * is set, position (X, Y, Q, Sum) as computed by the FPGA */
+static void gen_sample (double x, double y, int pos, int32_t *out,
+        uint64_t *seed)
+{
+    double level = adc_level () * 64.0;  // CORDIC/CIC gain, arb. units
+    double sig[NUM_CHANNELS], a[NUM_CHANNELS], s;
+    int c;
+
+    beam_buttons (x, y, sig);
+    baseband_amp (sig, a, level, seed);
+
+    if (!pos) {
+        for (c = 0; c < NUM_CHANNELS; ++c) {
+            out[c] = clip32 (a[c]);
+        }
+        return;
+    }
+
+    s = a[0] + a[1] + a[2] + a[3];
+    if (s == 0.0) {
+        s = 1.0;
+    }
+    out[0] = clip32 (st.kx*((a[0]+a[3])-(a[1]+a[2]))/s);
+    out[1] = clip32 (st.ky*((a[0]+a[1])-(a[2]+a[3]))/s);
+    out[2] = clip32 (st.kx*((a[0]+a[2])-(a[1]+a[3]))/s);
+    out[3] = clip32 (ksum_value ()*s);
+}
+
+static void gen_adc (uint8_t *buf, uint32_t npts, uint64_t *seed)
+{
+    int16_t *out = (int16_t *) buf;
+    double level = adc_level ();
+    uint32_t period = st.sw_divclk*FE_SW_DIV_FACTOR;
+    int switching = st.fe_sw == FE_SW_ON && period > 1;
+    double phase[NUM_CHANNELS];
+    double f_if;
+    uint32_t i;
+    int c;
+
+    // The IF sits at the DDS frequency. Cable delays show up as phase
+    // lags of the RF carrier, which the aliasing keeps
+    f_if = (double) st.dds_freq / st.adc_clk;
+    for (c = 0; c < NUM_CHANNELS; ++c) {
+        phase[c] = -2*M_PI*MOCK_CARRIER_FREQ*cfg.cable_delay_ps[c]*1e-12;
+    }
+
+    for (i = 0; i < npts; ++i) {
+        double x, y, amp[NUM_CHANNELS];
+        double arg = 2*M_PI*f_if*i;
+        int crossed = switching &&
+            ((i + st.sw_phaseclk) % period) >= period/2;
+
+        beam_position_tbt ((double) i / MOCK_TBT_DECIM, &x, &y);
+        beam_buttons (x, y, amp);
+
+        // ADC channel c is always RF path c. With the RFFE switching, path c
+        // carries antenna c+2 during half of each period
+        for (c = 0; c < NUM_CHANNELS; ++c) {
+            int src = crossed ? (c + 2) % NUM_CHANNELS : c;
+            out[i*NUM_CHANNELS + c] = clip16 (4.0*level*amp[src]*
+                    path_gain[c]*cos (arg + phase[src]) +
+                    2.0*rng_gauss (seed));
+        }
+    }
+}
+
+/* Amplitude (A, B, C, D) or position (X, Y, Q, Sum) samples, one per
+ * decim ADC clocks. Turn-by-turn data carries betatron motion */
+static void gen_baseband (uint8_t *buf, uint32_t npts, uint32_t decim,
+        int pos, uint64_t *seed)
+{
+    int32_t *out = (int32_t *) buf;
+    uint32_t i;
+
+    for (i = 0; i < npts; ++i) {
+        double x, y;
+
+        if (decim == MOCK_TBT_DECIM) {
+            beam_position_tbt (i, &x, &y);
+        }
+        else {
+            beam_position_slow ((double) i * decim / st.adc_clk, &x, &y);
+        }
+
+        gen_sample (x, y, pos, out + i*NUM_CHANNELS, seed);
+    }
+}
+
+/* Runs an acquisition of st.acq_samples on st.acq_chan into the back
+ * buffer. Called with st.lock held */
+static void acq_generate (void)
+{
+    static uint64_t seed = 0x9E3779B97F4A7C15ULL;
+    uint32_t chan = st.acq_chan;
+    uint32_t npts = st.acq_samples;
+    uint8_t *buf = curve_buf[chan].back;
+
+    memset (buf, 0, cfg.samples*curve_sample_size[chan]);
+
+    switch (chan) {
+        case CURVE_ADC_ID:
+            gen_adc (buf, npts, &seed);
+            break;
+        case CURVE_TBTAMP_ID:
+        case CURVE_TBTPOS_ID:
+        case CURVE_FOFBAMP_ID:
+        case CURVE_FOFMPOS_ID:
+            gen_baseband (buf, npts, curve_decim[chan],
+                    chan == CURVE_TBTPOS_ID || chan == CURVE_FOFMPOS_ID, &seed);
+            break;
+    }
+}
+
+/* Makes completed acquisitions visible. Called with st.lock held */
+static void acq_latch (void)
+{
+    struct timespec now;
+    uint8_t *tmp;
+
+    if (!st.acq_pending) {
+        return;
+    }
+
+    clock_gettime (CLOCK_MONOTONIC, &now);
+    if (!ts_after (&now, &st.acq_done)) {
+        return;
+    }
+
+    // Not st.acq_chan: the channel may have changed since the start
+    tmp = curve_buf[st.acq_pending_chan].front;
+    curve_buf[st.acq_pending_chan].front = curve_buf[st.acq_pending_chan].back;
+    curve_buf[st.acq_pending_chan].back = tmp;
+    st.acq_pending = 0;
+}
+
+/***************************************************************/
+/******************* FPGA BSMP functions ***********************/
+/***************************************************************/
+
+#define MOCK_GET_U32(fname, field)                              \
+    static uint8_t fname (uint8_t *input, uint8_t *output)      \
+    {                                                           \
+        (void) input;                                           \
+        memcpy (output, &st.field, sizeof(uint32_t));           \
+        return 0;                                               \
+    }
+
+#define MOCK_SET_U32(fname, field)                              \
+    static uint8_t fname (uint8_t *input, uint8_t *output)      \
+    {                                                           \
+        (void) output;                                          \
+        memcpy (&st.field, input, sizeof(uint32_t));            \
+        return 0;                                               \
+    }
+
+#define MOCK_SET_CONST(fname, field, val)                       \
+    static uint8_t fname (uint8_t *input, uint8_t *output)      \
+    {                                                           \
+        (void) input;                                           \
+        (void) output;                                          \
+        st.field = val;                                         \
+        return 0;                                               \
+    }
+
+static uint8_t mock_blink (uint8_t *input, uint8_t *output)
+{
+    (void) input;
+    (void) output;
+    if (cfg.verbose) {
+        fprintf (stderr, M "*blink*\n");
+    }
+    return 0;
+}
+
+static uint8_t mock_reset (uint8_t *input, uint8_t *output)
+{
+    (void) input;
+    (void) output;
+    st.kx = MOCK_KX;
+    st.ky = MOCK_KY;
+    st.ksum = MOCK_KSUM;
+    st.sw = FE_SW_OFF;
+    st.sw_clk_en = 0;
+    st.sw_divclk = 0;
+    st.sw_phaseclk = 0;
+    st.wdw = 0;
+    st.wdw_dly = 0;
+    st.adc_clk = MOCK_ADC_CLK;
+    st.dds_freq = MOCK_DDS_FREQ;
+    return 0;
+}
+
+static uint8_t mock_get_fmc_temp1 (uint8_t *input, uint8_t *output)
+{
+    double temp = 45.0 + 0.1*sin (time (NULL)/60.0);
+    (void) input;
+    memcpy (output, &temp, sizeof(double));
+    return 0;
+}
+
+static uint8_t mock_get_fmc_temp2 (uint8_t *input, uint8_t *output)
+{
+    double temp = 47.5 + 0.1*cos (time (NULL)/60.0);
+    (void) input;
+    memcpy (output, &temp, sizeof(double));
+    return 0;
+}
+
+MOCK_SET_U32 (mock_set_kx, kx)
+MOCK_GET_U32 (mock_get_kx, kx)
+MOCK_SET_U32 (mock_set_ky, ky)
+MOCK_GET_U32 (mock_get_ky, ky)
+MOCK_SET_U32 (mock_set_ksum, ksum)
+MOCK_GET_U32 (mock_get_ksum, ksum)
+MOCK_SET_CONST (mock_set_sw_on, sw, FE_SW_ON)
+MOCK_SET_CONST (mock_set_sw_off, sw, FE_SW_OFF)
+MOCK_GET_U32 (mock_get_sw, sw)
+MOCK_SET_CONST (mock_set_sw_clk_en_on, sw_clk_en, 1)
+MOCK_SET_CONST (mock_set_sw_clk_en_off, sw_clk_en, 0)
+MOCK_GET_U32 (mock_get_sw_clk_en, sw_clk_en)
+MOCK_SET_U32 (mock_set_sw_divclk, sw_divclk)
+MOCK_GET_U32 (mock_get_sw_divclk, sw_divclk)
+MOCK_SET_U32 (mock_set_sw_phaseclk, sw_phaseclk)
+MOCK_GET_U32 (mock_get_sw_phaseclk, sw_phaseclk)
+MOCK_SET_CONST (mock_set_wdw_on, wdw, 1)
+MOCK_SET_CONST (mock_set_wdw_off, wdw, 0)
+MOCK_GET_U32 (mock_get_wdw, wdw)
+MOCK_GET_U32 (mock_get_adc_clk, adc_clk)
+MOCK_SET_U32 (mock_set_dds_freq, dds_freq)
+MOCK_GET_U32 (mock_get_dds_freq, dds_freq)
+MOCK_GET_U32 (mock_get_acq_samples, acq_samples)
+MOCK_GET_U32 (mock_get_acq_chan, acq_chan)
+
+/* Rates and timings are divided by it, so a 0 clock is refused */
+static uint8_t mock_set_adc_clk (uint8_t *input, uint8_t *output)
+{
+    uint32_t clk;
+    (void) output;
+    memcpy (&clk, input, sizeof(uint32_t));
+    if (clk == 0) {
+        return 1;
+    }
+    st.adc_clk = clk;
+    return 0;
+}
+
+static uint8_t mock_set_wdw_dly (uint8_t *input, uint8_t *output)
+{
+    uint32_t dly;
+    (void) output;
+    memcpy (&dly, input, sizeof(uint32_t));
+    if (dly > 500) {
+        return 1;
+    }
+    st.wdw_dly = dly;
+    return 0;
+}
+
+static uint8_t mock_get_wdw_dly (uint8_t *input, uint8_t *output)
+{
+    (void) input;
+    memcpy (output, &st.wdw_dly, sizeof(uint32_t));
+    return 0;
+}
+
+static uint8_t mock_set_acq_param (uint8_t *input, uint8_t *output)
+{
+    uint32_t samples, chan;
+    (void) output;
+    memcpy (&samples, input, sizeof(uint32_t));
+    memcpy (&chan, input + sizeof(uint32_t), sizeof(uint32_t));
+    if (chan >= END_CURVE_ID || samples < 4 || samples > cfg.samples) {
+        return 1;
+    }
+    st.acq_samples = samples;
+    st.acq_chan = chan;
+    return 0;
+}
+
+/* The answer to this function is held back by the connection thread until
+ * the simulated capture time has elapsed, as the real server blocks */
+static uint8_t mock_set_acq_start (uint8_t *input, uint8_t *output)
+{
+    double secs = (double) st.acq_samples * curve_decim[st.acq_chan] /
+        st.adc_clk * cfg.acq_time_scale;
+    (void) input;
+    (void) output;
+
+    // A previous capture still waiting to be latched is lost
+    st.acq_pending = 0;
+    acq_generate ();
+
+    clock_gettime (CLOCK_MONOTONIC, &st.acq_done);
+    ts_add_usec (&st.acq_done, (uint64_t) (secs*1e6));
+
+    if (cfg.double_buffer) {
+        st.acq_pending = 1;
+        st.acq_pending_chan = st.acq_chan;
+    }
+    else {
+        // Single buffer: data is overwritten as soon as capture starts
+        uint8_t *tmp = curve_buf[st.acq_chan].front;
+        curve_buf[st.acq_chan].front = curve_buf[st.acq_chan].back;
+        curve_buf[st.acq_chan].back = tmp;
+    }
+
+    return 0;
+}
+
+struct mock_func_s {
+    const char *name;
+    uint8_t input_size;
+    uint8_t output_size;
+    bsmp_func_t func_p;
+};
+
+static const struct mock_func_s mock_funcs[END_ID] = {
+    {BLINK_FUNC_NAME            , 0, 0, mock_blink},
+    {RESET_FUNC_NAME            , 0, 0, mock_reset},
+    {GET_FMC_TEMP1_NAME         , 0, 8, mock_get_fmc_temp1},
+    {GET_FMC_TEMP2_NAME         , 0, 8, mock_get_fmc_temp2},
+    {SET_KX_NAME                , 4, 0, mock_set_kx},
+    {GET_KX_NAME                , 0, 4, mock_get_kx},
+    {SET_KY_NAME                , 4, 0, mock_set_ky},
+    {GET_KY_NAME                , 0, 4, mock_get_ky},
+    {SET_KSUM_NAME              , 4, 0, mock_set_ksum},
+    {GET_KSUM_NAME              , 0, 4, mock_get_ksum},
+    {SET_SW_ON_NAME             , 0, 0, mock_set_sw_on},
+    {SET_SW_OFF_NAME            , 0, 0, mock_set_sw_off},
+    {GET_SW_NAME                , 0, 4, mock_get_sw},
+    {SET_SW_CLK_EN_ON_NAME      , 0, 0, mock_set_sw_clk_en_on},
+    {SET_SW_CLK_EN_OFF_NAME     , 0, 0, mock_set_sw_clk_en_off},
+    {GET_SW_CLK_EN_NAME         , 0, 4, mock_get_sw_clk_en},
+    {SET_SW_DIVCLK_NAME         , 4, 0, mock_set_sw_divclk},
+    {GET_SW_DIVCLK_NAME         , 0, 4, mock_get_sw_divclk},
+    {SET_SW_PHASECLK_NAME       , 4, 0, mock_set_sw_phaseclk},
+    {GET_SW_PHASECLK_NAME       , 0, 4, mock_get_sw_phaseclk},
+    {SET_WDW_ON_NAME            , 0, 0, mock_set_wdw_on},
+    {SET_WDW_OFF_NAME           , 0, 0, mock_set_wdw_off},
+    {GET_WDW_NAME               , 0, 4, mock_get_wdw},
+    {SET_WDW_DLY_NAME           , 4, 0, mock_set_wdw_dly},
+    {GET_WDW_DLY_NAME           , 0, 4, mock_get_wdw_dly},
+    {SET_ADCCLK_NAME            , 4, 0, mock_set_adc_clk},
+    {GET_ADCCLK_NAME            , 0, 4, mock_get_adc_clk},
+    {SET_DDSFREQ_NAME           , 4, 0, mock_set_dds_freq},
+    {GET_DDSFREQ_NAME           , 0, 4, mock_get_dds_freq},
+    {SET_ACQ_PARAM_NAME         , 8, 0, mock_set_acq_param},
+    {GET_ACQ_SAMPLES_NAME       , 0, 4, mock_get_acq_samples},
+    {GET_ACQ_CHAN_NAME          , 0, 4, mock_get_acq_chan},
+    {SET_ACQ_START_NAME         , 0, 0, mock_set_acq_start}
+};
+
+static struct bsmp_func fpga_funcs[END_ID];
+
+/***************************************************************/
+/********************* FPGA BSMP curves ************************/
+/***************************************************************/
+
+static void mock_read_curve_block (struct bsmp_curve *curve, uint16_t block,
+        uint8_t *data, uint16_t *len)
+{
+    struct mock_curve_buf_s *buf = curve->user;
+    uint32_t size = curve->info.nblocks*curve->info.block_size;
+    uint32_t offset = block*curve->info.block_size;
+    uint32_t n = curve->info.block_size;
+
+    acq_latch ();
+
+    if (offset >= size) {
+        *len = 0;
+        return;
+    }
+    if (offset + n > size) {
+        n = size - offset;
+    }
+
+    memcpy (data, buf->front + offset, n);
+    *len = n;
+}
+
+/* Monitoring curves produce a fresh sample at each read */
+static void mock_read_monit_block (struct bsmp_curve *curve, uint16_t block,
+        uint8_t *data, uint16_t *len)
+{
+    static uint64_t seed = 0xD1B54A32D192ED03ULL;
+    struct timespec now;
+    double x, y;
+
+    (void) block;
+    clock_gettime (CLOCK_REALTIME, &now);
+
+    beam_position_slow (now.tv_sec % 3600 + now.tv_nsec*1e-9, &x, &y);
+    // user != NULL selects position data
+    gen_sample (x, y, curve->user != NULL, (int32_t *) data, &seed);
+
+    *len = NUM_CHANNELS*sizeof(int32_t);
+}
+
+static struct bsmp_curve fpga_curves[END_CURVE_ID+END_MONIT_ID];
+
+/***************************************************************/
+/********************* RFFE BSMP variables *********************/
+/***************************************************************/
+
+static bool mock_att_ok (struct bsmp_var *var, uint8_t *value)
+{
+    double att;
+    (void) var;
+    memcpy (&att, value, sizeof(double));
+    return att >= 0.0 && att <= 31.5;
+}
+
+static struct bsmp_var fe_vars[END_FE_ID] = {
+    {{0, true,  sizeof(uint8_t)}, NULL,        (uint8_t *) &st.fe_sw,    NULL},
+    {{0, true,  sizeof(double)},  mock_att_ok, (uint8_t *) &st.fe_att1,  NULL},
+    {{0, true,  sizeof(double)},  mock_att_ok, (uint8_t *) &st.fe_att2,  NULL},
+    {{0, false, sizeof(double)},  NULL,        (uint8_t *) &st.fe_temp1, NULL},
+    {{0, false, sizeof(double)},  NULL,        (uint8_t *) &st.fe_temp2, NULL}
+};
+
+/***************************************************************/
+/*********************** Server setup **************************/
+/***************************************************************/
+
+static bsmp_server_t *fpga_server;
+static bsmp_server_t *fe_server;
+
+static int mock_fpga_server_new (void)
+{
+    unsigned int i;
+    enum bsmp_err err;
+
+    fpga_server = bsmp_server_new ();
+    if (!fpga_server) {
+        return -1;
+    }
+
+    for (i = 0; i < ARRAY_SIZE(mock_funcs); ++i) {
+        fpga_funcs[i].info.input_size = mock_funcs[i].input_size;
+        fpga_funcs[i].info.output_size = mock_funcs[i].output_size;
+        fpga_funcs[i].func_p = mock_funcs[i].func_p;
+
+        if ((err = bsmp_register_function (fpga_server, &fpga_funcs[i]))) {
+            fprintf (stderr, M "register %s: %s\n", mock_funcs[i].name,
+                    bsmp_error_str (err));
+            return -1;
+        }
+    }
+
+    // On-demand curves, then monitoring ones, as the client expects
+    for (i = 0; i < END_CURVE_ID; ++i) {
+        uint32_t size = cfg.samples*curve_sample_size[i];
+
+        curve_buf[i].front = calloc (1, size + cfg.block_size);
+        curve_buf[i].back = calloc (1, size + cfg.block_size);
+        if (!curve_buf[i].front || !curve_buf[i].back) {
+            fprintf (stderr, M "could not allocate %u bytes for curve %u\n",
+                    size, i);
+            return -1;
+        }
+
+        fpga_curves[i].info.writable = false;
+        fpga_curves[i].info.block_size = cfg.block_size;
+        fpga_curves[i].info.nblocks = (size + cfg.block_size - 1)/cfg.block_size;
+        fpga_curves[i].read_block = mock_read_curve_block;
+        fpga_curves[i].user = &curve_buf[i];
+    }
+
+    for (i = END_CURVE_ID; i < END_CURVE_ID+END_MONIT_ID; ++i) {
+        fpga_curves[i].info.writable = false;
+        fpga_curves[i].info.block_size = NUM_CHANNELS*sizeof(uint32_t);
+        fpga_curves[i].info.nblocks = 1;
+        fpga_curves[i].read_block = mock_read_monit_block;
+        // user != NULL selects position data
+        fpga_curves[i].user = (i - END_CURVE_ID == CURVE_MONIT_POS_ID) ?
+            &fpga_curves[i] : NULL;
+    }
+
+    for (i = 0; i < ARRAY_SIZE(fpga_curves); ++i) {
+        if ((err = bsmp_register_curve (fpga_server, &fpga_curves[i]))) {
+            fprintf (stderr, M "register curve #%u: %s\n", i,
+                    bsmp_error_str (err));
+            return -1;
+        }
+    }
+
+    // Start with valid data in every curve
+    for (i = 0; i < END_CURVE_ID; ++i) {
+        struct mock_curve_buf_s tmp;
+
+        st.acq_chan = i;
+        st.acq_samples = cfg.samples;
+        acq_generate ();
+        tmp = curve_buf[i];
+        curve_buf[i].front = tmp.back;
+        curve_buf[i].back = tmp.front;
+    }
+    st.acq_chan = CURVE_ADC_ID;
+
+    return 0;
+}
+
+static int mock_fe_server_new (void)
+{
+    unsigned int i;
+    enum bsmp_err err;
+
+    fe_server = bsmp_server_new ();
+    if (!fe_server) {
+        return -1;
+    }
+
+    for (i = 0; i < ARRAY_SIZE(fe_vars); ++i) {
+        if ((err = bsmp_register_variable (fe_server, &fe_vars[i]))) {
+            fprintf (stderr, M "register FE variable #%u: %s\n", i,
+                    bsmp_error_str (err));
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/***************************************************************/
+/********************** Connection handling ********************/
+/***************************************************************/
+
+struct mock_conn_s {
+    int fd;
+    bsmp_server_t *server;
+    const char *name;
+    uint64_t seed;
+};
+
+/* Delay and bandwidth shaping applied to every answer */
+static void mock_shape (struct mock_conn_s *conn, uint32_t len)
+{
+    uint64_t usec = cfg.latency_usec;
+
+    if (cfg.jitter_usec) {
+        usec += xorshift64 (&conn->seed) % cfg.jitter_usec;
+    }
+
+    if (cfg.bandwidth) {
+        usec += (uint64_t) len * 1000000 / cfg.bandwidth;
+    }
+
+    if (usec) {
+        sleep_usec (usec);
+    }
+}
+
+/* Returns 1 if the connection must be dropped */
+static int mock_inject_fault (struct mock_conn_s *conn,
+        struct bsmp_raw_packet *response)
+{
+    if (cfg.fault == MOCK_FAULT_NONE ||
+            rng_uniform (&conn->seed) >= cfg.fault_rate) {
+        return 0;
+    }
+
+    DEBUGP (M "%s: injecting %s fault\n", conn->name, fault_names[cfg.fault]);
+
+    switch (cfg.fault) {
+        case MOCK_FAULT_DROP:
+            return 1;
+
+        case MOCK_FAULT_CORRUPT:
+            if (response->len > BSMP_HEADER_SIZE) {
+                response->data[BSMP_HEADER_SIZE + xorshift64 (&conn->seed) %
+                    (response->len - BSMP_HEADER_SIZE)] ^= 0xFF;
+            }
+            break;
+
+        case MOCK_FAULT_ERROR:
+            response->data[0] = BSMP_CMD_ERR_MALFORMED;
+            response->data[1] = 0;
+            response->data[2] = 0;
+            response->len = BSMP_HEADER_SIZE;
+            break;
+
+        case MOCK_FAULT_STALL:
+            sleep_usec (MOCK_STALL_USEC);
+            break;
+
+        default:
+            break;
+    }
+
+    return 0;
+}
+
+static void *mock_conn_thread (void *arg)
+{
+    struct mock_conn_s *conn = arg;
+    struct bsmp_raw_packet request, response;
+    uint8_t *req_buf = malloc (BSMP_MAX_MESSAGE);
+    uint8_t *resp_buf = malloc (BSMP_MAX_MESSAGE);
+
+    if (!req_buf || !resp_buf) {
+        goto exit_conn;
+    }
+
+    if (cfg.verbose) {
+        fprintf (stderr, M "%s: client connected (fd %d)\n", conn->name,
+                conn->fd);
+    }
+
+    while (1) {
+        uint32_t len = BSMP_HEADER_SIZE;
+        uint32_t payload;
+        struct timespec done;
+        int hold = 0;
+
+        if (ethernet_recvall (conn->fd, req_buf, &len) < 0 ||
+                len != BSMP_HEADER_SIZE) {
+            break;
+        }
+
+        payload = (req_buf[1] << 8) + req_buf[2];
+        len = payload;
+        if (payload && (ethernet_recvall (conn->fd, req_buf + BSMP_HEADER_SIZE,
+                        &len) < 0 || len != payload)) {
+            break;
+        }
+
+        request.data = req_buf;
+        request.len = BSMP_HEADER_SIZE + payload;
+        response.data = resp_buf;
+        response.len = 0;
+
+        pthread_mutex_lock (&st.lock);
+        bsmp_server_process_packet (conn->server, &request, &response);
+        if (conn->server == fpga_server &&
+                req_buf[0] == BSMP_CMD_FUNC_EXECUTE && payload &&
+                req_buf[BSMP_HEADER_SIZE] == SET_ACQ_START_ID) {
+            done = st.acq_done;
+            hold = 1;
+        }
+        pthread_mutex_unlock (&st.lock);
+
+        // Acquisition start only answers once the capture is complete
+        if (hold) {
+            while (clock_nanosleep (CLOCK_MONOTONIC, TIMER_ABSTIME, &done,
+                        NULL) == EINTR);
+        }
+
+        if (mock_inject_fault (conn, &response)) {
+            break;
+        }
+
+        mock_shape (conn, response.len);
+
+        len = response.len;
+        if (ethnernet_sendall (conn->fd, resp_buf, &len) < 0 ||
+                len != response.len) {
+            break;
+        }
+    }
+
+    if (cfg.verbose) {
+        fprintf (stderr, M "%s: client disconnected (fd %d)\n", conn->name,
+                conn->fd);
+    }
+
+exit_conn:
+    close (conn->fd);
+    free (req_buf);
+    free (resp_buf);
+    free (conn);
+    return NULL;
+}
+
+struct mock_listener_s {
+    int fd;
+    bsmp_server_t *server;
+    const char *name;
+};
+
+static void *mock_accept_thread (void *arg)
+{
+    struct mock_listener_s *l = arg;
+    static uint64_t seed = 0x2545F4914F6CDD1DULL;
+
+    while (1) {
+        int yes = 1;
+        pthread_t tid;
+        struct mock_conn_s *conn;
+        int fd = accept (l->fd, NULL, NULL);
+
+        if (fd < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror ("accept");
+            break;
+        }
+
+        setsockopt (fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(int));
+
+        conn = malloc (sizeof(*conn));
+        if (!conn) {
+            close (fd);
+            continue;
+        }
+        conn->fd = fd;
+        conn->server = l->server;
+        conn->name = l->name;
+        conn->seed = xorshift64 (&seed);
+
+        if (pthread_create (&tid, NULL, mock_conn_thread, conn) != 0) {
+            perror ("pthread_create");
+            close (fd);
+            free (conn);
+            continue;
+        }
+        pthread_detach (tid);
+    }
+
+    return NULL;
+}
+
+static int mock_listen (const char *port)
+{
+    struct addrinfo hints, *servinfo, *p;
+    int rv;
+    int fd = -1;
+    int yes = 1;
+
+    memset (&hints, 0, sizeof hints);
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+
+    if ((rv = getaddrinfo (NULL, port, &hints, &servinfo)) != 0) {
+        fprintf (stderr, "getaddrinfo: %s\n", gai_strerror (rv));
+        return -1;
+    }
+
+    for (p = servinfo; p != NULL; p = p->ai_next) {
+        if ((fd = socket (p->ai_family, p->ai_socktype, p->ai_protocol)) == -1) {
+            perror ("server: socket");
+            continue;
+        }
+
+        setsockopt (fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(int));
+
+        if (bind (fd, p->ai_addr, p->ai_addrlen) == -1) {
+            close (fd);
+            perror ("server: bind");
+            fd = -1;
+            continue;
+        }
+
+        break;
+    }
+
+    freeaddrinfo (servinfo);
+
+    if (fd < 0 || listen (fd, 16) == -1) {
+        fprintf (stderr, M "failed to listen on port %s\n", port);
+        return -1;
+    }
+
+    return fd;
+}
+
+/***************************************************************/
+/********************* Command-line handling *******************/
+/***************************************************************/
+
+void print_usage (FILE* stream, int exit_code) __attribute__((noreturn));
+
+void print_usage (FILE* stream, int exit_code)
+{
+    fprintf (stream, "Mock BPM FPGA/RFFE BSMP server\n");
+    fprintf (stream, "Git commit ID: %s.\n", build_revision);
+    fprintf (stream, "Build date: %s.\n\n", build_date);
+    fprintf (stream, "Usage:  %s options \n", program_name);
+    fprintf (stream,
+            "  -h  --help                      Display this usage information.\n"
+            "  -v  --verbose                   Print verbose messages.\n"
+            "  -p  --fpgaport     <port>       Listen for FPGA clients on <port>\n"
+            "                                    [default: " MOCK_FPGA_PORT "]\n"
+            "  -f  --rffeport     <port>       Listen for RFFE clients on <port>\n"
+            "                                    [default: " MOCK_FE_PORT "]\n"
+            "  -n  --samples      <number>     Capacity of each on-demand curve\n"
+            "                                    [in samples of 4 channels]\n"
+            "  -s  --blocksize    <bytes>      BSMP curve block size\n"
+            "  -l  --latency      <usec>       Delay every answer by <usec>\n"
+            "  -j  --jitter       <usec>       Add a uniform random delay up to <usec>\n"
+            "  -b  --bandwidth    <bytes/s>    Limit the answer rate to <bytes/s>\n"
+            "  -F  --fault        <mode>       Inject faults on answers\n"
+            "                                    [<mode> must be one of the following:\n"
+            "                                     none, drop, corrupt, error, stall]\n"
+            "  -r  --faultrate    <prob>       Probability of a fault on each answer\n"
+            "  -t  --acqtimescale <factor>     Scale the simulated capture time\n"
+            "                                    [0 answers acquisitions immediately]\n"
+            "  -L  --siglevel     <dB>         ADC level relative to full scale\n"
+            "                                    with no RFFE attenuation\n"
+            "  -d  --cabledelays  <a,b,c,d>    Antenna cable delays [in ps]\n"
+            "  -2  --doublebuffer              Only replace curve data once the next\n"
+            "                                    acquisition completes\n"
+           );
+    exit (exit_code);
+}
+
+static struct option long_options[] =
+{
+    {"help",            no_argument,         NULL, 'h'},
+    {"verbose",         no_argument,         NULL, 'v'},
+    {"fpgaport",        required_argument,   NULL, 'p'},
+    {"rffeport",        required_argument,   NULL, 'f'},
+    {"samples",         required_argument,   NULL, 'n'},
+    {"blocksize",       required_argument,   NULL, 's'},
+    {"latency",         required_argument,   NULL, 'l'},
+    {"jitter",          required_argument,   NULL, 'j'},
+    {"bandwidth",       required_argument,   NULL, 'b'},
+    {"fault",           required_argument,   NULL, 'F'},
+    {"faultrate",       required_argument,   NULL, 'r'},
+    {"acqtimescale",    required_argument,   NULL, 't'},
+    {"siglevel",        required_argument,   NULL, 'L'},
+    {"cabledelays",     required_argument,   NULL, 'd'},
+    {"doublebuffer",    no_argument,         NULL, '2'},
+    {NULL, 0, NULL, 0}
+};
+
+int main(int argc, char *argv[])
+{
+    struct mock_listener_s fpga_listener, fe_listener;
+    pthread_t fpga_tid, fe_tid;
+    int ch;
+    int i;
+
+    program_name = argv[0];
+
+    while ((ch = getopt_long(argc, argv, "hvp:f:n:s:l:j:b:F:r:t:L:d:2",
+                    long_options, NULL)) != -1)
+    {
+        switch (ch)
+        {
+            case 'h':
+                print_usage (stderr, 0);
+            case 'v':
+                cfg.verbose = 1;
+                break;
+            case 'p':
+                cfg.fpga_port = strdup (optarg);
+                break;
+            case 'f':
+                cfg.fe_port = strdup (optarg);
+                break;
+            case 'n':
+                cfg.samples = (uint32_t) atoi (optarg);
+                break;
+            case 's':
+                cfg.block_size = (uint32_t) atoi (optarg);
+                break;
+            case 'l':
+                cfg.latency_usec = (uint32_t) atoi (optarg);
+                break;
+            case 'j':
+                cfg.jitter_usec = (uint32_t) atoi (optarg);
+                break;
+            case 'b':
+                cfg.bandwidth = (uint64_t) atoll (optarg);
+                break;
+            case 'F':
+                for (i = 0; i < MOCK_FAULT_END; ++i) {
+                    if (strcmp (optarg, fault_names[i]) == 0) {
+                        break;
+                    }
+                }
+                if (i == MOCK_FAULT_END) {
+                    fprintf (stderr, "%s: unknown fault mode %s\n",
+                            program_name, optarg);
+                    print_usage (stderr, 1);
+                }
+                cfg.fault = (enum mock_fault_e) i;
+                break;
+            case 'r':
+                cfg.fault_rate = atof (optarg);
+                break;
+            case 't':
+                cfg.acq_time_scale = atof (optarg);
+                break;
+            case 'L':
+                cfg.sig_level = atof (optarg);
+                break;
+            case 'd':
+                if (sscanf (optarg, "%lf,%lf,%lf,%lf", &cfg.cable_delay_ps[0],
+                            &cfg.cable_delay_ps[1], &cfg.cable_delay_ps[2],
+                            &cfg.cable_delay_ps[3]) != NUM_CHANNELS) {
+                    fprintf (stderr, "%s: --cabledelays needs 4 values\n",
+                            program_name);
+                    print_usage (stderr, 1);
+                }
+                break;
+            case '2':
+                cfg.double_buffer = 1;
+                break;
+            default:
+                print_usage (stderr, 1);
+        }
+    }
+
+    // BSMP numbers curve blocks with 16 bits
+    if (cfg.samples < 4 || cfg.block_size == 0 ||
+            cfg.block_size > BSMP_CURVE_BLOCK_MAX_SIZE ||
+            ((uint64_t) cfg.samples*NUM_CHANNELS*sizeof(uint32_t) +
+             cfg.block_size - 1)/cfg.block_size > UINT16_MAX) {
+        fprintf (stderr, "%s: invalid curve geometry\n", program_name);
+        return -1;
+    }
+
+    if (cfg.fault_rate == 0.0 && cfg.fault != MOCK_FAULT_NONE) {
+        cfg.fault_rate = 1.0;
+    }
+
+    // Clients going away must not kill us
+    signal (SIGPIPE, SIG_IGN);
+
+    if (mock_fpga_server_new () < 0 || mock_fe_server_new () < 0) {
+        fprintf (stderr, M "could not create BSMP servers\n");
+        return -1;
+    }
+
+    fpga_listener.fd = mock_listen (cfg.fpga_port ? cfg.fpga_port :
+            MOCK_FPGA_PORT);
+    fpga_listener.server = fpga_server;
+    fpga_listener.name = "FPGA";
+    fe_listener.fd = mock_listen (cfg.fe_port ? cfg.fe_port : MOCK_FE_PORT);
+    fe_listener.server = fe_server;
+    fe_listener.name = "RFFE";
+
+    if (fpga_listener.fd < 0 || fe_listener.fd < 0) {
+        return -1;
+    }
+
+    fprintf (stderr, M "FPGA on port %s, RFFE on port %s, fault %s\n",
+            cfg.fpga_port ? cfg.fpga_port : MOCK_FPGA_PORT,
+            cfg.fe_port ? cfg.fe_port : MOCK_FE_PORT,
+            fault_names[cfg.fault]);
+
+    pthread_create (&fpga_tid, NULL, mock_accept_thread, &fpga_listener);
+    pthread_create (&fe_tid, NULL, mock_accept_thread, &fe_listener);
+
+    pthread_join (fpga_tid, NULL);
+    pthread_join (fe_tid, NULL);
+
+    bsmp_server_destroy (fpga_server);
+    bsmp_server_destroy (fe_server);
+    for (i = 0; i < END_CURVE_ID; ++i) {
+        free (curve_buf[i].front);
+        free (curve_buf[i].back);
+    }
+    free (cfg.fpga_port);
+    free (cfg.fe_port);
+
+    return 0;
+}
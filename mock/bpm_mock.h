@@ -0,0 +1,61 @@
+#ifndef _BPM_MOCK_H_
+#define _BPM_MOCK_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+#include <bsmp/server.h>
+
+#include "fcs_client.h"
+
+#define MOCK_FPGA_PORT          "8080" // same as the real FPGA server
+#define MOCK_FE_PORT            "6791" // same as the real RFFE server
+
+/* Default synthetic machine. ADC is sampled at 35 times the revolution
+ * frequency and the IF completes 8 cycles per turn, so TBT and FOFB
+ * decimation are coherent with the carrier. The RF carrier, at harmonic
+ * 148 as in the metadata templates, aliases to the IF */
+#define MOCK_ADC_CLK            112583175
+#define MOCK_DDS_FREQ           (MOCK_ADC_CLK/35*8)
+#define MOCK_CARRIER_FREQ       ((double) MOCK_ADC_CLK/35*148)
+#define MOCK_TBT_DECIM          CURVE_TBT_DECIM
+#define MOCK_FOFB_DECIM         CURVE_FOFB_DECIM
+#define MOCK_TUNE_X             0.1316
+#define MOCK_TUNE_Y             0.2092
+#define MOCK_KX                 10000000 // nm, as in the metadata templates
+#define MOCK_KY                 10000000 // nm
+#define MOCK_KSUM               ((1 << 24) - 1) // ~1.0, the largest FIX25_24
+
+#define MOCK_DEFAULT_SAMPLES    100000
+#define MOCK_DEFAULT_BLOCK_SIZE 16384
+
+enum mock_fault_e {
+    MOCK_FAULT_NONE = 0,
+    MOCK_FAULT_DROP,        // close the connection instead of answering
+    MOCK_FAULT_CORRUPT,     // flip one payload byte of the answer
+    MOCK_FAULT_ERROR,       // answer with a BSMP malformed message error
+    MOCK_FAULT_STALL,       // hold the answer for MOCK_STALL_USEC
+    MOCK_FAULT_END
+};
+
+#define MOCK_STALL_USEC         2000000
+
+struct mock_config_s {
+    char *fpga_port;
+    char *fe_port;
+    uint32_t samples;               // capacity of each on-demand curve
+    uint32_t block_size;            // bytes per BSMP curve block
+    uint32_t latency_usec;          // fixed delay before each answer
+    uint32_t jitter_usec;           // uniform random delay added to it
+    uint64_t bandwidth;             // bytes/s, 0 is unlimited
+    enum mock_fault_e fault;
+    double fault_rate;              // probability of fault per answer
+    double acq_time_scale;          // scales the simulated capture time
+    double sig_level;               // dBFS at the ADC with 0 dB attenuation
+    double cable_delay_ps[4];       // per antenna delays (A is reference)
+    int double_buffer;              // latch curve data only on completion
+    int verbose;
+};
+
+#endif
@@ -0,0 +1,311 @@
+// Shared memory fan-out of the monitoring stream
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "monit_shm.h"
+#include "fcs_client.h"
+#include "debug.h"
+
+static size_t monit_shm_size (uint32_t nslots)
+{
+    return sizeof (struct monit_shm_hdr_s) +
+        (size_t) nslots*sizeof (struct monit_shm_slot_s);
+}
+
+/* Shared (not process private) futex: readers are other processes */
+static void monit_shm_futex_wake (uint32_t *uaddr)
+{
+    syscall (SYS_futex, uaddr, FUTEX_WAKE, INT32_MAX, NULL, NULL, 0);
+}
+
+static void monit_shm_futex_wait (uint32_t *uaddr, uint32_t val)
+{
+    struct timespec ts = {0, MONIT_SHM_WAIT_SLICE};
+
+    syscall (SYS_futex, uaddr, FUTEX_WAIT, val, &ts, NULL, 0);
+}
+
+static int monit_shm_alive (int32_t pid)
+{
+    return pid > 0 && (kill (pid, 0) == 0 || errno == EPERM);
+}
+
+/* Takes over the ring at name if its publisher is gone. Readers still on
+ * it resync on the new generation */
+static int monit_shm_take_over (struct monit_shm_s *shm, const char *name,
+        uint32_t curve_id)
+{
+    struct monit_shm_hdr_s hdr;
+    struct stat st;
+    int32_t pid;
+    int fd;
+
+    fd = shm_open (name, O_RDWR, 0);
+    if (fd < 0) {
+        perror ("monit_shm: shm_open");
+        return -1;
+    }
+
+    // Never write over anything else
+    if (fstat (fd, &st) < 0 || (size_t) st.st_size != shm->size ||
+            pread (fd, &hdr, sizeof hdr, 0) != (ssize_t) sizeof hdr ||
+            memcmp (hdr.magic, MONIT_SHM_MAGIC, sizeof hdr.magic) != 0 ||
+            hdr.version != MONIT_SHM_VERSION ||
+            hdr.nslots != MONIT_SHM_SLOTS ||
+            hdr.slot_size != sizeof (struct monit_shm_slot_s)) {
+        fprintf (stderr, "monit_shm: %s exists and is not a version %d "
+                "monitoring ring\n", name, MONIT_SHM_VERSION);
+        close (fd);
+        return -1;
+    }
+
+    shm->hdr = mmap (NULL, shm->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close (fd);
+    if (shm->hdr == MAP_FAILED) {
+        perror ("monit_shm: mmap");
+        shm->hdr = NULL;
+        return -1;
+    }
+
+    // Against a live publisher, and another one taking over at the same time
+    pid = __atomic_load_n (&shm->hdr->pid, __ATOMIC_ACQUIRE);
+    if (monit_shm_alive (pid) || !__atomic_compare_exchange_n (&shm->hdr->pid,
+                &pid, getpid (), 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        fprintf (stderr, "monit_shm: %s is published by process %d\n", name,
+                (int) pid);
+        munmap (shm->hdr, shm->size);
+        shm->hdr = NULL;
+        return -1;
+    }
+
+    shm->hdr->curve_id = curve_id;
+    __atomic_store_n (&shm->hdr->closed, 0, __ATOMIC_RELEASE);
+    __atomic_fetch_add (&shm->hdr->generation, 1, __ATOMIC_RELEASE);
+    __atomic_fetch_add (&shm->hdr->futex, 1, __ATOMIC_RELEASE);
+    monit_shm_futex_wake (&shm->hdr->futex);
+
+    DEBUGP ("monit_shm: took over %s from process %d\n", name, (int) pid);
+
+    return 0;
+}
+
+int monit_shm_publish_open (struct monit_shm_s *shm, const char *name,
+        uint32_t curve_id)
+{
+    int fd;
+
+    memset (shm, 0, sizeof *shm);
+    snprintf (shm->name, sizeof shm->name, "%s", name);
+    shm->size = monit_shm_size (MONIT_SHM_SLOTS);
+    shm->publisher = 1;
+    shm->curve_id = curve_id;
+
+    // A ring left behind by a publisher that died is taken over
+    fd = shm_open (name, O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0 && errno == EEXIST) {
+        return monit_shm_take_over (shm, name, curve_id);
+    }
+    if (fd < 0) {
+        perror ("monit_shm: shm_open");
+        return -1;
+    }
+
+    if (ftruncate (fd, shm->size) < 0) {
+        perror ("monit_shm: ftruncate");
+        close (fd);
+        shm_unlink (name);
+        return -1;
+    }
+
+    shm->hdr = mmap (NULL, shm->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close (fd);
+    if (shm->hdr == MAP_FAILED) {
+        perror ("monit_shm: mmap");
+        shm->hdr = NULL;
+        shm_unlink (name);
+        return -1;
+    }
+
+    // New, so all zero
+    shm->hdr->version = MONIT_SHM_VERSION;
+    shm->hdr->nslots = MONIT_SHM_SLOTS;
+    shm->hdr->slot_size = sizeof (struct monit_shm_slot_s);
+    shm->hdr->curve_id = curve_id;
+    shm->hdr->pid = getpid ();
+    shm->hdr->generation = 1;
+    // Readers check the magic last
+    __atomic_thread_fence (__ATOMIC_RELEASE);
+    memcpy (shm->hdr->magic, MONIT_SHM_MAGIC, sizeof shm->hdr->magic);
+
+    DEBUGP ("monit_shm: publishing on %s\n", name);
+
+    return 0;
+}
+
+void monit_shm_publish (struct monit_shm_s *shm,
+        const plot_values_monit_uint32_t *val, const struct timespec *ts)
+{
+    struct monit_shm_hdr_s *hdr = shm->hdr;
+    uint64_t n = hdr->write_seq;
+    struct monit_shm_slot_s *slot = &hdr->slots[n % hdr->nslots];
+
+    __atomic_store_n (&slot->seq, 2*n + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence (__ATOMIC_RELEASE);
+
+    slot->ts_sec = ts->tv_sec;
+    slot->ts_nsec = ts->tv_nsec;
+    slot->val = *val;
+
+    __atomic_store_n (&slot->seq, 2*n + 2, __ATOMIC_RELEASE);
+    __atomic_store_n (&hdr->write_seq, n + 1, __ATOMIC_RELEASE);
+
+    __atomic_fetch_add (&hdr->futex, 1, __ATOMIC_RELEASE);
+    monit_shm_futex_wake (&hdr->futex);
+}
+
+int monit_shm_subscribe (struct monit_shm_s *shm, const char *name)
+{
+    struct monit_shm_hdr_s hdr;
+    struct stat st;
+    int fd;
+
+    memset (shm, 0, sizeof *shm);
+    snprintf (shm->name, sizeof shm->name, "%s", name);
+
+    fd = shm_open (name, O_RDONLY, 0);
+    if (fd < 0) {
+        perror ("monit_shm: shm_open");
+        return -1;
+    }
+
+    if (fstat (fd, &st) < 0 || (size_t) st.st_size < sizeof hdr) {
+        fprintf (stderr, "monit_shm: %s is not a monitoring ring\n", name);
+        close (fd);
+        return -1;
+    }
+
+    if (pread (fd, &hdr, sizeof hdr, 0) != (ssize_t) sizeof hdr ||
+            memcmp (hdr.magic, MONIT_SHM_MAGIC, sizeof hdr.magic) != 0 ||
+            hdr.version != MONIT_SHM_VERSION ||
+            hdr.slot_size != sizeof (struct monit_shm_slot_s) ||
+            (size_t) st.st_size < monit_shm_size (hdr.nslots)) {
+        fprintf (stderr, "monit_shm: %s is not a version %d monitoring ring\n",
+                name, MONIT_SHM_VERSION);
+        close (fd);
+        return -1;
+    }
+
+    if (hdr.curve_id != CURVE_MONIT_AMP_ID && hdr.curve_id != CURVE_MONIT_POS_ID) {
+        fprintf (stderr, "monit_shm: %s carries unknown curve %u\n", name,
+                hdr.curve_id);
+        close (fd);
+        return -1;
+    }
+
+    shm->size = monit_shm_size (hdr.nslots);
+    shm->hdr = mmap (NULL, shm->size, PROT_READ, MAP_SHARED, fd, 0);
+    close (fd);
+    if (shm->hdr == MAP_FAILED) {
+        perror ("monit_shm: mmap");
+        shm->hdr = NULL;
+        return -1;
+    }
+
+    shm->curve_id = hdr.curve_id;
+    shm->generation = __atomic_load_n (&shm->hdr->generation, __ATOMIC_ACQUIRE);
+    shm->cursor = __atomic_load_n (&shm->hdr->write_seq, __ATOMIC_ACQUIRE);
+
+    return 0;
+}
+
+int monit_shm_read (struct monit_shm_s *shm, plot_values_monit_uint32_t *val,
+        struct timespec *ts)
+{
+    struct monit_shm_hdr_s *hdr = shm->hdr;
+
+    for (;;) {
+        uint32_t futex = __atomic_load_n (&hdr->futex, __ATOMIC_ACQUIRE);
+        uint32_t generation = __atomic_load_n (&hdr->generation, __ATOMIC_ACQUIRE);
+        uint64_t head = __atomic_load_n (&hdr->write_seq, __ATOMIC_ACQUIRE);
+        struct monit_shm_slot_s *slot;
+        uint64_t seq;
+
+        // Taken over: go on from the newest sample, if still the same curve
+        if (generation != shm->generation) {
+            if (__atomic_load_n (&hdr->curve_id, __ATOMIC_RELAXED) != shm->curve_id) {
+                fprintf (stderr, "monit_shm: %s now carries curve %u\n",
+                        shm->name, hdr->curve_id);
+                return -1;
+            }
+            DEBUGP ("monit_shm: %s taken over, resyncing\n", shm->name);
+            shm->generation = generation;
+            shm->cursor = head;
+        }
+
+        if (shm->cursor >= head) {
+            if (__atomic_load_n (&hdr->closed, __ATOMIC_ACQUIRE)) {
+                return -1;
+            }
+
+            monit_shm_futex_wait (&hdr->futex, futex);
+            if (shm->cursor >= __atomic_load_n (&hdr->write_seq, __ATOMIC_ACQUIRE)) {
+                return 0;
+            }
+            continue;
+        }
+
+        // Lapped: skip to the oldest sample still in the ring
+        if (head - shm->cursor > hdr->nslots) {
+            shm->dropped += head - hdr->nslots - shm->cursor;
+            shm->cursor = head - hdr->nslots;
+        }
+
+        slot = &hdr->slots[shm->cursor % hdr->nslots];
+        seq = __atomic_load_n (&slot->seq, __ATOMIC_ACQUIRE);
+
+        if (seq == 2*shm->cursor + 2) {
+            val->ch0 = slot->val.ch0;
+            val->ch1 = slot->val.ch1;
+            val->ch2 = slot->val.ch2;
+            val->ch3 = slot->val.ch3;
+            ts->tv_sec = slot->ts_sec;
+            ts->tv_nsec = slot->ts_nsec;
+
+            __atomic_thread_fence (__ATOMIC_ACQUIRE);
+            if (__atomic_load_n (&slot->seq, __ATOMIC_RELAXED) == seq) {
+                ++shm->cursor;
+                return 1;
+            }
+        }
+
+        // Overwritten while (or before) we got to it
+        ++shm->dropped;
+        ++shm->cursor;
+    }
+}
+
+void monit_shm_close (struct monit_shm_s *shm)
+{
+    if (!shm->hdr) {
+        return;
+    }
+
+    if (shm->publisher) {
+        __atomic_store_n (&shm->hdr->closed, 1, __ATOMIC_RELEASE);
+        __atomic_fetch_add (&shm->hdr->futex, 1, __ATOMIC_RELEASE);
+        monit_shm_futex_wake (&shm->hdr->futex);
+        shm_unlink (shm->name);
+    }
+
+    munmap (shm->hdr, shm->size);
+    shm->hdr = NULL;
+}
@@ -0,0 +1,73 @@
+#ifndef _MONIT_SHM_H_
+#define _MONIT_SHM_H_
+
+#include <time.h>
+#include <inttypes.h>
+
+#include "output.h"
+
+/* Monitoring samples published in a POSIX shared memory ring. There is a
+ * single publisher and any number of readers, each with its own cursor.
+ * Slots are guarded by a sequence lock, so a reader that is lapped by the
+ * publisher notices it and counts the samples it lost instead of blocking
+ * the publisher.
+ *
+ * A ring is only taken over from a publisher that is gone (its pid is not
+ * alive, or it closed). The taker keeps the samples and the sequence but
+ * bumps the generation, so readers left on the ring resync to its newest
+ * sample, or stop if it now carries another curve */
+#define MONIT_SHM_MAGIC         "FCSMONIT"
+#define MONIT_SHM_VERSION       2
+#define MONIT_SHM_SLOTS         4096
+#define MONIT_SHM_WAIT_SLICE    100000000 // ns, to notice signals/closing
+
+struct monit_shm_slot_s {
+    uint64_t seq;                   // 2n+1 while sample n is written, 2n+2 after
+    int64_t ts_sec;                 // CLOCK_REALTIME of the sample
+    int64_t ts_nsec;
+    plot_values_monit_uint32_t val;
+};
+
+struct monit_shm_hdr_s {
+    char magic[8];
+    uint32_t version;
+    uint32_t nslots;
+    uint32_t slot_size;
+    uint32_t curve_id;              // CURVE_MONIT_AMP_ID or CURVE_MONIT_POS_ID
+    uint64_t write_seq;             // samples published so far
+    uint32_t futex;                 // bumped on every publish, readers wait on it
+    uint32_t closed;                // publisher is gone
+    int32_t pid;                    // of the publisher
+    uint32_t generation;            // bumped on every take over
+    struct monit_shm_slot_s slots[];
+};
+
+struct monit_shm_s {
+    struct monit_shm_hdr_s *hdr;
+    size_t size;
+    char name[256];
+    int publisher;
+    uint32_t curve_id;
+    uint32_t generation;            // reader: of the publisher followed
+    uint64_t cursor;                // reader: next sample to read
+    uint64_t dropped;               // reader: samples lost to the publisher
+};
+
+/* name is a shm_open () name, e.g. "/fcs_monit_pos". Fails if another
+ * process is publishing on it */
+int monit_shm_publish_open (struct monit_shm_s *shm, const char *name,
+        uint32_t curve_id);
+void monit_shm_publish (struct monit_shm_s *shm,
+        const plot_values_monit_uint32_t *val, const struct timespec *ts);
+
+/* Attaches a reader at the newest sample */
+int monit_shm_subscribe (struct monit_shm_s *shm, const char *name);
+/* Copies the next sample out. Returns 1 with a sample, 0 if none arrived
+ * within MONIT_SHM_WAIT_SLICE and -1 once the publisher has closed or the
+ * ring was taken over for another curve */
+int monit_shm_read (struct monit_shm_s *shm, plot_values_monit_uint32_t *val,
+        struct timespec *ts);
+
+void monit_shm_close (struct monit_shm_s *shm);
+
+#endif
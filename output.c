@@ -0,0 +1,103 @@
+// Text formatting of curve and monitoring data
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "output.h"
+
+#define TIMESTAMP_BUF_LEN 80
+
+static char buffer[TIMESTAMP_BUF_LEN];
+char * timestamp_str_at (const struct timespec *tsp)
+{
+    int ret;
+    int len = TIMESTAMP_BUF_LEN;
+
+    ret = strftime (buffer, 80, "%Y-%m-%dT%H:%M:%S", localtime(&tsp->tv_sec));
+    len -= ret-1;
+    snprintf(&buffer[strlen(buffer)], len, ".%09ldZ", tsp->tv_nsec);
+
+    return buffer;
+}
+
+char * timestamp_str (void)
+{
+    struct timespec tsp;
+
+    clock_gettime(CLOCK_REALTIME, &tsp);   //Call clock_gettime to fill tsp
+    return timestamp_str_at (&tsp);
+}
+
+/* Print data composed of 16-bit signed data */
+int fprint_curve_16 (FILE *stream, uint8_t *curve_data, uint32_t len)
+{
+    unsigned int i;
+    for (i = 0; i < len/(SIZE_16_BYTES*NUM_CHANNELS); ++i) {
+        fprintf (stream, "%d %d %d %d\n",
+                *((int16_t *)curve_data + i*NUM_CHANNELS),
+                *((int16_t *)curve_data + i*NUM_CHANNELS+1),
+                *((int16_t *)curve_data + i*NUM_CHANNELS+2),
+                *((int16_t *)curve_data + i*NUM_CHANNELS+3));
+    }
+
+    return 0;
+}
+
+int print_curve_16 (uint8_t *curve_data, uint32_t len)
+{
+    return fprint_curve_16 (stdout, curve_data, len);
+}
+
+/* Print data composed of 32-bit signed data */
+int fprint_curve_32 (FILE *stream, uint8_t *curve_data, uint32_t len)
+{
+    unsigned int i;
+    //for (i = 0; i < len/4; ++i) {
+    //    printf ("%d\n", *((int32_t *)((uint8_t *)curve_data + i*4)));
+    //}
+    for (i = 0; i < len/(SIZE_32_BYTES*NUM_CHANNELS); ++i) {
+        fprintf (stream, "%d %d %d %d\n",
+                *((int32_t *)curve_data + i*NUM_CHANNELS),
+                *((int32_t *)curve_data + i*NUM_CHANNELS+1),
+                *((int32_t *)curve_data + i*NUM_CHANNELS+2),
+                *((int32_t *)curve_data + i*NUM_CHANNELS+3));
+    }
+
+    return 0;
+}
+
+int print_curve_32 (uint8_t *curve_data, uint32_t len)
+{
+    return fprint_curve_32 (stdout, curve_data, len);
+}
+
+/* Print a monitoring sample, preceded by the timestamp tsp if not NULL */
+int print_stream_curve_at (const struct timespec *tsp,
+        const plot_values_monit_uint32_t *pval_monit_uint32)
+{
+    if (tsp) {
+        printf ("%s ", timestamp_str_at (tsp));
+    }
+
+    printf ("%d %d %d %d\n",
+            pval_monit_uint32->ch0,
+            pval_monit_uint32->ch1,
+            pval_monit_uint32->ch2,
+            pval_monit_uint32->ch3);
+    fflush(stdout);
+
+    return 0;
+}
+
+int print_stream_curve (int monit_timestamp,
+        plot_values_monit_uint32_t *pval_monit_uint32)
+{
+    struct timespec tsp;
+
+    if (monit_timestamp) {
+        clock_gettime(CLOCK_REALTIME, &tsp);
+    }
+
+    return print_stream_curve_at (monit_timestamp ? &tsp : NULL,
+            pval_monit_uint32);
+}
@@ -0,0 +1,40 @@
+#ifndef _OUTPUT_H_
+#define _OUTPUT_H_
+
+#include <stdio.h>
+#include <time.h>
+#include <inttypes.h>
+
+#define PLOT_BUFFER_LEN 1024 // in 32-bit words
+#define NUM_CHANNELS 4
+typedef struct _plot_values_monit_double_t {
+    double ch0[PLOT_BUFFER_LEN];
+    double ch1[PLOT_BUFFER_LEN];
+    double ch2[PLOT_BUFFER_LEN];
+    double ch3[PLOT_BUFFER_LEN];
+} plot_values_monit_double_t;
+
+typedef struct _plot_values_monit_uint32_t {
+    uint32_t ch0;
+    uint32_t ch1;
+    uint32_t ch2;
+    uint32_t ch3;
+} plot_values_monit_uint32_t;
+
+#define SIZE_16_BYTES sizeof(uint16_t)
+#define SIZE_32_BYTES sizeof(uint32_t)
+
+char * timestamp_str (void);
+char * timestamp_str_at (const struct timespec *tsp);
+/* Print data composed of 16-bit signed data */
+int fprint_curve_16 (FILE *stream, uint8_t *curve_data, uint32_t len);
+int print_curve_16 (uint8_t *curve_data, uint32_t len);
+/* Print data composed of 32-bit signed data */
+int fprint_curve_32 (FILE *stream, uint8_t *curve_data, uint32_t len);
+int print_curve_32 (uint8_t *curve_data, uint32_t len);
+int print_stream_curve (int monit_timestamp,
+        plot_values_monit_uint32_t *pval_monit_uint32);
+int print_stream_curve_at (const struct timespec *tsp,
+        const plot_values_monit_uint32_t *pval_monit_uint32);
+
+#endif
@@ -0,0 +1,170 @@
+// Beam position (X, Y, Q, Sum) from button amplitudes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "position.h"
+
+typedef double pos_v4d_t __attribute__ ((vector_size (4*sizeof (double))));
+
+/* The FPGA divides by 1 when there is no signal at all */
+#define POS_NONZERO(s)          ((s) == 0 ? 1 : (s))
+#define POS_NONZERO_V(v)        ((v) - __builtin_convertvector ((v) == 0, pos_v4d_t))
+
+static const char *pos_names[POS_END] = {
+    "dos", "pds"
+};
+
+int pos_method (const char *name)
+{
+    int i;
+
+    for (i = 0; i < POS_END; ++i) {
+        if (strcmp (name, pos_names[i]) == 0) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+const char *pos_method_name (int method)
+{
+    return method >= 0 && method < POS_END ? pos_names[method] : "?";
+}
+
+void pos_k_init (struct pos_k_s *k, uint32_t kx, uint32_t ky, uint32_t ksum)
+{
+    k->kx = kx;
+    k->ky = ky;
+    // 25 bits, two's complement: bit 24 is the sign
+    ksum &= POS_KSUM_MASK;
+    k->ksum = ((double) ksum - (ksum & POS_KSUM_SIGN ? 2.0*POS_KSUM_SIGN : 0))/
+        POS_KSUM_ONE;
+}
+
+/***************************************************************/
+/*************************** Kernels ***************************/
+/***************************************************************/
+
+static void pos_one (int method, const struct pos_k_s *k, double a, double b,
+        double c, double d, double *out)
+{
+    double s = POS_NONZERO (a + b + c + d);
+
+    if (method == POS_PDS) {
+        double u = (a - c)/POS_NONZERO (a + c);
+        double v = (d - b)/POS_NONZERO (d + b);
+
+        out[0] = k->kx*(u + v)*0.5;
+        out[1] = k->ky*(u - v)*0.5;
+    }
+    else {
+        out[0] = k->kx*((a + d) - (b + c))/s;
+        out[1] = k->ky*((a + b) - (c + d))/s;
+    }
+
+    out[2] = k->kx*((a + c) - (b + d))/s;
+    out[3] = k->ksum*s;
+}
+
+/* Rows [0, n), n a multiple of 4, four rows at a time. Built for AVX2
+ * too, picked at load time on CPUs that have it */
+__attribute__ ((target_clones ("avx2", "default")))
+static void pos_kernel (int method, const struct pos_k_s *k,
+        double *const *amp, double *const *pos, uint32_t n)
+{
+    pos_v4d_t a, b, c, d, s, x, y;
+    uint32_t i;
+
+    for (i = 0; i < n; i += 4) {
+        memcpy (&a, amp[0] + i, sizeof a);
+        memcpy (&b, amp[1] + i, sizeof b);
+        memcpy (&c, amp[2] + i, sizeof c);
+        memcpy (&d, amp[3] + i, sizeof d);
+
+        s = a + b + c + d;
+        s = POS_NONZERO_V (s);
+
+        if (method == POS_PDS) {
+            pos_v4d_t ac = a + c, db = d + b;
+            pos_v4d_t u = (a - c)/POS_NONZERO_V (ac);
+            pos_v4d_t v = (d - b)/POS_NONZERO_V (db);
+
+            x = k->kx*(u + v)*0.5;
+            y = k->ky*(u - v)*0.5;
+        }
+        else {
+            x = k->kx*((a + d) - (b + c))/s;
+            y = k->ky*((a + b) - (c + d))/s;
+        }
+
+        memcpy (pos[0] + i, &x, sizeof x);
+        memcpy (pos[1] + i, &y, sizeof y);
+        x = k->kx*((a + c) - (b + d))/s;
+        y = k->ksum*s;
+        memcpy (pos[2] + i, &x, sizeof x);
+        memcpy (pos[3] + i, &y, sizeof y);
+    }
+}
+
+void pos_compute (int method, const struct pos_k_s *k,
+        const struct soa_s *amp, struct soa_s *pos)
+{
+    uint32_t n = amp->rows & ~3u;
+    uint32_t i;
+
+    pos_kernel (method, k, amp->ch, pos->ch, n);
+
+    for (i = n; i < amp->rows; ++i) {
+        double out[NUM_CHANNELS];
+        unsigned int c;
+
+        pos_one (method, k, amp->ch[0][i], amp->ch[1][i], amp->ch[2][i],
+                amp->ch[3][i], out);
+        for (c = 0; c < NUM_CHANNELS; ++c) {
+            pos->ch[c][i] = out[c];
+        }
+    }
+
+    pos->rows = amp->rows;
+}
+
+static int32_t pos_round (double v)
+{
+    if (v >= INT32_MAX) {
+        return INT32_MAX;
+    }
+    if (v <= INT32_MIN) {
+        return INT32_MIN;
+    }
+    return (int32_t) lrint (v);
+}
+
+void pos_sample (int method, const struct pos_k_s *k,
+        const plot_values_monit_uint32_t *amp, plot_values_monit_uint32_t *pos)
+{
+    double out[NUM_CHANNELS];
+
+    // Monitoring words are signed
+    pos_one (method, k, (int32_t) amp->ch0, (int32_t) amp->ch1,
+            (int32_t) amp->ch2, (int32_t) amp->ch3, out);
+
+    pos->ch0 = pos_round (out[0]);
+    pos->ch1 = pos_round (out[1]);
+    pos->ch2 = pos_round (out[2]);
+    pos->ch3 = pos_round (out[3]);
+}
+
+void pos_to_rows (const struct soa_s *pos, int32_t *rows)
+{
+    uint32_t i;
+    unsigned int c;
+
+    for (i = 0; i < pos->rows; ++i) {
+        for (c = 0; c < NUM_CHANNELS; ++c) {
+            rows[i*NUM_CHANNELS + c] = pos_round (pos->ch[c][i]);
+        }
+    }
+}
@@ -0,0 +1,50 @@
+#ifndef _POSITION_H_
+#define _POSITION_H_
+
+#include <inttypes.h>
+
+#include "output.h"
+#include "soa.h"
+
+/* Beam position from the four button amplitudes A, B, C, D (A and D on
+ * the +X side, A and B on the +Y side), as the FPGA computes it:
+ *  dos: delta over sum,
+ *       X = Kx*((A+D)-(B+C))/S, Y = Ky*((A+B)-(C+D))/S, S = A+B+C+D
+ *  pds: partial delta over sum, each diagonal pair on its own,
+ *       u = (A-C)/(A+C), v = (D-B)/(D+B), X = Kx*(u+v)/2, Y = Ky*(u-v)/2
+ * Both give Q = Kx*((A+C)-(B+D))/S and Sum = Ksum*S, in the layout of
+ * tbtpos_curve and monit_pos (X, Y, Q, Sum) */
+#define POS_KSUM_ONE            (1 << 24) // 1.0 in FIX25_24 (24 fraction bits)
+#define POS_KSUM_SIGN           (1u << 24)
+#define POS_KSUM_MASK           ((1u << 25) - 1)
+
+enum pos_method_e {
+    POS_DOS = 0,
+    POS_PDS,
+    POS_END
+};
+
+struct pos_k_s {
+    double kx;                      // nm
+    double ky;                      // nm
+    double ksum;
+};
+
+/* Returns -1 if name is not a method */
+int pos_method (const char *name);
+const char *pos_method_name (int method);
+
+/* From the get_kx/get_ky (UFIX25_0) and get_ksum (FIX25_24) words */
+void pos_k_init (struct pos_k_s *k, uint32_t kx, uint32_t ky, uint32_t ksum);
+
+/* amp->rows rows of amp (A, B, C, D) to pos (X, Y, Q, Sum). pos must
+ * have room for them */
+void pos_compute (int method, const struct pos_k_s *k,
+        const struct soa_s *amp, struct soa_s *pos);
+/* A single sample, e.g. of the Monitoring stream */
+void pos_sample (int method, const struct pos_k_s *k,
+        const plot_values_monit_uint32_t *amp, plot_values_monit_uint32_t *pos);
+/* Interleaved int32 rows, rounded and clipped as the FPGA outputs them */
+void pos_to_rows (const struct soa_s *pos, int32_t *rows);
+
+#endif
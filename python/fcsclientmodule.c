@@ -0,0 +1,1327 @@
+// CPython bindings of libfcsclient
+#include <stdlib.h>
+#include <string.h>
+
+#include "fcsclientmodule.h"
+
+static PyObject *fcspy_error;
+
+static PyObject *fcspy_raise (int err)
+{
+    PyObject *args = Py_BuildValue ("(is)", err, fcs_error_str (err));
+
+    if (args) {
+        PyErr_SetObject (fcspy_error, args);
+        Py_DECREF (args);
+    }
+
+    return NULL;
+}
+
+/***************************************************************/
+/**************************** Curve ****************************/
+/***************************************************************/
+
+static void fcspy_curve_dealloc (fcspy_curve_t *self)
+{
+    PyMem_RawFree (self->data);
+    Py_TYPE (self)->tp_free ((PyObject *) self);
+}
+
+static int fcspy_curve_getbuffer (fcspy_curve_t *self, Py_buffer *view,
+        int flags)
+{
+    // rows x channels, C order
+    if ((flags & PyBUF_F_CONTIGUOUS) == PyBUF_F_CONTIGUOUS) {
+        PyErr_SetString (PyExc_BufferError, "Curve is C contiguous only");
+        view->obj = NULL;
+        return -1;
+    }
+
+    view->obj = (PyObject *) self;
+    view->buf = self->data;
+    view->len = self->shape[0]*self->strides[0];
+    view->readonly = 0;
+    view->itemsize = self->sample_size;
+    view->format = (flags & PyBUF_FORMAT) ?
+        (self->sample_size == SIZE_16_BYTES ? "h" : "i") : NULL;
+    view->shape = (flags & PyBUF_ND) ? self->shape : NULL;
+    view->ndim = view->shape ? 2 : 1;
+    view->strides = (flags & PyBUF_STRIDES) == PyBUF_STRIDES ? self->strides : NULL;
+    view->suboffsets = NULL;
+    view->internal = NULL;
+
+    Py_INCREF (self);
+
+    return 0;
+}
+
+static Py_ssize_t fcspy_curve_len (fcspy_curve_t *self)
+{
+    return self->shape[0];
+}
+
+/* Same text as fcs_client --getcurve, as bytes */
+static PyObject *fcspy_curve_totext (fcspy_curve_t *self,
+        PyObject *Py_UNUSED (ignored))
+{
+    Py_ssize_t rows = self->shape[0];
+    PyObject *text;
+    char *p, *end;
+    Py_ssize_t i;
+
+    text = PyBytes_FromStringAndSize (NULL, rows*FCSPY_TEXT_ROW_LEN);
+    if (!text) {
+        return NULL;
+    }
+
+    p = PyBytes_AS_STRING (text);
+    end = p + rows*FCSPY_TEXT_ROW_LEN;
+
+    for (i = 0; i < rows; ++i) {
+        int32_t v[NUM_CHANNELS];
+        unsigned int c;
+
+        for (c = 0; c < NUM_CHANNELS; ++c) {
+            v[c] = self->sample_size == SIZE_16_BYTES ?
+                ((int16_t *) self->data)[i*NUM_CHANNELS + c] :
+                ((int32_t *) self->data)[i*NUM_CHANNELS + c];
+        }
+
+        p += snprintf (p, end - p, "%d %d %d %d\n", v[0], v[1], v[2], v[3]);
+    }
+
+    if (_PyBytes_Resize (&text, p - PyBytes_AS_STRING (text)) < 0) {
+        return NULL;
+    }
+
+    return text;
+}
+
+/* Software deswitching of an ADC curve, in place */
+static PyObject *fcspy_curve_deswitch (fcspy_curve_t *self, PyObject *args)
+{
+    unsigned int divclk, phaseclk;
+    struct dsw_s dsw;
+
+    if (!PyArg_ParseTuple (args, "II", &divclk, &phaseclk)) {
+        return NULL;
+    }
+
+    if (self->id != CURVE_ADC_ID) {
+        PyErr_SetString (PyExc_ValueError, "only ADC curves are switched");
+        return NULL;
+    }
+
+    if (dsw_init (&dsw, divclk, phaseclk) < 0) {
+        PyErr_SetString (PyExc_ValueError, "divclk too small to switch");
+        return NULL;
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    dsw_apply_16 (&dsw, (int16_t *) self->data, self->shape[0]);
+    Py_END_ALLOW_THREADS
+
+    Py_RETURN_NONE;
+}
+
+/* Data quality checks of the first rows of the curve (all if 0), as a
+ * dict of counts */
+static PyObject *fcspy_curve_check (fcspy_curve_t *self, PyObject *args)
+{
+    Py_ssize_t rows = 0;
+    struct qc_s qc;
+
+    if (!PyArg_ParseTuple (args, "|n", &rows)) {
+        return NULL;
+    }
+    if (rows <= 0 || rows > self->shape[0]) {
+        rows = self->shape[0];
+    }
+
+    qc_reset (&qc);
+
+    Py_BEGIN_ALLOW_THREADS
+    if (self->sample_size == SIZE_16_BYTES) {
+        qc_check_16 (&qc, (int16_t *) self->data, rows);
+    }
+    else {
+        qc_check_rows (&qc, (int32_t *) self->data, rows, QC_FS_32);
+    }
+    Py_END_ALLOW_THREADS
+
+    return Py_BuildValue ("{s:K,s:(KKKK),s:(KKKK),s:K,s:K}",
+            "rows", (unsigned long long) qc.rows,
+            "clipped", (unsigned long long) qc.clipped[0],
+            (unsigned long long) qc.clipped[1],
+            (unsigned long long) qc.clipped[2],
+            (unsigned long long) qc.clipped[3],
+            "stuck", (unsigned long long) qc.stuck[0],
+            (unsigned long long) qc.stuck[1],
+            (unsigned long long) qc.stuck[2],
+            (unsigned long long) qc.stuck[3],
+            "zero_blocks", (unsigned long long) qc.zero_blocks,
+            "issues", (unsigned long long) qc_issues (&qc));
+}
+
+static PyObject *fcspy_curve_get_name (fcspy_curve_t *self,
+        void *Py_UNUSED (closure))
+{
+    return PyUnicode_FromString (fcs_curve_name (self->id));
+}
+
+static PyObject *fcspy_curve_get_id (fcspy_curve_t *self,
+        void *Py_UNUSED (closure))
+{
+    return PyLong_FromUnsignedLong (self->id);
+}
+
+static PyMethodDef fcspy_curve_methods[] = {
+    {"totext", (PyCFunction) fcspy_curve_totext, METH_NOARGS,
+        "totext() -> bytes\n\nThe curve as fcs_client prints it: one row of "
+            "space separated channels per line."},
+    {"deswitch", (PyCFunction) fcspy_curve_deswitch, METH_VARARGS,
+        "deswitch(divclk, phaseclk)\n\nSwaps the crossed halves of each RFFE "
+            "switching period back, in place, given the get_sw_divclk and "
+            "get_sw_phaseclk read-back. ADC curves only."},
+    {"check", (PyCFunction) fcspy_curve_check, METH_VARARGS,
+        "check(rows=0) -> dict\n\nData quality counts of the first rows "
+            "(all if 0): clipped samples near full scale and stuck runs per "
+            "channel, all-zero blocks of rows, and their total as 'issues'."},
+    {NULL, NULL, 0, NULL}
+};
+
+static PyGetSetDef fcspy_curve_getset[] = {
+    {"name", (getter) fcspy_curve_get_name, NULL, "Curve name", NULL},
+    {"id", (getter) fcspy_curve_get_id, NULL, "Curve ID", NULL},
+    {NULL, NULL, NULL, NULL, NULL}
+};
+
+static PyBufferProcs fcspy_curve_as_buffer = {
+    .bf_getbuffer = (getbufferproc) fcspy_curve_getbuffer,
+};
+
+static PySequenceMethods fcspy_curve_as_sequence = {
+    .sq_length = (lenfunc) fcspy_curve_len,
+};
+
+static PyTypeObject fcspy_curve_type = {
+    PyVarObject_HEAD_INIT (NULL, 0)
+    .tp_name = "fcsclient.Curve",
+    .tp_doc = "Curve samples, rows x 4 channels. Supports the buffer "
+        "protocol:\nnumpy.asarray(curve) or memoryview(curve) use the "
+        "received memory\nwithout copying it.",
+    .tp_basicsize = sizeof (fcspy_curve_t),
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_dealloc = (destructor) fcspy_curve_dealloc,
+    .tp_as_buffer = &fcspy_curve_as_buffer,
+    .tp_as_sequence = &fcspy_curve_as_sequence,
+    .tp_methods = fcspy_curve_methods,
+    .tp_getset = fcspy_curve_getset,
+};
+
+/***************************************************************/
+/*************************** Session ***************************/
+/***************************************************************/
+
+/* Sessions must only be used by one thread at a time, and the BSMP calls
+ * run without the GIL: a second caller gets an exception, not a race */
+static int fcspy_acquire (fcspy_session_t *self)
+{
+    if (!self->session) {
+        PyErr_SetString (PyExc_ValueError, "Session is closed");
+        return -1;
+    }
+
+    if (!PyThread_acquire_lock (self->lock, NOWAIT_LOCK)) {
+        PyErr_SetString (PyExc_RuntimeError, "Session is in use");
+        return -1;
+    }
+
+    return 0;
+}
+
+static void fcspy_release (fcspy_session_t *self)
+{
+    PyThread_release_lock (self->lock);
+}
+
+static int fcspy_session_init (fcspy_session_t *self, PyObject *args,
+        PyObject *kwds)
+{
+    static char *kwlist[] = {"hostname", "endpoint", "timeout", NULL};
+    const char *hostname = "localhost";
+    const char *endpoint = "fpga";
+    int timeout = FCSPY_DEFAULT_TIMEOUT;
+    enum fcs_ep_e ep;
+    fcs_session_t *s;
+
+    if (!PyArg_ParseTupleAndKeywords (args, kwds, "|ssi", kwlist, &hostname,
+                &endpoint, &timeout)) {
+        return -1;
+    }
+
+    if (strcmp (endpoint, "fpga") == 0) {
+        ep = FCS_EP_FPGA;
+    }
+    else if (strcmp (endpoint, "fe") == 0 || strcmp (endpoint, "rffe") == 0) {
+        ep = FCS_EP_FE;
+    }
+    else {
+        PyErr_Format (PyExc_ValueError, "Unknown endpoint '%s' (fpga or fe)",
+                endpoint);
+        return -1;
+    }
+
+    if (self->session) {
+        PyErr_SetString (PyExc_RuntimeError, "Session is already open");
+        return -1;
+    }
+
+    if (!self->lock) {
+        self->lock = PyThread_allocate_lock ();
+        if (!self->lock) {
+            PyErr_NoMemory ();
+            return -1;
+        }
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    s = fcs_open (ep, FCS_DEV_ETHERNET, hostname, timeout);
+    Py_END_ALLOW_THREADS
+
+    if (!s) {
+        fcspy_raise (FCS_ERR_CONNECT);
+        return -1;
+    }
+
+    self->session = s;
+
+    return 0;
+}
+
+static void fcspy_session_dealloc (fcspy_session_t *self)
+{
+    if (self->session) {
+        fcs_close (self->session);
+    }
+
+    if (self->lock) {
+        PyThread_free_lock (self->lock);
+    }
+
+    Py_TYPE (self)->tp_free ((PyObject *) self);
+}
+
+static PyObject *fcspy_session_close (fcspy_session_t *self,
+        PyObject *Py_UNUSED (ignored))
+{
+    if (!self->session) {
+        Py_RETURN_NONE;
+    }
+
+    if (fcspy_acquire (self) < 0) {
+        return NULL;
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    fcs_close (self->session);
+    Py_END_ALLOW_THREADS
+
+    self->session = NULL;
+    fcspy_release (self);
+
+    Py_RETURN_NONE;
+}
+
+static PyObject *fcspy_session_enter (fcspy_session_t *self,
+        PyObject *Py_UNUSED (ignored))
+{
+    Py_INCREF (self);
+    return (PyObject *) self;
+}
+
+static PyObject *fcspy_session_exit (fcspy_session_t *self, PyObject *args)
+{
+    PyObject *ret = fcspy_session_close (self, NULL);
+
+    (void) args;
+    if (!ret) {
+        return NULL;
+    }
+
+    Py_DECREF (ret);
+    Py_RETURN_FALSE;
+}
+
+static PyObject *fcspy_session_execute (fcspy_session_t *self, PyObject *args)
+{
+    uint32_t in[BSMP_MAX_MESSAGE/sizeof (uint32_t)] = {0};
+    uint32_t out[BSMP_MAX_MESSAGE/sizeof (uint32_t)];
+    uint32_t input_size, output_size;
+    Py_ssize_t nargs = PyTuple_GET_SIZE (args);
+    PyObject *name, *ret;
+    unsigned int nout, i;
+    int id, err;
+
+    if (nargs < 1 || !PyUnicode_Check (PyTuple_GET_ITEM (args, 0))) {
+        PyErr_SetString (PyExc_TypeError, "execute(name, *args)");
+        return NULL;
+    }
+
+    if (fcspy_acquire (self) < 0) {
+        return NULL;
+    }
+
+    name = PyTuple_GET_ITEM (args, 0);
+    id = fcs_func_id (PyUnicode_AsUTF8 (name));
+    err = id < 0 ? id : fcs_func_size (self->session, id, &input_size,
+            &output_size);
+    if (err) {
+        fcspy_release (self);
+        return fcspy_raise (err);
+    }
+
+    // Every argument and result is a 32-bit word
+    if ((size_t) (nargs - 1)*sizeof (uint32_t) != input_size) {
+        fcspy_release (self);
+        PyErr_Format (PyExc_TypeError, "%U takes %u arguments", name,
+                (unsigned int) (input_size/sizeof (uint32_t)));
+        return NULL;
+    }
+
+    for (i = 1; i < nargs; ++i) {
+        in[i - 1] = (uint32_t) PyLong_AsUnsignedLongMask (PyTuple_GET_ITEM (args, i));
+        if (PyErr_Occurred ()) {
+            fcspy_release (self);
+            return NULL;
+        }
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    err = fcs_func_execute_id (self->session, id, in, out);
+    Py_END_ALLOW_THREADS
+
+    fcspy_release (self);
+
+    if (err) {
+        return fcspy_raise (err);
+    }
+
+    nout = output_size/sizeof (uint32_t);
+    if (nout == 0) {
+        Py_RETURN_NONE;
+    }
+
+    if (nout == 1) {
+        return PyLong_FromUnsignedLong (out[0]);
+    }
+
+    ret = PyTuple_New (nout);
+    for (i = 0; ret && i < nout; ++i) {
+        PyObject *val = PyLong_FromUnsignedLong (out[i]);
+
+        if (!val) {
+            Py_CLEAR (ret);
+            break;
+        }
+        PyTuple_SET_ITEM (ret, i, val);
+    }
+
+    return ret;
+}
+
+/* Variables are doubles (8 bytes) or unsigned integers */
+
+static PyObject *fcspy_session_read_var (fcspy_session_t *self, PyObject *args)
+{
+    uint8_t val[BSMP_MAX_MESSAGE] = {0};
+    const char *name;
+    uint64_t u = 0;
+    int err, size;
+
+    if (!PyArg_ParseTuple (args, "s", &name) || fcspy_acquire (self) < 0) {
+        return NULL;
+    }
+
+    size = fcs_var_size (self->session, name);
+    if (size < 0) {
+        fcspy_release (self);
+        return fcspy_raise (size);
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    err = fcs_var_read (self->session, name, val);
+    Py_END_ALLOW_THREADS
+
+    fcspy_release (self);
+
+    if (err) {
+        return fcspy_raise (err);
+    }
+
+    if ((size_t) size == sizeof (double)) {
+        double d;
+
+        memcpy (&d, val, sizeof d);
+        return PyFloat_FromDouble (d);
+    }
+
+    memcpy (&u, val, (size_t) size < sizeof u ? (size_t) size : sizeof u);
+    return PyLong_FromUnsignedLongLong (u);
+}
+
+static PyObject *fcspy_session_write_var (fcspy_session_t *self,
+        PyObject *args)
+{
+    uint8_t val[BSMP_MAX_MESSAGE] = {0};
+    const char *name;
+    PyObject *value;
+    int err, size;
+
+    if (!PyArg_ParseTuple (args, "sO", &name, &value) ||
+            fcspy_acquire (self) < 0) {
+        return NULL;
+    }
+
+    size = fcs_var_size (self->session, name);
+    if (size < 0) {
+        fcspy_release (self);
+        return fcspy_raise (size);
+    }
+
+    if ((size_t) size == sizeof (double)) {
+        double d = PyFloat_AsDouble (value);
+
+        memcpy (val, &d, sizeof d);
+    }
+    else {
+        uint64_t u = PyLong_AsUnsignedLongLongMask (value);
+
+        memcpy (val, &u, (size_t) size < sizeof u ? (size_t) size : sizeof u);
+    }
+
+    if (PyErr_Occurred ()) {
+        fcspy_release (self);
+        return NULL;
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    err = fcs_var_write (self->session, name, val);
+    Py_END_ALLOW_THREADS
+
+    fcspy_release (self);
+
+    if (err) {
+        return fcspy_raise (err);
+    }
+
+    Py_RETURN_NONE;
+}
+
+/* A curve name or ID */
+static int fcspy_curve_arg (PyObject *arg, unsigned int *id)
+{
+    long l;
+
+    if (PyUnicode_Check (arg)) {
+        l = fcs_curve_id (PyUnicode_AsUTF8 (arg));
+    }
+    else {
+        l = PyLong_AsLong (arg);
+        if (l == -1 && PyErr_Occurred ()) {
+            return -1;
+        }
+    }
+
+    if (l < 0 || l >= END_CURVE_ID) {
+        fcspy_raise (FCS_ERR_NAME);
+        return -1;
+    }
+
+    *id = l;
+
+    return 0;
+}
+
+static PyObject *fcspy_session_read_curve (fcspy_session_t *self,
+        PyObject *arg)
+{
+    fcspy_curve_t *curve;
+    unsigned int id;
+    uint32_t size;
+    int err;
+
+    if (fcspy_curve_arg (arg, &id) < 0 || fcspy_acquire (self) < 0) {
+        return NULL;
+    }
+
+    size = fcs_curve_size (self->session, id);
+    curve = PyObject_New (fcspy_curve_t, &fcspy_curve_type);
+    if (!curve) {
+        fcspy_release (self);
+        return NULL;
+    }
+
+    curve->id = id;
+    curve->sample_size = id == CURVE_ADC_ID ? SIZE_16_BYTES : SIZE_32_BYTES;
+    curve->len = 0;
+    curve->data = PyMem_RawMalloc (size ? size : 1);
+    if (!curve->data) {
+        fcspy_release (self);
+        Py_DECREF (curve);
+        return PyErr_NoMemory ();
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    err = fcs_curve_read (self->session, id, curve->data, size, &curve->len);
+    Py_END_ALLOW_THREADS
+
+    fcspy_release (self);
+
+    if (err) {
+        Py_DECREF (curve);
+        return fcspy_raise (err);
+    }
+
+    curve->strides[1] = curve->sample_size;
+    curve->strides[0] = NUM_CHANNELS*curve->sample_size;
+    curve->shape[0] = curve->len/curve->strides[0];
+    curve->shape[1] = NUM_CHANNELS;
+
+    return (PyObject *) curve;
+}
+
+struct fcspy_monit_s {
+    PyObject *callback;
+    PyThreadState *tstate;
+    int failed;                     // the callback raised
+};
+
+/* Runs without the GIL, as the BSMP reads; takes it for the callback */
+static int fcspy_monit_cb (void *arg, const struct fcs_monit_sample_s *val,
+        const struct timespec *ts)
+{
+    struct fcspy_monit_s *m = arg;
+    PyObject *ret;
+    int stop;
+
+    PyEval_RestoreThread (m->tstate);
+
+    ret = PyObject_CallFunction (m->callback, "(iiii)d",
+            (int32_t) val->ch0, (int32_t) val->ch1, (int32_t) val->ch2,
+            (int32_t) val->ch3, ts->tv_sec + ts->tv_nsec/1e9);
+    if (ret) {
+        stop = PyObject_IsTrue (ret);
+        Py_DECREF (ret);
+    }
+    else {
+        stop = -1;
+    }
+
+    if (stop == 0 && PyErr_CheckSignals () < 0) {
+        stop = -1;
+    }
+
+    m->failed = stop < 0;
+    m->tstate = PyEval_SaveThread ();
+
+    return stop != 0;
+}
+
+static PyObject *fcspy_session_monit (fcspy_session_t *self, PyObject *args,
+        PyObject *kwds)
+{
+    static char *kwlist[] = {"callback", "curve", "period_us", NULL};
+    struct fcspy_monit_s m = {NULL, NULL, 0};
+    const char *curve = CURVE_MONIT_AMP_NAME;
+    unsigned int period_us = 0;
+    int id, err;
+
+    if (!PyArg_ParseTupleAndKeywords (args, kwds, "O|sI", kwlist, &m.callback,
+                &curve, &period_us)) {
+        return NULL;
+    }
+
+    if (!PyCallable_Check (m.callback)) {
+        PyErr_SetString (PyExc_TypeError, "callback must be callable");
+        return NULL;
+    }
+
+    id = fcs_curve_id (curve);
+    if (id < END_CURVE_ID) {
+        return fcspy_raise (FCS_ERR_NAME);
+    }
+
+    if (fcspy_acquire (self) < 0) {
+        return NULL;
+    }
+
+    m.tstate = PyEval_SaveThread ();
+    err = fcs_monit_stream (self->session, id - END_CURVE_ID, period_us,
+            fcspy_monit_cb, &m);
+    PyEval_RestoreThread (m.tstate);
+
+    fcspy_release (self);
+
+    if (m.failed) {
+        return NULL;
+    }
+
+    if (err) {
+        return fcspy_raise (err);
+    }
+
+    Py_RETURN_NONE;
+}
+
+static PyTypeObject fcspy_session_type;
+
+/* Runs on this FPGA session and the fe one, both held */
+static PyObject *fcspy_session_autorange (fcspy_session_t *self,
+        PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"fe", "lo", "hi", "natt", NULL};
+    fcspy_session_t *fe;
+    struct ar_s ar;
+    double lo, hi;
+    unsigned int natt = 2;
+    int err;
+
+    if (!PyArg_ParseTupleAndKeywords (args, kwds, "O!dd|I", kwlist,
+                &fcspy_session_type, &fe, &lo, &hi, &natt)) {
+        return NULL;
+    }
+
+    if (ar_init (&ar, lo, hi, natt) < 0) {
+        PyErr_SetString (PyExc_ValueError,
+                "need 0 < lo < hi < 1 and natt 1 or 2");
+        return NULL;
+    }
+
+    if (fe == self) {
+        PyErr_SetString (PyExc_ValueError, "fe must be another Session");
+        return NULL;
+    }
+
+    if (fcspy_acquire (self) < 0) {
+        return NULL;
+    }
+    if (fcspy_acquire (fe) < 0) {
+        fcspy_release (self);
+        return NULL;
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    err = ar_run (self->session, fe->session, &ar);
+    Py_END_ALLOW_THREADS
+
+    fcspy_release (fe);
+    fcspy_release (self);
+
+    if (err) {
+        return fcspy_raise (err);
+    }
+
+    return Py_BuildValue ("{s:d,s:d,s:d,s:I,s:d,s:O}", "att1", ar.att[0],
+            "att2", ar.att[1], "peak",
+            ar.step_peak[(ar.steps < AR_MAX_STEPS ? ar.steps : AR_MAX_STEPS) - 1],
+            "steps", ar.steps, "time", ar.ns/1e9, "in_window",
+            ar.status == AR_IN_WINDOW ? Py_True : Py_False);
+}
+
+static PyObject *fcspy_session_get_missed (fcspy_session_t *self,
+        void *Py_UNUSED (closure))
+{
+    return PyLong_FromUnsignedLongLong (self->session ?
+            fcs_missed_deadlines (self->session) : 0);
+}
+
+static PyObject *fcspy_session_get_hostname (fcspy_session_t *self,
+        void *Py_UNUSED (closure))
+{
+    if (!self->session) {
+        Py_RETURN_NONE;
+    }
+
+    return PyUnicode_FromString (fcs_hostname (self->session));
+}
+
+static PyMethodDef fcspy_session_methods[] = {
+    {"execute", (PyCFunction) fcspy_session_execute, METH_VARARGS,
+        "execute(name, *args) -> None, int or tuple\n\nExecutes an FPGA "
+            "function. Arguments and results are 32-bit unsigned words."},
+    {"read_var", (PyCFunction) fcspy_session_read_var, METH_VARARGS,
+        "read_var(name) -> float or int\n\nReads an RFFE variable."},
+    {"write_var", (PyCFunction) fcspy_session_write_var, METH_VARARGS,
+        "write_var(name, value)\n\nWrites an RFFE variable."},
+    {"read_curve", (PyCFunction) fcspy_session_read_curve, METH_O,
+        "read_curve(curve) -> Curve\n\nReads an on-demand curve, by name or "
+            "ID, into a new Curve."},
+    {"monit", (PyCFunction) (void (*) (void)) fcspy_session_monit,
+        METH_VARARGS | METH_KEYWORDS,
+        "monit(callback, curve='monit_amp', period_us=0)\n\nPolls a "
+            "monitoring curve and calls callback((ch0, ch1, ch2, ch3), "
+            "timestamp)\nwith every sample, until it returns a true value."},
+    {"autorange", (PyCFunction) (void (*) (void)) fcspy_session_autorange,
+        METH_VARARGS | METH_KEYWORDS,
+        "autorange(fe, lo, hi, natt=2) -> dict\n\nAdjusts the attenuators of "
+            "the RFFE session fe until the peak of short\nADC captures is "
+            "between lo and hi of full scale. Returns {att1, att2,\npeak, "
+            "steps, time [s], in_window}."},
+    {"close", (PyCFunction) fcspy_session_close, METH_NOARGS,
+        "close()\n\nCloses the connection."},
+    {"__enter__", (PyCFunction) fcspy_session_enter, METH_NOARGS, NULL},
+    {"__exit__", (PyCFunction) fcspy_session_exit, METH_VARARGS, NULL},
+    {NULL, NULL, 0, NULL}
+};
+
+static PyGetSetDef fcspy_session_getset[] = {
+    {"hostname", (getter) fcspy_session_get_hostname, NULL, "Server host",
+        NULL},
+    {"missed_deadlines", (getter) fcspy_session_get_missed, NULL,
+        "monit() polls that started late", NULL},
+    {NULL, NULL, NULL, NULL, NULL}
+};
+
+static PyTypeObject fcspy_session_type = {
+    PyVarObject_HEAD_INIT (NULL, 0)
+    .tp_name = "fcsclient.Session",
+    .tp_doc = "Session(hostname='localhost', endpoint='fpga', timeout=0)\n\n"
+        "A BSMP connection to the FPGA or the RFFE ('fe') server, kept\n"
+        "open until close(). Use it from one thread at a time.",
+    .tp_basicsize = sizeof (fcspy_session_t),
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_new = PyType_GenericNew,
+    .tp_init = (initproc) fcspy_session_init,
+    .tp_dealloc = (destructor) fcspy_session_dealloc,
+    .tp_methods = fcspy_session_methods,
+    .tp_getset = fcspy_session_getset,
+};
+
+/***************************************************************/
+/************************** Metadata ***************************/
+/***************************************************************/
+
+static int fcspy_metadata_init (fcspy_metadata_t *self, PyObject *args,
+        PyObject *kwds)
+{
+    static char *kwlist[] = {"filename", NULL};
+    PyObject *filename = NULL;
+    int err;
+
+    if (!PyArg_ParseTupleAndKeywords (args, kwds, "|O&", kwlist,
+                PyUnicode_FSConverter, &filename)) {
+        return -1;
+    }
+
+    md_free (&self->md);
+    if (!filename) {
+        return 0;
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    err = md_load (&self->md, PyBytes_AS_STRING (filename));
+    Py_END_ALLOW_THREADS
+
+    if (err < 0) {
+        PyErr_SetFromErrnoWithFilename (PyExc_OSError,
+                PyBytes_AS_STRING (filename));
+    }
+    Py_DECREF (filename);
+
+    return err;
+}
+
+static void fcspy_metadata_dealloc (fcspy_metadata_t *self)
+{
+    md_free (&self->md);
+    Py_TYPE (self)->tp_free ((PyObject *) self);
+}
+
+static const struct md_entry_s *fcspy_metadata_entry (fcspy_metadata_t *self,
+        PyObject *key)
+{
+    const char *k = PyUnicode_AsUTF8 (key);
+
+    return k ? md_get (&self->md, k) : NULL;
+}
+
+static Py_ssize_t fcspy_metadata_len (fcspy_metadata_t *self)
+{
+    return self->md.n;
+}
+
+static PyObject *fcspy_metadata_subscript (fcspy_metadata_t *self,
+        PyObject *key)
+{
+    const struct md_entry_s *e = fcspy_metadata_entry (self, key);
+
+    if (!e) {
+        if (!PyErr_Occurred ()) {
+            PyErr_SetObject (PyExc_KeyError, key);
+        }
+        return NULL;
+    }
+
+    return PyUnicode_FromString (e->value);
+}
+
+static int fcspy_metadata_ass_subscript (fcspy_metadata_t *self,
+        PyObject *key, PyObject *value)
+{
+    const char *k, *v;
+
+    if (!value) {
+        PyErr_SetString (PyExc_TypeError, "metadata keys cannot be deleted");
+        return -1;
+    }
+
+    k = PyUnicode_AsUTF8 (key);
+    v = k ? PyUnicode_AsUTF8 (value) : NULL;
+    if (!v) {
+        return -1;
+    }
+
+    if (md_set (&self->md, k, v) < 0) {
+        PyErr_NoMemory ();
+        return -1;
+    }
+
+    return 0;
+}
+
+static int fcspy_metadata_contains (fcspy_metadata_t *self, PyObject *key)
+{
+    const struct md_entry_s *e = fcspy_metadata_entry (self, key);
+
+    return e ? 1 : PyErr_Occurred () ? -1 : 0;
+}
+
+static PyObject *fcspy_metadata_keys (fcspy_metadata_t *self,
+        PyObject *Py_UNUSED (ignored))
+{
+    PyObject *keys = PyList_New (self->md.n);
+    uint32_t i;
+
+    for (i = 0; keys && i < self->md.n; ++i) {
+        PyObject *k = PyUnicode_FromString (md_key (&self->md,
+                    md_sorted (&self->md, i)));
+
+        if (!k) {
+            Py_CLEAR (keys);
+            break;
+        }
+        PyList_SET_ITEM (keys, i, k);
+    }
+
+    return keys;
+}
+
+static PyObject *fcspy_metadata_iter (fcspy_metadata_t *self)
+{
+    PyObject *keys = fcspy_metadata_keys (self, NULL), *it;
+
+    if (!keys) {
+        return NULL;
+    }
+    it = PyObject_GetIter (keys);
+    Py_DECREF (keys);
+
+    return it;
+}
+
+static PyObject *fcspy_metadata_get (fcspy_metadata_t *self, PyObject *args)
+{
+    PyObject *key, *dflt = Py_None;
+    const struct md_entry_s *e;
+
+    if (!PyArg_ParseTuple (args, "O|O", &key, &dflt)) {
+        return NULL;
+    }
+
+    e = fcspy_metadata_entry (self, key);
+    if (!e) {
+        if (PyErr_Occurred ()) {
+            return NULL;
+        }
+        Py_INCREF (dflt);
+        return dflt;
+    }
+
+    return PyUnicode_FromString (e->value);
+}
+
+static PyObject *fcspy_metadata_number (fcspy_metadata_t *self, PyObject *key)
+{
+    const struct md_entry_s *e = fcspy_metadata_entry (self, key);
+
+    if (!e) {
+        if (!PyErr_Occurred ()) {
+            PyErr_SetObject (PyExc_KeyError, key);
+        }
+        return NULL;
+    }
+
+    if (e->type != MD_NUMBER) {
+        Py_RETURN_NONE;
+    }
+
+    return Py_BuildValue ("(ds)", e->num, e->unit);
+}
+
+/* Keys and values (str () of them) of a mapping, as metadata */
+static int fcspy_metadata_extra (PyObject *extra, struct md_s *md)
+{
+    PyObject *items;
+    Py_ssize_t i, n;
+    int err = 0;
+
+    md_init (md);
+    if (!extra || extra == Py_None) {
+        return 0;
+    }
+
+    items = PyMapping_Items (extra);
+    if (!items) {
+        return -1;
+    }
+
+    n = PyList_GET_SIZE (items);
+    for (i = 0; i < n && !err; ++i) {
+        PyObject *kv = PyList_GET_ITEM (items, i), *v;
+        const char *ks, *vs;
+
+        v = PyObject_Str (PyTuple_GET_ITEM (kv, 1));
+        ks = v ? PyUnicode_AsUTF8 (PyTuple_GET_ITEM (kv, 0)) : NULL;
+        vs = ks ? PyUnicode_AsUTF8 (v) : NULL;
+        if (!vs) {
+            err = -1;
+        }
+        else if (md_set (md, ks, vs) < 0) {
+            PyErr_NoMemory ();
+            err = -1;
+        }
+        Py_XDECREF (v);
+    }
+    Py_DECREF (items);
+
+    if (err) {
+        md_free (md);
+    }
+
+    return err;
+}
+
+static PyObject *fcspy_metadata_render (fcspy_metadata_t *self,
+        PyObject *args)
+{
+    PyObject *extra = NULL, *ret;
+    struct md_s x;
+    size_t len;
+    char *text;
+
+    if (!PyArg_ParseTuple (args, "|O", &extra) ||
+            fcspy_metadata_extra (extra, &x) < 0) {
+        return NULL;
+    }
+
+    text = md_render (&self->md, &x, &len);
+    md_free (&x);
+    if (!text) {
+        return PyErr_NoMemory ();
+    }
+
+    ret = PyUnicode_FromStringAndSize (text, len);
+    free (text);
+
+    return ret;
+}
+
+static PyObject *fcspy_metadata_write (fcspy_metadata_t *self,
+        PyObject *args)
+{
+    PyObject *filename, *extra = NULL;
+    struct md_s x;
+    int err;
+
+    if (!PyArg_ParseTuple (args, "O&|O", PyUnicode_FSConverter, &filename,
+                &extra)) {
+        return NULL;
+    }
+    if (fcspy_metadata_extra (extra, &x) < 0) {
+        Py_DECREF (filename);
+        return NULL;
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    err = md_write (&self->md, &x, PyBytes_AS_STRING (filename));
+    Py_END_ALLOW_THREADS
+
+    md_free (&x);
+    if (err < 0) {
+        PyErr_SetFromErrnoWithFilename (PyExc_OSError,
+                PyBytes_AS_STRING (filename));
+        Py_DECREF (filename);
+        return NULL;
+    }
+    Py_DECREF (filename);
+
+    Py_RETURN_NONE;
+}
+
+static PyMethodDef fcspy_metadata_methods[] = {
+    {"keys", (PyCFunction) fcspy_metadata_keys, METH_NOARGS,
+        "keys() -> list\n\nKeys, sorted."},
+    {"get", (PyCFunction) fcspy_metadata_get, METH_VARARGS,
+        "get(key, default=None) -> str"},
+    {"number", (PyCFunction) fcspy_metadata_number, METH_O,
+        "number(key) -> (value, unit) or None\n\nThe value as parsed, if it "
+            "is a number with an optional unit\n('476066000 Hz' -> "
+            "(476066000.0, 'Hz'))."},
+    {"render", (PyCFunction) fcspy_metadata_render, METH_VARARGS,
+        "render(extra=None) -> str\n\nSorted 'key = value' lines, with the "
+            "keys of the mapping extra\nadded or replacing them."},
+    {"write", (PyCFunction) fcspy_metadata_write, METH_VARARGS,
+        "write(filename, extra=None)\n\nWrites render(extra) to a new file, "
+            "in one write. Fails if it exists."},
+    {NULL, NULL, 0, NULL}
+};
+
+static PyMappingMethods fcspy_metadata_as_mapping = {
+    .mp_length = (lenfunc) fcspy_metadata_len,
+    .mp_subscript = (binaryfunc) fcspy_metadata_subscript,
+    .mp_ass_subscript = (objobjargproc) fcspy_metadata_ass_subscript,
+};
+
+static PySequenceMethods fcspy_metadata_as_sequence = {
+    .sq_contains = (objobjproc) fcspy_metadata_contains,
+};
+
+static PyTypeObject fcspy_metadata_type = {
+    PyVarObject_HEAD_INIT (NULL, 0)
+    .tp_name = "fcsclient.Metadata",
+    .tp_doc = "Metadata(filename=None)\n\nExperiment metadata ('key = "
+        "value' lines, '#' comments), parsed once.\nA mapping of str to "
+        "str; keys can be set but not deleted.",
+    .tp_basicsize = sizeof (fcspy_metadata_t),
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_new = PyType_GenericNew,
+    .tp_init = (initproc) fcspy_metadata_init,
+    .tp_dealloc = (destructor) fcspy_metadata_dealloc,
+    .tp_as_mapping = &fcspy_metadata_as_mapping,
+    .tp_as_sequence = &fcspy_metadata_as_sequence,
+    .tp_iter = (getiterfunc) fcspy_metadata_iter,
+    .tp_methods = fcspy_metadata_methods,
+};
+
+/***************************************************************/
+/*************************** Module ****************************/
+/***************************************************************/
+
+/* Pre-evaluation of a sausaging sweep on one (switched) ADC capture */
+static PyObject *fcspy_window_sweep (PyObject *Py_UNUSED (self),
+        PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"curve", "divclk", "points", "adc_clk",
+        "dds_freq", "decim", "alpha", NULL};
+    fcspy_curve_t *curve;
+    unsigned int divclk, adc_clk, dds_freq, decim = CURVE_TBT_DECIM;
+    double alpha = WDW_ALPHA;
+    PyObject *points, *seq, *ret = NULL;
+    struct wdw_point_s *pts = NULL;
+    struct soa_s adc = {0, 0, {NULL}};
+    struct ddc_s ddc;
+    Py_ssize_t npts, i;
+    int err;
+
+    if (!PyArg_ParseTupleAndKeywords (args, kwds, "O!IOII|Id", kwlist,
+                &fcspy_curve_type, &curve, &divclk, &points, &adc_clk,
+                &dds_freq, &decim, &alpha)) {
+        return NULL;
+    }
+
+    if (curve->id != CURVE_ADC_ID) {
+        PyErr_SetString (PyExc_ValueError, "only ADC curves are switched");
+        return NULL;
+    }
+
+    seq = PySequence_Fast (points, "points must be (phaseclk, dly, on) tuples");
+    if (!seq) {
+        return NULL;
+    }
+
+    npts = PySequence_Fast_GET_SIZE (seq);
+    pts = PyMem_RawCalloc (npts ? npts : 1, sizeof *pts);
+    if (!pts) {
+        PyErr_NoMemory ();
+        goto out;
+    }
+
+    for (i = 0; i < npts; ++i) {
+        int on;
+
+        if (!PyArg_ParseTuple (PySequence_Fast_GET_ITEM (seq, i), "IIp",
+                    &pts[i].phaseclk, &pts[i].dly, &on)) {
+            goto out;
+        }
+        pts[i].on = on;
+    }
+
+    if (ddc_init (&ddc, adc_clk, dds_freq, decim, DDC_ORDER) < 0) {
+        PyErr_SetString (PyExc_ValueError, "cannot down-convert with these "
+                "clocks and decimation");
+        goto out;
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    err = soa_from_curve (&adc, curve->id, curve->data, curve->len, NULL) < 0 ||
+        wdw_sweep (&adc, divclk, alpha, &ddc, pts, npts) < 0;
+    Py_END_ALLOW_THREADS
+
+    soa_free (&adc);
+    ddc_free (&ddc);
+
+    if (err) {
+        PyErr_SetString (PyExc_ValueError, "divclk too small to switch, or "
+                "out of memory");
+        goto out;
+    }
+
+    ret = PyList_New (npts);
+    for (i = 0; ret && i < npts; ++i) {
+        struct wdw_point_s *p = &pts[i];
+        PyObject *item = Py_BuildValue ("(IIO(dddd)(dddd))", p->phaseclk,
+                p->dly, p->on ? Py_True : Py_False,
+                p->mean[0], p->mean[1], p->mean[2], p->mean[3],
+                p->ripple[0], p->ripple[1], p->ripple[2], p->ripple[3]);
+
+        if (!item) {
+            Py_CLEAR (ret);
+            break;
+        }
+        PyList_SET_ITEM (ret, i, item);
+    }
+
+out:
+    PyMem_RawFree (pts);
+    Py_DECREF (seq);
+
+    return ret;
+}
+
+static PyObject *fcspy_xcorr (PyObject *Py_UNUSED (self), PyObject *args,
+        PyObject *kwds)
+{
+    static char *kwlist[] = {"curve", "adc_clk", "carrier", "rows", NULL};
+    fcspy_curve_t *curve;
+    double adc_clk, carrier, t;
+    Py_ssize_t rows = 0;
+    struct soa_s adc = {0, 0, {NULL}};
+    struct xc_result_s r;
+    struct xc_s xc;
+    uint32_t n;
+    int err;
+
+    if (!PyArg_ParseTupleAndKeywords (args, kwds, "O!dd|n", kwlist,
+                &fcspy_curve_type, &curve, &adc_clk, &carrier, &rows)) {
+        return NULL;
+    }
+
+    if (curve->id != CURVE_ADC_ID || !(adc_clk > 0) || !(carrier > 0)) {
+        PyErr_SetString (PyExc_ValueError, "only ADC curves are correlated, "
+                "with adc_clk > 0 and the RF carrier > 0");
+        return NULL;
+    }
+    if (rows <= 0 || rows > curve->shape[0]) {
+        rows = curve->shape[0];
+    }
+
+    n = xc_size (rows);
+    if (!n) {
+        PyErr_SetString (PyExc_ValueError, "too few rows to correlate");
+        return NULL;
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    err = soa_from_curve (&adc, curve->id, curve->data,
+            rows*curve->strides[0], NULL) < 0 || xc_init (&xc, n) < 0;
+    if (!err) {
+        xc_estimate (&xc, &adc, &r);
+        xc_free (&xc);
+    }
+    soa_free (&adc);
+    Py_END_ALLOW_THREADS
+
+    if (err) {
+        return PyErr_NoMemory ();
+    }
+
+    t = 1e12*xc_lag_time (adc_clk, carrier);
+    return Py_BuildValue ("{s:(dddd),s:(dddddd),s:d}", "delays",
+            r.delay[0]*t, r.delay[1]*t, r.delay[2]*t, r.delay[3]*t,
+            "lags", r.lag[0], r.lag[1], r.lag[2], r.lag[3], r.lag[4], r.lag[5],
+            "residual", r.residual*fabs (t));
+}
+
+static PyMethodDef fcspy_module_methods[] = {
+    {"window_sweep", (PyCFunction) (void (*) (void)) fcspy_window_sweep,
+        METH_VARARGS | METH_KEYWORDS,
+        "window_sweep(curve, divclk, points, adc_clk, dds_freq, decim=35, "
+            "alpha=1.0)\n-> [(phaseclk, dly, on, means, ripples), ...]\n\n"
+            "Deswitches (phaseclk), windows (dly, if on) and down-converts "
+            "a switched\nADC curve for every point, as the FPGA would have "
+            "with those settings.\nmeans are the channel amplitudes, ripples "
+            "their rms over the mean."},
+    {"xcorr", (PyCFunction) (void (*) (void)) fcspy_xcorr,
+        METH_VARARGS | METH_KEYWORDS,
+        "xcorr(curve, adc_clk, carrier, rows=0) -> dict\n\nDelays of the "
+            "channels of the first rows of an ADC curve to\nchannel A, from "
+            "their cross-correlation: {delays [ps], lags [samples,\npairs "
+            "AB AC AD BC BD CD], residual [ps]}. carrier is the RF frequency "
+            "[Hz]."},
+    {NULL, NULL, 0, NULL}
+};
+
+static struct PyModuleDef fcspy_module = {
+    PyModuleDef_HEAD_INIT,
+    .m_name = "fcsclient",
+    .m_doc = "In-process FCS client (libfcsclient).",
+    .m_size = -1,
+    .m_methods = fcspy_module_methods,
+};
+
+PyMODINIT_FUNC PyInit_fcsclient (void)
+{
+    PyObject *m;
+
+    if (PyType_Ready (&fcspy_session_type) < 0 ||
+            PyType_Ready (&fcspy_curve_type) < 0 ||
+            PyType_Ready (&fcspy_metadata_type) < 0) {
+        return NULL;
+    }
+
+    m = PyModule_Create (&fcspy_module);
+    if (!m) {
+        return NULL;
+    }
+
+    // args are (code, message); code < 0 is FCS_ERR_*, > 0 a BSMP error
+    fcspy_error = PyErr_NewException ("fcsclient.Error", NULL, NULL);
+    Py_XINCREF (fcspy_error);
+    if (PyModule_AddObject (m, "Error", fcspy_error) < 0) {
+        Py_XDECREF (fcspy_error);
+        Py_CLEAR (fcspy_error);
+        Py_DECREF (m);
+        return NULL;
+    }
+
+    Py_INCREF (&fcspy_session_type);
+    PyModule_AddObject (m, "Session", (PyObject *) &fcspy_session_type);
+    Py_INCREF (&fcspy_curve_type);
+    PyModule_AddObject (m, "Curve", (PyObject *) &fcspy_curve_type);
+    Py_INCREF (&fcspy_metadata_type);
+    PyModule_AddObject (m, "Metadata", (PyObject *) &fcspy_metadata_type);
+
+    return m;
+}
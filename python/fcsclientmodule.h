@@ -0,0 +1,47 @@
+#ifndef _FCSCLIENTMODULE_H_
+#define _FCSCLIENTMODULE_H_
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <pythread.h>
+
+#include "fcs_client.h"
+#include "libfcsclient.h"
+#include "deswitch.h"
+#include "window.h"
+#include "quality.h"
+#include "autorange.h"
+#include "xcorr.h"
+#include "metadata.h"
+
+/* CPython bindings of libfcsclient (import fcsclient). A Session keeps its
+ * BSMP connection open between calls; BSMP calls run without the GIL */
+#define FCSPY_DEFAULT_TIMEOUT   0 // sec. set_acq_start blocks until done
+#define FCSPY_TEXT_ROW_LEN      48 // "%d %d %d %d\n" of 32-bit samples
+
+typedef struct {
+    PyObject_HEAD
+    fcs_session_t *session;
+    PyThread_type_lock lock;        // one BSMP call at a time
+} fcspy_session_t;
+
+/* A curve as read from the server. The samples are received straight
+ * into data, which the buffer protocol exposes as rows x NUM_CHANNELS
+ * int16 (ADC) or int32 values */
+typedef struct {
+    PyObject_HEAD
+    unsigned int id;
+    uint32_t sample_size;           // bytes per channel sample
+    uint32_t len;                   // bytes received
+    uint8_t *data;
+    Py_ssize_t shape[2];
+    Py_ssize_t strides[2];
+} fcspy_curve_t;
+
+/* A metadata template, parsed once, and the keys set since */
+typedef struct {
+    PyObject_HEAD
+    struct md_s md;
+} fcspy_metadata_t;
+
+#endif
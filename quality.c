@@ -0,0 +1,139 @@
+// Data quality checks: saturation, stuck channels and dropouts
+#include <stdio.h>
+#include <string.h>
+
+#include "quality.h"
+
+#define QC_BLOCK                256 // rows, lane counters cannot overflow
+
+void qc_reset (struct qc_s *qc)
+{
+    memset (qc, 0, sizeof *qc);
+}
+
+void qc_begin (struct qc_s *qc)
+{
+    qc->started = 0;
+    qc->run = (qc_row_t) {0};
+    qc->zero_run = 0;
+}
+
+/* A block of up to QC_BLOCK rows */
+static void qc_block (struct qc_s *qc, const qc_row_t *rows, uint32_t n,
+        int32_t fs)
+{
+    int32_t lim = fs - fs/QC_CLIP_DIV;
+    qc_row_t hi = {lim, lim, lim, lim}, lo = -hi;
+    qc_row_t clipped = {0}, stuck = {0}, m;
+    unsigned int c;
+    uint32_t i;
+
+    // The first row is not a repeat of anything
+    if (!qc->started) {
+        qc->prev = rows[0];
+        qc->run = (qc_row_t) {-1, -1, -1, -1};
+        qc->started = 1;
+    }
+
+    for (i = 0; i < n; ++i) {
+        // Masks are -1 where true
+        clipped -= (rows[i] >= hi) | (rows[i] <= lo);
+
+        m = rows[i] == qc->prev;
+        qc->run = (qc->run + 1) & m;
+        stuck -= qc->run == QC_STUCK_RUN - 1;
+        qc->prev = rows[i];
+
+        m = rows[i] == 0;
+        if (m[0] & m[1] & m[2] & m[3]) {
+            qc->zero_blocks += ++qc->zero_run == QC_ZERO_RUN;
+        }
+        else {
+            qc->zero_run = 0;
+        }
+    }
+
+    for (c = 0; c < NUM_CHANNELS; ++c) {
+        qc->clipped[c] += clipped[c];
+        qc->stuck[c] += stuck[c];
+    }
+    qc->rows += n;
+}
+
+void qc_check_rows (struct qc_s *qc, const int32_t *rows, uint32_t n,
+        int32_t fs)
+{
+    qc_row_t block[QC_BLOCK];
+    uint32_t i, nb;
+
+    // Copied, as curve data carries no alignment
+    for (i = 0; i < n; i += nb) {
+        nb = n - i < QC_BLOCK ? n - i : QC_BLOCK;
+        memcpy (block, rows + i*NUM_CHANNELS, nb*sizeof *block);
+        qc_block (qc, block, nb, fs);
+    }
+}
+
+void qc_check_16 (struct qc_s *qc, const int16_t *rows, uint32_t n)
+{
+    qc_row_t block[QC_BLOCK];
+    uint32_t i, j, nb;
+
+    for (i = 0; i < n; i += nb) {
+        nb = n - i < QC_BLOCK ? n - i : QC_BLOCK;
+        for (j = 0; j < nb; ++j) {
+            const int16_t *p = rows + (i + j)*NUM_CHANNELS;
+
+            block[j] = (qc_row_t) {p[0], p[1], p[2], p[3]};
+        }
+        qc_block (qc, block, nb, QC_FS_16);
+    }
+}
+
+void qc_check_sample (struct qc_s *qc, const plot_values_monit_uint32_t *val)
+{
+    qc_row_t row = {(int32_t) val->ch0, (int32_t) val->ch1,
+        (int32_t) val->ch2, (int32_t) val->ch3};
+    qc_row_t m = row == qc->prev;
+
+    if (qc->started && (m[0] & m[1] & m[2] & m[3])) {
+        ++qc->repeated;
+    }
+
+    qc_block (qc, &row, 1, QC_FS_32);
+}
+
+void qc_merge (struct qc_s *dst, const struct qc_s *src)
+{
+    unsigned int c;
+
+    dst->rows += src->rows;
+    for (c = 0; c < NUM_CHANNELS; ++c) {
+        dst->clipped[c] += src->clipped[c];
+        dst->stuck[c] += src->stuck[c];
+    }
+    dst->zero_blocks += src->zero_blocks;
+    dst->repeated += src->repeated;
+}
+
+uint64_t qc_issues (const struct qc_s *qc)
+{
+    uint64_t n = qc->zero_blocks + qc->repeated;
+    unsigned int c;
+
+    for (c = 0; c < NUM_CHANNELS; ++c) {
+        n += qc->clipped[c] + qc->stuck[c];
+    }
+
+    return n;
+}
+
+void qc_print (FILE *stream, const struct qc_s *qc)
+{
+    fprintf (stream, "quality: clipped %" PRIu64 " %" PRIu64 " %" PRIu64
+            " %" PRIu64 ", stuck %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64
+            ", zero blocks %" PRIu64 ", repeated %" PRIu64 "%s\n",
+            qc->clipped[0], qc->clipped[1], qc->clipped[2], qc->clipped[3],
+            qc->stuck[0], qc->stuck[1], qc->stuck[2], qc->stuck[3],
+            qc->zero_blocks, qc->repeated, qc_issues (qc) ? "" : " (ok)");
+}
@@ -0,0 +1,57 @@
+#ifndef _QUALITY_H_
+#define _QUALITY_H_
+
+#include <stdio.h>
+#include <inttypes.h>
+
+#include "output.h"
+
+/* Data quality of 4-channel rows, checked as they go by, the channels
+ * together as one SIMD vector:
+ *  clipped:     samples within 1/QC_CLIP_DIV of full scale (ADC
+ *               saturation, int16; int32 overflow of the later stages)
+ *  stuck:       runs of QC_STUCK_RUN or more equal samples of a channel
+ *  zero blocks: runs of QC_ZERO_RUN or more rows with all channels at 0
+ *               (dropouts, or curves not filled up)
+ *  repeated:    Monitoring samples equal to the previous one in all
+ *               channels (the FPGA not updating them)
+ * A run counts once, when it gets long enough */
+#define QC_CLIP_DIV             1024
+#define QC_STUCK_RUN            64 // samples
+#define QC_ZERO_RUN             64 // rows
+#define QC_FS_16                INT16_MAX // full scale of ADC curves
+#define QC_FS_32                INT32_MAX
+
+typedef int32_t qc_row_t __attribute__ ((vector_size (NUM_CHANNELS*sizeof (int32_t))));
+
+struct qc_s {
+    uint64_t rows;
+    uint64_t clipped[NUM_CHANNELS];
+    uint64_t stuck[NUM_CHANNELS];
+    uint64_t zero_blocks;
+    uint64_t repeated;
+    // Running state
+    int started;
+    qc_row_t prev;
+    qc_row_t run;                   // equal samples in a row, minus one
+    uint32_t zero_run;
+};
+
+void qc_reset (struct qc_s *qc);
+/* The next rows start a capture of their own: runs do not go on */
+void qc_begin (struct qc_s *qc);
+
+/* Rows of 4 signed samples of full scale fs */
+void qc_check_rows (struct qc_s *qc, const int32_t *rows, uint32_t n,
+        int32_t fs);
+void qc_check_16 (struct qc_s *qc, const int16_t *rows, uint32_t n);
+void qc_check_sample (struct qc_s *qc, const plot_values_monit_uint32_t *val);
+
+/* Counts of src added to dst */
+void qc_merge (struct qc_s *dst, const struct qc_s *src);
+/* Clipped samples, stuck runs, zero blocks and repeated samples found */
+uint64_t qc_issues (const struct qc_s *qc);
+
+void qc_print (FILE *stream, const struct qc_s *qc);
+
+#endif
@@ -5,9 +5,20 @@ import hashlib
 from time import strftime, gmtime
 from time import sleep
 from math import floor
-import subprocess
+import sys
 
-from metadata_parser import MetadataParser
+try:
+    import fcsclient
+except ImportError:
+    # Not installed: the module built in the source tree (make python)
+    sys.path.append(os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', '..', 'python'))
+    import fcsclient
+
+# Values of the RFFE switching variable (FE_SW_ON/OFF in fcs_client.h)
+FE_SW_ON = 0x3
+FE_SW_OFF = 0x1
+# ADC clocks per FPGA switching divider count (FE_SW_DIV_FACTOR)
+FE_SW_DIV_FACTOR = 2
 
 class BPMExperiment():
 
@@ -16,105 +27,184 @@ class BPMExperiment():
         self.rffe_hostname = rffe_hostname
         self.debug = debug
 
-        self.metadata_parser = MetadataParser()
+        # BSMP sessions, kept open from one run to the next
+        self.sessions = {}
+
+    def session(self, endpoint):
+        if endpoint == 'fpga':
+            hostname = self.fpga_hostname
+        else:
+            hostname = self.rffe_hostname
+
+        s = self.sessions.get(endpoint)
+        if s is not None and s.hostname != hostname:
+            s.close()
+            s = None
+
+        if s is None and not self.debug:
+            s = fcsclient.Session(hostname, endpoint)
+            self.sessions[endpoint] = s
+
+        return s
+
+    def close(self):
+        for s in self.sessions.values():
+            s.close()
+        self.sessions = {}
+
+    def execute(self, session, name, *args):
+        if not self.debug:
+            return session.execute(name, *args)
+        print([name] + list(args))
+
+    def write_var(self, session, name, value):
+        if not self.debug:
+            session.write_var(name, value)
+        else:
+            print([name, value])
 
     def load_from_metadata(self, input_metadata_filename):
-        # Parse metadata file into a dictionary
-        self.metadata_parser.parse(input_metadata_filename)
-        self.metadata = self.metadata_parser.options
+        # Parsed once, in C; sweeps only set the keys that change
+        self.metadata = fcsclient.Metadata(input_metadata_filename)
 
     def get_metadata_lines(self):
-        experiment_parameters = list(self.metadata.keys())
-        lines = []
-        for key in experiment_parameters:
-            lines.append(key + ' = ' + self.metadata[key] + '\n')
-        return lines
-
-    def run(self, data_filename, datapath):
-        if datapath == 'adc':
-            data_rate_decimation_ratio = '1'
-            acq_channel = '0'
-            acq_npts = '100000'
-            data_file_structure = 'bpm_amplitudes_if'
-        elif datapath == 'tbt':
-            data_rate_decimation_ratio = self.metadata['adc_clock_sampling_harmonic'].split()[0] # FIXME: data_rate_decim_factor should be ideally read from FPGA
-            acq_channel = '1'
-            acq_npts = '100000'
-            data_file_structure = 'bpm_amplitudes_baseband'
-        elif datapath == 'fofb':
-            data_rate_decimation_ratio = '1000' # FIXME: data_rate_decim_factor should be ideally read from FPGA
-            acq_channel = '3'
-            acq_npts = '500000'
-            data_file_structure = 'bpm_amplitudes_baseband'
+        return self.metadata.render().splitlines(True)
 
+    def configure(self, acq_npts, acq_channel):
+        # FPGA and RFFE set up from the metadata, for an acquisition of
+        # acq_npts samples on acq_channel. Returns the FPGA session
         deswitching_phase_offset = str(int(self.metadata['dsp_deswitching_phase'].split()[0]) - int(self.metadata['rffe_switching_phase'].split()[0]))
 
         # FIXME: should not divide by 2 and subtract 4 to make FPGA counter count right. FPGA must be corrected
         rffe_switching_frequency_ratio = str(int(self.metadata['rffe_switching_frequency_ratio'].split()[0])/2 - 4)
 
+        fpga = self.session('fpga')
+        rffe = self.session('fe')
+
         # Run FPGA configuration commands
-        command_argument_list = ['fcs_client']
-        #command_argument_list.extend(['--setdivclk', self.metadata['rffe_switching_frequency_ratio'].split()[0]])
-        command_argument_list.extend(['--setdivclk', rffe_switching_frequency_ratio])
-        #command_argument_list.extend(['--setkx', self.metadata['bpm_Kx'].split()[0]])
-        #command_argument_list.extend(['--setky', self.metadata['bpm_Ky'].split()[0]])
-        command_argument_list.extend(['--setphaseclk', deswitching_phase_offset])
-        command_argument_list.extend(['--setsw' + self.metadata['rffe_switching'].split()[0]])
-        command_argument_list.extend(['--setwdw' + self.metadata['dsp_sausaging'].split()[0]])
-        command_argument_list.extend(['--setsamples', acq_npts])
-        command_argument_list.extend(['--setchan', acq_channel])
-        command_argument_list.extend(['--setfpgahostname', self.fpga_hostname])
-        if not self.debug:
-            subprocess.call(command_argument_list)
-        else:
-            print(command_argument_list)
+        # fcs_client --setdivclk divides by the RFFE switching factor
+        self.execute(fpga, 'set_sw_divclk', int(float(rffe_switching_frequency_ratio))//2)
+        #self.execute(fpga, 'set_kx', int(self.metadata['bpm_Kx'].split()[0]))
+        #self.execute(fpga, 'set_ky', int(self.metadata['bpm_Ky'].split()[0]))
+        self.execute(fpga, 'set_sw_phaseclk', int(deswitching_phase_offset))
+        self.execute(fpga, 'set_sw_' + self.metadata['rffe_switching'].split()[0])
+        self.execute(fpga, 'set_wdw_' + self.metadata['dsp_sausaging'].split()[0])
+        self.execute(fpga, 'set_acq_param', int(acq_npts), int(acq_channel))
 
         # Run RFFE configuration commands
-        command_argument_list = ['fcs_client']
-        command_argument_list.extend(['--setfesw' + self.metadata['rffe_switching'].split()[0]])
+        if self.metadata['rffe_switching'].split()[0] == 'on':
+            self.write_var(rffe, 'getset_fe_sw', FE_SW_ON)
+        else:
+            self.write_var(rffe, 'getset_fe_sw', FE_SW_OFF)
         att_items = self.metadata['rffe_attenuators'].split(',')
         i = 1
         for item in att_items:
             item.strip()
-            command_argument_list.extend(['--setfeatt' + str(i), item.split()[0]])
+            self.write_var(rffe, 'getset_fe_att' + str(i), float(item.split()[0]))
             i = i+1
-        command_argument_list.extend(['--setrffehostname', self.rffe_hostname])
-        if not self.debug:
-            subprocess.call(command_argument_list)
-            sleep(0.2) # FIXME: it seems RFFE controller (mbed) doesn't realize the connection has been closed
-        else:
-            print(command_argument_list)
 
         # TODO: Check if everything was properly set
 
         # Enable switching signal
-        command_argument_list = ['fcs_client']
-        command_argument_list.extend(['--setswclken' + self.metadata['rffe_switching'].split()[0]])
-        command_argument_list.extend(['--setfpgahostname', self.fpga_hostname])
-        if not self.debug:
-            subprocess.call(command_argument_list)
-        else:
-            print(command_argument_list)
+        self.execute(fpga, 'set_sw_clk_en_' + self.metadata['rffe_switching'].split()[0])
 
-        # Timestamp the start of data acquisition
-        # FIXME: timestamp should ideally come together with data.
-        t = time()
+        return fpga
 
-        # Run acquisition
-        command_argument_list = ['fcs_client']
-        command_argument_list.append('--startacq')
-        command_argument_list.extend(['--setfpgahostname', self.fpga_hostname])
-        if not self.debug:
-            p = subprocess.call(command_argument_list)
-        else:
-            print(command_argument_list)
+    def autorange(self, lo, hi):
+        # Sets the attenuators of the metadata so that the ADC peak is
+        # between lo and hi of full scale, and writes them back into the
+        # metadata. Returns what fcsclient.Session.autorange found, or None
+        # in debug mode
+        natt = len(self.metadata['rffe_attenuators'].split(','))
+        fpga = self.configure(100000, 0)
+        if self.debug:
+            print(['autorange', lo, hi, natt])
+            return None
+
+        result = fpga.autorange(self.session('fe'), lo, hi, natt)
+        atts = [result['att1'], result['att2']][:natt]
+        self.metadata['rffe_attenuators'] = ', '.join(('%g dB' % att) for att in atts)
+
+        return result
+
+    def preview_sausaging(self, points, decim = 35):
+        # Takes one ADC capture with the current settings and returns what
+        # each (deswitching phase, window delay, window on) point would give
+        # after deswitching, windowing and down-conversion by decim, without
+        # re-acquiring: [(phase, dly, on, means, ripples), ...]
+        fpga = self.configure(100000, 0)
+        self.execute(fpga, 'set_acq_start')
+        if self.debug:
+            return []
 
-        # The script execution is blocked here until data acquisition has completed
+        # Phases are relative to the RFFE switching, as in the metadata, and
+        # the FPGA counts them modulo the switching period
+        rffe_phase = int(self.metadata['rffe_switching_phase'].split()[0])
+        divclk = fpga.execute('get_sw_divclk')
+        period = FE_SW_DIV_FACTOR*divclk
+        alpha = 1.0
+        if self.metadata.get('dsp_sausaging_window', 'tukey').split()[0] == 'tukey':
+            alpha = float(self.metadata['dsp_sausaging_window_parameters'].split()[0])
 
-        # Get the result of data acquisition and write it to data file
-        command_argument_list = ['fcs_client']
-        command_argument_list.extend(['--getcurve', acq_channel])
-        command_argument_list.extend(['--setfpgahostname', self.fpga_hostname])
+        results = fcsclient.window_sweep(fpga.read_curve(0), divclk,
+                [((phase - rffe_phase) % period, dly, on) for (phase, dly, on) in points],
+                fpga.execute('get_adc_clk'), fpga.execute('get_dds_freq'),
+                decim, alpha)
+
+        return [(p[0],) + r[1:] for (p, r) in zip(points, results)]
+
+    def run(self, data_filename, datapath, retries = 0):
+        # Acquires and saves one datapath with its metadata. A capture that
+        # fails the data quality checks is taken again, up to retries more
+        # times. Returns the quality counts of the capture saved, with the
+        # number of attempts, or None in debug mode
+        if datapath == 'adc':
+            data_rate_decimation_ratio = '1'
+            acq_channel = '0'
+            acq_npts = '100000'
+            data_file_structure = 'bpm_amplitudes_if'
+        elif datapath == 'tbt':
+            data_rate_decimation_ratio = self.metadata['adc_clock_sampling_harmonic'].split()[0] # FIXME: data_rate_decim_factor should be ideally read from FPGA
+            acq_channel = '1'
+            acq_npts = '100000'
+            data_file_structure = 'bpm_amplitudes_baseband'
+        elif datapath == 'fofb':
+            data_rate_decimation_ratio = '1000' # FIXME: data_rate_decim_factor should be ideally read from FPGA
+            acq_channel = '3'
+            acq_npts = '500000'
+            data_file_structure = 'bpm_amplitudes_baseband'
+
+        fpga = self.configure(acq_npts, acq_channel)
+
+        quality = None
+        attempts = 0
+        while True:
+            # Timestamp the start of data acquisition
+            # FIXME: timestamp should ideally come together with data.
+            t = time()
+
+            # Run acquisition and get its result over the same session.
+            # set_acq_start only returns when data acquisition has completed
+            self.execute(fpga, 'set_acq_start')
+            attempts = attempts+1
+            if self.debug:
+                print(['read_curve', int(acq_channel)])
+                break
+
+            # Only the samples acquired, the curve may be longer
+            curve = fpga.read_curve(int(acq_channel))
+            quality = curve.check(int(acq_npts))
+            quality['attempts'] = attempts
+            if not quality['issues'] or attempts > retries:
+                break
+
+        # Cable delays the template leaves out, measured from the channels
+        # of an ADC capture. Switching would swap them, and the lags only
+        # scale to delays with the RF carrier known
+        delays = None
+        if not self.debug and datapath == 'adc' and 'bpm2rffe_cables_delay_a' not in self.metadata and 'signal_carrier_frequency' in self.metadata and self.metadata['rffe_switching'].split()[0] == 'off':
+            carrier = float(self.metadata['signal_carrier_frequency'].split()[0])
+            delays = fcsclient.xcorr(curve, fpga.execute('get_adc_clk'), carrier, int(acq_npts))['delays']
 
         # Ensure file path exists
         path = os.path.dirname(data_filename)
@@ -124,26 +214,23 @@ class BPMExperiment():
             if not os.path.isdir(path):
                 raise
 
-        f = open(data_filename, 'x')
         if not self.debug:
-            p = subprocess.call(command_argument_list, stdout=f)
+            text = curve.totext()
         else:
-            f.writelines(['10 11 -9 80\n54 5 6 98\n']);
-            print(command_argument_list)
-        f.close()
+            text = b'10 11 -9 80\n54 5 6 98\n'
 
-        # Compute data file signature
-        f = open(data_filename, 'r')
-        text = f.read()
+        f = open(data_filename, 'xb')
+        f.write(text)
         f.close()
 
+        # Compute data file signature
         if self.metadata['data_signature_method'].split()[0] == 'md5':
             md = hashlib.md5()
         elif self.metadata['data_signature_method'].split()[0] == 'sha-1':
             md = hashlib.sha1()
         elif self.metadata['data_signature_method'].split()[0] == 'sha-256':
             md = hashlib.sha256()
-        md.update(text.encode(f.encoding))
+        md.update(text)
         filesignature = md.hexdigest()
 
         # Format date and hour as an standard UTC timestamp (ISO 8601)
@@ -153,27 +240,30 @@ class BPMExperiment():
         # Trhow away absolute path of data filename
         data_filename_basename = os.path.basename(data_filename)
 
-        # Build metadata file based on template metadata file and post-processed metadata
-
-        config_base_metadata_lines = self.get_metadata_lines()
-
-        config_automatic_lines = [];
-        config_automatic_lines.append('data_original_filename = ' + data_filename_basename + '\n')
-        config_automatic_lines.append('data_signature = ' + filesignature + '\n')
-        config_automatic_lines.append('dsp_data_rate_decimation_ratio = ' + data_rate_decimation_ratio + '\n')
-        config_automatic_lines.append('timestamp_start = ' + timestamp_start + '\n')
-        config_automatic_lines.append('data_file_structure = ' + data_file_structure + '\n')
-        config_automatic_lines.append('data_file_format = ascii\n')
-        #config_automatic_lines.append('adc_board_temperature = ' + '0' + ' C\n') #TODO: implement ADC temperature read on FPGA
-        #config_automatic_lines.append('rffe_board_temperature = ' + '0' + ' C\n') #TODO: implement RFFE temperature read on FPGA
-
-        config_fromfile_lines = []
-        config_fromfile_lines.extend(config_base_metadata_lines)
-        config_fromfile_lines.extend(config_automatic_lines)
+        # Metadata of this run: the template and sweep settings, with the
+        # post-processed keys of this capture only
+        config_automatic = {}
+        config_automatic['data_original_filename'] = data_filename_basename
+        config_automatic['data_signature'] = filesignature
+        config_automatic['dsp_data_rate_decimation_ratio'] = data_rate_decimation_ratio
+        config_automatic['timestamp_start'] = timestamp_start
+        config_automatic['data_file_structure'] = data_file_structure
+        config_automatic['data_file_format'] = 'ascii'
+        if quality is not None:
+            config_automatic['data_quality_clipped_samples'] = ', '.join(str(n) for n in quality['clipped'])
+            config_automatic['data_quality_stuck_runs'] = ', '.join(str(n) for n in quality['stuck'])
+            config_automatic['data_quality_zero_blocks'] = quality['zero_blocks']
+            config_automatic['data_quality_attempts'] = quality['attempts']
+        if delays is not None:
+            for (antenna, delay) in zip('abcd', delays):
+                config_automatic['bpm2rffe_cables_delay_' + antenna] = ('%.1f' % delay) + ' ps'
+        #config_automatic['adc_board_temperature'] = '0 C' #TODO: implement ADC temperature read on FPGA
+        #config_automatic['rffe_board_temperature'] = '0 C' #TODO: implement RFFE temperature read on FPGA
 
         # Metadata file is placed in the same path and with the same filename as the data file, but with .metadata extension
         output_metadata_filename = os.path.splitext(data_filename)[0] + '.metadata'
 
-        f = open(output_metadata_filename, 'x')
-        f.writelines(sorted(config_fromfile_lines))
-        f.close()
+        # Sorted and written at once; fails if the file exists
+        self.metadata.write(output_metadata_filename, config_automatic)
+
+        return quality
@@ -4,6 +4,7 @@ import sys
 import time
 from time import sleep, strftime
 
+from bpm_experiment import BPMExperiment
 from run_single import run_single
 from run_sweep import run_sweep
 
@@ -22,15 +23,18 @@ else:
 
 last_experiment_time = time.time()
 
+# The FPGA and RFFE sessions stay open from one burst to the next
+exp = BPMExperiment('localhost', 'localhost')
+
 while True:
     print('\n\n\n======================================================')
     print('New experiment burst. Initiated at ' + strftime('%Y-%m-%d %H:%M:%S'))
     print('======================================================')
 
     if run_type == 'run_single':
-        run_single([input_metadata_file_path, data_file_path, 'localhost', '0', False])
+        run_single([input_metadata_file_path, data_file_path, 'localhost', '0', False], exp)
     elif run_type == 'run_sweep':
-        run_sweep([input_metadata_file_path, data_file_path, 'localhost', '0', False])
+        run_sweep([input_metadata_file_path, data_file_path, 'localhost', '0', False], exp)
     else:
         break
 
@@ -48,3 +52,5 @@ while True:
 
     except:
         raise
+
+exp.close()
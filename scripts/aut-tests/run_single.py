@@ -1,6 +1,6 @@
 #!/usr/bin/python3
 
-def run_single(argv):
+def run_single(argv, exp = None):
     import sys
     import os
     from bpm_experiment import BPMExperiment
@@ -30,7 +30,10 @@ def run_single(argv):
         askconfirmation = True
 
     # FIXME: FPGA and RFFE IPs should ideally come from function input arguments
-    exp = BPMExperiment(fpga_hostname, rffe_hostname)
+    # A caller's experiment keeps its sessions open when we are done
+    own_exp = exp is None
+    if own_exp:
+        exp = BPMExperiment(fpga_hostname, rffe_hostname)
 
     datapaths = ['adc', 'tbt', 'fofb']
 
@@ -79,6 +82,9 @@ def run_single(argv):
         elif input_text == 'q':
             break
 
+    if own_exp:
+        exp.close()
+
 if __name__ == "__main__":
     import sys
     run_single(sys.argv[1:])
@@ -1,6 +1,6 @@
 #!/usr/bin/python3
 
-def run_sweep(argv):
+def run_sweep(argv, exp = None):
     import sys
     import os
     import itertools
@@ -32,7 +32,13 @@ def run_sweep(argv):
         askconfirmation = True
 
     # FIXME: FPGA and RFFE IPs should ideally come from function input arguments
-    exp = BPMExperiment(fpga_hostname, rffe_hostname)
+    # A caller's experiment keeps its sessions open when we are done
+    own_exp = exp is None
+    if own_exp:
+        exp = BPMExperiment(fpga_hostname, rffe_hostname)
+
+    # Captures failing the data quality checks are taken again this many times
+    data_quality_retries = 2
 
     rffe_switching_sweep = ['off', 'on']
     dsp_sausaging_sweep = ['off', 'on']
@@ -125,8 +131,11 @@ def run_sweep(argv):
                             for i in range(0,len(data_filenames)):
                                 print('        Running ' + datapaths[i] + ' datapath...', end='')
                                 sys.stdout.flush()
-                                exp.run(data_filenames[i], datapaths[i])
-                                print(' done. Results in: ' + data_filenames[i])
+                                quality = exp.run(data_filenames[i], datapaths[i], data_quality_retries)
+                                if quality is not None and quality['issues']:
+                                    print(' done, data quality issues after ' + str(quality['attempts']) + ' tries (see metadata). Results in: ' + data_filenames[i])
+                                else:
+                                    print(' done. Results in: ' + data_filenames[i])
 
                             print('')
 
@@ -139,6 +148,9 @@ def run_sweep(argv):
         if input_text == 'q':
             break
 
+    if own_exp:
+        exp.close()
+
 if __name__ == "__main__":
     import sys
     run_sweep(sys.argv[1:])
@@ -16,6 +16,16 @@ dsp_deswitching_phase_sweep = range(20,60,1)
 
 datapaths = ['adc', 'tbt', 'fofb']
 
+def set_rffe_hostname(exp):
+    if 'rffe_v1' in exp.metadata['rffe_board_version']:
+        exp.rffe_hostname = '192.168.10.101'
+    elif 'rffe_v2' in exp.metadata['rffe_board_version']:
+        exp.rffe_hostname = '192.168.10.104'
+    else:
+        print('Unknown version of RFFE. Ending experiment...\n')
+        return False
+    return True
+
 while True:
     exp.load_from_metadata(input_metadata_filename)
     exp.metadata['rffe_switching'] = 'on'
@@ -24,15 +34,26 @@ while True:
     print('EXPERIMENT SETTINGS:')
     print('====================')
     print(''.join(sorted(exp.get_metadata_lines())))
-    input_text = input('Press ENTER to run the experiment. \nType \'l\' and press ENTER to load new experiment settings from \'' + os.path.abspath(input_metadata_filename) + '\'.\nType \'q\' and press ENTER to quit.\n')
+    input_text = input('Press ENTER to run the experiment. \nType \'p\' and press ENTER to pre-evaluate the sweep from a single ADC capture.\nType \'l\' and press ENTER to load new experiment settings from \'' + os.path.abspath(input_metadata_filename) + '\'.\nType \'q\' and press ENTER to quit.\n')
+
+    if input_text == 'p':
+        if not set_rffe_hostname(exp):
+            break
+
+        # Same points as the sweep, computed in software on one capture
+        exp.metadata['dsp_sausaging'] = 'off'
+        points = [(phase, 0, sausaging == 'on') for sausaging in dsp_sausaging_sweep
+                for phase in dsp_deswitching_phase_sweep]
+        print('Sausaging Phase  Amplitude A, B, C, D [ADC counts]  Ripple A, B, C, D [%]')
+        for (phase, dly, on, means, ripples) in exp.preview_sausaging(points):
+            print(str.rjust('on' if on else 'off', 9) + str.rjust(str(phase), 7) + '  ' +
+                    ' '.join('%7.1f' % m for m in means) + '  ' +
+                    ' '.join('%6.3f' % (100*r) for r in ripples))
+        print('')
+        continue
 
     if not input_text:
-        if 'rffe_v1' in exp.metadata['rffe_board_version']:
-            exp.rffe_hostname = '192.168.10.101'
-        elif 'rffe_v2' in exp.metadata['rffe_board_version']:
-            exp.rffe_hostname = '192.168.10.104'
-        else:
-            print('Unknown version of RFFE. Ending experiment...\n')
+        if not set_rffe_hostname(exp):
             break
 
         # Find the number of attenuators on the RFFE
@@ -3,13 +3,13 @@
 # Number of samples
 EXPECTED_ARGS=1
 
-if [ $# -ne $EXPECTED_ARGS ]
+if [ $# -lt $EXPECTED_ARGS ]
 then
-	echo "Usage: `basename $0` {number of samples}"
+	echo "Usage: `basename $0` {number of samples} [fcs_client options]"
 	exit 1;
 fi
 
 nsamples=$1
 chan=3 # FOFB amplitude channel number
 
-./get_raw_data.sh $nsamples $chan
+./get_raw_data.sh $nsamples $chan "${@:2}"
@@ -3,9 +3,9 @@
 # Number of samples
 EXPECTED_ARGS=2
 
-if [ $# -ne $EXPECTED_ARGS ]
+if [ $# -lt $EXPECTED_ARGS ]
 then
-	echo "Usage: `basename $0` {number of samples} {channel number}"
+	echo "Usage: `basename $0` {number of samples} {channel number} [fcs_client options]"
 	exit 1;
 fi
 
@@ -13,4 +13,4 @@ nsamples=$1
 chan=$2
 
 # Set acquisition parameters, start acquisition and retrieve samples
-fcs_client -l $nsamples -c $chan -t -B $chan -o localhost 
+fcs_client -l $nsamples -c $chan -t -B $chan -o localhost "${@:3}" 
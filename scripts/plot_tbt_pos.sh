@@ -10,8 +10,15 @@ then
 fi
 
 nsamples=$1
+# About 2000 min/max pairs are enough for a screen and keep it interactive
+decimate=$(( nsamples / 2000 ))
+decimate_opts=
+if [ $decimate -gt 1 ]
+then
+	decimate_opts="--decimate $decimate --method minmax"
+fi
 
-./get_tbt_pos.sh $nsamples | \
+./get_tbt_pos.sh $nsamples $decimate_opts | \
 	feedgnuplot --lines \
 	--title 'TBT Position Data' \
 	--ylabel 'Position Data [nm]' \
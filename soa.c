@@ -0,0 +1,360 @@
+// De-interleaving of 4-channel curves into scaled per-channel doubles
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "soa.h"
+#include "fcs_client.h"
+
+#if defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__))
+#define SOA_X86 1
+#include <immintrin.h>
+#endif
+
+static const char *soa_isa_names[SOA_ISA_END] = {
+    "scalar", "sse2", "avx2"
+};
+
+/***************************************************************/
+/*************************** Kernels ***************************/
+/***************************************************************/
+
+/* Rows [i, rows). Also the tail of the SIMD kernels */
+static void soa_16_scalar (const int16_t *in, uint32_t i, uint32_t rows,
+        const double *k, double *const *out)
+{
+    for (; i < rows; ++i) {
+        out[0][i] = in[i*NUM_CHANNELS]*k[0];
+        out[1][i] = in[i*NUM_CHANNELS + 1]*k[1];
+        out[2][i] = in[i*NUM_CHANNELS + 2]*k[2];
+        out[3][i] = in[i*NUM_CHANNELS + 3]*k[3];
+    }
+}
+
+static void soa_32_scalar (const int32_t *in, uint32_t i, uint32_t rows,
+        const double *k, double *const *out)
+{
+    for (; i < rows; ++i) {
+        out[0][i] = in[i*NUM_CHANNELS]*k[0];
+        out[1][i] = in[i*NUM_CHANNELS + 1]*k[1];
+        out[2][i] = in[i*NUM_CHANNELS + 2]*k[2];
+        out[3][i] = in[i*NUM_CHANNELS + 3]*k[3];
+    }
+}
+
+#ifdef SOA_X86
+
+/* 4 rows of int32 in, 4 columns (one channel, 4 rows each) out */
+static inline void soa_transpose (__m128i *r)
+{
+    __m128i t0 = _mm_unpacklo_epi32 (r[0], r[1]);
+    __m128i t1 = _mm_unpacklo_epi32 (r[2], r[3]);
+    __m128i t2 = _mm_unpackhi_epi32 (r[0], r[1]);
+    __m128i t3 = _mm_unpackhi_epi32 (r[2], r[3]);
+
+    r[0] = _mm_unpacklo_epi64 (t0, t1);
+    r[1] = _mm_unpackhi_epi64 (t0, t1);
+    r[2] = _mm_unpacklo_epi64 (t2, t3);
+    r[3] = _mm_unpackhi_epi64 (t2, t3);
+}
+
+static inline void soa_store_sse2 (const __m128i *col, uint32_t i,
+        const __m128d *k, double *const *out)
+{
+    unsigned int c;
+
+    for (c = 0; c < NUM_CHANNELS; ++c) {
+        _mm_storeu_pd (out[c] + i, _mm_mul_pd (_mm_cvtepi32_pd (col[c]), k[c]));
+        _mm_storeu_pd (out[c] + i + 2, _mm_mul_pd (_mm_cvtepi32_pd (
+                        _mm_srli_si128 (col[c], 8)), k[c]));
+    }
+}
+
+/* Sign extension of 8 int16 (2 rows) to 2 rows of int32 */
+static inline void soa_widen_sse2 (__m128i x, __m128i *r)
+{
+    r[0] = _mm_srai_epi32 (_mm_unpacklo_epi16 (x, x), 16);
+    r[1] = _mm_srai_epi32 (_mm_unpackhi_epi16 (x, x), 16);
+}
+
+static void soa_16_sse2 (const int16_t *in, uint32_t rows, const double *k,
+        double *const *out)
+{
+    __m128d kv[NUM_CHANNELS];
+    uint32_t i;
+    unsigned int c;
+
+    for (c = 0; c < NUM_CHANNELS; ++c) {
+        kv[c] = _mm_set1_pd (k[c]);
+    }
+
+    for (i = 0; i + 4 <= rows; i += 4) {
+        const __m128i *p = (const __m128i *) (in + i*NUM_CHANNELS);
+        __m128i r[NUM_CHANNELS];
+
+        soa_widen_sse2 (_mm_loadu_si128 (p), r);
+        soa_widen_sse2 (_mm_loadu_si128 (p + 1), r + 2);
+        soa_transpose (r);
+        soa_store_sse2 (r, i, kv, out);
+    }
+
+    soa_16_scalar (in, i, rows, k, out);
+}
+
+static void soa_32_sse2 (const int32_t *in, uint32_t rows, const double *k,
+        double *const *out)
+{
+    __m128d kv[NUM_CHANNELS];
+    uint32_t i;
+    unsigned int c;
+
+    for (c = 0; c < NUM_CHANNELS; ++c) {
+        kv[c] = _mm_set1_pd (k[c]);
+    }
+
+    for (i = 0; i + 4 <= rows; i += 4) {
+        const __m128i *p = (const __m128i *) (in + i*NUM_CHANNELS);
+        __m128i r[NUM_CHANNELS];
+
+        for (c = 0; c < NUM_CHANNELS; ++c) {
+            r[c] = _mm_loadu_si128 (p + c);
+        }
+        soa_transpose (r);
+        soa_store_sse2 (r, i, kv, out);
+    }
+
+    soa_32_scalar (in, i, rows, k, out);
+}
+
+/* The transpose stays 128-bit; the conversion, scaling and stores of a
+ * whole column (4 rows) take one 256-bit instruction each */
+__attribute__ ((target ("avx2")))
+static inline void soa_store_avx2 (const __m128i *col, uint32_t i,
+        const double *k, double *const *out)
+{
+    unsigned int c;
+
+    for (c = 0; c < NUM_CHANNELS; ++c) {
+        _mm256_storeu_pd (out[c] + i, _mm256_mul_pd (_mm256_cvtepi32_pd (col[c]),
+                    _mm256_broadcast_sd (k + c)));
+    }
+}
+
+__attribute__ ((target ("avx2")))
+static void soa_16_avx2 (const int16_t *in, uint32_t rows, const double *k,
+        double *const *out)
+{
+    uint32_t i;
+
+    for (i = 0; i + 4 <= rows; i += 4) {
+        const __m128i *p = (const __m128i *) (in + i*NUM_CHANNELS);
+        __m256i w01 = _mm256_cvtepi16_epi32 (_mm_loadu_si128 (p));
+        __m256i w23 = _mm256_cvtepi16_epi32 (_mm_loadu_si128 (p + 1));
+        __m128i r[NUM_CHANNELS];
+
+        r[0] = _mm256_castsi256_si128 (w01);
+        r[1] = _mm256_extracti128_si256 (w01, 1);
+        r[2] = _mm256_castsi256_si128 (w23);
+        r[3] = _mm256_extracti128_si256 (w23, 1);
+        soa_transpose (r);
+        soa_store_avx2 (r, i, k, out);
+    }
+
+    soa_16_scalar (in, i, rows, k, out);
+}
+
+__attribute__ ((target ("avx2")))
+static void soa_32_avx2 (const int32_t *in, uint32_t rows, const double *k,
+        double *const *out)
+{
+    uint32_t i;
+    unsigned int c;
+
+    for (i = 0; i + 4 <= rows; i += 4) {
+        const __m128i *p = (const __m128i *) (in + i*NUM_CHANNELS);
+        __m128i r[NUM_CHANNELS];
+
+        for (c = 0; c < NUM_CHANNELS; ++c) {
+            r[c] = _mm_loadu_si128 (p + c);
+        }
+        soa_transpose (r);
+        soa_store_avx2 (r, i, k, out);
+    }
+
+    soa_32_scalar (in, i, rows, k, out);
+}
+
+#endif
+
+/***************************************************************/
+/************************** Dispatch ***************************/
+/***************************************************************/
+
+static int soa_best = -1;
+
+int soa_isa_supported (int isa)
+{
+    switch (isa) {
+        case SOA_ISA_SCALAR:
+            return 1;
+#ifdef SOA_X86
+        case SOA_ISA_SSE2:
+            return 1;
+        case SOA_ISA_AVX2:
+            __builtin_cpu_init ();
+            return __builtin_cpu_supports ("avx2");
+#endif
+        default:
+            return 0;
+    }
+}
+
+int soa_isa (void)
+{
+    int isa = __atomic_load_n (&soa_best, __ATOMIC_RELAXED);
+
+    // Racing first callers all come to the same answer
+    if (isa < 0) {
+        for (isa = SOA_ISA_END - 1; !soa_isa_supported (isa); --isa)
+            ;
+        __atomic_store_n (&soa_best, isa, __ATOMIC_RELAXED);
+    }
+
+    return isa;
+}
+
+const char *soa_isa_name (int isa)
+{
+    return isa >= 0 && isa < SOA_ISA_END ? soa_isa_names[isa] : "?";
+}
+
+static const double soa_unit[NUM_CHANNELS] = {1.0, 1.0, 1.0, 1.0};
+
+void soa_deinterleave_16_isa (int isa, const int16_t *in, uint32_t rows,
+        const double *scale, double *const *out)
+{
+    const double *k = scale ? scale : soa_unit;
+
+    switch (isa) {
+#ifdef SOA_X86
+        case SOA_ISA_AVX2:
+            soa_16_avx2 (in, rows, k, out);
+            break;
+        case SOA_ISA_SSE2:
+            soa_16_sse2 (in, rows, k, out);
+            break;
+#endif
+        default:
+            soa_16_scalar (in, 0, rows, k, out);
+            break;
+    }
+}
+
+void soa_deinterleave_32_isa (int isa, const int32_t *in, uint32_t rows,
+        const double *scale, double *const *out)
+{
+    const double *k = scale ? scale : soa_unit;
+
+    switch (isa) {
+#ifdef SOA_X86
+        case SOA_ISA_AVX2:
+            soa_32_avx2 (in, rows, k, out);
+            break;
+        case SOA_ISA_SSE2:
+            soa_32_sse2 (in, rows, k, out);
+            break;
+#endif
+        default:
+            soa_32_scalar (in, 0, rows, k, out);
+            break;
+    }
+}
+
+void soa_deinterleave_16 (const int16_t *in, uint32_t rows,
+        const double *scale, double *const *out)
+{
+    soa_deinterleave_16_isa (soa_isa (), in, rows, scale, out);
+}
+
+void soa_deinterleave_32 (const int32_t *in, uint32_t rows,
+        const double *scale, double *const *out)
+{
+    soa_deinterleave_32_isa (soa_isa (), in, rows, scale, out);
+}
+
+/***************************************************************/
+/**************************** Arrays ***************************/
+/***************************************************************/
+
+int soa_alloc (struct soa_s *soa, uint32_t rows)
+{
+    // aligned_alloc wants a multiple of the alignment
+    size_t size = ((size_t) rows*sizeof (double) + SOA_ALIGN - 1) &
+        ~(size_t) (SOA_ALIGN - 1);
+    unsigned int c;
+
+    memset (soa, 0, sizeof *soa);
+
+    for (c = 0; c < NUM_CHANNELS; ++c) {
+        soa->ch[c] = aligned_alloc (SOA_ALIGN, size ? size : SOA_ALIGN);
+        if (!soa->ch[c]) {
+            perror ("soa: aligned_alloc");
+            soa_free (soa);
+            return -1;
+        }
+    }
+
+    soa->cap = rows;
+
+    return 0;
+}
+
+void soa_free (struct soa_s *soa)
+{
+    unsigned int c;
+
+    for (c = 0; c < NUM_CHANNELS; ++c) {
+        free (soa->ch[c]);
+        soa->ch[c] = NULL;
+    }
+
+    soa->rows = soa->cap = 0;
+}
+
+int soa_from_curve (struct soa_s *soa, unsigned int id,
+        const uint8_t *data, uint32_t len, const double *scale)
+{
+    uint32_t sample_size = id == CURVE_ADC_ID ? SIZE_16_BYTES : SIZE_32_BYTES;
+    uint32_t rows = len/(sample_size*NUM_CHANNELS);
+
+    if (rows > soa->cap) {
+        soa_free (soa);
+        if (soa_alloc (soa, rows) < 0) {
+            return -1;
+        }
+    }
+
+    if (id == CURVE_ADC_ID) {
+        soa_deinterleave_16 ((const int16_t *) data, rows, scale, soa->ch);
+    }
+    else {
+        soa_deinterleave_32 ((const int32_t *) data, rows, scale, soa->ch);
+    }
+
+    soa->rows = rows;
+
+    return 0;
+}
+
+int soa_write (FILE *stream, const struct soa_s *soa)
+{
+    unsigned int c;
+
+    for (c = 0; c < NUM_CHANNELS; ++c) {
+        if (fwrite (soa->ch[c], sizeof (double), soa->rows, stream) != soa->rows) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
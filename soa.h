@@ -0,0 +1,52 @@
+#ifndef _SOA_H_
+#define _SOA_H_
+
+#include <inttypes.h>
+
+#include "output.h"
+
+/* De-interleaving of 4-channel curves (ch0 ch1 ch2 ch3 per row, int16 for
+ * the ADC curve and int32 otherwise) into one array of doubles per
+ * channel (structure of arrays), scaled on the way. The kernel is picked
+ * once, at the first call, from what the CPU supports */
+#define SOA_ALIGN               32 // bytes, of every channel array
+
+enum soa_isa_e {
+    SOA_ISA_SCALAR = 0,
+    SOA_ISA_SSE2,
+    SOA_ISA_AVX2,
+    SOA_ISA_END
+};
+
+struct soa_s {
+    uint32_t rows;
+    uint32_t cap;                   // rows allocated
+    double *ch[NUM_CHANNELS];
+};
+
+/* Best kernel this CPU runs */
+int soa_isa (void);
+const char *soa_isa_name (int isa);
+/* 1 if this build and CPU can run isa */
+int soa_isa_supported (int isa);
+
+/* out[c][i] = in[i*NUM_CHANNELS + c]*scale[c]. scale NULL -> 1 */
+void soa_deinterleave_16 (const int16_t *in, uint32_t rows,
+        const double *scale, double *const *out);
+void soa_deinterleave_32 (const int32_t *in, uint32_t rows,
+        const double *scale, double *const *out);
+/* Same, with a given kernel (benchmarks, checks). isa must be supported */
+void soa_deinterleave_16_isa (int isa, const int16_t *in, uint32_t rows,
+        const double *scale, double *const *out);
+void soa_deinterleave_32_isa (int isa, const int32_t *in, uint32_t rows,
+        const double *scale, double *const *out);
+
+int soa_alloc (struct soa_s *soa, uint32_t rows);
+void soa_free (struct soa_s *soa);
+/* De-interleaves len bytes of curve id, growing soa if needed */
+int soa_from_curve (struct soa_s *soa, unsigned int id,
+        const uint8_t *data, uint32_t len, const double *scale);
+/* Writes the channels one after the other, as native doubles */
+int soa_write (FILE *stream, const struct soa_s *soa);
+
+#endif
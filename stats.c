@@ -0,0 +1,165 @@
+// Per-operation latency histograms and per-endpoint counters
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "stats.h"
+
+static struct stats_hist_s hists[STATS_EP_END][STATS_OP_END];
+static struct stats_ep_counters_s counters[STATS_EP_END];
+
+static const char *ep_names[STATS_EP_END] = {
+    "fpga", "rffe", "local"
+};
+
+static const char *op_names[STATS_OP_END] = {
+    "send", "recv", "func_execute", "read_var", "write_var", "read_curve",
+    "output"
+};
+
+uint64_t stats_now (void)
+{
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec*1000000000 + ts.tv_nsec;
+}
+
+static unsigned int stats_bucket (uint64_t v)
+{
+    unsigned int msb, shift, idx;
+
+    if (v < STATS_SUB_COUNT) {
+        return (unsigned int) v;
+    }
+
+    msb = 63 - __builtin_clzll (v);
+    shift = msb - STATS_SUB_BITS;
+    idx = shift*STATS_SUB_COUNT + (unsigned int) (v >> shift);
+
+    return idx < STATS_HIST_BUCKETS ? idx : STATS_HIST_BUCKETS - 1;
+}
+
+/* Highest value that falls in bucket idx */
+static uint64_t stats_bucket_value (unsigned int idx)
+{
+    unsigned int shift;
+
+    if (idx < 2*STATS_SUB_COUNT) {
+        return idx;
+    }
+
+    shift = idx/STATS_SUB_COUNT - 1;
+    return (((uint64_t) (idx % STATS_SUB_COUNT + STATS_SUB_COUNT) + 1) << shift) - 1;
+}
+
+/* Counters may be read by other threads (e.g. the metrics server) while
+ * the polling thread updates them, hence the relaxed atomics */
+void stats_record (enum stats_ep_e ep, enum stats_op_e op, uint64_t start_ns,
+        int err)
+{
+    struct stats_hist_s *h = &hists[ep][op];
+    uint64_t ns = stats_now () - start_ns;
+    uint64_t min = __atomic_load_n (&h->min_ns, __ATOMIC_RELAXED);
+
+    __atomic_fetch_add (&h->buckets[stats_bucket (ns)], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add (&h->sum_ns, ns, __ATOMIC_RELAXED);
+    if (min == 0 || ns < min) {
+        __atomic_store_n (&h->min_ns, ns ? ns : 1, __ATOMIC_RELAXED);
+    }
+    if (ns > __atomic_load_n (&h->max_ns, __ATOMIC_RELAXED)) {
+        __atomic_store_n (&h->max_ns, ns, __ATOMIC_RELAXED);
+    }
+    if (err) {
+        __atomic_fetch_add (&h->errors, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add (&counters[ep].errors, 1, __ATOMIC_RELAXED);
+    }
+    __atomic_fetch_add (&h->count, 1, __ATOMIC_RELEASE);
+}
+
+void stats_bytes (enum stats_ep_e ep, uint64_t sent, uint64_t recv)
+{
+    __atomic_fetch_add (&counters[ep].bytes_sent, sent, __ATOMIC_RELAXED);
+    __atomic_fetch_add (&counters[ep].bytes_recv, recv, __ATOMIC_RELAXED);
+}
+
+uint64_t stats_quantile (const struct stats_hist_s *hist, double q)
+{
+    uint64_t count = __atomic_load_n (&hist->count, __ATOMIC_ACQUIRE);
+    uint64_t rank = (uint64_t) (q*count + 0.5);
+    uint64_t seen = 0;
+    unsigned int i;
+
+    if (count == 0) {
+        return 0;
+    }
+
+    rank = rank == 0 ? 1 : rank;
+    for (i = 0; i < STATS_HIST_BUCKETS; ++i) {
+        seen += __atomic_load_n (&hist->buckets[i], __ATOMIC_RELAXED);
+        if (seen >= rank) {
+            uint64_t v = stats_bucket_value (i);
+            return v > hist->max_ns ? hist->max_ns : v;
+        }
+    }
+
+    return hist->max_ns;
+}
+
+const struct stats_hist_s *stats_hist (enum stats_ep_e ep, enum stats_op_e op)
+{
+    return &hists[ep][op];
+}
+
+const struct stats_ep_counters_s *stats_counters (enum stats_ep_e ep)
+{
+    return &counters[ep];
+}
+
+const char *stats_ep_name (enum stats_ep_e ep)
+{
+    return ep < STATS_EP_END ? ep_names[ep] : "?";
+}
+
+const char *stats_op_name (enum stats_op_e op)
+{
+    return op < STATS_OP_END ? op_names[op] : "?";
+}
+
+void stats_dump (FILE *stream)
+{
+    unsigned int ep, op;
+
+    fprintf (stream, "# %-5s %-12s %9s %6s %10s %10s %10s %10s %10s %10s\n",
+            "ep", "op", "count", "errors", "mean[us]", "p50[us]", "p90[us]",
+            "p99[us]", "p999[us]", "max[us]");
+
+    for (ep = 0; ep < STATS_EP_END; ++ep) {
+        for (op = 0; op < STATS_OP_END; ++op) {
+            const struct stats_hist_s *h = &hists[ep][op];
+
+            if (h->count == 0) {
+                continue;
+            }
+
+            fprintf (stream, "  %-5s %-12s %9" PRIu64 " %6" PRIu64
+                    " %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+                    ep_names[ep], op_names[op], h->count, h->errors,
+                    h->sum_ns/1e3/h->count,
+                    stats_quantile (h, 0.50)/1e3,
+                    stats_quantile (h, 0.90)/1e3,
+                    stats_quantile (h, 0.99)/1e3,
+                    stats_quantile (h, 0.999)/1e3,
+                    h->max_ns/1e3);
+        }
+    }
+
+    fprintf (stream, "# %-5s %14s %14s %8s\n", "ep", "bytes_sent",
+            "bytes_recv", "errors");
+    for (ep = 0; ep < STATS_EP_LOCAL; ++ep) {
+        fprintf (stream, "  %-5s %14" PRIu64 " %14" PRIu64 " %8" PRIu64 "\n",
+                ep_names[ep], counters[ep].bytes_sent, counters[ep].bytes_recv,
+                counters[ep].errors);
+    }
+
+    fflush (stream);
+}
@@ -0,0 +1,76 @@
+#ifndef _STATS_H_
+#define _STATS_H_
+
+#include <stdio.h>
+#include <inttypes.h>
+
+/* Always compiled, low-overhead instrumentation. Latencies go into
+ * log-linear (HDR-style) histograms: values below 2^STATS_SUB_BITS ns are
+ * exact, larger ones are kept with STATS_SUB_BITS bits of mantissa, so the
+ * relative error is under 1/2^STATS_SUB_BITS (6.25%) up to ~18 minutes */
+#define STATS_SUB_BITS          4
+#define STATS_SUB_COUNT         (1 << STATS_SUB_BITS)
+#define STATS_MAX_BITS          40
+#define STATS_HIST_BUCKETS      ((STATS_MAX_BITS - STATS_SUB_BITS + 1)*STATS_SUB_COUNT)
+
+enum stats_ep_e {
+    STATS_EP_FPGA = 0,
+    STATS_EP_FE,
+    STATS_EP_LOCAL,                 // client side work (formatting output)
+    STATS_EP_END
+};
+
+enum stats_op_e {
+    STATS_OP_SEND = 0,              // a BSMP frame sent
+    STATS_OP_RECV,                  // one received (includes server time)
+    STATS_OP_FUNC_EXECUTE,
+    STATS_OP_READ_VAR,
+    STATS_OP_WRITE_VAR,
+    STATS_OP_READ_CURVE,
+    STATS_OP_OUTPUT,                // formatting and writing data out
+    STATS_OP_END
+};
+
+struct stats_hist_s {
+    uint64_t count;
+    uint64_t errors;
+    uint64_t sum_ns;
+    uint64_t min_ns;
+    uint64_t max_ns;
+    uint64_t buckets[STATS_HIST_BUCKETS];
+};
+
+struct stats_ep_counters_s {
+    uint64_t bytes_sent;
+    uint64_t bytes_recv;
+    uint64_t errors;
+};
+
+/* Monotonic time in ns */
+uint64_t stats_now (void);
+
+/* Records one operation started at start_ns. err != 0 counts an error */
+void stats_record (enum stats_ep_e ep, enum stats_op_e op, uint64_t start_ns,
+        int err);
+void stats_bytes (enum stats_ep_e ep, uint64_t sent, uint64_t recv);
+
+/* Value (in ns) below which a fraction q of the samples fall */
+uint64_t stats_quantile (const struct stats_hist_s *hist, double q);
+const struct stats_hist_s *stats_hist (enum stats_ep_e ep, enum stats_op_e op);
+const struct stats_ep_counters_s *stats_counters (enum stats_ep_e ep);
+
+const char *stats_ep_name (enum stats_ep_e ep);
+const char *stats_op_name (enum stats_op_e op);
+
+void stats_dump (FILE *stream);
+
+/* Times a BSMP call (or any expression returning an error code) */
+#define STATS_TIMED(ep, op, func)                               \
+    ({                                                          \
+        uint64_t __stats_t0 = stats_now ();                     \
+        int __stats_err = (func);                               \
+        stats_record (ep, op, __stats_t0, __stats_err);         \
+        __stats_err;                                            \
+    })
+
+#endif
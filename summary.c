@@ -0,0 +1,426 @@
+// Single-pass per-channel statistics and quantile sketches
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "summary.h"
+
+#define SMRY_MAGIC              0x59524d53 // "SMRY"
+#define SMRY_VERSION            2
+#define SMRY_SEL(m, a, b)       (((m) & (a)) | (~(m) & (b)))
+
+typedef int32_t smry_row_t __attribute__ ((vector_size (NUM_CHANNELS*sizeof (int32_t))));
+
+struct smry_weighted_s {
+    double v;
+    uint64_t w;
+};
+
+struct smry_s *smry_new (void)
+{
+    struct smry_s *s = malloc (sizeof *s);
+
+    if (!s) {
+        perror ("smry: malloc");
+        return NULL;
+    }
+
+    smry_reset (s);
+    return s;
+}
+
+void smry_free (struct smry_s *s)
+{
+    free (s);
+}
+
+void smry_reset (struct smry_s *s)
+{
+    unsigned int c;
+
+    s->n = 0;
+    s->mean = s->m2 = s->min = s->max = (smry_v4d_t) {0};
+    // The items are only read up to n[h]
+    for (c = 0; c < NUM_CHANNELS; ++c) {
+        s->q[c].levels = 0;
+        s->q[c].flip = 0;
+        memset (s->q[c].n, 0, sizeof s->q[c].n);
+    }
+    qc_reset (&s->qc);
+}
+
+/***************************************************************/
+/*************************** Sketch ****************************/
+/***************************************************************/
+
+static int smry_cmp (const void *a, const void *b)
+{
+    double x = *(const double *) a, y = *(const double *) b;
+
+    return (x > y) - (x < y);
+}
+
+static void smry_push (struct smry_sketch_s *q, unsigned int h, double v);
+
+/* Sorts full level h and moves every other sample, alternately the odd
+ * and the even ones, up a level */
+static void smry_compact (struct smry_sketch_s *q, unsigned int h)
+{
+    uint32_t i, off = (q->flip >> h) & 1;
+
+    qsort (q->item[h], q->n[h], sizeof q->item[h][0], smry_cmp);
+    q->flip ^= 1ULL << h;
+
+    // Out of levels: half of the top one is dropped
+    if (h + 1 == SMRY_LEVELS) {
+        for (i = 0; off + 2*i < SMRY_K; ++i) {
+            q->item[h][i] = q->item[h][off + 2*i];
+        }
+        q->n[h] = i;
+        return;
+    }
+
+    q->n[h] = 0;
+    for (i = off; i < SMRY_K; i += 2) {
+        smry_push (q, h + 1, q->item[h][i]);
+    }
+}
+
+static void smry_push (struct smry_sketch_s *q, unsigned int h, double v)
+{
+    q->item[h][q->n[h]++] = v;
+    if (h >= q->levels) {
+        q->levels = h + 1;
+    }
+
+    if (q->n[h] == SMRY_K) {
+        smry_compact (q, h);
+    }
+}
+
+static int smry_weighted_cmp (const void *a, const void *b)
+{
+    return smry_cmp (&((const struct smry_weighted_s *) a)->v,
+            &((const struct smry_weighted_s *) b)->v);
+}
+
+double smry_quantile (const struct smry_s *s, unsigned int c, double q)
+{
+    const struct smry_sketch_s *sk = &s->q[c];
+    struct smry_weighted_s *all;
+    uint64_t total = 0, cum = 0;
+    uint32_t h, i, n = 0;
+    double v;
+
+    if (!s->n || q <= 0) {
+        return s->min[c];
+    }
+    if (q >= 1) {
+        return s->max[c];
+    }
+
+    for (h = 0; h < sk->levels; ++h) {
+        n += sk->n[h];
+    }
+
+    all = malloc ((n ? n : 1)*sizeof *all);
+    if (!all) {
+        return NAN;
+    }
+
+    for (h = 0, n = 0; h < sk->levels; ++h) {
+        for (i = 0; i < sk->n[h]; ++i, ++n) {
+            all[n].v = sk->item[h][i];
+            all[n].w = 1ULL << h;
+            total += all[n].w;
+        }
+    }
+
+    qsort (all, n, sizeof *all, smry_weighted_cmp);
+
+    v = s->max[c];
+    for (i = 0; i < n; ++i) {
+        cum += all[i].w;
+        if (cum >= q*total) {
+            v = all[i].v;
+            break;
+        }
+    }
+    free (all);
+
+    return v;
+}
+
+/***************************************************************/
+/*************************** Moments ***************************/
+/***************************************************************/
+
+/* Folds in nb rows of mean mb, squared deviations m2b and extremes */
+static void smry_fold (struct smry_s *s, uint64_t nb, const smry_v4d_t *mb,
+        const smry_v4d_t *m2b, const smry_v4d_t *lo, const smry_v4d_t *hi)
+{
+    uint64_t n = s->n + nb;
+    smry_v4d_t d = *mb - s->mean;
+    unsigned int c;
+
+    if (!nb) {
+        return;
+    }
+
+    if (!s->n) {
+        s->min = *lo;
+        s->max = *hi;
+    }
+    for (c = 0; c < NUM_CHANNELS; ++c) {
+        s->min[c] = (*lo)[c] < s->min[c] ? (*lo)[c] : s->min[c];
+        s->max[c] = (*hi)[c] > s->max[c] ? (*hi)[c] : s->max[c];
+    }
+
+    s->mean += d*((double) nb/n);
+    s->m2 += *m2b + d*d*((double) s->n*nb/n);
+    s->n = n;
+}
+
+/* Mean, squared deviations and extremes of a block of n rows, two passes
+ * over it while it is in cache */
+static void smry_block (const smry_row_t *rows, uint32_t n, smry_v4d_t *mean,
+        smry_v4d_t *m2, smry_v4d_t *lo, smry_v4d_t *hi)
+{
+    smry_row_t min = rows[0], max = rows[0], m;
+    smry_v4d_t sum = {0}, d, acc = {0};
+    uint32_t i;
+
+    for (i = 0; i < n; ++i) {
+        sum += __builtin_convertvector (rows[i], smry_v4d_t);
+        m = rows[i] < min;
+        min = SMRY_SEL (m, rows[i], min);
+        m = rows[i] > max;
+        max = SMRY_SEL (m, rows[i], max);
+    }
+
+    *mean = sum/(double) n;
+    for (i = 0; i < n; ++i) {
+        d = __builtin_convertvector (rows[i], smry_v4d_t) - *mean;
+        acc += d*d;
+    }
+
+    *m2 = acc;
+    *lo = __builtin_convertvector (min, smry_v4d_t);
+    *hi = __builtin_convertvector (max, smry_v4d_t);
+}
+
+static void smry_add_block (struct smry_s *s, const smry_row_t *rows,
+        uint32_t n, int32_t fs)
+{
+    smry_v4d_t mean, m2, lo, hi;
+    unsigned int c;
+    uint32_t i;
+
+    qc_check_rows (&s->qc, (const int32_t *) rows, n, fs);
+    smry_block (rows, n, &mean, &m2, &lo, &hi);
+    smry_fold (s, n, &mean, &m2, &lo, &hi);
+
+    for (c = 0; c < NUM_CHANNELS; ++c) {
+        for (i = 0; i < n; ++i) {
+            smry_push (&s->q[c], 0, rows[i][c]);
+        }
+    }
+}
+
+void smry_add_16 (struct smry_s *s, const int16_t *rows, uint32_t n)
+{
+    smry_row_t block[SMRY_BLOCK];
+    uint32_t i, j, nb;
+
+    qc_begin (&s->qc);
+    for (i = 0; i < n; i += nb) {
+        nb = n - i < SMRY_BLOCK ? n - i : SMRY_BLOCK;
+        for (j = 0; j < nb; ++j) {
+            const int16_t *p = rows + (i + j)*NUM_CHANNELS;
+
+            block[j] = (smry_row_t) {p[0], p[1], p[2], p[3]};
+        }
+        smry_add_block (s, block, nb, QC_FS_16);
+    }
+}
+
+void smry_add_32 (struct smry_s *s, const int32_t *rows, uint32_t n)
+{
+    smry_row_t block[SMRY_BLOCK];
+    uint32_t i, nb;
+
+    // Copied, as curve data carries no alignment
+    qc_begin (&s->qc);
+    for (i = 0; i < n; i += nb) {
+        nb = n - i < SMRY_BLOCK ? n - i : SMRY_BLOCK;
+        memcpy (block, rows + i*NUM_CHANNELS, nb*sizeof *block);
+        smry_add_block (s, block, nb, QC_FS_32);
+    }
+}
+
+void smry_add_sample (struct smry_s *s, const plot_values_monit_uint32_t *val)
+{
+    smry_v4d_t mean = {(int32_t) val->ch0, (int32_t) val->ch1,
+        (int32_t) val->ch2, (int32_t) val->ch3}, zero = {0};
+    unsigned int c;
+
+    qc_check_sample (&s->qc, val);
+    smry_fold (s, 1, &mean, &zero, &mean, &mean);
+
+    for (c = 0; c < NUM_CHANNELS; ++c) {
+        smry_push (&s->q[c], 0, mean[c]);
+    }
+}
+
+void smry_merge (struct smry_s *dst, const struct smry_s *src)
+{
+    unsigned int c;
+    uint32_t h, i;
+
+    smry_fold (dst, src->n, &src->mean, &src->m2, &src->min, &src->max);
+    qc_merge (&dst->qc, &src->qc);
+
+    for (c = 0; c < NUM_CHANNELS; ++c) {
+        for (h = 0; h < src->q[c].levels; ++h) {
+            for (i = 0; i < src->q[c].n[h]; ++i) {
+                smry_push (&dst->q[c], h, src->q[c].item[h][i]);
+            }
+        }
+    }
+}
+
+/***************************************************************/
+/*************************** Output ****************************/
+/***************************************************************/
+
+void smry_print (FILE *stream, const struct smry_s *s, const char *name)
+{
+    unsigned int c;
+
+    fprintf (stream, "%s: %" PRIu64 " rows\n", name, s->n);
+    if (!s->n) {
+        return;
+    }
+
+    fprintf (stream, "%4s %14s %12s %14s %12s %12s %12s %12s %12s\n", "ch",
+            "mean", "std", "rms", "min", "max", "p1", "p50", "p99");
+    for (c = 0; c < NUM_CHANNELS; ++c) {
+        double var = s->m2[c]/s->n;
+
+        fprintf (stream, "%4u %14.3f %12.3f %14.3f %12.0f %12.0f %12.0f "
+                "%12.0f %12.0f\n", c, s->mean[c], sqrt (var),
+                sqrt (s->mean[c]*s->mean[c] + var), s->min[c], s->max[c],
+                smry_quantile (s, c, 0.01), smry_quantile (s, c, 0.5),
+                smry_quantile (s, c, 0.99));
+    }
+    fprintf (stream, "%4s ", "");
+    qc_print (stream, &s->qc);
+}
+
+/* The counts of the quality checks, in and out of the files */
+static void smry_qc_pack (const struct qc_s *qc, uint64_t *v)
+{
+    memcpy (v, &qc->rows, sizeof qc->rows);
+    memcpy (v + 1, qc->clipped, sizeof qc->clipped);
+    memcpy (v + 1 + NUM_CHANNELS, qc->stuck, sizeof qc->stuck);
+    v[1 + 2*NUM_CHANNELS] = qc->zero_blocks;
+    v[2 + 2*NUM_CHANNELS] = qc->repeated;
+}
+
+static void smry_qc_unpack (struct qc_s *qc, const uint64_t *v)
+{
+    qc_reset (qc);
+    qc->rows = v[0];
+    memcpy (qc->clipped, v + 1, sizeof qc->clipped);
+    memcpy (qc->stuck, v + 1 + NUM_CHANNELS, sizeof qc->stuck);
+    qc->zero_blocks = v[1 + 2*NUM_CHANNELS];
+    qc->repeated = v[2 + 2*NUM_CHANNELS];
+}
+
+int smry_write (FILE *stream, const struct smry_s *s, uint32_t id)
+{
+    uint32_t hdr[3] = {SMRY_MAGIC, SMRY_VERSION, id};
+    double mom[4][NUM_CHANNELS];
+    uint64_t qc[3 + 2*NUM_CHANNELS];
+    unsigned int c;
+    uint32_t h;
+    int err = 0;
+
+    smry_qc_pack (&s->qc, qc);
+    memcpy (mom[0], &s->mean, sizeof mom[0]);
+    memcpy (mom[1], &s->m2, sizeof mom[1]);
+    memcpy (mom[2], &s->min, sizeof mom[2]);
+    memcpy (mom[3], &s->max, sizeof mom[3]);
+
+    err |= fwrite (hdr, sizeof hdr, 1, stream) != 1;
+    err |= fwrite (&s->n, sizeof s->n, 1, stream) != 1;
+    err |= fwrite (mom, sizeof mom, 1, stream) != 1;
+    err |= fwrite (qc, sizeof qc, 1, stream) != 1;
+
+    // Only the samples the levels hold
+    for (c = 0; c < NUM_CHANNELS && !err; ++c) {
+        const struct smry_sketch_s *q = &s->q[c];
+
+        err |= fwrite (&q->levels, sizeof q->levels, 1, stream) != 1;
+        err |= fwrite (&q->flip, sizeof q->flip, 1, stream) != 1;
+        err |= fwrite (q->n, sizeof q->n[0], q->levels, stream) != q->levels;
+        for (h = 0; h < q->levels && !err; ++h) {
+            err |= fwrite (q->item[h], sizeof q->item[h][0], q->n[h],
+                    stream) != q->n[h];
+        }
+    }
+
+    return err ? -1 : 0;
+}
+
+int smry_read (FILE *stream, struct smry_s *s, uint32_t *id)
+{
+    uint32_t hdr[3];
+    double mom[4][NUM_CHANNELS];
+    uint64_t qc[3 + 2*NUM_CHANNELS];
+    unsigned int c;
+    uint32_t h;
+    int err = 0;
+
+    if (fread (hdr, sizeof hdr, 1, stream) != 1) {
+        return feof (stream) ? 0 : -1;
+    }
+    if (hdr[0] != SMRY_MAGIC || hdr[1] != SMRY_VERSION) {
+        return -1;
+    }
+
+    smry_reset (s);
+    *id = hdr[2];
+    err |= fread (&s->n, sizeof s->n, 1, stream) != 1;
+    err |= fread (mom, sizeof mom, 1, stream) != 1;
+    err |= fread (qc, sizeof qc, 1, stream) != 1;
+
+    for (c = 0; c < NUM_CHANNELS && !err; ++c) {
+        struct smry_sketch_s *q = &s->q[c];
+
+        err |= fread (&q->levels, sizeof q->levels, 1, stream) != 1;
+        err |= fread (&q->flip, sizeof q->flip, 1, stream) != 1;
+        err |= q->levels > SMRY_LEVELS;
+        err |= !err && fread (q->n, sizeof q->n[0], q->levels, stream) !=
+            q->levels;
+        for (h = 0; h < q->levels && !err; ++h) {
+            err |= q->n[h] >= SMRY_K;
+            err |= !err && fread (q->item[h], sizeof q->item[h][0], q->n[h],
+                    stream) != q->n[h];
+        }
+    }
+
+    if (err) {
+        smry_reset (s);
+        return -1;
+    }
+
+    memcpy (&s->mean, mom[0], sizeof mom[0]);
+    memcpy (&s->m2, mom[1], sizeof mom[1]);
+    memcpy (&s->min, mom[2], sizeof mom[2]);
+    memcpy (&s->max, mom[3], sizeof mom[3]);
+    smry_qc_unpack (&s->qc, qc);
+
+    return 1;
+}
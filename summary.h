@@ -0,0 +1,67 @@
+#ifndef _SUMMARY_H_
+#define _SUMMARY_H_
+
+#include <stdio.h>
+#include <inttypes.h>
+
+#include "output.h"
+#include "quality.h"
+
+/* Single-pass statistics of 4-channel data. Mean and variance are kept
+ * with Welford's update, a block of rows at a time (Chan's parallel form,
+ * the same one that merges two summaries); the channels go together as
+ * one SIMD vector. Quantiles come from a compactor sketch per channel
+ * (KLL with fixed-size levels): level h holds up to SMRY_K samples of
+ * weight 2^h and, when full, is sorted and every other one moves up. The
+ * rank error stays below about levels/SMRY_K, whatever the value range,
+ * so the spread of a large offset (jitter of a position) is kept. Two
+ * summaries merge by adding level to level, so those of many BPMs or
+ * cycles combine at the cost of one compaction per level. The data
+ * quality checks run on the same rows */
+#define SMRY_K                  512 // samples per level
+#define SMRY_LEVELS             32 // up to SMRY_K*2^SMRY_LEVELS samples
+#define SMRY_BLOCK              256 // rows folded in at a time
+
+typedef double smry_v4d_t __attribute__ ((vector_size (NUM_CHANNELS*sizeof (double))));
+
+struct smry_sketch_s {
+    uint32_t levels;                // in use
+    uint32_t n[SMRY_LEVELS];
+    uint64_t flip;                  // bit h: half of level h kept next
+    double item[SMRY_LEVELS][SMRY_K];
+};
+
+struct smry_s {
+    uint64_t n;                     // rows
+    smry_v4d_t mean;
+    smry_v4d_t m2;                  // sum of squared deviations
+    smry_v4d_t min;
+    smry_v4d_t max;
+    struct smry_sketch_s q[NUM_CHANNELS];
+    struct qc_s qc;
+};
+
+/* Empty summary, to be freed, or NULL if out of memory */
+struct smry_s *smry_new (void);
+void smry_free (struct smry_s *s);
+void smry_reset (struct smry_s *s);
+
+/* Rows of 4 signed samples, as in the curves, a capture per call */
+void smry_add_16 (struct smry_s *s, const int16_t *rows, uint32_t n);
+void smry_add_32 (struct smry_s *s, const int32_t *rows, uint32_t n);
+/* A Monitoring sample (signed words) */
+void smry_add_sample (struct smry_s *s, const plot_values_monit_uint32_t *val);
+void smry_merge (struct smry_s *dst, const struct smry_s *src);
+
+/* Value below which a fraction q of the samples of channel c fall */
+double smry_quantile (const struct smry_s *s, unsigned int c, double q);
+
+void smry_print (FILE *stream, const struct smry_s *s, const char *name);
+
+/* Summaries saved (binary, native byte order) with the id of their data,
+ * to merge later. smry_read returns 1, 0 at the end of the file, or -1 if
+ * it is not a summary */
+int smry_write (FILE *stream, const struct smry_s *s, uint32_t id);
+int smry_read (FILE *stream, struct smry_s *s, uint32_t *id);
+
+#endif
@@ -0,0 +1,133 @@
+// Binary BSMP frame recorder
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+
+#include "trace.h"
+#include "debug.h"
+
+static int trace_fd = -1;
+static uint8_t *trace_buf;
+static uint32_t trace_used;
+
+static int trace_write (const uint8_t *data, uint32_t len)
+{
+    while (len > 0) {
+        ssize_t n = write (trace_fd, data, len);
+
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror ("trace: write");
+            return -1;
+        }
+
+        data += n;
+        len -= n;
+    }
+
+    return 0;
+}
+
+void trace_flush (void)
+{
+    if (trace_fd < 0 || trace_used == 0) {
+        return;
+    }
+
+    if (trace_write (trace_buf, trace_used) < 0) {
+        // Stop tracing rather than failing the acquisition
+        close (trace_fd);
+        trace_fd = -1;
+    }
+    trace_used = 0;
+}
+
+static void trace_append (const void *data, uint32_t len)
+{
+    if (trace_used + len > TRACE_BUF_SIZE) {
+        trace_flush ();
+    }
+
+    // Frames larger than the buffer go straight to the file
+    if (len > TRACE_BUF_SIZE) {
+        if (trace_fd >= 0 && trace_write (data, len) < 0) {
+            close (trace_fd);
+            trace_fd = -1;
+        }
+        return;
+    }
+
+    memcpy (trace_buf + trace_used, data, len);
+    trace_used += len;
+}
+
+int trace_open (const char *filename)
+{
+    struct trace_file_hdr_s hdr;
+
+    trace_buf = malloc (TRACE_BUF_SIZE);
+    if (!trace_buf) {
+        perror ("trace: malloc");
+        return -1;
+    }
+
+    trace_fd = open (filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (trace_fd < 0) {
+        perror ("trace: open");
+        free (trace_buf);
+        trace_buf = NULL;
+        return -1;
+    }
+
+    memset (&hdr, 0, sizeof hdr);
+    memcpy (hdr.magic, TRACE_MAGIC, sizeof hdr.magic);
+    hdr.version = TRACE_VERSION;
+    trace_append (&hdr, sizeof hdr);
+
+    atexit (trace_close);
+    DEBUGP ("trace: recording to %s\n", filename);
+
+    return 0;
+}
+
+int trace_enabled (void)
+{
+    return trace_fd >= 0;
+}
+
+void trace_frame (enum stats_ep_e ep, enum trace_dir_e dir, const uint8_t *data,
+        uint32_t len)
+{
+    struct trace_rec_s rec;
+
+    if (trace_fd < 0) {
+        return;
+    }
+
+    memset (&rec, 0, sizeof rec);
+    rec.ts_ns = stats_now ();
+    rec.len = len;
+    rec.ep = ep;
+    rec.dir = dir;
+
+    trace_append (&rec, sizeof rec);
+    trace_append (data, len);
+}
+
+void trace_close (void)
+{
+    trace_flush ();
+
+    if (trace_fd >= 0) {
+        close (trace_fd);
+        trace_fd = -1;
+    }
+
+    free (trace_buf);
+    trace_buf = NULL;
+}
@@ -0,0 +1,43 @@
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include <inttypes.h>
+
+#include "stats.h"
+
+/* Binary BSMP frame trace. The file starts with a trace_file_hdr_s and is
+ * followed by records, each a trace_rec_s and len bytes of payload. All
+ * fields are in host byte order */
+#define TRACE_MAGIC             "FCSTRACE"
+#define TRACE_VERSION           1
+#define TRACE_BUF_SIZE          (1 << 20)
+
+enum trace_dir_e {
+    TRACE_DIR_TX = 0,               // client -> server frame
+    TRACE_DIR_RX,                   // server -> client frame
+    TRACE_DIR_CONNECT               // connection opened. Payload is the port
+};
+
+struct trace_file_hdr_s {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+};
+
+struct trace_rec_s {
+    uint64_t ts_ns;                 // monotonic timestamp
+    uint32_t len;                   // payload length
+    uint8_t ep;                     // enum stats_ep_e
+    uint8_t dir;                    // enum trace_dir_e
+    uint16_t reserved;
+};
+
+/* Starts recording to filename. Pending records are flushed on exit */
+int trace_open (const char *filename);
+int trace_enabled (void);
+void trace_frame (enum stats_ep_e ep, enum trace_dir_e dir, const uint8_t *data,
+        uint32_t len);
+void trace_flush (void);
+void trace_close (void);
+
+#endif
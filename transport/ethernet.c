@@ -11,10 +11,10 @@ int ethnernet_sendall(int fd, uint8_t *buf, uint32_t *len)
 {
     uint32_t total = 0;        // how many bytes we've sent
     uint32_t bytesleft = *len; // how many we have left to send
-    int32_t n;
+    int32_t n = 0;
 
     while(total < *len) {
-        n = send(fd, (char *)buf+total, bytesleft, 0);
+        n = send(fd, (char *)buf+total, bytesleft, MSG_NOSIGNAL); // EPIPE instead of SIGPIPE
         if (n == -1) { break; }
         total += n;
         bytesleft -= n;
@@ -29,10 +29,11 @@ int ethernet_recvall(int fd, uint8_t *buf, uint32_t *len)
 {
     uint32_t total = 0;        // how many bytes we've recv
     uint32_t bytesleft = *len; // how many we have left to recv
-    int32_t n;
+    int32_t n = 0;
 
     while(total < *len) {
         n = recv(fd, (char *)buf+total, bytesleft, 0);
+        if (n == 0) { n = -1; } // peer closed the connection
         if (n == -1) { break; }
         total += n;
         bytesleft -= n;
@@ -0,0 +1,270 @@
+#include "transport.h"
+#include "replay.h"
+#include "trace.h"
+#include "debug.h"
+
+struct replay_ep_s {
+    int fd;                         // placeholder fd handed to the client
+    size_t tx_off;                  // next record to look for a request at
+    size_t rx_off;                  // current response record
+    uint32_t rx_pos;                // bytes of it already handed out
+    int diverged;
+};
+
+static uint8_t *replay_data;
+static size_t replay_size;
+static struct replay_ep_s replay_eps[STATS_EP_END];
+
+/***************************************************************/
+/********************** Utility functions **********************/
+/***************************************************************/
+
+/* Records are packed back to back, so they are not necessarily aligned */
+static struct trace_rec_s replay_rec (size_t off)
+{
+    struct trace_rec_s rec;
+
+    memcpy (&rec, replay_data + off, sizeof rec);
+    return rec;
+}
+
+/* Offset of the first record at or after off for ep/dir. 0 if none */
+static size_t replay_find (size_t off, int ep, int dir)
+{
+    while (off + sizeof (struct trace_rec_s) <= replay_size) {
+        struct trace_rec_s rec = replay_rec (off);
+
+        if (off + sizeof rec + rec.len > replay_size) {
+            break; // truncated trace
+        }
+        if (rec.ep == ep && rec.dir == dir) {
+            return off;
+        }
+        off += sizeof rec + rec.len;
+    }
+
+    return 0;
+}
+
+static size_t replay_next (size_t off)
+{
+    return off + sizeof (struct trace_rec_s) + replay_rec (off).len;
+}
+
+static struct replay_ep_s *replay_ep (int fd)
+{
+    unsigned int i;
+
+    for (i = 0; i < STATS_EP_END; ++i) {
+        if (replay_eps[i].fd == fd) {
+            return &replay_eps[i];
+        }
+    }
+
+    return NULL;
+}
+
+int replay_open(const char *filename)
+{
+    const struct trace_file_hdr_s *hdr;
+    unsigned int i;
+    long size;
+    FILE *f = fopen (filename, "rb");
+
+    if (!f) {
+        perror ("replay: fopen");
+        return -1;
+    }
+
+    fseek (f, 0, SEEK_END);
+    size = ftell (f);
+    rewind (f);
+
+    if (size < (long) sizeof *hdr) {
+        fprintf (stderr, "replay: %s is not a trace file\n", filename);
+        goto err_close;
+    }
+
+    replay_data = malloc (size);
+    if (!replay_data) {
+        perror ("replay: malloc");
+        goto err_close;
+    }
+
+    if (fread (replay_data, 1, size, f) != (size_t) size) {
+        perror ("replay: fread");
+        goto err_free;
+    }
+
+    hdr = (const struct trace_file_hdr_s *) replay_data;
+    if (memcmp (hdr->magic, TRACE_MAGIC, sizeof hdr->magic) != 0 ||
+            hdr->version != TRACE_VERSION) {
+        fprintf (stderr, "replay: %s is not a version %d trace file\n",
+                filename, TRACE_VERSION);
+        goto err_free;
+    }
+
+    replay_size = size;
+    for (i = 0; i < STATS_EP_END; ++i) {
+        replay_eps[i].fd = -1;
+    }
+
+    fclose (f);
+    return 0;
+
+err_free:
+    free (replay_data);
+    replay_data = NULL;
+err_close:
+    fclose (f);
+    return -1;
+}
+
+/* All connected endpoints have run out of responses */
+int replay_done(void)
+{
+    unsigned int i;
+    int connected = 0;
+
+    for (i = 0; i < STATS_EP_END; ++i) {
+        struct replay_ep_s *ep = &replay_eps[i];
+
+        if (ep->fd < 0) {
+            continue;
+        }
+
+        connected = 1;
+        if (ep->rx_off && ep->rx_pos < replay_rec (ep->rx_off).len) {
+            return 0;
+        }
+        if (replay_find (ep->rx_off ? replay_next (ep->rx_off) :
+                    sizeof (struct trace_file_hdr_s), i, TRACE_DIR_RX)) {
+            return 0;
+        }
+    }
+
+    return connected;
+}
+
+/***************************************************************/
+/********************** Replay functions ***********************/
+/***************************************************************/
+
+int replay_sendall(int fd, uint8_t *buf, uint32_t *len)
+{
+    struct replay_ep_s *ep = replay_ep (fd);
+    size_t off;
+
+    if (!ep) {
+        *len = 0;
+        return -1;
+    }
+
+    off = replay_find (ep->tx_off, ep - replay_eps, TRACE_DIR_TX);
+
+    if (!off || replay_rec (off).len != *len ||
+            memcmp (replay_data + off + sizeof (struct trace_rec_s), buf, *len)) {
+        if (!ep->diverged) {
+            fprintf (stderr, "replay: request to %s differs from the trace. "
+                    "Responses may not match\n", stats_ep_name (ep - replay_eps));
+            ep->diverged = 1;
+        }
+    }
+
+    if (off) {
+        ep->tx_off = replay_next (off);
+    }
+
+    return 0;
+}
+
+int replay_recvall(int fd, uint8_t *buf, uint32_t *len)
+{
+    struct replay_ep_s *ep = replay_ep (fd);
+    uint32_t total = 0;
+
+    if (!ep) {
+        *len = 0;
+        return -1;
+    }
+
+    while (total < *len) {
+        struct trace_rec_s rec;
+        uint32_t n;
+
+        if (!ep->rx_off || ep->rx_pos == replay_rec (ep->rx_off).len) {
+            size_t off = replay_find (ep->rx_off ? replay_next (ep->rx_off) :
+                    sizeof (struct trace_file_hdr_s), ep - replay_eps,
+                    TRACE_DIR_RX);
+
+            if (!off) {
+                fprintf (stderr, "replay: end of trace for %s\n",
+                        stats_ep_name (ep - replay_eps));
+                break;
+            }
+
+            ep->rx_off = off;
+            ep->rx_pos = 0;
+        }
+
+        rec = replay_rec (ep->rx_off);
+        n = rec.len - ep->rx_pos;
+        n = n < *len - total ? n : *len - total;
+
+        memcpy (buf + total, replay_data + ep->rx_off + sizeof rec + ep->rx_pos, n);
+        ep->rx_pos += n;
+        total += n;
+    }
+
+    *len = total;
+
+    return 0;
+}
+
+/* The endpoint is the one that was recorded connecting to the same port */
+int replay_connection(int *fd, char *hostname, char* port)
+{
+    size_t off;
+    unsigned int i;
+
+    (void) hostname;
+
+    if (!replay_data) {
+        fprintf (stderr, "replay: no trace loaded\n");
+        return -1;
+    }
+
+    for (i = 0; i < STATS_EP_END; ++i) {
+        off = replay_find (sizeof (struct trace_file_hdr_s), i, TRACE_DIR_CONNECT);
+
+        if (off && replay_rec (off).len == strlen (port) &&
+                memcmp (replay_data + off + sizeof (struct trace_rec_s), port,
+                    strlen (port)) == 0) {
+            break;
+        }
+    }
+
+    if (i == STATS_EP_END) {
+        fprintf (stderr, "replay: no connection to port %s in the trace\n", port);
+        return -1;
+    }
+
+    // A real descriptor, so the client can close () it as usual
+    *fd = open ("/dev/null", O_RDONLY);
+    if (*fd < 0) {
+        perror ("replay: open");
+        return -1;
+    }
+
+    replay_eps[i].fd = *fd;
+    replay_eps[i].tx_off = sizeof (struct trace_file_hdr_s);
+    DEBUGP("replay: port %s replays %s frames\n", port, stats_ep_name (i));
+
+    return *fd;
+}
+
+const struct transport_ops replay_ops = {
+    .bpm_connection = replay_connection,
+    .bpm_recv = replay_recvall,
+    .bpm_send = replay_sendall
+};
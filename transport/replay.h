@@ -0,0 +1,22 @@
+#ifndef _TRANSPORT_REPLAY_
+#define _TRANSPORT_REPLAY_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <inttypes.h>
+
+/* Serves the responses recorded with --trace back to the client, as fast
+ * as they are asked for. Requests are checked against the recorded ones */
+int replay_open(const char *filename);
+int replay_done(void);
+
+int replay_sendall(int fd, uint8_t *buf, uint32_t *len);
+int replay_recvall(int fd, uint8_t *buf, uint32_t *len);
+int replay_connection(int *fd, char *hostname, char* port);
+
+extern const struct transport_ops replay_ops;
+
+#endif
@@ -0,0 +1,264 @@
+// Betatron tune estimation: radix-2 FFT and interpolated peak finding
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "tune.h"
+
+typedef double tune_v4d_t __attribute__ ((vector_size (4*sizeof (double))));
+
+uint32_t tune_fft_size (uint32_t rows)
+{
+    uint32_t n = 1;
+
+    while (n <= rows/2) {
+        n *= 2;
+    }
+
+    return n >= TUNE_MIN_N && n <= rows ? n : 0;
+}
+
+int tune_plan_init (struct tune_plan_s *plan, uint32_t n)
+{
+    uint32_t bits = 0, i, m, j, t = 0;
+
+    memset (plan, 0, sizeof *plan);
+
+    if (n < 2 || (n & (n - 1))) {
+        return -1;
+    }
+
+    plan->rev = malloc (n*sizeof *plan->rev);
+    plan->tw_re = malloc (n*sizeof (double));
+    plan->tw_im = malloc (n*sizeof (double));
+    plan->win = malloc (n*sizeof (double));
+    plan->re = malloc (n*sizeof (double));
+    plan->im = malloc (n*sizeof (double));
+    plan->mag[0] = malloc ((n/2 + 1)*sizeof (double));
+    plan->mag[1] = malloc ((n/2 + 1)*sizeof (double));
+    if (!plan->rev || !plan->tw_re || !plan->tw_im || !plan->win ||
+            !plan->re || !plan->im || !plan->mag[0] || !plan->mag[1]) {
+        perror ("tune: malloc");
+        tune_plan_free (plan);
+        return -1;
+    }
+
+    plan->n = n;
+
+    while ((1u << bits) < n) {
+        ++bits;
+    }
+
+    for (i = 0; i < n; ++i) {
+        uint32_t r = 0, b;
+
+        for (b = 0; b < bits; ++b) {
+            r |= ((i >> b) & 1) << (bits - 1 - b);
+        }
+        plan->rev[i] = r;
+        plan->win[i] = 0.5*(1 - cos (2*M_PI*i/n));
+    }
+
+    // Stage of butterfly span m uses m/2 twiddles, stored contiguously so
+    // the butterflies read them in order
+    for (m = 2; m <= n; m *= 2) {
+        for (j = 0; j < m/2; ++j, ++t) {
+            plan->tw_re[t] = cos (-2*M_PI*j/m);
+            plan->tw_im[t] = sin (-2*M_PI*j/m);
+        }
+    }
+
+    return 0;
+}
+
+void tune_plan_free (struct tune_plan_s *plan)
+{
+    free (plan->rev);
+    free (plan->tw_re);
+    free (plan->tw_im);
+    free (plan->win);
+    free (plan->re);
+    free (plan->im);
+    free (plan->mag[0]);
+    free (plan->mag[1]);
+    memset (plan, 0, sizeof *plan);
+}
+
+/***************************************************************/
+/*************************** Kernels ***************************/
+/***************************************************************/
+
+/* The butterflies of one stage with half >= 4, four at a time. Built for
+ * AVX2 too, picked at load time on CPUs that have it */
+__attribute__ ((target_clones ("avx2", "default")))
+static void tune_stage_kernel (double *re, double *im, const double *wr,
+        const double *wi, uint32_t n, uint32_t half)
+{
+    tune_v4d_t ar, ai, br, bi, cr, ci, tr, ti;
+    uint32_t k, j;
+
+    for (k = 0; k < n; k += 2*half) {
+        for (j = 0; j < half; j += 4) {
+            memcpy (&ar, re + k + j, sizeof ar);
+            memcpy (&ai, im + k + j, sizeof ai);
+            memcpy (&br, re + k + j + half, sizeof br);
+            memcpy (&bi, im + k + j + half, sizeof bi);
+            memcpy (&cr, wr + j, sizeof cr);
+            memcpy (&ci, wi + j, sizeof ci);
+
+            tr = br*cr - bi*ci;
+            ti = br*ci + bi*cr;
+            br = ar - tr;
+            bi = ai - ti;
+            ar += tr;
+            ai += ti;
+
+            memcpy (re + k + j, &ar, sizeof ar);
+            memcpy (im + k + j, &ai, sizeof ai);
+            memcpy (re + k + j + half, &br, sizeof br);
+            memcpy (im + k + j + half, &bi, sizeof bi);
+        }
+    }
+}
+
+static void tune_stage (double *re, double *im, const double *wr,
+        const double *wi, uint32_t n, uint32_t half)
+{
+    uint32_t k, j;
+
+    for (k = 0; k < n; k += 2*half) {
+        for (j = 0; j < half; ++j) {
+            double tr = re[k+j+half]*wr[j] - im[k+j+half]*wi[j];
+            double ti = re[k+j+half]*wi[j] + im[k+j+half]*wr[j];
+
+            re[k+j+half] = re[k+j] - tr;
+            im[k+j+half] = im[k+j] - ti;
+            re[k+j] += tr;
+            im[k+j] += ti;
+        }
+    }
+}
+
+void tune_fft (const struct tune_plan_s *plan, double *re, double *im)
+{
+    uint32_t n = plan->n;
+    uint32_t i, half, t = 0;
+
+    for (i = 0; i < n; ++i) {
+        uint32_t r = plan->rev[i];
+
+        if (r > i) {
+            double x = re[i], y = im[i];
+
+            re[i] = re[r];
+            im[i] = im[r];
+            re[r] = x;
+            im[r] = y;
+        }
+    }
+
+    for (half = 1; half < n; half *= 2) {
+        if (half >= 4) {
+            tune_stage_kernel (re, im, plan->tw_re + t, plan->tw_im + t,
+                    n, half);
+        }
+        else {
+            tune_stage (re, im, plan->tw_re + t, plan->tw_im + t, n, half);
+        }
+        t += half;
+    }
+}
+
+/***************************************************************/
+/**************************** Tunes ****************************/
+/***************************************************************/
+
+/* |X[k]| and |Y[k]| of the real x and y packed in z = x + jy */
+static void tune_split (const struct tune_plan_s *plan, uint32_t k,
+        double *mx, double *my)
+{
+    uint32_t n = plan->n;
+    double zr = plan->re[k], zi = plan->im[k];
+    double cr = plan->re[(n - k) % n], ci = -plan->im[(n - k) % n];
+
+    // X = (Z[k] + conj Z[n-k])/2, Y = (Z[k] - conj Z[n-k])/2j
+    *mx = hypot (zr + cr, zi + ci)/2;
+    *my = hypot (zr - cr, zi - ci)/2;
+}
+
+/* Response of the Hann window to a line d bins off, 1 at d = 0 */
+static double tune_hann_gain (double d)
+{
+    if (fabs (d) < 1e-9) {
+        return 1;
+    }
+    if (fabs (fabs (d) - 1) < 1e-9) {
+        return 0.5;
+    }
+
+    return sin (M_PI*d)/(M_PI*d)/(1 - d*d);
+}
+
+/* Peak of one plane. Hann interpolation: with bins a, b, c around the
+ * highest one, the line sits (2c - b)/(b + c) bins to the right if c > a,
+ * or (2a - b)/(a + b) to the left */
+static void tune_peak (const double *mag, uint32_t n, double *q, double *amp)
+{
+    uint32_t k, best = TUNE_MIN_BIN;
+    double a, b, c, d;
+
+    for (k = TUNE_MIN_BIN; k <= n/2; ++k) {
+        if (mag[k] > mag[best]) {
+            best = k;
+        }
+    }
+
+    a = mag[best - 1];
+    b = mag[best];
+    c = best < n/2 ? mag[best + 1] : 0;
+
+    if (b <= 0) {
+        d = 0;
+    }
+    else if (c > a) {
+        d = (2*c - b)/(b + c);
+    }
+    else {
+        d = -(2*a - b)/(a + b);
+    }
+
+    *q = (best + d)/n;
+    // A line of amplitude A gives n*A/4 at its bin through the window
+    *amp = 4*b/n/tune_hann_gain (d);
+}
+
+void tune_estimate (const struct tune_plan_s *plan, const double *x,
+        const double *y, struct tune_s *out)
+{
+    uint32_t n = plan->n;
+    double mx = 0, my = 0;
+    uint32_t i;
+
+    for (i = 0; i < n; ++i) {
+        mx += x[i];
+        my += y[i];
+    }
+    mx /= n;
+    my /= n;
+
+    for (i = 0; i < n; ++i) {
+        plan->re[i] = (x[i] - mx)*plan->win[i];
+        plan->im[i] = (y[i] - my)*plan->win[i];
+    }
+
+    tune_fft (plan, plan->re, plan->im);
+
+    for (i = 0; i <= n/2; ++i) {
+        tune_split (plan, i, &plan->mag[0][i], &plan->mag[1][i]);
+    }
+
+    out->n = n;
+    tune_peak (plan->mag[0], n, &out->q[0], &out->amp[0]);
+    tune_peak (plan->mag[1], n, &out->q[1], &out->amp[1]);
+}
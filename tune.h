@@ -0,0 +1,47 @@
+#ifndef _TUNE_H_
+#define _TUNE_H_
+
+#include <inttypes.h>
+
+/* Fractional betatron tunes from turn-by-turn positions. X and Y go
+ * through one complex FFT (x + jy) of the largest power of two of turns
+ * in the curve, after taking out the mean and applying a Hann window; the
+ * planes are separated from the conjugate-symmetric halves. The tune of
+ * each plane is the highest line above TUNE_MIN_BIN, interpolated between
+ * bins with the Hann window shape.
+ *
+ * A plan holds the bit reversal, twiddles, window and work buffers of one
+ * FFT size, so continuous acquisitions of the same length reuse it */
+#define TUNE_MIN_N              16 // turns
+#define TUNE_MIN_BIN            2 // lines below, orbit drifts, are skipped
+
+struct tune_plan_s {
+    uint32_t n;
+    uint32_t *rev;                  // bit reversal permutation
+    double *tw_re;                  // twiddles of every stage, one after
+    double *tw_im;                  // the other (n - 1 of them)
+    double *win;
+    double *re;                     // work buffers
+    double *im;
+    double *mag[2];                 // |X|, |Y| up to n/2
+};
+
+struct tune_s {
+    uint32_t n;                     // turns analyzed
+    double q[2];                    // fractional tune, X and Y [0, 0.5]
+    double amp[2];                  // oscillation amplitude, input units
+};
+
+/* Largest power of two not above rows, or 0 if below TUNE_MIN_N */
+uint32_t tune_fft_size (uint32_t rows);
+/* n a power of two. Returns -1 if out of memory */
+int tune_plan_init (struct tune_plan_s *plan, uint32_t n);
+void tune_plan_free (struct tune_plan_s *plan);
+/* Forward FFT of plan->n points, in place */
+void tune_fft (const struct tune_plan_s *plan, double *re, double *im);
+
+/* Tunes of the first plan->n turns of x and y */
+void tune_estimate (const struct tune_plan_s *plan, const double *x,
+        const double *y, struct tune_s *out);
+
+#endif
@@ -0,0 +1,250 @@
+// Windowing (sausaging) of raw ADC data and offline sweeps of it
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "window.h"
+#include "deswitch.h"
+#include "fcs_client.h"
+
+typedef double wdw_v4d_t __attribute__ ((vector_size (4*sizeof (double))));
+
+int wdw_init (struct wdw_s *wdw, uint32_t divclk, uint32_t phaseclk,
+        uint32_t dly, double alpha)
+{
+    uint32_t half, taper, k;
+    double sum = 0;
+
+    memset (wdw, 0, sizeof *wdw);
+
+    wdw->period = divclk*FE_SW_DIV_FACTOR;
+    wdw->phase = phaseclk;
+    wdw->dly = dly;
+    half = wdw->period/2;
+
+    if (half < 1) {
+        return -1;
+    }
+
+    wdw->w = malloc (half*sizeof *wdw->w);
+    if (!wdw->w) {
+        perror ("wdw: malloc");
+        return -1;
+    }
+
+    // Tukey: cosine tapers over alpha*(half - 1)/2 samples at each end
+    taper = alpha > 0 ? (uint32_t) (alpha*(half - 1)/2.0) : 0;
+    for (k = 0; k < half; ++k) {
+        uint32_t e = k < half - 1 - k ? k : half - 1 - k;
+
+        wdw->w[k] = e < taper ? 0.5*(1 - cos (M_PI*e/taper)) : 1.0;
+        sum += wdw->w[k];
+    }
+
+    for (k = 0; k < half; ++k) {
+        wdw->w[k] *= half/sum;
+    }
+
+    return 0;
+}
+
+void wdw_free (struct wdw_s *wdw)
+{
+    free (wdw->w);
+    wdw->w = NULL;
+}
+
+void wdw_reset (struct wdw_s *wdw)
+{
+    wdw->n = 0;
+}
+
+/* Window index of sample i of the stream */
+static uint32_t wdw_index (uint32_t period, uint32_t phase, uint32_t dly,
+        uint64_t i)
+{
+    uint32_t half = period/2;
+    uint32_t pos = ((i + phase) % period) % half;
+
+    return (pos + half - dly % half) % half;
+}
+
+/***************************************************************/
+/*************************** Kernels ***************************/
+/***************************************************************/
+
+/* out[i] = x[i]*w[i], i in [0, n). Built for AVX2 too, picked at load
+ * time on CPUs that have it */
+__attribute__ ((target_clones ("avx2", "default")))
+static void wdw_mul_kernel (const double *x, const double *w, double *out,
+        uint32_t n)
+{
+    wdw_v4d_t a, b;
+    uint32_t i;
+
+    for (i = 0; i + 4 <= n; i += 4) {
+        memcpy (&a, x + i, sizeof a);
+        memcpy (&b, w + i, sizeof b);
+        a *= b;
+        memcpy (out + i, &a, sizeof a);
+    }
+
+    for (; i < n; ++i) {
+        out[i] = x[i]*w[i];
+    }
+}
+
+void wdw_apply (struct wdw_s *wdw, struct soa_s *adc)
+{
+    uint32_t half = wdw->period/2;
+    uint32_t i, n, k;
+    unsigned int c;
+
+    // Runs of samples over which the window index goes up by one
+    for (i = 0; i < adc->rows; i += n) {
+        k = wdw_index (wdw->period, wdw->phase, wdw->dly, wdw->n + i);
+        n = half - k;
+        n = n < adc->rows - i ? n : adc->rows - i;
+
+        for (c = 0; c < NUM_CHANNELS; ++c) {
+            wdw_mul_kernel (adc->ch[c] + i, wdw->w + k, adc->ch[c] + i, n);
+        }
+    }
+
+    wdw->n += adc->rows;
+}
+
+/***************************************************************/
+/**************************** Sweeps ***************************/
+/***************************************************************/
+
+struct wdw_sweep_s {
+    const struct soa_s *adc;
+    const struct ddc_s *ddc;
+    const struct wdw_s *wdw;        // window table, period
+    struct wdw_point_s *pts;
+    unsigned int njobs;             // points x channels
+    unsigned int next;              // next job, taken atomically
+};
+
+/* Channel c of the capture as deswitched (and windowed) for pt into x */
+static void wdw_sweep_input (const struct wdw_sweep_s *sw,
+        const struct wdw_point_s *pt, unsigned int c, double *x)
+{
+    const struct wdw_s *wdw = sw->wdw;
+    uint32_t half = wdw->period/2;
+    uint32_t rows = sw->adc->rows;
+    uint32_t i, n, k;
+    struct dsw_s dsw;
+
+    dsw_init (&dsw, wdw->period/FE_SW_DIV_FACTOR, pt->phaseclk);
+
+    for (i = 0; i < rows; i += n) {
+        const double *in = sw->adc->ch[dsw_crossed (&dsw, i) ?
+            (c + NUM_CHANNELS/2) % NUM_CHANNELS : c];
+        uint32_t pos = (i + pt->phaseclk) % wdw->period;
+
+        // Up to the next switching edge or window wrap, whichever is first
+        k = pt->on ? wdw_index (wdw->period, pt->phaseclk, pt->dly, i) : 0;
+        n = half - pos % half;
+        n = half - k < n ? half - k : n;
+        n = n < rows - i ? n : rows - i;
+
+        if (pt->on) {
+            wdw_mul_kernel (in + i, wdw->w + k, x + i, n);
+        }
+        else {
+            memcpy (x + i, in + i, n*sizeof *x);
+        }
+    }
+}
+
+static void *wdw_sweep_worker (void *arg)
+{
+    struct wdw_sweep_s *sw = arg;
+    uint32_t rows = sw->adc->rows;
+    double *x = malloc ((size_t) rows*sizeof *x);
+    double *amp = malloc ((ddc_rows (sw->ddc, rows) + 1)*sizeof *amp);
+    unsigned int job;
+
+    if (!x || !amp) {
+        free (x);
+        free (amp);
+        return (void *) -1;
+    }
+
+    while ((job = __atomic_fetch_add (&sw->next, 1, __ATOMIC_RELAXED)) <
+            sw->njobs) {
+        struct wdw_point_s *pt = &sw->pts[job/NUM_CHANNELS];
+        unsigned int c = job % NUM_CHANNELS;
+        struct ddc_chan_s st;
+        uint32_t nout, skip = sw->ddc->order + 1, i;
+        double sum = 0, sum2 = 0, mean;
+
+        memset (&st, 0, sizeof st);
+        wdw_sweep_input (sw, pt, c, x);
+        nout = ddc_process_channel (sw->ddc, &st, x, rows, amp, NULL);
+
+        // Past the filters settling
+        skip = skip < nout ? skip : 0;
+        for (i = skip; i < nout; ++i) {
+            sum += amp[i];
+            sum2 += amp[i]*amp[i];
+        }
+
+        mean = nout > skip ? sum/(nout - skip) : 0;
+        pt->mean[c] = mean;
+        pt->ripple[c] = mean > 0 ?
+            sqrt (fmax (sum2/(nout - skip) - mean*mean, 0))/mean : 0;
+    }
+
+    free (x);
+    free (amp);
+
+    return NULL;
+}
+
+int wdw_sweep (const struct soa_s *adc, uint32_t divclk, double alpha,
+        const struct ddc_s *ddc, struct wdw_point_s *pts, unsigned int npts)
+{
+    struct wdw_sweep_s sw = {adc, ddc, NULL, pts, npts*NUM_CHANNELS, 0};
+    struct wdw_s wdw;
+    long ncpu = sysconf (_SC_NPROCESSORS_ONLN);
+    unsigned int nthreads, t;
+    pthread_t *thread;
+    void *ret;
+    int err = 0;
+
+    if (wdw_init (&wdw, divclk, 0, 0, alpha) < 0) {
+        return -1;
+    }
+    sw.wdw = &wdw;
+
+    nthreads = ncpu > 0 ? (unsigned int) ncpu : 1;
+    nthreads = nthreads < sw.njobs ? nthreads : sw.njobs;
+    thread = calloc (nthreads ? nthreads : 1, sizeof *thread);
+    if (!thread) {
+        wdw_free (&wdw);
+        return -1;
+    }
+
+    // The calling thread is one of the workers
+    for (t = 1; t < nthreads; ++t) {
+        if (pthread_create (&thread[t], NULL, wdw_sweep_worker, &sw) != 0) {
+            break;
+        }
+    }
+    err |= wdw_sweep_worker (&sw) != NULL;
+    while (--t > 0) {
+        pthread_join (thread[t], &ret);
+        err |= ret != NULL;
+    }
+
+    free (thread);
+    wdw_free (&wdw);
+
+    return err ? -1 : 0;
+}
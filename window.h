@@ -0,0 +1,56 @@
+#ifndef _WINDOW_H_
+#define _WINDOW_H_
+
+#include <inttypes.h>
+
+#include "output.h"
+#include "soa.h"
+#include "ddc.h"
+
+/* Windowing ("sausaging") of raw ADC data, as the FPGA does it with
+ * set_wdw_on/set_wdw_dly: every half switching period (one RFFE switch
+ * state, divclk*FE_SW_DIV_FACTOR/2 ADC clocks) is multiplied by a Tukey
+ * window, which takes out the switching transients at the edges. The
+ * window starts dly ADC clocks after the switching edge, in the timing of
+ * the deswitching (phaseclk). alpha is the tapered fraction (0: none,
+ * 1: Hann); the window is scaled to a mean of 1 so amplitudes keep their
+ * level */
+#define WDW_DLY_MAX             500 // ADC clocks, as set_wdw_dly takes
+#define WDW_ALPHA               1.0 // Hann, the metadata default
+
+struct wdw_s {
+    uint32_t period;                // ADC clocks
+    uint32_t phase;                 // ADC clocks
+    uint32_t dly;                   // ADC clocks
+    double *w;                      // period/2 entries
+    uint64_t n;                     // samples so far
+};
+
+/* From the get_sw_divclk and get_sw_phaseclk words and the window delay.
+ * Returns -1 if the period is too short to switch or out of memory */
+int wdw_init (struct wdw_s *wdw, uint32_t divclk, uint32_t phaseclk,
+        uint32_t dly, double alpha);
+void wdw_free (struct wdw_s *wdw);
+void wdw_reset (struct wdw_s *wdw);
+
+/* In place, on de-interleaved samples (adc->rows of them) */
+void wdw_apply (struct wdw_s *wdw, struct soa_s *adc);
+
+/* A point of a sausaging sweep: deswitching phase and window settings in,
+ * the down-converted amplitude of each channel out */
+struct wdw_point_s {
+    uint32_t phaseclk;
+    uint32_t dly;
+    int on;                         // window on
+    double mean[NUM_CHANNELS];      // amplitude, ADC counts
+    double ripple[NUM_CHANNELS];    // rms about the mean, over the mean
+};
+
+/* Evaluates npts points on one ADC capture (switched, not deswitched):
+ * deswitching with each point's phase, windowing if on and down-
+ * conversion with ddc. Points and channels are spread over one thread
+ * per CPU. Returns -1 if out of memory or the period is too short */
+int wdw_sweep (const struct soa_s *adc, uint32_t divclk, double alpha,
+        const struct ddc_s *ddc, struct wdw_point_s *pts, unsigned int npts);
+
+#endif
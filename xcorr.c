@@ -0,0 +1,239 @@
+// Cross-correlation of the ADC channels: relative cable delays
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+#include "xcorr.h"
+
+const unsigned int xc_pair[XC_PAIRS][2] = {
+    {0, 1}, {0, 2}, {0, 3}, {1, 2}, {1, 3}, {2, 3}
+};
+
+uint32_t xc_size (uint32_t rows)
+{
+    uint32_t n = tune_fft_size (rows < XC_MAX_N ? rows : XC_MAX_N);
+
+    return n >= XC_MIN_N ? n : 0;
+}
+
+int xc_init (struct xc_s *xc, uint32_t n)
+{
+    unsigned int k;
+
+    memset (xc, 0, sizeof *xc);
+
+    if (n < XC_MIN_N || tune_plan_init (&xc->plan, 2*n) < 0) {
+        return -1;
+    }
+    xc->n = n;
+
+    for (k = 0; k < NUM_CHANNELS; ++k) {
+        xc->re[k] = malloc (2*n*sizeof (double));
+        xc->im[k] = malloc (2*n*sizeof (double));
+        if (!xc->re[k] || !xc->im[k]) {
+            goto no_mem;
+        }
+    }
+
+    for (k = 0; k < XC_PAIRS; ++k) {
+        xc->cre[k] = malloc (2*n*sizeof (double));
+        xc->cim[k] = malloc (2*n*sizeof (double));
+        if (!xc->cre[k] || !xc->cim[k]) {
+            goto no_mem;
+        }
+    }
+
+    return 0;
+
+no_mem:
+    perror ("xc: malloc");
+    xc_free (xc);
+    return -1;
+}
+
+void xc_free (struct xc_s *xc)
+{
+    unsigned int k;
+
+    tune_plan_free (&xc->plan);
+    for (k = 0; k < NUM_CHANNELS; ++k) {
+        free (xc->re[k]);
+        free (xc->im[k]);
+    }
+    for (k = 0; k < XC_PAIRS; ++k) {
+        free (xc->cre[k]);
+        free (xc->cim[k]);
+    }
+    memset (xc, 0, sizeof *xc);
+}
+
+/***************************************************************/
+/**************************** Jobs *****************************/
+/***************************************************************/
+
+struct xc_job_s {
+    struct xc_s *xc;
+    const struct soa_s *adc;
+    unsigned int k;                 // channel or pair
+    double *lag;                    // of the pair
+    pthread_t thread;
+    int started;
+};
+
+/* Spectrum of channel k, mean taken out and zero-padded */
+static void *xc_channel_run (void *arg)
+{
+    struct xc_job_s *job = arg;
+    struct xc_s *xc = job->xc;
+    const double *x = job->adc->ch[job->k];
+    double *re = xc->re[job->k], *im = xc->im[job->k], mean = 0;
+    uint32_t i;
+
+    for (i = 0; i < xc->n; ++i) {
+        mean += x[i];
+    }
+    mean /= xc->n;
+
+    for (i = 0; i < xc->n; ++i) {
+        re[i] = x[i] - mean;
+    }
+    memset (re + xc->n, 0, xc->n*sizeof *re);
+    memset (im, 0, 2*xc->n*sizeof *im);
+
+    tune_fft (&xc->plan, re, im);
+
+    return NULL;
+}
+
+/* Fraction of a sample from the peak y0 to the true one, given its
+ * neighbours ym (lag - 1) and yp (lag + 1) */
+static double xc_interpolate (double ym, double y0, double yp)
+{
+    double c = y0 > 0 ? (ym + yp)/(2*y0) : 2, w, d;
+
+    // A cosine through the three points
+    if (c > -1 && c < 1) {
+        w = acos (c);
+        return atan2 (yp - ym, 2*y0*sin (w))/w;
+    }
+
+    d = ym - 2*y0 + yp;
+    return d < 0 ? (ym - yp)/(2*d) : 0;
+}
+
+/* Cross-correlation of pair k and its interpolated peak */
+static void *xc_pair_run (void *arg)
+{
+    struct xc_job_s *job = arg;
+    struct xc_s *xc = job->xc;
+    unsigned int a = xc_pair[job->k][0], b = xc_pair[job->k][1];
+    double *re = xc->cre[job->k], *im = xc->cim[job->k], y[3], top = 0;
+    uint32_t i, m = 2*xc->n;
+    int32_t l, best = 0, lmax = XC_MAX_LAG < xc->n/2 ? XC_MAX_LAG : xc->n/2;
+
+    // conj (A)*B, conjugated: the forward FFT then inverts it (real part)
+    for (i = 0; i < m; ++i) {
+        re[i] = xc->re[a][i]*xc->re[b][i] + xc->im[a][i]*xc->im[b][i];
+        im[i] = xc->im[a][i]*xc->re[b][i] - xc->re[a][i]*xc->im[b][i];
+    }
+    tune_fft (&xc->plan, re, im);
+
+    for (l = -lmax; l <= lmax; ++l) {
+        top = re[(l + m) % m] > top ? re[(l + m) % m] : top;
+    }
+
+    // The crest nearest 0: 0, 1, -1, 2, -2...
+    for (i = 0; i <= 2*(uint32_t) lmax; ++i) {
+        l = i % 2 ? (int32_t) (i + 1)/2 : -(int32_t) (i/2);
+        y[1] = re[(l + m) % m];
+        if (y[1] >= XC_PEAK_FRAC*top && y[1] >= re[(l - 1 + m) % m] &&
+                y[1] >= re[(l + 1 + m) % m]) {
+            best = l;
+            break;
+        }
+    }
+
+    // Unbiased: the overlap of the channels shrinks with the lag
+    for (l = -1; l <= 1; ++l) {
+        int32_t j = best + l;
+
+        y[l + 1] = re[(j + m) % m]/(xc->n - (j < 0 ? -j : j));
+    }
+
+    *job->lag = best + xc_interpolate (y[0], y[1], y[2]);
+
+    return NULL;
+}
+
+/* Runs jobs[0..n) in threads, or here if one cannot be started */
+static void xc_run_jobs (struct xc_job_s *jobs, unsigned int n,
+        void *(*run) (void *))
+{
+    unsigned int k;
+
+    for (k = 0; k < n; ++k) {
+        jobs[k].started = pthread_create (&jobs[k].thread, NULL, run,
+                &jobs[k]) == 0;
+        if (!jobs[k].started) {
+            run (&jobs[k]);
+        }
+    }
+
+    for (k = 0; k < n; ++k) {
+        if (jobs[k].started) {
+            pthread_join (jobs[k].thread, NULL);
+        }
+    }
+}
+
+void xc_estimate (struct xc_s *xc, const struct soa_s *adc,
+        struct xc_result_s *out)
+{
+    struct xc_job_s jobs[XC_PAIRS];
+    double d[NUM_CHANNELS] = {0}, e, sum = 0;
+    unsigned int k;
+
+    memset (jobs, 0, sizeof jobs);
+    for (k = 0; k < XC_PAIRS; ++k) {
+        jobs[k].xc = xc;
+        jobs[k].adc = adc;
+        jobs[k].k = k;
+        jobs[k].lag = &out->lag[k];
+    }
+
+    xc_run_jobs (jobs, NUM_CHANNELS, xc_channel_run);
+    xc_run_jobs (jobs, XC_PAIRS, xc_pair_run);
+
+    // Least squares over all pairs: each delay (to the mean of the four)
+    // is the mean of its lags to the others
+    for (k = 0; k < XC_PAIRS; ++k) {
+        d[xc_pair[k][1]] += out->lag[k]/NUM_CHANNELS;
+        d[xc_pair[k][0]] -= out->lag[k]/NUM_CHANNELS;
+    }
+
+    for (k = 0; k < NUM_CHANNELS; ++k) {
+        out->delay[k] = d[k] - d[0];
+    }
+
+    for (k = 0; k < XC_PAIRS; ++k) {
+        e = out->lag[k] - (d[xc_pair[k][1]] - d[xc_pair[k][0]]);
+        sum += e*e;
+    }
+    out->residual = sqrt (sum/XC_PAIRS);
+}
+
+double xc_lag_time (double adc_clk, double carrier)
+{
+    double alias;
+
+    if (carrier <= 0) {
+        return 1/adc_clk;
+    }
+
+    // Signed: a carrier aliased to a negative frequency flips the lag
+    alias = carrier - floor (carrier/adc_clk + 0.5)*adc_clk;
+
+    return alias/(adc_clk*carrier);
+}
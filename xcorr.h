@@ -0,0 +1,67 @@
+#ifndef _XCORR_H_
+#define _XCORR_H_
+
+#include <inttypes.h>
+
+#include "output.h"
+#include "soa.h"
+#include "tune.h"
+
+/* Relative delays of the four ADC channels from one capture. Each channel
+ * (mean taken out, zero-padded to twice its length) goes through a
+ * forward FFT; the cross-correlation of every pair of channels is the
+ * inverse FFT of one spectrum times the conjugate of the other. The four
+ * channel FFTs, then the six pairs, run in threads of their own.
+ *
+ * The peak is the crest nearest 0, within XC_MAX_LAG samples, of those at
+ * least XC_PEAK_FRAC of the highest: the RF carrier makes the correlation
+ * a sinusoid, so delays are only known to a carrier period, and the beam
+ * motion tilts the crests. It is interpolated between samples with the
+ * cosine through the three around it (exact for a carrier), or a parabola
+ * if they do not fit one. The four delays are the least-squares fit of the
+ * six pair lags, channel 0 (A) the reference; the rms misfit tells how far
+ * the lags agree.
+ *
+ * A lag in ADC samples is a time lag of the aliased carrier. The delay of
+ * the cables is the same phase at the RF carrier: xc_lag_time scales one
+ * to the other, with the sign of the alias */
+#define XC_MAX_N                32768 // rows correlated
+#define XC_MIN_N                64
+#define XC_MAX_LAG              64 // samples either side of 0
+#define XC_PEAK_FRAC            0.5
+#define XC_PAIRS                6
+
+struct xc_s {
+    uint32_t n;                     // rows correlated, a power of two
+    struct tune_plan_s plan;        // FFT of 2n points
+    double *re[NUM_CHANNELS];       // spectra of the channels
+    double *im[NUM_CHANNELS];
+    double *cre[XC_PAIRS];          // cross-correlation of each pair
+    double *cim[XC_PAIRS];
+};
+
+struct xc_result_s {
+    double lag[XC_PAIRS];           // of the second channel of each pair
+    double delay[NUM_CHANNELS];     // to channel 0, samples
+    double residual;                // rms misfit of the pair lags, samples
+};
+
+/* Channels of each pair: 0-1, 0-2, 0-3, 1-2, 1-3, 2-3 */
+extern const unsigned int xc_pair[XC_PAIRS][2];
+
+/* Rows correlated of a capture of rows, or 0 if too short */
+uint32_t xc_size (uint32_t rows);
+/* n from xc_size. Returns -1 if out of memory */
+int xc_init (struct xc_s *xc, uint32_t n);
+void xc_free (struct xc_s *xc);
+
+/* Delays of the first xc->n rows of adc. Jobs that cannot get a thread
+ * run in the caller */
+void xc_estimate (struct xc_s *xc, const struct soa_s *adc,
+        struct xc_result_s *out);
+
+/* Seconds of delay per sample of lag, for ADC clock and RF carrier
+ * frequencies in Hz. A carrier of 0 is taken as not undersampled */
+double xc_lag_time (double adc_clk, double carrier);
+
+#endif